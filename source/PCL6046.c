@@ -13,119 +13,283 @@
 #include	<stdint.h>
 #include	<stdbool.h>
 
+#include	<stddef.h>
+
+#include	"FreeRTOS.h"
+#include	"task.h"
+#include	"queue.h"
+
 #include	"PCL6046.h"
+#include	"PCL6046_trace.h"
+
+//	compile-time checks; a false condition is a negative array size
+#define	STATIC_CHECK(name, condition)	typedef char static_check_##name[(condition) ? 1 : -1]
+
+//	offset of a register in AXIS_MAP, from its read command code:  RMV..RIPS
+//	descend from 0xBC, PRMV..PRCI from 0xF4
+#define	REG_OFFSET(code)	(((code) >= RMV) ? (0xBC - (4 * ((code) - RMV))) : (0xF4 - (4 * ((code) - PRMV))))
 
+//	every register of the table is mapped where its code says, and every
+//	field of the field table fits its register
+#define	CHECK_REGISTER(name, code, member)		STATIC_CHECK(map_##name, offsetof(AXIS_MAP, member) == REG_OFFSET(code));
+#define	CHECK_FIELD(reg, field, shift, width)	STATIC_CHECK(field_##reg##_##field, ((shift) + (width)) <= (8 * sizeof(((AXIS_MAP *) 0)->reg##_reg)));
+
+PCL6046_REGISTERS(CHECK_REGISTER)
+PCL6046_FIELDS(CHECK_FIELD)
+STATIC_CHECK(axis_map, sizeof(AXIS_MAP) == 0x100);
 
 
 /*************************************************************************
- *	@brief		write_command
- *				Primitive function for writing a command to PCL6046.
- *	@param[in]	command is the command word taken from enumeration ASIC_CMD.
+ *	@brief		is_shadowed
+ *				Identifies registers that are kept in the shadow; these hold
+ *				configuration that the ASIC never changes on its own.
+ *	@param[in]	regName is the register, taken from enumeration ASIC_REG
+ *	@returns	true, if the register is shadowed
+ ************************************************************************/
+static bool is_shadowed(ASIC_REG regName)
+{
+	return (((regName >= RFL) && (regName <= RENV7)) || ((regName >= RCMP1) && (regName <= RIRQ)));
+}
+
+/*************************************************************************
+ *	@brief		shadow_axes
+ *				Selects the axes whose shadow of a register can be trusted once
+ *				it has been written or read.  RFL..RDS are loaded from the 1st
+ *				pre-register whenever a queued operation starts (section 6.2),
+ *				so they aren't kept for axes that stream pre-registers; nor is
+ *				RCMP5 for axes that have written its pre-register.
+ *	@param[in]	dev is the chip
+ *	@param[in]	regName is the register, taken from enumeration ASIC_REG
+ *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *	@returns	the subset of axis
+ ************************************************************************/
+static uint8_t shadow_axes(const PCL6046_DEVICE *dev, ASIC_REG regName, uint8_t axis)
+{
+	if (!is_shadowed(regName))
+	{
+		return (0);
+	}
+
+	if ((regName >= RFL) && (regName <= RDS))
+	{
+		axis &= (uint8_t) ~dev->streamingAxes;
+	}
+
+	if (regName == RCMP5)
+	{
+		axis &= (uint8_t) ~dev->cmp5PreAxes;
+	}
+
+	return (axis);
+}
+
+/*************************************************************************
+ *	@brief		invalidate_shadow
+ *				Forgets the shadowed register values of 1 to 4 axes, so the
+ *				next field update reads them back from the ASIC.  Must be called
+ *				whenever the ASIC may have changed them itself, e.g. on reset.
+ *	@param[in]	dev is the chip
  *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
  *	@returns	none
  ************************************************************************/
-void write_command(ASIC_CMD command, uint8_t axis)
+static void invalidate_shadow(PCL6046_DEVICE *dev, uint8_t axis)
 {
-	//	construct the command word according to section 5.1.3 of the
-	//	PCL6046 user manual
-	uint16_t commWord = ((uint16_t) axis << 8) + (uint16_t) command;
+	MOTION_AXIS i;
+
+	for (i = AXIS_X; i < AXISCNT; i++)
+	{
+		if (axis & (1 << i))
+		{
+			dev->shadowValid[i] = 0;
+		}
+	}
+}
 
-	//	reserve the motion controller chip's comm interface for use by this
-	//	thread
-	(void) xSemaphoreTake(PCL6046_mutex, portMAX_DELAY);
+
+/*************************************************************************
+ *	@brief		issue_command
+ *				Writes a command word to COMW and waits out the interface busy
+ *				time; every access to the ASIC's command interface comes through
+ *				here, and is traced.
+ *	@param[in]	dev is the chip
+ *	@param[in]	commWord is the axis bits and the command or register code
+ *	@returns	none
+ ************************************************************************/
+static void issue_command(PCL6046_DEVICE *dev, uint16_t commWord)
+{
+	uint8_t chip = (uint8_t) (dev - pcl6046);
+	uint32_t stamp;
 
 	//	the axis is selected by the command bits, so we can write it to the
 	//	X axis address space according to section 5.1.3 of the PCL6046 user manual
-	X_axis->MSTSWr_COMWw = commWord;
+	ASIC_WRITE16(dev->axes[AXIS_X].MSTSWr_COMWw, commWord);
+	stamp = (uint32_t) TIMESTAMP();
 
 	//	see section 5.1.3 of PCL6046 user manual; assume that WRQ isn't connected
 	//	since this is STM32, not 68000; this should block for no more than
 	//	203ns, which is 4 cycles of CLK (19.6608MHz); it is significantly less
 	//	than the RTOS tick time, so it makes little sense to use an RTOS
 	//	delay here
-	while (!IFB_HIGH());
+	while (!IFB_HIGH(chip));
 
-	//	release the comm interface
-	(void) xSemaphoreGive(PCL6046_mutex);
+	trace_command(chip, commWord, stamp, (uint32_t) TIMESTAMP() - stamp);
+}
+
+/*************************************************************************
+ *	@brief		bus_command
+ *				Writes a command to PCL6046; runs on the bus-owner task.
+ *	@param[in]	dev is the chip
+ *	@param[in]	command is the command word taken from enumeration ASIC_CMD.
+ *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *	@returns	none
+ ************************************************************************/
+static void bus_command(PCL6046_DEVICE *dev, ASIC_CMD command, uint8_t axis)
+{
+	//	construct the command word according to section 5.1.3 of the
+	//	PCL6046 user manual
+	uint16_t commWord = ((uint16_t) axis << 8) + (uint16_t) command;
+	MOTION_AXIS i;
+
+	issue_command(dev, commWord);
+
+	//	a reset returns every register to its default, and a pre-register shift
+	//	replaces the speed registers, so the shadow no longer matches the ASIC
+	if ((command == SRST) || (command == PRESHF))
+	{
+		invalidate_shadow(dev, axis);
+	}
+
+	//	a comparator 5 pre-register shift replaces RCMP5
+	if (command == PCPSHF)
+	{
+		for (i = AXIS_X; i < AXISCNT; i++)
+		{
+			if (axis & (1 << i))
+			{
+				dev->shadowValid[i] &= ~RCMP5_SHADOW_BIT;
+			}
+		}
+	}
+
+	//	a reset also clears the pre-registers
+	if (command == SRST)
+	{
+		dev->streamingAxes &= (uint8_t) ~axis;
+		dev->cmp5PreAxes &= (uint8_t) ~axis;
+	}
 }
 
 
 /*************************************************************************
- *	@brief		write_register
- *				Primitive function for writing to a 32-bit PCL6046 ASIC
- *				register.
- *	@param[in]	register is an enumerated register read command taken from
+ *	@brief		bus_write
+ *				Writes a different value to the same 32-bit PCL6046 ASIC
+ *				register in 1 to 4 axes, with a single command word; runs on
+ *				the bus-owner task.
+ *	@param[in]	dev is the chip
+ *	@param[in]	regName is an enumerated register read command taken from
  *				section 5.3.2.10 of the PCL6046 user manual; the write
  *				register command is derived by clearing bit 6
  *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
- *	@param[in]	value is what's to be written to the register
+ *	@param[in]	values points to an array of 4, 32-bit register values;
+ *				index 0 corresponds to the X axis, index 3 corresponds to
+ *				the U axis; values of unselected axes are ignored
  *	@returns	none
  ************************************************************************/
-void write_register(ASIC_REG register, uint8_t axis, uint32_t value)
+static void bus_write(PCL6046_DEVICE *dev, ASIC_REG regName, uint8_t axis, const uint32_t values[AXISCNT])
 {
-	uint16_t upperVal = (uint16_t) (value >> 16);
-	uint16_t lowerVal = (uint16_t) value;
-
-	//	construct the write register command word, selecting the specified
-	//	axes
-	uint16_t commWord = ((uint16_t) axis << 8) + (uint16_t) (register ^ 0x40);
+	uint16_t commWord;
+	MOTION_AXIS i;
 
-	//	reserve the motion controller chip's comm interface for use by this
-	//	thread
-	(void) xSemaphoreTake(PCL6046_mutex, portMAX_DELAY);
+	//	writing an operation pre-register means the axis is streaming, and
+	//	its speed registers will change under the shadow from now on
+	if ((regName >= PRMV) && (regName <= PRDS))
+	{
+		dev->streamingAxes |= axis;
 
-	//	"set the write data in I/O buffer of each axis", section 5.1.4.2
-	//	of PCL6046 user manual
-	if (axis & 1)
- 	{
- 		X_axis->BUFW1_reg = upperVal;
- 		microsleep();
- 		X_axis->BUFW0_reg = lowerVal;
+		for (i = AXIS_X; i < AXISCNT; i++)
+		{
+			if (axis & (1 << i))
+			{
+				dev->shadowValid[i] &= ~PREREG_SHADOW_BITS;
+			}
+		}
 	}
 
-	if (axis & 2)
+	//	likewise, once PRCP5 is written, comparator 5 can shift it into RCMP5
+	if (regName == PRCP5)
 	{
-		Y_axis->BUFW1_reg = upperVal;
-		microsleep();
-		Y_axis->BUFW0_reg = lowerVal;
+		dev->cmp5PreAxes |= axis;
+
+		for (i = AXIS_X; i < AXISCNT; i++)
+		{
+			if (axis & (1 << i))
+			{
+				dev->shadowValid[i] &= ~RCMP5_SHADOW_BIT;
+			}
+		}
 	}
 
-	if (axis & 4)
+	//	deselect every axis whose shadow shows that it already holds its value;
+	//	if that leaves nothing to write, the bus isn't touched at all
+	if (is_shadowed(regName))
 	{
-		Z_axis->BUFW1_reg = upperVal;
-		microsleep();
-		Z_axis->BUFW0_reg = lowerVal;
+		for (i = AXIS_X; i < AXISCNT; i++)
+		{
+			if ((axis & (1 << i)) && (dev->shadowValid[i] & (1UL << (regName - SHADOW_FIRST))) && (dev->shadowValue[i][regName - SHADOW_FIRST] == values[i]))
+			{
+				axis &= (uint8_t) ~(1 << i);
+			}
+		}
+
+		if (axis == 0)
+		{
+			return;
+		}
 	}
 
-	if (axis & 8)
+	//	construct the write register command word, selecting the specified
+	//	axes
+	commWord = ((uint16_t) axis << 8) + (uint16_t) REG_WRITE_CODE(regName);
+
+	//	"set the write data in I/O buffer of each axis", section 5.1.4.2
+	//	of PCL6046 user manual; every axis has its own buffer, so each can
+	//	be given its own value
+	for (i = AXIS_X; i < AXISCNT; i++)
 	{
-		U_axis->BUFW1_reg = upperVal;
-		microsleep();
-		U_axis->BUFW0_reg = lowerVal;
+		if (axis & (1 << i))
+		{
+			ASIC_WRITE16(dev->axes[i].BUFW1_reg, values[i] >> 16);
+			microsleep();
+			ASIC_WRITE16(dev->axes[i].BUFW0_reg, values[i]);
+		}
 	}
 
 	microsleep();
 
-	//	the axis is selected by the command bits, so we can write it to the
-	//	X axis address space according to section 5.1.3 of the PCL6046 user manual
-	X_axis->MSTSWr_COMWw = commWord;
+	issue_command(dev, commWord);
 
-	//	see section 5.1.3 of PCL6046 user manual; assume that WRQ isn't connected
-	//	since this is STM32, not 68000; this should block for no more than
-	//	203ns, which is 4 cycles of CLK (19.6608MHz); it is significantly less
-	//	than the typical RTOS tick time, so it makes little sense to use an RTOS
-	//	delay here
-	while (!IFB_HIGH());
+	//	the shadow now matches what was written
+	axis = shadow_axes(dev, regName, axis);
 
-	//	release the comm interface
-	(void) xSemaphoreGive(PCL6046_mutex);
+	if (axis != 0)
+	{
+		for (i = AXIS_X; i < AXISCNT; i++)
+		{
+			if (axis & (1 << i))
+			{
+				dev->shadowValue[i][regName - SHADOW_FIRST] = values[i];
+				dev->shadowValid[i] |= (1UL << (regName - SHADOW_FIRST));
+			}
+		}
+	}
 }
 
 /*************************************************************************
- *	@brief		read_registers
- *				Primitive function for reading from 32-bit PCL6046 ASIC
- *				register in 1 to 4 axes.
- *	@param[in]	register is an enumerated register read command taken from
+ *	@brief		bus_read
+ *				Reads the same 32-bit PCL6046 ASIC register in 1 to 4 axes,
+ *				with a single command word; runs on the bus-owner task.
+ *	@param[in]	dev is the chip
+ *	@param[in]	regName is an enumerated register read command taken from
  *				section 5.3.2.10 of the PCL6046 user manual
  *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
  *	@param[out]	results points to an array of 4, 32-bit register values;
@@ -133,82 +297,144 @@ void write_register(ASIC_REG register, uint8_t axis, uint32_t value)
  *				the U axis
  *	@returns	none
  ************************************************************************/
-void read_registers(ASIC_REG register, uint8_t axis, uint32_t *results)
+static void bus_read(PCL6046_DEVICE *dev, ASIC_REG regName, uint8_t axis, uint32_t *results)
 {
 	//	construct the read register command word, selecting the specified
 	//	axes
-	uint16_t commWord = ((uint16_t) axis << 8) + (uint16_t) register;
-
-	//	reserve the motion controller chip's comm interface for use by this
-	//	thread
-	(void) xSemaphoreTake(PCL6046_mutex, portMAX_DELAY);
+	uint16_t commWord = ((uint16_t) axis << 8) + (uint16_t) regName;
+	MOTION_AXIS i;
 
-	//	the axis is selected by the command bits, so we can write it to the
-	//	X axis address space according to section 5.1.3 of the PCL6046 user manual
-	X_axis->MSTSWr_COMWw = commWord;
-
-	//	see section 5.1.3 of PCL6046 user manual; assume that WRQ isn't connected
-	//	since this is STM32, not 68000; this should block for no more than
-	//	203ns, which is 4 cycles of CLK (19.6608MHz); it is significantly less
-	//	than the typical RTOS tick time, so it makes little sense to use an RTOS
-	//	delay here
-	while (!IFB_HIGH());
+	issue_command(dev, commWord);
 
 	//	collect a result for each specified axis, writing it to the result
 	//	array in the calling routine
-	if (axis & 1)
- 	{
- 		*(results + 0) = ((uint32_t) X_axis->BUFW1_reg << 16) + (uint32_t) X_axis->BUFW0_reg;
-	}
-
-	if (axis & 2)
+	for (i = AXIS_X; i < AXISCNT; i++)
 	{
-		*(results + 1) = ((uint32_t) Y_axis->BUFW1_reg << 16) + (uint32_t) Y_axis->BUFW0_reg;
+		if (axis & (1 << i))
+		{
+			results[i] = ((uint32_t) ASIC_READ16(dev->axes[i].BUFW1_reg) << 16) + (uint32_t) ASIC_READ16(dev->axes[i].BUFW0_reg);
+		}
 	}
 
-	if (axis & 4)
-	{
-		*(results + 2) = ((uint32_t) Z_axis->BUFW1_reg << 16) + (uint32_t) Z_axis->BUFW0_reg;
-	}
+	//	anything read from a shadowed register refreshes the shadow
+	axis = shadow_axes(dev, regName, axis);
 
-	if (axis & 8)
+	if (axis != 0)
 	{
-		*(results + 3) = ((uint32_t) U_axis->BUFW1_reg << 16) + (uint32_t) U_axis->BUFW0_reg;
+		for (i = AXIS_X; i < AXISCNT; i++)
+		{
+			if (axis & (1 << i))
+			{
+				dev->shadowValue[i][regName - SHADOW_FIRST] = results[i];
+				dev->shadowValid[i] |= (1UL << (regName - SHADOW_FIRST));
+			}
+		}
 	}
-
-	//	release the comm interface
-	(void) xSemaphoreGive(PCL6046_mutex);
 }
 
 /*************************************************************************
- *	@brief		ReadReg
- *				This is the read register routine required by the challenge.
- *				I think the axis is required, so I added it as an argument.
- *	@param[in]	RegName is the register name, taken from enumeration ASIC_REG
- *	@param[in]	axis identifies the X, Y, Z, or U axis
- *	@returns	the value read from the specified register
+ *	@brief		bus_modify
+ *				Updates a field of the same 32-bit PCL6046 ASIC register in 1
+ *				to 4 axes, leaving the other bits as they are.  The current
+ *				values come from the shadow, so there is no read-modify-write
+ *				on the bus; only axes whose value actually changes are written,
+ *				with a single command word.  Runs on the bus-owner task, so
+ *				nothing can get between the shadow lookup and the write.
+ *	@param[in]	dev is the chip
+ *	@param[in]	regName is a shadowed register, taken from enumeration ASIC_REG
+ *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *	@param[in]	fieldMask selects the bits to be replaced
+ *	@param[in]	fieldValues points to an array of 4 replacement values, one
+ *				per axis; bits outside fieldMask are ignored
+ *	@returns	none
  ************************************************************************/
-uint32_t ReadReg(ASIC_REG RegName, MOTION_AXIS axis)
+static void bus_modify(PCL6046_DEVICE *dev, ASIC_REG regName, uint8_t axis, uint32_t fieldMask, const uint32_t fieldValues[AXISCNT])
 {
-	uint32_t regSet[AXISCNT];
+	uint32_t values[AXISCNT] = {0};
+	uint8_t unknown = 0;
+	MOTION_AXIS i;
 
-	read_registers(RegName, (uint8_t) (1 << axis), regSet);
+	//	an axis that hasn't been written or read since reset has to be read
+	//	once; all such axes are read together
+	if (is_shadowed(regName))
+	{
+		for (i = AXIS_X; i < AXISCNT; i++)
+		{
+			if ((axis & (1 << i)) && !(dev->shadowValid[i] & (1UL << (regName - SHADOW_FIRST))))
+			{
+				unknown |= (uint8_t) (1 << i);
+			}
+		}
+	}
+	else
+	{
+		unknown = axis;
+	}
 
-	return (regSet[axis]);
+	if (unknown != 0)
+	{
+		bus_read(dev, regName, unknown, values);
+	}
+
+	for (i = AXIS_X; i < AXISCNT; i++)
+	{
+		if (axis & (1 << i))
+		{
+			if (!(unknown & (1 << i)))
+			{
+				values[i] = dev->shadowValue[i][regName - SHADOW_FIRST];
+			}
+
+			values[i] = (values[i] & ~fieldMask) | (fieldValues[i] & fieldMask);
+		}
+	}
+
+	bus_write(dev, regName, axis, values);
 }
 
 /*************************************************************************
- *	@brief		WriteReg
- *				This is the write register routine required by the challenge.
- *				I think the axis is required, so I added it as an argument.
- *	@param[in]	RegName is the register name, taken from enumeration ASIC_REG
- *	@param[in]	axis identifies the X, Y, Z, or U axis
- *	@param[in]	value is the value to be written
+ *	@brief		bus_shadowed
+ *				Reads a shadowed register of 1 to 4 axes from the shadow; only
+ *				axes whose shadow isn't valid are read from the ASIC, all with
+ *				one command word.  Runs on the bus-owner task.
+ *	@param[in]	dev is the chip
+ *	@param[in]	regName is a shadowed register, taken from enumeration ASIC_REG
+ *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *	@param[out]	results points to an array of 4, 32-bit register values
  *	@returns	none
  ************************************************************************/
-void WriteReg(ASIC_REG RegName, MOTION_AXIS axis, uint32_t value)
+static void bus_shadowed(PCL6046_DEVICE *dev, ASIC_REG regName, uint8_t axis, uint32_t *results)
 {
-	write_register(RegName, (uint8_t) (1 << axis), value);
+	uint8_t unknown = 0;
+	MOTION_AXIS i;
+
+	if (!is_shadowed(regName))
+	{
+		bus_read(dev, regName, axis, results);
+		return;
+	}
+
+	for (i = AXIS_X; i < AXISCNT; i++)
+	{
+		if ((axis & (1 << i)) && !(dev->shadowValid[i] & (1UL << (regName - SHADOW_FIRST))))
+		{
+			unknown |= (uint8_t) (1 << i);
+		}
+	}
+
+	if (unknown != 0)
+	{
+		bus_read(dev, regName, unknown, results);
+	}
+
+	//	the axes just read already have their results
+	for (i = AXIS_X; i < AXISCNT; i++)
+	{
+		if ((axis & (1 << i)) && !(unknown & (1 << i)))
+		{
+			results[i] = dev->shadowValue[i][regName - SHADOW_FIRST];
+		}
+	}
 }
 
 /*************************************************************************
@@ -219,14 +445,24 @@ void WriteReg(ASIC_REG RegName, MOTION_AXIS axis, uint32_t value)
 bool init_PCL6046_resources(void)
 {
 	bool success = true;
+	uint8_t busClass;
+	uint8_t chip;
 
-	//	create the comm mutex, if it hasn't been created yet
-	if (PCL6046_mutex == (SemaphoreHandle_t) NULL)
+	//	create the transaction queues of every chip, if they haven't been
+	//	created yet; if a queue can't be created, that's a fatal error
+	for (chip = 0; chip < PCL6046_CHIPS; chip++)
 	{
-		//	if the mutex can't be created, that's a fatal error
-		if ((PCL6046_mutex = xSemaphoreCreateMutex()) == NULL)
+		pcl6046[chip].axes = PCL6046_BANK(chip);
+
+		for (busClass = BUS_EMERGENCY; busClass < BUS_CLASSES; busClass++)
 		{
-			success = false;
+			if (pcl6046[chip].queue[busClass] == (QueueHandle_t) NULL)
+			{
+				if ((pcl6046[chip].queue[busClass] = xQueueCreate(BUS_QUEUE_DEPTH, sizeof(BUS_TXN *))) == NULL)
+				{
+					success = false;
+				}
+			}
 		}
 	}
 
@@ -240,9 +476,533 @@ bool init_PCL6046_resources(void)
  ************************************************************************/
 void destroy_PCL6046_resources(void)
 {
-	if (PCL6046_mutex != (SemaphoreHandle_t) NULL)
+	uint8_t busClass;
+	uint8_t chip;
+
+	for (chip = 0; chip < PCL6046_CHIPS; chip++)
+	{
+		for (busClass = BUS_EMERGENCY; busClass < BUS_CLASSES; busClass++)
+		{
+			if (pcl6046[chip].queue[busClass] != (QueueHandle_t) NULL)
+			{
+				vQueueDelete(pcl6046[chip].queue[busClass]);
+				pcl6046[chip].queue[busClass] = (QueueHandle_t) NULL;
+			}
+		}
+	}
+}
+
+/*************************************************************************
+ *	@brief		bus_status
+ *				Reads the main or sub-status word of 1 to 4 axes; runs on the
+ *				bus-owner task.
+ *	@param[in]	dev is the chip
+ *	@param[in]	kind is OP_MSTSW or OP_SSTSW
+ *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *	@param[out]	results points to an array of 4 status words, zero-extended
+ *	@returns	none
+ ************************************************************************/
+static void bus_status(const PCL6046_DEVICE *dev, BUS_OP_KIND kind, uint8_t axis, uint32_t *results)
+{
+	MOTION_AXIS i;
+
+	for (i = AXIS_X; i < AXISCNT; i++)
 	{
-		vSemaphoreDelete(PCL6046_mutex);
-		PCL6046_mutex = (SemaphoreHandle_t) NULL;
+		if (axis & (1 << i))
+		{
+			if (kind == OP_MSTSW)
+			{
+				results[i] = (uint32_t) ASIC_READ16(dev->axes[i].MSTSWr_COMWw);
+			}
+			else
+			{
+				results[i] = (uint32_t) ASIC_READ16(dev->axes[i].SSTSWr_OTPWw);
+			}
+		}
 	}
 }
+
+/*************************************************************************
+ *	@brief		execute_op
+ *				Carries out one bus operation; runs on the bus-owner task.
+ *	@param[in]	dev is the chip
+ *	@param[in]	op is the operation; results are written back to it
+ *	@returns	none
+ ************************************************************************/
+static void execute_op(PCL6046_DEVICE *dev, BUS_OP *op)
+{
+	//	an operation that selects no axis doesn't reach the bus
+	if (op->axis == 0)
+	{
+		return;
+	}
+
+	switch (op->kind)
+	{
+		case OP_COMMAND:
+			bus_command(dev, (ASIC_CMD) op->code, op->axis);
+			break;
+
+		case OP_WRITE:
+			bus_write(dev, (ASIC_REG) op->code, op->axis, op->values);
+			break;
+
+		case OP_READ:
+			bus_read(dev, (ASIC_REG) op->code, op->axis, op->values);
+			break;
+
+		case OP_MODIFY:
+			bus_modify(dev, (ASIC_REG) op->code, op->axis, op->mask, op->values);
+			break;
+
+		case OP_MSTSW:
+		case OP_SSTSW:
+			bus_status(dev, op->kind, op->axis, op->values);
+			break;
+
+		case OP_SHADOWED:
+			bus_shadowed(dev, (ASIC_REG) op->code, op->axis, op->values);
+			break;
+
+		default:
+			break;
+	}
+}
+
+/*************************************************************************
+ *	@brief		can_merge
+ *				Decides whether a queued transaction can share the command
+ *				word of the one being built:  both must be a single command,
+ *				register write, or register read of the same code, on
+ *				different axes.
+ *	@param[in]	merged is the operation being built
+ *	@param[in]	txn is the queued transaction
+ *	@returns	true, if txn can be merged into merged
+ ************************************************************************/
+static bool can_merge(const BUS_OP *merged, const BUS_TXN *txn)
+{
+	return ((txn->count == 1) && (txn->ops[0].kind == merged->kind) && (txn->ops[0].code == merged->code) && ((txn->ops[0].axis & merged->axis) == 0));
+}
+
+/*************************************************************************
+ *	@brief		ASIC_bus
+ *				This RTOS task owns the bus of one PCL6046 chip.  It serves the
+ *				class queues in priority order, merges compatible single-operation
+ *				transactions of a class into one command word, and completes
+ *				each caller with a task notification.  It must run above
+ *				every task that submits transactions.  One is created per chip.
+ *	@param[in]	pvParameters is the chip number, cast to a pointer
+ *	@returns	none
+ ************************************************************************/
+void ASIC_bus(void *pvParameters)
+{
+	PCL6046_DEVICE *dev = &pcl6046[(uintptr_t) pvParameters];
+	BUS_TXN *txn[AXISCNT];
+	BUS_OP merged;
+	uint8_t txnCount;
+	uint8_t t;
+	uint8_t busClass;
+	uint32_t start;
+	uint32_t elapsed;
+	MOTION_AXIS i;
+
+	if (init_PCL6046_resources() == true)
+	{
+		dev->task = xTaskGetCurrentTaskHandle();
+
+		while (1)
+		{
+			(void) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+			//	serve everything that's queued, going back to the most urgent
+			//	class after every transaction
+			busClass = BUS_EMERGENCY;
+
+			while (busClass < BUS_CLASSES)
+			{
+				if (xQueueReceive(dev->queue[busClass], &txn[0], 0) != pdTRUE)
+				{
+					busClass++;
+					continue;
+				}
+
+				txnCount = 1;
+
+				if ((txn[0]->count == 1) && ((txn[0]->ops[0].kind == OP_COMMAND) || (txn[0]->ops[0].kind == OP_WRITE) || (txn[0]->ops[0].kind == OP_READ)))
+				{
+					merged = txn[0]->ops[0];
+
+					//	fold in the transactions that follow it in the same class
+					//	and address the same register or command on other axes
+					while ((txnCount < AXISCNT) && (xQueuePeek(dev->queue[busClass], &txn[txnCount], 0) == pdTRUE) && can_merge(&merged, txn[txnCount]))
+					{
+						(void) xQueueReceive(dev->queue[busClass], &txn[txnCount], 0);
+
+						merged.axis |= txn[txnCount]->ops[0].axis;
+
+						for (i = AXIS_X; i < AXISCNT; i++)
+						{
+							if (txn[txnCount]->ops[0].axis & (1 << i))
+							{
+								merged.values[i] = txn[txnCount]->ops[0].values[i];
+							}
+						}
+
+						txnCount++;
+					}
+
+					start = (uint32_t) TIMESTAMP();
+					trace_context((uint8_t) (dev - pcl6046), txn[0]->caller, busClass, start - txn[0]->stamp, txnCount);
+					execute_op(dev, &merged);
+
+					//	hand each caller the results for its own axes
+					for (t = 0; t < txnCount; t++)
+					{
+						for (i = AXIS_X; i < AXISCNT; i++)
+						{
+							if (txn[t]->ops[0].axis & (1 << i))
+							{
+								txn[t]->ops[0].values[i] = merged.values[i];
+							}
+						}
+					}
+				}
+				else
+				{
+					start = (uint32_t) TIMESTAMP();
+					trace_context((uint8_t) (dev - pcl6046), txn[0]->caller, busClass, start - txn[0]->stamp, 1);
+
+					for (t = 0; t < txn[0]->count; t++)
+					{
+						execute_op(dev, &txn[0]->ops[t]);
+					}
+				}
+
+				elapsed = (uint32_t) TIMESTAMP() - start;
+
+				taskENTER_CRITICAL();
+
+				dev->stats[busClass].transactions += txnCount;
+				dev->stats[busClass].merged += (uint32_t) (txnCount - 1);
+
+				if (elapsed > dev->stats[busClass].maxService)
+				{
+					dev->stats[busClass].maxService = elapsed;
+				}
+
+				for (t = 0; t < txnCount; t++)
+				{
+					if ((start - txn[t]->stamp) > dev->stats[busClass].maxWait)
+					{
+						dev->stats[busClass].maxWait = start - txn[t]->stamp;
+					}
+				}
+
+				taskEXIT_CRITICAL();
+
+				//	a transaction belongs to its caller again once notified
+				for (t = 0; t < txnCount; t++)
+				{
+					(void) xTaskNotifyGiveIndexed(txn[t]->caller, BUS_NOTIFY_INDEX);
+				}
+
+				busClass = BUS_EMERGENCY;
+			}
+		}
+	}
+
+	//	we should never get here
+	vTaskDelete(NULL);
+}
+
+/*************************************************************************
+ *	@brief		submit
+ *				Queues a transaction to the bus owner of a chip, or carries it
+ *				out directly when that owner isn't running yet or is the caller.
+ *	@param[in]	dev is the chip
+ *	@param[in]	txn is the transaction, filled in but for its caller and stamp
+ *	@param[in]	busClass is the priority class of the transaction
+ *	@returns	true, if the transaction was queued and its completion must be
+ *				waited for; false, if it's already done
+ ************************************************************************/
+static bool submit(PCL6046_DEVICE *dev, BUS_TXN *txn, BUS_CLASS busClass)
+{
+	uint8_t i;
+
+	if ((dev->task == (TaskHandle_t) NULL) || (xTaskGetCurrentTaskHandle() == dev->task))
+	{
+		if (dev->task == (TaskHandle_t) NULL)
+		{
+			trace_context((uint8_t) (dev - pcl6046), xTaskGetCurrentTaskHandle(), (uint8_t) busClass, 0, 1);
+		}
+
+		for (i = 0; i < txn->count; i++)
+		{
+			execute_op(dev, &txn->ops[i]);
+		}
+
+		return (false);
+	}
+
+	txn->caller = xTaskGetCurrentTaskHandle();
+	txn->stamp = (uint32_t) TIMESTAMP();
+
+	(void) xQueueSend(dev->queue[busClass], &txn, portMAX_DELAY);
+	(void) xTaskNotifyGive(dev->task);
+
+	return (true);
+}
+
+/*************************************************************************
+ *	@brief		bus_transact
+ *				Submits operations to be carried out back-to-back on one chip,
+ *				with nothing else on its bus between them, and blocks until they
+ *				are done.  Before the chip's ASIC_bus is running, or when called
+ *				on it, the operations are carried out directly.
+ *	@param[in]	chip is the chip number
+ *	@param[in]	busClass is the priority class of the transaction
+ *	@param[in]	ops points to the operations; results are written back to
+ *				them
+ *	@param[in]	count is the number of operations
+ *	@returns	none
+ ************************************************************************/
+void bus_transact(uint8_t chip, BUS_CLASS busClass, BUS_OP *ops, uint8_t count)
+{
+	BUS_TXN txn = {ops, count, (TaskHandle_t) NULL, 0};
+
+	if (submit(&pcl6046[chip], &txn, busClass))
+	{
+		(void) ulTaskNotifyTakeIndexed(BUS_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+	}
+}
+
+/*************************************************************************
+ *	@brief		bus_transact_all
+ *				Carries out one transaction on every chip at once, and blocks
+ *				until all of them are done.  Each chip's transaction is atomic
+ *				on its own bus; the chips run concurrently, so there's no
+ *				ordering between them.
+ *	@param[in]	busClass is the priority class of the transactions
+ *	@param[in]	ops points to PCL6046_CHIPS sets of count operations, the
+ *				first set for chip 0; results are written back to them
+ *	@param[in]	count is the number of operations per chip
+ *	@returns	none
+ ************************************************************************/
+void bus_transact_all(BUS_CLASS busClass, BUS_OP *ops, uint8_t count)
+{
+	BUS_TXN txn[PCL6046_CHIPS];
+	uint8_t pending = 0;
+	uint8_t chip;
+
+	for (chip = 0; chip < PCL6046_CHIPS; chip++)
+	{
+		txn[chip].ops = &ops[chip * count];
+		txn[chip].count = count;
+
+		if (submit(&pcl6046[chip], &txn[chip], busClass))
+		{
+			pending++;
+		}
+	}
+
+	//	each bus owner gives one notification as its transaction completes
+	while (pending-- > 0)
+	{
+		(void) ulTaskNotifyTakeIndexed(BUS_NOTIFY_INDEX, pdFALSE, portMAX_DELAY);
+	}
+}
+
+/*************************************************************************
+ *	@brief		get_bus_stats
+ *				Get method for the counters of one priority class, summed
+ *				over the chips; the maxima are those of the worst chip
+ *	@param[in]	busClass is the priority class
+ *	@param[out]	stats receives a copy of the counters
+ *	@returns	none
+ ************************************************************************/
+void get_bus_stats(BUS_CLASS busClass, BUS_STATS *stats)
+{
+	uint8_t chip;
+
+	taskENTER_CRITICAL();
+
+	*stats = pcl6046[0].stats[busClass];
+
+	for (chip = 1; chip < PCL6046_CHIPS; chip++)
+	{
+		const BUS_STATS *chipStats = &pcl6046[chip].stats[busClass];
+
+		stats->transactions += chipStats->transactions;
+		stats->merged += chipStats->merged;
+
+		if (chipStats->maxWait > stats->maxWait)
+		{
+			stats->maxWait = chipStats->maxWait;
+		}
+
+		if (chipStats->maxService > stats->maxService)
+		{
+			stats->maxService = chipStats->maxService;
+		}
+	}
+
+	taskEXIT_CRITICAL();
+}
+
+//	the primitives below address the first chip, which carries the interrupt
+//	and motion-queue users; the other chips are reached with bus_transact()
+
+/*************************************************************************
+ *	@brief		write_command
+ *				Primitive function for writing a command to PCL6046.  Stop
+ *				commands, including the simultaneous stop, go ahead of all
+ *				other traffic.
+ *	@param[in]	command is the command word taken from enumeration ASIC_CMD.
+ *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *	@returns	none
+ ************************************************************************/
+void write_command(ASIC_CMD command, uint8_t axis)
+{
+	BUS_OP op = {OP_COMMAND, (uint8_t) command, axis, 0, {0}};
+
+	if ((command == CMEMG) || (command == CMSTP) || (command == STOP) || (command == SDSTP))
+	{
+		bus_transact(0, BUS_EMERGENCY, &op, 1);
+	}
+	else
+	{
+		bus_transact(0, BUS_CONFIG, &op, 1);
+	}
+}
+
+/*************************************************************************
+ *	@brief		write_registers
+ *				Primitive function for writing a different value to the same
+ *				32-bit PCL6046 ASIC register in 1 to 4 axes, with a single
+ *				command word.
+ *	@param[in]	regName is an enumerated register read command taken from
+ *				section 5.3.2.10 of the PCL6046 user manual; the write
+ *				register command is derived by clearing bit 6
+ *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *	@param[in]	values points to an array of 4, 32-bit register values;
+ *				index 0 corresponds to the X axis, index 3 corresponds to
+ *				the U axis; values of unselected axes are ignored
+ *	@returns	none
+ ************************************************************************/
+void write_registers(ASIC_REG regName, uint8_t axis, const uint32_t values[AXISCNT])
+{
+	BUS_OP op = {OP_WRITE, (uint8_t) regName, axis, 0, {values[AXIS_X], values[AXIS_Y], values[AXIS_Z], values[AXIS_U]}};
+
+	bus_transact(0, BUS_CONFIG, &op, 1);
+}
+
+/*************************************************************************
+ *	@brief		write_register
+ *				Primitive function for writing the same value to a 32-bit
+ *				PCL6046 ASIC register in 1 to 4 axes.
+ *	@param[in]	regName is an enumerated register read command taken from
+ *				section 5.3.2.10 of the PCL6046 user manual
+ *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *	@param[in]	value is what's to be written to the register
+ *	@returns	none
+ ************************************************************************/
+void write_register(ASIC_REG regName, uint8_t axis, uint32_t value)
+{
+	const uint32_t values[AXISCNT] = {value, value, value, value};
+
+	write_registers(regName, axis, values);
+}
+
+/*************************************************************************
+ *	@brief		read_registers
+ *				Primitive function for reading from 32-bit PCL6046 ASIC
+ *				register in 1 to 4 axes.
+ *	@param[in]	regName is an enumerated register read command taken from
+ *				section 5.3.2.10 of the PCL6046 user manual
+ *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *	@param[out]	results points to an array of 4, 32-bit register values;
+ *				index 0 corresponds to the X axis, index 3 corresponds to
+ *				the U axis; entries of unselected axes are left alone
+ *	@returns	none
+ ************************************************************************/
+void read_registers(ASIC_REG regName, uint8_t axis, uint32_t *results)
+{
+	BUS_OP op = {OP_READ, (uint8_t) regName, axis, 0, {0}};
+	MOTION_AXIS i;
+
+	bus_transact(0, BUS_CONFIG, &op, 1);
+
+	for (i = AXIS_X; i < AXISCNT; i++)
+	{
+		if (axis & (1 << i))
+		{
+			results[i] = op.values[i];
+		}
+	}
+}
+
+/*************************************************************************
+ *	@brief		modify_registers
+ *				Updates a field of the same 32-bit PCL6046 ASIC register in 1
+ *				to 4 axes, leaving the other bits as they are; see bus_modify().
+ *	@param[in]	regName is a shadowed register, taken from enumeration ASIC_REG
+ *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *	@param[in]	fieldMask selects the bits to be replaced
+ *	@param[in]	fieldValues points to an array of 4 replacement values, one
+ *				per axis; bits outside fieldMask are ignored
+ *	@returns	none
+ ************************************************************************/
+void modify_registers(ASIC_REG regName, uint8_t axis, uint32_t fieldMask, const uint32_t fieldValues[AXISCNT])
+{
+	BUS_OP op = {OP_MODIFY, (uint8_t) regName, axis, fieldMask, {fieldValues[AXIS_X], fieldValues[AXIS_Y], fieldValues[AXIS_Z], fieldValues[AXIS_U]}};
+
+	bus_transact(0, BUS_CONFIG, &op, 1);
+}
+
+/*************************************************************************
+ *	@brief		modify_register
+ *				Updates the same field, with the same value, of a 32-bit PCL6046
+ *				ASIC register in 1 to 4 axes; see modify_registers().
+ *	@param[in]	regName is a shadowed register, taken from enumeration ASIC_REG
+ *	@param[in]	axis is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *	@param[in]	fieldMask selects the bits to be replaced
+ *	@param[in]	fieldValue holds the replacement bits
+ *	@returns	none
+ ************************************************************************/
+void modify_register(ASIC_REG regName, uint8_t axis, uint32_t fieldMask, uint32_t fieldValue)
+{
+	const uint32_t fieldValues[AXISCNT] = {fieldValue, fieldValue, fieldValue, fieldValue};
+
+	modify_registers(regName, axis, fieldMask, fieldValues);
+}
+
+/*************************************************************************
+ *	@brief		ReadReg
+ *				This is the read register routine required by the challenge.
+ *				I think the axis is required, so I added it as an argument.
+ *	@param[in]	RegName is the register name, taken from enumeration ASIC_REG
+ *	@param[in]	axis identifies the X, Y, Z, or U axis
+ *	@returns	the value read from the specified register
+ ************************************************************************/
+uint32_t ReadReg(ASIC_REG RegName, MOTION_AXIS axis)
+{
+	uint32_t regSet[AXISCNT];
+
+	read_registers(RegName, (uint8_t) (1 << axis), regSet);
+
+	return (regSet[axis]);
+}
+
+/*************************************************************************
+ *	@brief		WriteReg
+ *				This is the write register routine required by the challenge.
+ *				I think the axis is required, so I added it as an argument.
+ *	@param[in]	RegName is the register name, taken from enumeration ASIC_REG
+ *	@param[in]	axis identifies the X, Y, Z, or U axis
+ *	@param[in]	value is the value to be written
+ *	@returns	none
+ ************************************************************************/
+void WriteReg(ASIC_REG RegName, MOTION_AXIS axis, uint32_t value)
+{
+	write_register(RegName, (uint8_t) (1 << axis), value);
+}
@@ -13,14 +13,69 @@
 
 	#define	BASE_TASK_PRI   2
 
-	//	TODO:	populate this macro from the motion controller schematic;
-	//	hardware-specific macro for reading IFB (Interface Busy) pin of PCL6046
-	#define	IFB_HIGH()		()
+	//	a task's stack, in StackType_t words:  what the kernel needs beneath
+	//	any task (the idle task's minimum), bus_transact_all()'s transaction
+	//	of 4 words per chip, plus the locals of the task's deepest frame, in
+	//	bytes; the large buffers are kept in static storage, so they don't
+	//	count
+	#define	TASK_STACK_SIZE(frameBytes)	(configMINIMAL_STACK_SIZE + (4 * PCL6046_CHIPS) + (((frameBytes) + sizeof(StackType_t) - 1) / sizeof(StackType_t)))
 
-	//	TODO:	populate this macro with a call to implement > 1us sleep,
-	//			to satisfy timing requirements of PCL6046 communications
-	//			("2 cycles of CLK signals", section 5.1.4.2)
-	#define microsleep()	()
+	//	reference clock of the ASIC, section 5.1.3 of the PCL6046 user manual
+	#define	PCL6046_CLK_HZ	19660800UL
+
+	//	number of PCL6046 chips on the board; each has its own FMC bank, IFB
+	//	pin and bus-owner task, and drives AXISCNT carriers
+	#ifndef	PCL6046_CHIPS
+		#define	PCL6046_CHIPS	1
+	#endif
+
+	#ifdef	PCL6046_HOST_SIM
+
+		//	host builds replace the parallel bus with the emulated chips in
+		//	PCL6046_sim.c; every access below is decoded and cycle-counted there
+		#define	IFB_HIGH(chip)	PCL6046_sim_IFB(chip)
+		#define microsleep()	PCL6046_sim_microsleep()
+		#define	INT_ASSERTED()	PCL6046_sim_INT()
+
+		//	free-running timestamp for latency measurements, in nanoseconds
+		#define	TIMESTAMP()		PCL6046_sim_timestamp()
+		#define	TIMESTAMP_HZ	1000000000UL
+
+		#define	ASIC_WRITE16(field, value)	PCL6046_sim_write16(&(field), (uint16_t) (value))
+		#define	ASIC_READ16(field)			PCL6046_sim_read16(&(field))
+
+	#else
+
+		//	TODO:	populate this macro from the motion controller schematic;
+		//	hardware-specific macro for reading IFB (Interface Busy) pin of the
+		//	PCL6046 numbered chip
+		#define	IFB_HIGH(chip)	()
+
+		//	TODO:	populate this macro with a call to implement > 1us sleep,
+		//			to satisfy timing requirements of PCL6046 communications
+		//			("2 cycles of CLK signals", section 5.1.4.2)
+		#define microsleep()	()
+
+		//	TODO:	populate this macro from the motion controller schematic;
+		//	hardware-specific macro for reading the INT pin of PCL6046 (active low);
+		//	only the first chip's INT pin is wired to the MCU
+		#define	INT_ASSERTED()	()
+
+		//	free-running timestamp for latency measurements; the DWT cycle counter
+		//	must be enabled by the hardware initialization
+		#define	TIMESTAMP()		(DWT->CYCCNT)
+		#define	TIMESTAMP_HZ	SystemCoreClock
+
+		//	all 16-bit accesses to the ASIC go through these, so that the compiler
+		//	can't merge, reorder, or elide them
+		#define	ASIC_WRITE16(field, value)	(*((volatile uint16_t *) &(field)) = (uint16_t) (value))
+		#define	ASIC_READ16(field)			(*((volatile uint16_t *) &(field)))
+
+	#endif
+
+	//	keeps the compiler from moving memory accesses across it; enough to
+	//	order a single-core writer against a preempting reader
+	#define	COMPILER_BARRIER()	__asm volatile ("" ::: "memory")
 
 	typedef enum
 	{
@@ -31,6 +86,12 @@
 		AXISCNT	=	4
 	}	MOTION_AXIS;
 
+	//	carriers are numbered across the chips:  carrier c is axis
+	//	c % AXISCNT of chip c / AXISCNT
+	#define	CARRIERCNT			(PCL6046_CHIPS * AXISCNT)
+	#define	CARRIER_CHIP(c)		((uint8_t) ((c) / AXISCNT))
+	#define	CARRIER_AXIS(c)		((MOTION_AXIS) ((c) % AXISCNT))
+
 	//	create a type representing the PCL6046 register block for a single
 	//	axis
 	typedef struct
@@ -161,94 +222,350 @@
 	}	ASIC_CMD;
 
 
+	//	the register table, section 5.3:  each register's name, its read
+	//	command code, and the member of AXIS_MAP that maps it.  ASIC_REG is
+	//	generated from it, and PCL6046.c checks at compile time that every
+	//	member sits at the offset its code implies.
+	#define	PCL6046_REGISTERS(X)	\
+		X(PRMV,		0xC0,	PRMV_reg)	\
+		X(PRFL,		0xC1,	PRFL_reg)	\
+		X(PRFH,		0xC2,	PRFH_reg)	\
+		X(PRUR,		0xC3,	PRUR_reg)	\
+		X(PRDR,		0xC4,	PRDR_reg)	\
+		X(PRMG,		0xC5,	PRMG_reg)	\
+		X(PRDP,		0xC6,	PRDP_reg)	\
+		X(PRMD,		0xC7,	PRMD_reg)	\
+		X(PRIP,		0xC8,	PRIP_reg)	\
+		X(PRUS,		0xC9,	PRUS_reg)	\
+		X(PRDS,		0xCA,	PRDS_reg)	\
+		X(PRCP5,	0xCB,	PRCP5_reg)	\
+		X(PRCI,		0xCC,	PRCI_reg)	\
+		X(RMV,		0xD0,	RMV_reg)	\
+		X(RFL,		0xD1,	RFL_reg)	\
+		X(RFH,		0xD2,	RFH_reg)	\
+		X(RUR,		0xD3,	RUR_reg)	\
+		X(RDR,		0xD4,	RDR_reg)	\
+		X(RMG,		0xD5,	RMG_reg)	\
+		X(RDP,		0xD6,	RDP_reg)	\
+		X(RMD,		0xD7,	RMD_reg)	\
+		X(RIP,		0xD8,	RIP_reg)	\
+		X(RUS,		0xD9,	RUS_reg)	\
+		X(RDS,		0xDA,	RDS_reg)	\
+		X(RFA,		0xDB,	RFA_reg)	\
+		X(RENV1,	0xDC,	RENV1_reg)	\
+		X(RENV2,	0xDD,	RENV2_reg)	\
+		X(RENV3,	0xDE,	RENV3_reg)	\
+		X(RENV4,	0xDF,	RENV4_reg)	\
+		X(RENV5,	0xE0,	RENV5_reg)	\
+		X(RENV6,	0xE1,	RENV6_reg)	\
+		X(RENV7,	0xE2,	RENV7_reg)	\
+		X(RCUN1,	0xE3,	RCUN1_reg)	\
+		X(RCUN2,	0xE4,	RCUN2_reg)	\
+		X(RCUN3,	0xE5,	RCUN3_reg)	\
+		X(RCUN4,	0xE6,	RCUN4_reg)	\
+		X(RCMP1,	0xE7,	RCMP1_reg)	\
+		X(RCMP2,	0xE8,	RCMP2_reg)	\
+		X(RCMP3,	0xE9,	RCMP3_reg)	\
+		X(RCMP4,	0xEA,	RCMP4_reg)	\
+		X(RCMP5,	0xEB,	RCMP5_reg)	\
+		X(RIRQ,		0xEC,	RIRQ_reg)	\
+		X(RLTC1,	0xED,	RLTC1_reg)	\
+		X(RLTC2,	0xEE,	RLTC2_reg)	\
+		X(RLTC3,	0xEF,	RLTC3_reg)	\
+		X(RLTC4,	0xF0,	RLTC4_reg)	\
+		X(RSTS,		0xF1,	RSTS_reg)	\
+		X(REST,		0xF2,	REST_reg)	\
+		X(RIST,		0xF3,	RIST_reg)	\
+		X(RPLS,		0xF4,	RPLS_reg)	\
+		X(PSPD,		0xF5,	RSPD_reg)	\
+		X(RSDC,		0xF6,	RSDC_reg)	\
+		X(RCI,		0xFC,	RCI_reg)	\
+		X(RCIC,		0xFD,	RCIC_reg)	\
+		X(RIPS,		0xFF,	RIPS_reg)
+
 	//	enumeration for reading/writing registers indirectly;
 	//	to read, use the enumerated value; to write (if permissible),
-	//	XOR the enumerated value with 0x40
+	//	use REG_WRITE_CODE() of it
+	#define	REG_ENUM(name, code, member)	name = code,
+
 	typedef enum
 	{
-		PRMV	=	0xC0,
-		PRFL	=	0xC1,
-		PRFH	=	0xC2,
-		PRUR	=	0xC3,
-		PRDR	=	0xC4,
-		PRMG	=	0xC5,
-		PRDP	=	0xC6,
-		PRMD	=	0xC7,
-		PRIP	=	0xC8,
-		PRUS	=	0xC9,
-		PRDS	=	0xCA,
-		PRCP5	=	0xCB,
-		PRCI	=	0xCC,
-
-		RMV		=	0xD0,
-		RFL		=	0xD1,
-		RFH		=	0xD2,
-		RUR		=	0xD3,
-		RDR		=	0xD4,
-		RMG		=	0xD5,
-		RDP		=	0xD6,
-		RMD		=	0xD7,
-		RIP		=	0xD8,
-		RUS		=	0xD9,
-		RDS		=	0xDA,
-		RFA		=	0xDB,
-		RENV1	=	0xDC,
-		RENV2	=	0xDD,
-		RENV3	=	0xDE,
-		RENV4	=	0xDF,
-		RENV5	=	0xE0,
-		RENV6	=	0xE1,
-		RENV7	=	0xE2,
-		RCUN1	=	0xE3,
-		RCUN2	=	0xE4,
-		RCUN3	=	0xE5,
-		RCUN4	=	0xE6,
-		RCMP1	=	0xE7,
-		RCMP2	=	0xE8,
-		RCMP3	=	0xE9,
-		RCMP4	=	0xEA,
-		RCMP5	=	0xEB,
-		RIRQ	=	0xEC,
-		RLTC1	=	0xED,
-		RLTC2	=	0xEE,
-		RLTC3	=	0xEF,
-		RLTC4	=	0xF0,
-		RSTS	=	0xF1,
-		REST	=	0xF2,
-		RIST	=	0xF3,
-		RPLS	=	0xF4,
-		PSPD	=	0xF5,
-		RSDC	=	0xF6,
-		RCI		=	0xFC,
-		RCIC	=	0xFD,
-		RIPS	=	0xFF
+		PCL6046_REGISTERS(REG_ENUM)
 
 	}	ASIC_REG;
 
+	#define	REG_WRITE_CODE(regName)	((uint8_t) ((regName) ^ 0x40))
+
 	//	axis selection written to upper byte of COMW register
 	#define	AXIS_X_MASK	1
 	#define AXIS_Y_MASK	2
 	#define AXIS_Z_MASK	4
 	#define	AXIS_U_MASK	8
 
+	//	main status (MSTSW) bits, section 5.2.1 of the PCL6046 user manual
+	#define	MSTS_SSCM	0x0001		//	start command has been written
+	#define	MSTS_SRUN	0x0002		//	operation mode running
+	#define	MSTS_SENI	0x0004		//	operation stop interrupt
+	#define	MSTS_SEND	0x0008		//	operation mode stopped
+	#define	MSTS_SERR	0x0010		//	error interrupt (REST != 0)
+	#define	MSTS_SINT	0x0020		//	event interrupt (RIST != 0)
+	#define	MSTS_SCP1	0x0100		//	comparator 1 condition satisfied
+	#define	MSTS_SCP2	0x0200
+	#define	MSTS_SCP3	0x0400
+	#define	MSTS_SCP4	0x0800
+	#define	MSTS_SCP5	0x1000
+	#define	MSTS_SPRF	0x4000		//	2nd pre-register for operation is full
+
+	//	sub-status (SSTSW) bits, section 5.2.2 of the PCL6046 user manual
+	#define	SSTS_SFU	0x0100		//	accelerating
+	#define	SSTS_SFD	0x0200		//	decelerating
+	#define	SSTS_SFC	0x0400		//	constant speed
+
+	//	the field table:  register, field, lowest bit and width of the
+	//	register fields the firmware uses (sections 5.4.1 to 5.4.8).  The
+	//	macros below build masks and values from it as constant expressions,
+	//	so fields of one register are OR'ed into a single write or
+	//	modify_register() with no read-modify-write on the CPU.
+	#define	PCL6046_FIELDS(X)	\
+		X(RFL,		FL,		0,	16)		/*	initial speed step						*/	\
+		X(RFH,		FH,		0,	16)		/*	operation speed step					*/	\
+		X(RUR,		UR,		0,	16)		/*	acceleration rate						*/	\
+		X(RDR,		DR,		0,	16)		/*	deceleration rate; 0 uses RUR			*/	\
+		X(RMG,		MG,		0,	12)		/*	speed magnification						*/	\
+		X(RUS,		US,		0,	16)		/*	S-curve section of acceleration			*/	\
+		X(RDS,		DS,		0,	16)		/*	... of deceleration						*/	\
+		X(RMD,		MOD,	0,	7)		/*	operation mode, MOD_xxx					*/	\
+		X(RMD,		MSMD,	10,	1)		/*	S-curve acceleration/deceleration		*/	\
+		X(RMD,		MCCE,	11,	1)		/*	COUNTER1 doesn't count					*/	\
+		X(RMD,		METM,	12,	1)		/*	end of operation on the last pulse		*/	\
+		X(RMD,		MSY,	18,	2)		/*	start timing, MSY_xxx					*/	\
+		X(RENV3,	ORM,	0,	4)		/*	origin return, ORM_xxx					*/	\
+		X(RENV3,	CI3,	10,	2)		/*	COUNTER3 input, CI3_xxx					*/	\
+		X(RENV4,	C1C,	0,	2)		/*	comparator 1 counter, CMP_COUNTERn		*/	\
+		X(RENV4,	C1S,	2,	3)		/*	... method, CMP_xxx						*/	\
+		X(RENV4,	C1D,	5,	2)		/*	... processing, CMP_xxx					*/	\
+		X(RENV4,	C2C,	8,	2)		\
+		X(RENV4,	C2S,	10,	3)		\
+		X(RENV4,	C2D,	13,	2)		\
+		X(RENV4,	C3C,	16,	2)		\
+		X(RENV4,	C3S,	18,	3)		\
+		X(RENV4,	C3D,	21,	2)		\
+		X(RENV4,	C4C,	24,	2)		\
+		X(RENV4,	C4S,	26,	3)		\
+		X(RENV4,	C4D,	29,	2)		\
+		X(RENV5,	C5C,	0,	3)		/*	comparator 5 counter, or CMP5_SPEED		*/	\
+		X(RENV5,	C5S,	3,	3)		\
+		X(RENV5,	C5D,	6,	2)		\
+		X(RENV5,	LTOF,	15,	1)		/*	counters only latch on LTCH				*/	\
+		X(RIRQ,		IREN,	0,	1)		/*	normal stop								*/	\
+		X(RIRQ,		IRN,	1,	1)		/*	next operation started from pre-regs	*/	\
+		X(RIRQ,		IRNM,	2,	1)		/*	2nd pre-register can be written			*/	\
+		X(RIRQ,		IRC3,	10,	1)		/*	comparator 3 condition met				*/	\
+		X(RIRQ,		IRC4,	11,	1)		\
+		X(RIRQ,		IRC5,	12,	1)		\
+		X(REST,		ESC,	0,	5)		/*	stopped by comparator 1..5				*/	\
+		X(RIST,		ISEN,	0,	1)		/*	normal stop								*/	\
+		X(RIST,		ISN,	1,	1)		/*	next operation started					*/	\
+		X(RIST,		ISNM,	2,	1)		/*	2nd pre-register can be written			*/	\
+		X(RIST,		ISC,	8,	5)		/*	comparator 1..5 condition met			*/	\
+		X(RSTS,		SDIR,	4,	1)		/*	operating in the - direction			*/	\
+		X(RSTS,		PFM,	20,	2)		/*	pre-registers determined				*/
+
+	#define	FIELD_ENUM(reg, field, shift, width)	reg##_##field##_SHIFT = (shift), reg##_##field##_WIDTH = (width),
+
+	enum
+	{
+		PCL6046_FIELDS(FIELD_ENUM)
+	};
+
+	//	mask of a field; its value shifted into place; and its value in a
+	//	register's contents
+	#define	FIELD_MASK(reg, field)			((uint32_t) (((1ULL << reg##_##field##_WIDTH) - 1) << reg##_##field##_SHIFT))
+	#define	FIELD_SET(reg, field, value)	(((uint32_t) (value) << reg##_##field##_SHIFT) & FIELD_MASK(reg, field))
+	#define	FIELD_GET(reg, field, contents)	(((uint32_t) (contents) & FIELD_MASK(reg, field)) >> reg##_##field##_SHIFT)
+
+	//	operation modes (RMD.MOD), section 5.4.3.1
+	#define	MOD_CONT_PLUS		0x00		//	continuous, + direction
+	#define	MOD_CONT_MINUS		0x08		//	continuous, - direction
+	#define	MOD_ORIGIN_PLUS		0x10		//	origin return, + direction
+	#define	MOD_ORIGIN_MINUS	0x18		//	origin return, - direction
+	#define	MOD_INCREMENTAL		0x41		//	positioning, RMV is the feed amount
+	#define	MOD_ABSOLUTE_CUN1	0x42		//	positioning, RMV is a COUNTER1 position
+	#define	MOD_ZERO_CUN1		0x44		//	positioning to COUNTER1 = 0
+
+	//	origin return method (RENV3.ORM), section 5.4.3.4:  stop when the ORG
+	//	input turns on (at once from FL speed)
+	#define	ORM_ORG_STOP		0
+
+	//	COUNTER3 input (RENV3.CI3):  the deviation of the output pulses from
+	//	the EA/EB encoder input
+	#define	CI3_DEVIATION		0
+
+	//	start timing (RMD.MSY):  at once, or on the CSTA input
+	#define	MSY_IMMEDIATE		0
+	#define	MSY_CSTA			1
+
+	//	comparators (RENV4, RENV5):  the counter compared, the method, and the
+	//	processing when the condition is met, sections 5.4.3.5 and 5.4.3.6
+	#define	CMP_COUNTER1		0
+	#define	CMP_COUNTER3		2			//	compared as |COUNTER3|
+	#define	CMP5_SPEED			5
+
+	#define	CMP_EQUAL			1
+	#define	CMP_EQUAL_UP		2
+	#define	CMP_EQUAL_DOWN		3
+	#define	CMP_GREATER			4			//	RCMPn > counter
+	#define	CMP_LESS			5			//	RCMPn < counter
+	#define	CMP_SOFT_LIMIT		6
+
+	#define	CMP_NO_ACTION		0
+	#define	CMP_STOP			1
+	#define	CMP_DECEL_STOP		2
+
+	//	priority classes of bus transactions; ASIC_bus always serves the
+	//	lowest-numbered class that has anything queued
+	typedef enum
+	{
+		BUS_EMERGENCY	=	0,		//	stop commands
+		BUS_SAFETY		=	1,		//	software limits, interrupt factors
+		BUS_ACQUISITION	=	2,		//	periodic snapshots
+		BUS_CONFIG		=	3,		//	everything else
+		BUS_CLASSES
+
+	}	BUS_CLASS;
+
+	//	the operations a bus transaction is built from
+	typedef enum
+	{
+		OP_COMMAND,			//	code is an ASIC_CMD
+		OP_WRITE,			//	code is an ASIC_REG; values are written
+		OP_READ,			//	code is an ASIC_REG; values receive the results
+		OP_MODIFY,			//	code is an ASIC_REG; the bits of mask are replaced from values
+		OP_MSTSW,			//	values receive the main status words
+		OP_SSTSW,			//	values receive the sub-status words
+		OP_SHADOWED			//	code is a shadowed ASIC_REG; values receive the shadow,
+							//	which is only read from the ASIC where it isn't valid
+
+	}	BUS_OP_KIND;
+
+	typedef struct
+	{
+		BUS_OP_KIND	kind;
+		uint8_t		code;
+		uint8_t		axis;				//	axis:bit == X:0, Y:1, Z:2, U:3
+		uint32_t	mask;				//	OP_MODIFY only
+		uint32_t	values[AXISCNT];	//	index 0 is X, index 3 is U
+
+	}	BUS_OP;
+
+	//	per-class counters; times are in TIMESTAMP() counts
+	typedef struct
+	{
+		uint32_t	transactions;		//	transactions completed
+		uint32_t	merged;				//	... that shared a COMW with an earlier one
+		uint32_t	maxWait;			//	longest time queued
+		uint32_t	maxService;			//	longest time on the bus
+
+	}	BUS_STATS;
+
+	//	depth of each class queue
+	#define	BUS_QUEUE_DEPTH		8
+
+	//	task notification index used to complete a caller; requires
+	//	configTASK_NOTIFICATION_ARRAY_ENTRIES >= 2, so that index 0 remains
+	//	free for the caller's own use
+	#define	BUS_NOTIFY_INDEX	1
+
+	//	ASIC_bus's stack:  the transactions it's serving, their merged
+	//	operation, and the scalars of the bus cycles beneath it
+	#define	BUS_STACK_SIZE		TASK_STACK_SIZE((AXISCNT * sizeof(void *)) + sizeof(BUS_OP) + (32 * sizeof(uint32_t)))
+
+	#ifdef	PCL6046_HOST_SIM
+		#include	"PCL6046_sim.h"
+	#endif
+
 	#ifdef	PCL6046_C
 
-		//	assume that the PCL6046 ASIC is interfaced to the STM32 via the
-		//	FMC external memory controller, memory bank #1;
-		//	the STM32 would be initialized in code I haven't written, dependent
-		//	on the particular microcontroller chosen
-		AXIS_MAP *X_axis = (AXIS_MAP *) 0x60000000;
-		AXIS_MAP *Y_axis = (AXIS_MAP *) 0x60000100;
-		AXIS_MAP *Z_axis = (AXIS_MAP *) 0x60000200;
-		AXIS_MAP *U_axis = (AXIS_MAP *) 0x60000300;
+		#ifdef	PCL6046_HOST_SIM
+
+			//	on the host, the axis blocks are backed by the emulated chips
+			#define	PCL6046_BANK(chip)	(&PCL6046_sim_space[(chip) * AXISCNT])
+
+		#else
+
+			//	assume that the PCL6046 ASICs are interfaced to the STM32 via the
+			//	FMC external memory controller, memory bank #1, one chip per
+			//	sub-bank (NE1..NE4), with the 4 axis blocks at 0x100 intervals;
+			//	the STM32 would be initialized in code I haven't written, dependent
+			//	on the particular microcontroller chosen
+			#if		(PCL6046_CHIPS > 4)
+				#error	"FMC bank #1 has room for 4 PCL6046 chips"
+			#endif
+
+			#define	PCL6046_BANK(chip)	((AXIS_MAP *) (0x60000000UL + ((uint32_t) (chip) * 0x04000000UL)))
+
+		#endif
+
+		//	a submitted transaction; the queues carry pointers to these, which
+		//	live on the stack of the blocked caller
+		typedef struct
+		{
+			BUS_OP			*ops;
+			uint8_t			count;
+			TaskHandle_t	caller;
+			uint32_t		stamp;		//	TIMESTAMP() at submission
+
+		}	BUS_TXN;
+
+		//	write-through shadow of the registers that only change when the CPU
+		//	writes them (RFL..RENV7, RCMP1..RCMP5, RIRQ), indexed from RFL
+		#define	SHADOW_FIRST	RFL
+		#define	SHADOW_COUNT	(RIRQ - RFL + 1)
+
+		//	axes that have had operation pre-registers written since reset
+		//	never treat their RFL..RDS entries as valid
+		#define	PREREG_SHADOW_BITS	((1UL << (RDS - SHADOW_FIRST + 1)) - 1)
+
+		//	RCMP5 is loaded from PRCP5 by PCPSHF, or by the ASIC itself when
+		//	comparator 5 is met, so it isn't kept for axes that have written it
+		#define	RCMP5_SHADOW_BIT	(1UL << (RCMP5 - SHADOW_FIRST))
+
+		//	the device table:  one entry per chip, each the sole owner of its
+		//	bank; the bus-owner task of a chip is its lock, as it's the only
+		//	task that touches that chip once it is running, so chips never
+		//	wait on each other
+		typedef struct
+		{
+			AXIS_MAP		*axes;						//	the chip's AXISCNT axis blocks
+
+			//	one queue per priority class, all served by the bus-owner task
+			QueueHandle_t	queue[BUS_CLASSES];
+			TaskHandle_t	task;
+			BUS_STATS		stats[BUS_CLASSES];
+
+			//	shadowValid has a bit per entry that is known to match the
+			//	ASIC; both are only touched on the bus-owner task
+			uint32_t		shadowValue[AXISCNT][SHADOW_COUNT];
+			uint32_t		shadowValid[AXISCNT];
+			uint8_t			streamingAxes;
+			uint8_t			cmp5PreAxes;				//	axes that have written PRCP5
+
+		}	PCL6046_DEVICE;
 
-		//	mutex for preventing conflicting access to PCL6046 ASIC
-		static SemaphoreHandle_t PCL6046_mutex = NULL;
+		static PCL6046_DEVICE	pcl6046[PCL6046_CHIPS];
 
 
 	#else
-		void write_register(ASIC_REG register, uint8_t axis, uint32_t value);
-		void read_registers(ASIC_REG register, uint8_t axis, uint32_t *results);
+		void bus_transact(uint8_t chip, BUS_CLASS busClass, BUS_OP *ops, uint8_t count);
+		void bus_transact_all(BUS_CLASS busClass, BUS_OP *ops, uint8_t count);
+		void get_bus_stats(BUS_CLASS busClass, BUS_STATS *stats);
+		void ASIC_bus(void *pvParameters);
+		void write_command(ASIC_CMD command, uint8_t axis);
+		void write_register(ASIC_REG regName, uint8_t axis, uint32_t value);
+		void write_registers(ASIC_REG regName, uint8_t axis, const uint32_t values[AXISCNT]);
+		void modify_register(ASIC_REG regName, uint8_t axis, uint32_t fieldMask, uint32_t fieldValue);
+		void modify_registers(ASIC_REG regName, uint8_t axis, uint32_t fieldMask, const uint32_t fieldValues[AXISCNT]);
+		void read_registers(ASIC_REG regName, uint8_t axis, uint32_t *results);
 		uint32_t ReadReg(ASIC_REG RegName, MOTION_AXIS axis);
 		void WriteReg(ASIC_REG RegName, MOTION_AXIS axis, uint32_t value);
 		bool init_PCL6046_resources(void);
@@ -1,7 +1,11 @@
 /*************************************************************************
  *  Challenge_1_Firmware:   PCL6046_comm.c
  *                          Handles USB and SOC/ASIC communication, as
- *                          specified in challenge description
+ *                          specified in challenge description.  Each USB
+ *                          transfer is one frame of any number of commands;
+ *                          frames are parsed in the receive buffer the USB
+ *                          endpoint filled, which is then handed back to it,
+ *                          so command data is never copied on the way in.
  *
  *  Engineer:               Larry Pelton
  *
@@ -11,12 +15,635 @@
 #include    <stdint.h>
 #include    <stdbool.h>
 
+#include    "FreeRTOS.h"
+#include    "task.h"
+#include    "queue.h"
+#include    "semphr.h"
+
 #include    "PCL6046.h"
+#include    "PCL6046_profile.h"
 #include    "PCL6046_maint.h"
-#include    "PCL6046_comm.h"
+#include    "PCL6046_motion.h"
 #include    "PCL6046_limit.h"
+#include    "PCL6046_sched.h"
+#include    "PCL6046_group.h"
+#include    "PCL6046_home.h"
+#include    "PCL6046_deviation.h"
+#include    "PCL6046_warm.h"
+#include    "PCL6046_telem.h"
+#include    "PCL6046_trace.h"
+#include    "PCL6046_comm.h"
 
 
+/*************************************************************************
+ *  @brief      usb_rx_buffer
+ *              Gets a free receive buffer for the USB endpoint to fill.
+ *  @param[in]  timeout is the maximum wait for one, in RTOS ticks
+ *  @returns    the buffer, USB_RX_BUFFER_SIZE bytes, or NULL if none is free
+ ************************************************************************/
+uint32_t *usb_rx_buffer(TickType_t timeout)
+{
+    uint32_t *buffer = NULL;
+
+    if ((usbRxFree == (QueueHandle_t) NULL) || (xQueueReceive(usbRxFree, (void *) &buffer, timeout) != pdPASS))
+    {
+        commStats.noBuffer++;
+        return (NULL);
+    }
+
+    return (buffer);
+}
+
+/*************************************************************************
+ *  @brief      usb_rx_buffer_FromISR
+ *              usb_rx_buffer() for the USB receive interrupt; never waits
+ *  @returns    the buffer, or NULL if none is free
+ ************************************************************************/
+uint32_t *usb_rx_buffer_FromISR(void)
+{
+    uint32_t *buffer = NULL;
+
+    if ((usbRxFree == (QueueHandle_t) NULL) || (xQueueReceiveFromISR(usbRxFree, (void *) &buffer, NULL) != pdPASS))
+    {
+        commStats.noBuffer++;
+        return (NULL);
+    }
+
+    return (buffer);
+}
+
+/*************************************************************************
+ *  @brief      usb_rx_submit
+ *              Passes a filled receive buffer to ASIC_comm; the buffer
+ *              belongs to ASIC_comm until usb_rx_buffer() returns it again.
+ *  @param[in]  buffer is a buffer from usb_rx_buffer()
+ *  @param[in]  length is the number of bytes received
+ *  @param[in]  timeout is the maximum wait for room in the queue
+ *  @returns    true, if the buffer was queued; false, otherwise
+ ************************************************************************/
+bool usb_rx_submit(uint32_t *buffer, uint16_t length, TickType_t timeout)
+{
+    USB_RX_t rx = {buffer, length};
+
+    return (xQueueSend(ASIC_comm_queue, (void *) &rx, timeout) == pdPASS);
+}
+
+/*************************************************************************
+ *  @brief      usb_rx_submit_FromISR
+ *              usb_rx_submit() for the USB receive interrupt
+ *  @param[in]  buffer is a buffer from usb_rx_buffer_FromISR()
+ *  @param[in]  length is the number of bytes received
+ *  @param[out] higherPriorityTaskWoken is set if a yield is due on exit
+ *  @returns    true, if the buffer was queued; false, otherwise
+ ************************************************************************/
+bool usb_rx_submit_FromISR(uint32_t *buffer, uint16_t length, BaseType_t *higherPriorityTaskWoken)
+{
+    USB_RX_t rx = {buffer, length};
+
+    return (xQueueSendFromISR(ASIC_comm_queue, (void *) &rx, higherPriorityTaskWoken) == pdPASS);
+}
+
+/*************************************************************************
+ *  @brief      usb_attach_tx
+ *              Attaches the function that sends a packet to the host; it
+ *              must be done with the data by the time it returns.
+ *  @param[in]  transmit is the function, or NULL to detach it
+ *  @returns    none
+ ************************************************************************/
+void usb_attach_tx(bool (*transmit)(const uint8_t *data, uint16_t length))
+{
+    usbTransmit = transmit;
+}
+
+/*************************************************************************
+ *  @brief      usb_transmit
+ *              Sends a packet to the host through the attached function;
+ *              the tasks that send take turns.
+ *  @param[in]  data is the packet
+ *  @param[in]  length is its size, in bytes
+ *  @returns    true, if it was sent; false, if not, or if nothing is
+ *              attached
+ ************************************************************************/
+bool usb_transmit(const uint8_t *data, uint16_t length)
+{
+    bool sent = false;
+
+    if ((usbTxMutex == (SemaphoreHandle_t) NULL) || (xSemaphoreTake(usbTxMutex, portMAX_DELAY) != pdPASS))
+    {
+        return (false);
+    }
+
+    if (usbTransmit != NULL)
+    {
+        sent = usbTransmit(data, length);
+    }
+
+    (void) xSemaphoreGive(usbTxMutex);
+
+    return (sent);
+}
+
+/*************************************************************************
+ *  @brief      dump_trace
+ *              Sends the trace records recorded since the last dump, as
+ *              packets of as many records as fit the transmit buffer.
+ *  @returns    none
+ ************************************************************************/
+static void dump_trace(void)
+{
+    static uint32_t cursor = 0;
+    TRACE_DUMP_HDR *header = (TRACE_DUMP_HDR *) usbTxBuffer;
+    TRACE_RECORD *records = (TRACE_RECORD *) (header + 1);
+
+    if (usbTransmit == NULL)
+    {
+        return;
+    }
+
+    do
+    {
+        header->magic = TRACE_MAGIC;
+        header->stampHz = (uint32_t) TIMESTAMP_HZ;
+        header->reserved = 0;
+        header->count = trace_read(&cursor, records, (uint16_t) ((USB_TX_BUFFER_SIZE - sizeof(TRACE_DUMP_HDR)) / sizeof(TRACE_RECORD)));
+
+        //  records lost to overwriting move "first" on
+        header->first = cursor - header->count;
+
+        if ((header->count != 0) && !usb_transmit((const uint8_t *) usbTxBuffer, (uint16_t) (sizeof(TRACE_DUMP_HDR) + (header->count * sizeof(TRACE_RECORD)))))
+        {
+            break;
+        }
+
+    } while (header->count != 0);
+}
+
+/*************************************************************************
+ *  @brief      report_stops
+ *              Sends the stops counted per carrier, as one packet.
+ *  @returns    none
+ ************************************************************************/
+static void report_stops(void)
+{
+    STOP_REPORT_HDR *header = (STOP_REPORT_HDR *) usbTxBuffer;
+
+    header->magic = STOP_REPORT_MAGIC;
+    header->tickHz = (uint32_t) configTICK_RATE_HZ;
+    header->tick = (uint32_t) xTaskGetTickCount();
+    header->carriers = CARRIERCNT;
+    get_limit_stops((LIMIT_STOPS *) (header + 1));
+
+    (void) usb_transmit((const uint8_t *) usbTxBuffer, (uint16_t) (sizeof(STOP_REPORT_HDR) + (CARRIERCNT * sizeof(LIMIT_STOPS))));
+}
+
+/*************************************************************************
+ *  @brief      report_homing
+ *              Sends how the last homing went, and its time to ready, as
+ *              one packet.
+ *  @returns    none
+ ************************************************************************/
+static void report_homing(void)
+{
+    usbTxBuffer[0] = HOME_REPORT_MAGIC;
+    get_home_stats((HOME_STATS *) &usbTxBuffer[1]);
+
+    (void) usb_transmit((const uint8_t *) usbTxBuffer, (uint16_t) (sizeof(uint32_t) + sizeof(HOME_STATS)));
+}
+
+/*************************************************************************
+ *  @brief      report_deviation
+ *              Sends the deviation counts per carrier, as one packet.
+ *  @returns    none
+ ************************************************************************/
+static void report_deviation(void)
+{
+    DEVIATION_REPORT_HDR *header = (DEVIATION_REPORT_HDR *) usbTxBuffer;
+
+    header->magic = DEVIATION_REPORT_MAGIC;
+    header->watched = deviation_watched();
+    header->carriers = CARRIERCNT;
+    get_deviation_stats((DEVIATION_STATS *) (header + 1));
+
+    (void) usb_transmit((const uint8_t *) usbTxBuffer, (uint16_t) (sizeof(DEVIATION_REPORT_HDR) + (CARRIERCNT * sizeof(DEVIATION_STATS))));
+}
+
+/*************************************************************************
+ *  @brief      report_warm
+ *              Sends the snapshot counters, and how the restore at start-up
+ *              went, as one packet.
+ *  @returns    none
+ ************************************************************************/
+static void report_warm(void)
+{
+    usbTxBuffer[0] = WARM_REPORT_MAGIC;
+    get_warm_stats((WARM_STATS *) &usbTxBuffer[1]);
+
+    (void) usb_transmit((const uint8_t *) usbTxBuffer, (uint16_t) (sizeof(uint32_t) + sizeof(WARM_STATS)));
+}
+
+/*************************************************************************
+ *  @brief      axis_count
+ *              Counts the axes selected by a command.
+ *  @param[in]  axes is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *  @returns    0 to 4
+ ************************************************************************/
+static uint16_t axis_count(uint8_t axes)
+{
+    uint16_t count = 0;
+    MOTION_AXIS axis;
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        if (axes & (1 << axis))
+        {
+            count++;
+        }
+    }
+
+    return (count);
+}
+
+/*************************************************************************
+ *  @brief      execute_command
+ *              Performs one command of a frame.
+ *  @param[in]  cmd is the command header
+ *  @param[in]  payload points to its payload words, in the receive buffer
+ *  @returns    true, if the command was well-formed; false, otherwise
+ ************************************************************************/
+static bool execute_command(const USB_CMD_HDR *cmd, const uint32_t *payload)
+{
+    MOTION_AXIS axis;
+    uint8_t carrier;
+    uint16_t move;
+
+    //  once any of MOTION_QUEUE, GROUP_START, SCHEDULE and HOME has been
+    //  accepted, a carrier may move, so a saved snapshot no longer holds;
+    //  each consumes it as soon as it's taken
+    switch (cmd->opcode)
+    {
+        //  this is the feature required by the challenge; the limit task
+        //  starts with the first set of parameters and picks up later ones
+        //  from its mailbox; the payload is the margin and flags, the n
+        //  carriers in track order, then the n - 1 gaps between them
+        case ANTI_COLLIDE:
+            if ((cmd->words < 4) || (cmd->words & 1) || (cmd->words > (2 * CARRIERCNT)))
+            {
+                return (false);
+            }
+
+            //  the first word is the margin, in percent, with LIMIT_xxx flags
+            //  in its upper half
+            commLimits.marginPercent = payload[0] & 0xFFFF;
+            commLimits.flags = payload[0] >> 16;
+            commLimits.carriers = (uint8_t) (cmd->words / 2);
+
+            for (carrier = 0; carrier < commLimits.carriers; carrier++)
+            {
+                if (payload[1 + carrier] >= CARRIERCNT)
+                {
+                    return (false);
+                }
+
+                commLimits.order[carrier] = (uint8_t) payload[1 + carrier];
+            }
+
+            for (carrier = 0; carrier < (commLimits.carriers - 1); carrier++)
+            {
+                commLimits.minimumGap[carrier] = payload[1 + commLimits.carriers + carrier];
+            }
+
+            return (configure_limits(&commLimits));
+
+        //  light a corresponding LED whenever a motor stops due to software limits (low priority)
+        case INDICATE_STOPS:
+            enable_limit_indicators();
+            break;
+
+        //  one segment per selected axis, in axis order; each is queued
+        //  straight from the payload, once every start word is known to be
+        //  a start command, so a bad one doesn't leave the others queued
+        case MOTION_QUEUE:
+            if (cmd->words != (5 * axis_count(cmd->axes)))
+            {
+                return (false);
+            }
+
+            for (move = 0; move < cmd->words; move += 5)
+            {
+                if ((payload[move + 4] != STAFL) && (payload[move + 4] != STAFH) && (payload[move + 4] != STAD) && (payload[move + 4] != STAUD))
+                {
+                    return (false);
+                }
+            }
+
+            for (axis = AXIS_X; axis < AXISCNT; axis++)
+            {
+                if (cmd->axes & (1 << axis))
+                {
+                    MOTION_SEGMENT segment;
+
+                    segment.distance = payload[0];
+                    segment.high = payload[1];
+                    segment.rate = payload[2];
+                    segment.mode = payload[3];
+                    segment.start = (ASIC_CMD) payload[4];
+                    payload += 5;
+
+                    if (!queue_motion(axis, &segment, 0))
+                    {
+                        return (false);
+                    }
+
+                    consume_warm_state();
+                }
+            }
+            break;
+
+        case MOTION_CANCEL:
+            for (axis = AXIS_X; axis < AXISCNT; axis++)
+            {
+                if (cmd->axes & (1 << axis))
+                {
+                    cancel_motion(axis);
+                }
+            }
+            break;
+
+        case ACQUIRE:
+            if (cmd->words != 1)
+            {
+                return (false);
+            }
+
+            acquire_items(payload[0]);
+            break;
+
+        case TRACE:
+            if (cmd->words != 1)
+            {
+                return (false);
+            }
+
+            if (payload[0] == TRACE_DUMP)
+            {
+                dump_trace();
+            }
+            else
+            {
+                trace_enable(payload[0] == TRACE_START);
+            }
+            break;
+
+        //  the period of the timer-paced safety loop, in microseconds; 0
+        //  returns the limits to the RTOS tick
+        case SAFETY_LOOP:
+            if (cmd->words != 1)
+            {
+                return (false);
+            }
+
+            return (pace_limits(payload[0]));
+
+        //  moves for the track scheduler, each a carrier and a target
+        //  position, queued in order; an empty list discards the moves that
+        //  haven't started
+        case SCHEDULE:
+            if (cmd->words & 1)
+            {
+                return (false);
+            }
+
+            if (cmd->words == 0)
+            {
+                cancel_schedule();
+            }
+
+            for (move = 0; move < (cmd->words / 2); move++)
+            {
+                if ((payload[0] >= CARRIERCNT) || !schedule_move((uint8_t) payload[0], (int32_t) payload[1]))
+                {
+                    return (false);
+                }
+
+                consume_warm_state();
+                payload += 2;
+            }
+            break;
+
+        //  the telemetry subscription:  ACQ_xxx items, a carrier bitfield,
+        //  and the acquisitions per sample
+        case TELEMETRY:
+            if (cmd->words != 3)
+            {
+                return (false);
+            }
+
+            return (subscribe_telemetry(payload[0], payload[1], payload[2]));
+
+        //  the stops counted per carrier, and when each last stopped
+        case STOP_REPORT:
+            if (cmd->words != 0)
+            {
+                return (false);
+            }
+
+            report_stops();
+            break;
+
+        //  a motion group:  the members, then a segment per member in
+        //  carrier order, all started on the same clock
+        case GROUP_START:
+            if ((cmd->words == 0) || ((payload[0] >> (CARRIERCNT - 1)) > 1))
+            {
+                return (false);
+            }
+
+            for (move = 0, carrier = 0; carrier < CARRIERCNT; carrier++)
+            {
+                if (payload[0] & (1UL << carrier))
+                {
+                    move++;
+                }
+            }
+
+            if (cmd->words != (1 + (5 * move)))
+            {
+                return (false);
+            }
+
+            for (move = 0, carrier = 0; carrier < CARRIERCNT; carrier++)
+            {
+                if (payload[0] & (1UL << carrier))
+                {
+                    const uint32_t *member = &payload[1 + (5 * move++)];
+
+                    commMoves[carrier].distance = member[0];
+                    commMoves[carrier].high = member[1];
+                    commMoves[carrier].rate = member[2];
+                    commMoves[carrier].mode = member[3];
+                    commMoves[carrier].start = (ASIC_CMD) member[4];
+                }
+            }
+
+            if (!start_group(payload[0], commMoves))
+            {
+                return (false);
+            }
+
+            consume_warm_state();
+            break;
+
+        case GROUP_STOP:
+            if (cmd->words != 2)
+            {
+                return (false);
+            }
+
+            stop_group(payload[0], (payload[1] != 0));
+            break;
+
+        //  a speed profile in physical units, compiled into the speed
+        //  registers of the carriers; refused if they can't express it
+        case PROFILE:
+            if ((cmd->words != 7) || (payload[0] == 0) || ((payload[0] >> (CARRIERCNT - 1)) > 1))
+            {
+                return (false);
+            }
+
+            commSpec.resolution = payload[1];
+            commSpec.startSpeed = payload[2];
+            commSpec.speed = payload[3];
+            commSpec.accel = payload[4];
+            commSpec.decel = payload[5];
+            commSpec.jerk = payload[6];
+
+            if (!compile_profile(&commSpec, commProfile))
+            {
+                return (false);
+            }
+
+            load_profile(payload[0], commProfile);
+            break;
+
+        //  homing, all the carriers listed at once where the track allows;
+        //  the payload is how many of them, from the - end, home that way,
+        //  then the carriers in track order from the - end
+        case HOME:
+            if ((cmd->words < 2) || (cmd->words > (1 + CARRIERCNT)))
+            {
+                return (false);
+            }
+
+            commHoming.carriers = (uint8_t) (cmd->words - 1);
+            commHoming.minus = (uint8_t) ((payload[0] > commHoming.carriers) ? (uint32_t) (commHoming.carriers + 1) : payload[0]);
+
+            for (carrier = 0; carrier < commHoming.carriers; carrier++)
+            {
+                commHoming.order[carrier] = (uint8_t) ((payload[1 + carrier] < CARRIERCNT) ? payload[1 + carrier] : CARRIERCNT);
+            }
+
+            if (!start_homing(&commHoming))
+            {
+                return (false);
+            }
+
+            consume_warm_state();
+            break;
+
+        case HOME_REPORT:
+            if (cmd->words != 0)
+            {
+                return (false);
+            }
+
+            report_homing();
+            break;
+
+        //  the encoder deviation watch, which the ASIC trips by itself; the
+        //  payload is the carriers, the threshold, and the flags
+        case DEVIATION:
+            if (cmd->words != 3)
+            {
+                return (false);
+            }
+
+            return (configure_deviation(payload[0], payload[1], payload[2]));
+
+        case DEVIATION_REPORT:
+            if (cmd->words != 0)
+            {
+                return (false);
+            }
+
+            report_deviation();
+            break;
+
+        //  a controlled stop ahead of a reset; the snapshot it saves is
+        //  restored at start-up, so the carriers needn't be homed again;
+        //  neither command is taken without a store
+        case WARM_SAVE:
+            if ((cmd->words != 0) || !WARM_STORE_PRESENT)
+            {
+                return (false);
+            }
+
+            return (save_warm_state());
+
+        case WARM_REPORT:
+            if ((cmd->words != 0) || !WARM_STORE_PRESENT)
+            {
+                return (false);
+            }
+
+            report_warm();
+            break;
+
+        default:
+            return (false);
+    }
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      parse_frame
+ *              Validates a frame and executes its commands in order, where
+ *              they lie in the receive buffer.
+ *  @param[in]  rx is the filled receive buffer
+ *  @returns    none
+ ************************************************************************/
+static void parse_frame(const USB_RX_t *rx)
+{
+    const USB_FRAME_HDR *frame = (const USB_FRAME_HDR *) rx->buffer;
+    const uint32_t *word = rx->buffer + (sizeof(USB_FRAME_HDR) / sizeof(uint32_t));
+    const uint32_t *end;
+    uint8_t n;
+
+    if ((rx->length < sizeof(USB_FRAME_HDR)) || (frame->length > rx->length) || (frame->length > USB_RX_BUFFER_SIZE) || (frame->length & 3))
+    {
+        commStats.badFrames++;
+        return;
+    }
+
+    end = rx->buffer + (frame->length / sizeof(uint32_t));
+    commStats.frames++;
+
+    for (n = 0; n < frame->count; n++)
+    {
+        const USB_CMD_HDR *cmd = (const USB_CMD_HDR *) word;
+
+        //  the command header and its payload must both be inside the frame
+        if (((word + 1) > end) || ((word + 1 + cmd->words) > end) || !execute_command(cmd, word + 1))
+        {
+            commStats.badFrames++;
+            return;
+        }
+
+        commStats.commands++;
+        word += 1 + cmd->words;
+    }
+}
+
 /*************************************************************************
  *  @brief      ASIC_comm
  *              This RTOS task handles execution of ASIC tasks demanded
@@ -28,62 +655,53 @@
  ************************************************************************/
 void ASIC_comm(void *pvParameters)
 {
-    //  create the queue for routing messages from the USB interface to this
-    //  task
-    if ((ASIC_comm_queue = xQueueCreate(ASIC_COMM_QUEUE_SIZE, (UBaseType_t) sizeof(USB_ASIC_Q_t))) != NULL)
+    uint8_t n;
+
+    //  create the queue for routing receive buffers from the USB interface to
+    //  this task, and the pool of free ones; then the workers that the
+    //  commands reconfigure
+    if (((ASIC_comm_queue = xQueueCreate(USB_RX_BUFFERS, (UBaseType_t) sizeof(USB_RX_t))) != NULL) &&
+        ((usbRxFree = xQueueCreate(USB_RX_BUFFERS, (UBaseType_t) sizeof(uint32_t *))) != NULL) &&
+        ((usbTxMutex = xSemaphoreCreateMutex()) != NULL) &&
+        (init_limit_workers(uxTaskPriorityGet(NULL)) == true))
     {
-        if ((comm_data_consumed = xSemaphoreCreateBinary()) != NULL)
+        //  the current receive buffer, parsed in place
+        USB_RX_t rx;
+
+        for (n = 0; n < USB_RX_BUFFERS; n++)
         {
-            //  a current message extracted from the queue is written to this local
-            //  variable for processing
-            USB_ASIC_Q_t queueMsg = {0};
-            //  keep a handle on the software limits task, because it must be deleted and restarted if the
-            //  user updates the limits
-            TaskHandle_t limitTask = (TaskHandle_t) NULL;
+            uint32_t *buffer = usbRxBuffer[n];
 
-            while (1)
-            {
-                //  wait for the external USB handler to send an ASIC-related message, and copy
-                //  it to queueMsg when that happens
-                (void) xQueueReceive(ASIC_comm_queue, (void *) &queueMsg, portMAX_DELAY);
+            (void) xQueueSend(usbRxFree, (void *) &buffer, 0);
+        }
 
-                //  process the message
-                switch (queueMsg.opcode)
-                {
-                    //  this is the feature required by the challenge; execute it with a task
-                    case ANTI_COLLIDE:
-                        //  if it's already running, delete it and create a new instance
-                        //  TODO:   Ensure whether the task is deleted immediately or whether we
-                        //          must loop checking the task status until it's dead; I seem to remember
-                        //          having issues with this in the past
-                        if (limitTask != (TaskHandle_t) NULL)
-                        {
-                            vTaskDelete(limitTask);
-                            limitTask = (TaskHandle_t) NULL;    
-                        }
-                        (void) xTaskCreate(ASIC_limit, "limit", configMINIMAL_STACK_SIZE, (void *) &queueMsg, (uxTaskPriorityGet(NULL) + 1), &limitTask);
-                        break;
-
-                    //  light a corresponding LED whenever a motor stops due to software limits (low priority)
-                    case INDICATE_STOPS:
-                        (void) xTaskCreate(ASIC_limit_indicators, "leds", configMINIMAL_STACK_SIZE, (void *) NULL, BASE_TASK_PRI, NULL);                   
-                        break;
-
-                    default:
-                        break;
-                }
+        //  a warm restart picks up where the last controlled stop left off;
+        //  no command is taken until the chips have been restored and
+        //  checked, or found to be starting cold
+        (void) restore_warm_state();
 
-                //  wait for whatever task was created above to copy the data it needs from
-                //  queueMsg before allowing it to be overwritten
-                xSemaphoreTake(comm_data_consumed, TASK_STARTUP_DELAY);
-            }
+        while (1)
+        {
+            //  wait for the external USB handler to submit a frame
+            (void) xQueueReceive(ASIC_comm_queue, (void *) &rx, portMAX_DELAY);
+
+            parse_frame(&rx);
+
+            //  nothing refers to the buffer any more; hand it back
+            (void) xQueueSend(usbRxFree, (void *) &rx.buffer, 0);
         }
     }
 
-    if (comm_data_consumed != (SemaphoreHandle_t) NULL)
+    if (usbTxMutex != (SemaphoreHandle_t) NULL)
     {
-        vSemaphoreDelete(comm_data_consumed);
-        comm_data_consumed = (SemaphoreHandle_t) NULL;
+        vSemaphoreDelete(usbTxMutex);
+        usbTxMutex = (SemaphoreHandle_t) NULL;
+    }
+
+    if (usbRxFree != (QueueHandle_t) NULL)
+    {
+        vQueueDelete(usbRxFree);
+        usbRxFree = (QueueHandle_t) NULL;
     }
 
     if (ASIC_comm_queue != (QueueHandle_t) NULL)
@@ -95,3 +713,15 @@ void ASIC_comm(void *pvParameters)
     vTaskDelete(NULL);
 }
 
+/*************************************************************************
+ *  @brief      get_comm_stats
+ *              Get method for the frame and command counters
+ *  @param[out] stats receives a copy of the counters
+ *  @returns    none
+ ************************************************************************/
+void get_comm_stats(COMM_STATS *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = commStats;
+    taskEXIT_CRITICAL();
+}
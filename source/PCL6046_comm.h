@@ -11,43 +11,120 @@
     //  performed by the ASIC
     typedef enum
     {
-        INDICATE_STOPS  =   1,
-        ANTI_COLLIDE    =   2,
+        INDICATE_STOPS  =   1,      //  no payload
+        ANTI_COLLIDE    =   2,      //  2n words for n carriers, see LIMIT_PARAMS
+        MOTION_QUEUE    =   3,      //  5 words per selected axis, see MOTION_SEGMENT
+        MOTION_CANCEL   =   4,      //  no payload
+        ACQUIRE         =   5,      //  1 word, ACQ_xxx items to add to the snapshot
+        TRACE           =   6,      //  1 word, see TRACE_xxx
+        SAFETY_LOOP     =   7,      //  1 word, period in microseconds, 0 to stop
+        SCHEDULE        =   8,      //  2 words per move, carrier and target; none to cancel
+        TELEMETRY       =   9,      //  3 words, ACQ_xxx items (0 to stop), carriers, decimation
+        STOP_REPORT     =   10,     //  no payload; answered with a STOP_REPORT_HDR packet
+        GROUP_START     =   11,     //  1 word of carriers, then 5 words per carrier, see MOTION_SEGMENT
+        GROUP_STOP      =   12,     //  2 words, carriers and 1 to decelerate (SDSTP) or 0 (STOP)
+        PROFILE         =   13,     //  7 words, carriers, then a PROFILE_SPEC
+        HOME            =   14,     //  1 word, n homing toward the - end, then n to CARRIERCNT carriers in track order
+        HOME_REPORT     =   15,     //  no payload; answered with HOME_REPORT_MAGIC and a HOME_STATS
+        DEVIATION       =   16,     //  3 words, carriers, threshold in pulses (0 to stop), DEVIATION_xxx flags
+        DEVIATION_REPORT =  17,     //  no payload; answered with a DEVIATION_REPORT_HDR packet
+        WARM_SAVE       =   18,     //  no payload; stops every carrier and saves the warm-restart snapshot
+        WARM_REPORT     =   19,     //  no payload; answered with WARM_REPORT_MAGIC and a WARM_STATS
         LAST_MSG        =   0xFF
     }   USB_ASIC_e;
-    
-    //  ASIC_comm_queue elements are of this type;  this allows the USB interface
-    //  to specify an action (via opcode) and supply 4 pieces of 32-bit data, one
-    //  per axis of the motion controller; this might need reworking, depending on
-    //  the needs of an actual system
+
+    //  one USB transfer carries one frame:  a frame header, then "count"
+    //  commands, each a command header followed by "words" 32-bit payload
+    //  words; every part is a multiple of 4 bytes, so a frame is parsed in
+    //  place in its (word-aligned) receive buffer, little-endian
+    typedef struct
+    {
+        uint16_t    length;         //  total bytes, including this header
+        uint8_t     count;          //  commands in the frame
+        uint8_t     sequence;       //  chosen by the host; not interpreted
+
+    }   USB_FRAME_HDR;
+
     typedef struct
     {
-        USB_ASIC_e  opcode;
-        uint32_t    data1;
-        uint32_t    data2;
-        uint32_t    data3;
-        uint32_t    data4;
-    
-    }   USB_ASIC_Q_t;
+        uint8_t     opcode;         //  USB_ASIC_e
+        uint8_t     axes;           //  bit 0..3 = X..U, where the command is per axis
+        uint16_t    words;          //  payload words that follow
+
+    }   USB_CMD_HDR;
 
-    //  for now, assume that 16 elements is enough that the queue won't overrun
-    #define ASIC_COMM_QUEUE_SIZE    16
+    //  receive buffers shared with the USB endpoint:  the endpoint fills one
+    //  and submits it; ASIC_comm parses it where it lies and hands it back
+    #define USB_RX_BUFFERS          4
+    #define USB_RX_BUFFER_SIZE      512
+
+    //  TRACE command actions; a dump goes out as TRACE_DUMP_HDR packets
+    #define TRACE_STOP              0
+    #define TRACE_START             1
+    #define TRACE_DUMP              2
+
+    //  the transmit buffer for packets to the host; no packet is larger
+    #define USB_TX_BUFFER_SIZE      512
+
+    //  ASIC_comm_queue elements are of this type:  a filled receive buffer
+    typedef struct
+    {
+        uint32_t    *buffer;
+        uint16_t    length;         //  bytes received
 
-    //  wait this many milliseconds for a created task to copy the queue'd USB user
-    //  data, to ensure the data isn't destroyed before that happens
-    #define TASK_STARTUP_DELAY      25
+    }   USB_RX_t;
+
+    //  ASIC_comm's stack:  the receive buffer it's parsing, stop_group()'s
+    //  operation per chip, and the scalars on the way down; the command
+    //  payloads and the other bus operations below it are static
+    #define COMM_STACK_SIZE         TASK_STACK_SIZE(sizeof(USB_RX_t) + (PCL6046_CHIPS * sizeof(BUS_OP)) + (32 * sizeof(uint32_t)))
+
+    //  frame and command counters; a frame that fails validation, or has a
+    //  command refused, is dropped from the offending command on, and counted
+    //  in badFrames
+    typedef struct
+    {
+        uint32_t    frames;
+        uint32_t    commands;
+        uint32_t    badFrames;
+        uint32_t    noBuffer;       //  receive buffers requested while none was free
+
+    }   COMM_STATS;
 
     #ifdef  PCL6046_COMM_C
-        
-        //  queue handle for messages received over USB and applicable to ASIC operations
-        QueueHandle_t       ASIC_comm_queue     = (QueueHandle_t) NULL;
-        SemaphoreHandle_t   comm_data_consumed  = (SemaphoreHandle_t) NULL;
+
+        //  queue handle for filled receive buffers, and the free ones
+        QueueHandle_t           ASIC_comm_queue     = (QueueHandle_t) NULL;
+        static QueueHandle_t    usbRxFree           = (QueueHandle_t) NULL;
+
+        static uint32_t         usbRxBuffer[USB_RX_BUFFERS][USB_RX_BUFFER_SIZE / sizeof(uint32_t)];
+
+        //  sends a packet to the host; attached by the USB endpoint
+        static bool             (*usbTransmit)(const uint8_t *data, uint16_t length) = NULL;
+        static SemaphoreHandle_t usbTxMutex         = (SemaphoreHandle_t) NULL;
+        static uint32_t         usbTxBuffer[USB_TX_BUFFER_SIZE / sizeof(uint32_t)];
+
+        static COMM_STATS       commStats;
+
+        //  execute_command()'s copies of command payloads; only ASIC_comm
+        //  executes commands, so they're never shared
+        static LIMIT_PARAMS     commLimits;
+        static MOTION_SEGMENT   commMoves[CARRIERCNT];
+        static PROFILE_SPEC     commSpec;
+        static HOME_PARAMS      commHoming;
+        static uint32_t         commProfile[PROFILE_REGS];
 
     #else
 
         extern QueueHandle_t        ASIC_comm_queue;
-        extern SemaphoreHandle_t    comm_data_consumed;
 
+        uint32_t *usb_rx_buffer(TickType_t timeout);
+        uint32_t *usb_rx_buffer_FromISR(void);
+        bool usb_rx_submit(uint32_t *buffer, uint16_t length, TickType_t timeout);
+        bool usb_rx_submit_FromISR(uint32_t *buffer, uint16_t length, BaseType_t *higherPriorityTaskWoken);
+        void usb_attach_tx(bool (*transmit)(const uint8_t *data, uint16_t length));
+        bool usb_transmit(const uint8_t *data, uint16_t length);
+        void get_comm_stats(COMM_STATS *stats);
         void ASIC_comm(void *pvParameters);
     #endif
-#endif
\ No newline at end of file
+#endif
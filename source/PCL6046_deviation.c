@@ -0,0 +1,258 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_deviation.c
+ *                          Deviation watch:  COUNTER3 counts how far each
+ *                          watched carrier's encoder is behind (or ahead of)
+ *                          its output pulses, and comparator 3 is met when
+ *                          that exceeds the threshold, so a stalled or
+ *                          slipping carrier raises the comparator 3 event
+ *                          or is decelerated to a stop by the ASIC itself,
+ *                          without the counters being polled.
+ *
+ *                          Comparator 4 follows each move's peak deviation:
+ *                          it is met each time the deviation grows by a
+ *                          step past the last peak, and ASIC_deviation then
+ *                          reads COUNTER3 and raises it.  A move that
+ *                          deviates less than a step costs one read, at its
+ *                          end.  Only the first chip's INT pin is wired, so
+ *                          the peaks are followed on its carriers only;
+ *                          the other chips still stop on a trip.
+ *
+ *                          Approach watch (LIMIT_APPROACH_WATCH) uses the
+ *                          same comparators, so the two exclude each other.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_DEVIATION_C
+
+#include    <stdint.h>
+#include    <stdbool.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+#include    "queue.h"
+#include    "event_groups.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_maint.h"
+#include    "PCL6046_event.h"
+#include    "PCL6046_limit.h"
+#include    "PCL6046_deviation.h"
+
+
+/*************************************************************************
+ *  @brief      deviation_watched
+ *              Get method for the carriers with the deviation watch on
+ *  @returns    a bitfield, bit n for carrier n
+ ************************************************************************/
+uint32_t deviation_watched(void)
+{
+    uint32_t carriers;
+
+    taskENTER_CRITICAL();
+    carriers = deviationCarriers;
+    taskEXIT_CRITICAL();
+
+    return (carriers);
+}
+
+/*************************************************************************
+ *  @brief      follow_peaks
+ *              Reads the deviations of the first chip's carriers that have
+ *              events, raises their comparator 4 a step past the peaks, and
+ *              closes the moves that have ended.
+ *  @param[in]  axes is a bitfield where axis:bit == X:0, Y:1, Z:2, U:3
+ *  @returns    none
+ ************************************************************************/
+static void follow_peaks(uint8_t axes)
+{
+    BUS_OP ops[2] =
+    {
+        {OP_READ,  (uint8_t) RCUN3, axes, 0, {0}},
+        {OP_MSTSW, 0,               axes, 0, {0}}
+    };
+    BUS_OP raise = {OP_WRITE, (uint8_t) RCMP4, axes, 0, {0}};
+    MOTION_AXIS axis;
+
+    bus_transact(0, BUS_SAFETY, ops, 2);
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        int32_t counted = (int32_t) ops[0].values[axis];
+        uint32_t deviation = (counted < 0) ? (uint32_t) -counted : (uint32_t) counted;
+        bool tripped;
+
+        if ((axes & (1 << axis)) == 0)
+        {
+            continue;
+        }
+
+        //  the comparator 3 event is taken, so each trip counts once
+        tripped = (wait_axis_events(axis, PCL6046_EVT_CMP3, 0) != 0);
+
+        taskENTER_CRITICAL();
+
+        deviationStats[axis].reads++;
+        deviationStats[axis].trips += tripped ? 1 : 0;
+
+        if (deviation > movePeak[axis])
+        {
+            movePeak[axis] = deviation;
+        }
+
+        //  a move has ended; the next one's peak starts from where this one
+        //  left the deviation
+        if ((ops[1].values[axis] & (MSTS_SSCM | MSTS_SRUN)) == 0)
+        {
+            deviationStats[axis].moves++;
+            deviationStats[axis].lastPeak = movePeak[axis];
+
+            if (movePeak[axis] > deviationStats[axis].maxPeak)
+            {
+                deviationStats[axis].maxPeak = movePeak[axis];
+            }
+
+            movePeak[axis] = deviation;
+        }
+
+        raise.values[axis] = movePeak[axis] + peakStep[axis];
+
+        taskEXIT_CRITICAL();
+    }
+
+    bus_transact(0, BUS_SAFETY, &raise, 1);
+}
+
+/*************************************************************************
+ *  @brief      ASIC_deviation
+ *              This RTOS task follows the peak deviations of the watched
+ *              carriers of the first chip.  It listens for their end of
+ *              operation, error, and comparator 3 and 4 events, and only
+ *              touches the bus when one comes.
+ *  @param[in]  pvParameters is ignored
+ *  @returns    none
+ ************************************************************************/
+void ASIC_deviation(void *pvParameters)
+{
+    uint32_t axes;
+
+    deviationTask = xTaskGetCurrentTaskHandle();
+
+    while (1)
+    {
+        (void) xTaskNotifyWait(0, (uint32_t) ~0UL, &axes, portMAX_DELAY);
+
+        axes &= (deviation_watched() & 0x0F);
+
+        if (axes != 0)
+        {
+            follow_peaks((uint8_t) axes);
+        }
+    }
+
+    vTaskDelete(NULL);
+}
+
+/*************************************************************************
+ *  @brief      configure_deviation
+ *              Turns the deviation watch on or off for carriers, on all the
+ *              chips at once.  Turning it on clears COUNTER3 and the
+ *              carriers' counts.
+ *  @param[in]  carriers has bit n set for carrier n
+ *  @param[in]  threshold is the deviation that trips it, in pulses; 0
+ *              turns the watch off
+ *  @param[in]  flags are DEVIATION_xxx
+ *  @returns    true, if the watch was set up; false, if a carrier doesn't
+ *              exist, the threshold is out of range, the task isn't
+ *              running, or the limits have approach watch
+ ************************************************************************/
+bool configure_deviation(uint32_t carriers, uint32_t threshold, uint32_t flags)
+{
+    uint32_t step = (threshold / DEVIATION_PEAK_STEPS) ? (threshold / DEVIATION_PEAK_STEPS) : 1;
+    uint32_t renv4 = DEVIATION_RENV4_WATCH | FIELD_SET(RENV4, C3D, (flags & DEVIATION_STOP) ? CMP_DECEL_STOP : CMP_NO_ACTION);
+    uint8_t carrier;
+    uint8_t chip;
+
+    if ((carriers == 0) || ((carriers >> (CARRIERCNT - 1)) > 1) || (threshold > (uint32_t) INT32_MAX) ||
+        (deviationTask == (TaskHandle_t) NULL) ||
+        ((threshold != 0) && get_limit_params(&deviationLimits) && (deviationLimits.flags & LIMIT_APPROACH_WATCH)))
+    {
+        return (false);
+    }
+
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        deviationOps[chip][0] = (BUS_OP) {OP_MODIFY, (uint8_t) RENV3, 0, FIELD_MASK(RENV3, CI3), {0}};
+        deviationOps[chip][1] = (BUS_OP) {OP_COMMAND, (uint8_t) CUN3R, 0, 0, {0}};
+        deviationOps[chip][2] = (BUS_OP) {OP_WRITE, (uint8_t) RCMP3, 0, 0, {0}};
+        deviationOps[chip][3] = (BUS_OP) {OP_WRITE, (uint8_t) RCMP4, 0, 0, {0}};
+        deviationOps[chip][4] = (BUS_OP) {OP_MODIFY, (uint8_t) RENV4, 0, DEVIATION_RENV4_FIELDS, {0}};
+        deviationOps[chip][5] = (BUS_OP) {OP_MODIFY, (uint8_t) RIRQ, 0, DEVIATION_RIRQ_WATCH, {0}};
+    }
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        BUS_OP *chipOps = deviationOps[CARRIER_CHIP(carrier)];
+        MOTION_AXIS axis = CARRIER_AXIS(carrier);
+        uint8_t n;
+
+        if ((carriers & (1UL << carrier)) == 0)
+        {
+            continue;
+        }
+
+        //  turning the watch off only takes the comparators and interrupts
+        for (n = ((threshold != 0) ? 0 : 4); n < DEVIATION_OPS; n++)
+        {
+            chipOps[n].axis |= (uint8_t) (1 << axis);
+        }
+
+        chipOps[0].values[axis] = FIELD_SET(RENV3, CI3, CI3_DEVIATION);
+        chipOps[2].values[axis] = threshold;
+        chipOps[3].values[axis] = step;
+        chipOps[4].values[axis] = (threshold != 0) ? renv4 : 0;
+        chipOps[5].values[axis] = (threshold != 0) ? DEVIATION_RIRQ_WATCH : 0;
+    }
+
+    taskENTER_CRITICAL();
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        if ((carriers & (1UL << carrier)) && (threshold != 0))
+        {
+            peakStep[carrier] = step;
+            movePeak[carrier] = 0;
+            deviationStats[carrier] = (DEVIATION_STATS) {0, 0, 0, 0, 0};
+        }
+    }
+
+    deviationCarriers = (threshold != 0) ? (deviationCarriers | carriers) : (deviationCarriers & ~carriers);
+
+    taskEXIT_CRITICAL();
+
+    bus_transact_all(BUS_CONFIG, &deviationOps[0][0], DEVIATION_OPS);
+
+    (void) listen_axis_events(deviationTask, (deviation_watched() & 0x0F) ? (PCL6046_EVT_END | PCL6046_EVT_ERROR | PCL6046_EVT_CMP3 | PCL6046_EVT_CMP4) : 0);
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      get_deviation_stats
+ *              Get method for the deviation counts of every carrier
+ *  @param[out] stats receives a copy of the counts, indexed by carrier
+ *  @returns    none
+ ************************************************************************/
+void get_deviation_stats(DEVIATION_STATS stats[CARRIERCNT])
+{
+    uint8_t carrier;
+
+    taskENTER_CRITICAL();
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        stats[carrier] = deviationStats[carrier];
+    }
+
+    taskEXIT_CRITICAL();
+}
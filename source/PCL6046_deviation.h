@@ -0,0 +1,84 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_deviation.h
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_DEVIATION_H
+    #define PCL6046_DEVIATION_H
+
+    //  DEVIATION command flags:  a trip starts a decelerate-stop, rather than
+    //  only raising the comparator 3 event
+    #define DEVIATION_STOP              0x0001
+
+    //  the peak deviation of a move is followed by comparator 4, which is
+    //  raised by a step each time it's met; the threshold is this many
+    //  steps, so a peak is known to within threshold / DEVIATION_PEAK_STEPS
+    #define DEVIATION_PEAK_STEPS        16
+
+    //  bus operations per chip to set the watch up:  RENV3.CI3, CUN3R, RCMP3,
+    //  RCMP4, the comparator fields of RENV4, and RIRQ
+    #define DEVIATION_OPS               6
+
+    //  comparator settings:  COUNTER3 counts the deviation, and is compared
+    //  as an absolute value; comparator 3 is met when RCMP3 < |COUNTER3|,
+    //  comparator 4 when RCMP4 < |COUNTER3|, with their interrupts
+    #define DEVIATION_RENV4_FIELDS      (FIELD_MASK(RENV4, C3C) | FIELD_MASK(RENV4, C3S) | FIELD_MASK(RENV4, C3D) | \
+                                         FIELD_MASK(RENV4, C4C) | FIELD_MASK(RENV4, C4S) | FIELD_MASK(RENV4, C4D))
+    #define DEVIATION_RENV4_WATCH       (FIELD_SET(RENV4, C3C, CMP_COUNTER3) | FIELD_SET(RENV4, C3S, CMP_LESS) | \
+                                         FIELD_SET(RENV4, C4C, CMP_COUNTER3) | FIELD_SET(RENV4, C4S, CMP_LESS) | FIELD_SET(RENV4, C4D, CMP_NO_ACTION))
+    #define DEVIATION_RIRQ_WATCH        (FIELD_MASK(RIRQ, IRC3) | FIELD_MASK(RIRQ, IRC4))
+
+    //  the moves of one carrier since its watch was set up, how many tripped
+    //  comparator 3, and peak deviations in pulses:  the last move's and the
+    //  highest; reads are the bus transactions its events took
+    typedef struct
+    {
+        uint32_t    moves;
+        uint32_t    trips;
+        uint32_t    lastPeak;
+        uint32_t    maxPeak;
+        uint32_t    reads;
+
+    }   DEVIATION_STATS;
+
+    //  the DEVIATION_REPORT command is answered with a packet of this
+    //  header, then a DEVIATION_STATS per carrier, little-endian
+    #define DEVIATION_REPORT_MAGIC      0x44503650UL        //  "P6PD"
+
+    typedef struct
+    {
+        uint32_t    magic;
+        uint32_t    watched;                //  carriers with the watch on
+        uint32_t    carriers;               //  DEVIATION_STATS that follow
+
+    }   DEVIATION_REPORT_HDR;
+
+    //  ASIC_deviation's stack:  follow_peaks()'s three bus operations, and
+    //  the scalars on the way down
+    #define DEVIATION_STACK_SIZE        TASK_STACK_SIZE((3 * sizeof(BUS_OP)) + (32 * sizeof(uint32_t)))
+
+    #ifdef  PCL6046_DEVIATION_C
+
+        static TaskHandle_t     deviationTask = (TaskHandle_t) NULL;
+
+        //  the carriers watched, their peak steps, and the peak deviation of
+        //  each one's move under way
+        static uint32_t         deviationCarriers;
+        static uint32_t         peakStep[CARRIERCNT];
+        static uint32_t         movePeak[CARRIERCNT];
+
+        static DEVIATION_STATS  deviationStats[CARRIERCNT];
+
+        //  configure_deviation()'s bus operations, and the limits it checks;
+        //  only ASIC_comm configures the watch, so these are never shared
+        static BUS_OP           deviationOps[PCL6046_CHIPS][DEVIATION_OPS];
+        static LIMIT_PARAMS     deviationLimits;
+
+    #else
+        bool configure_deviation(uint32_t carriers, uint32_t threshold, uint32_t flags);
+        uint32_t deviation_watched(void);
+        void get_deviation_stats(DEVIATION_STATS stats[CARRIERCNT]);
+        void ASIC_deviation(void *pvParameters);
+    #endif
+#endif
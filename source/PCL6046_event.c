@@ -0,0 +1,327 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_event.c
+ *                          Interrupt-driven event dispatch for the PCL6046.
+ *                          The INT pin handler only stamps the time and wakes
+ *                          a task; the task reads RIST/REST (which clears
+ *                          them) and publishes the interrupt factors as
+ *                          per-axis event group bits, so that other tasks can
+ *                          block on stops, comparator hits, and errors rather
+ *                          than poll the main status registers.  Only the
+ *                          first chip's INT pin is wired, so the events are
+ *                          those of its axes.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_EVENT_C
+
+#include    <stdint.h>
+#include    <stdbool.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+#include    "event_groups.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_event.h"
+
+/*************************************************************************
+ *  @brief      init_PCL6046_events
+ *              Creates the per-axis event groups.  It must run before any
+ *              task waits on events.
+ *  @returns    true, if no errors were encountered; false, otherwise
+ ************************************************************************/
+bool init_PCL6046_events(void)
+{
+    bool success = true;
+    MOTION_AXIS axis;
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        if (PCL6046_axis_events[axis] == (EventGroupHandle_t) NULL)
+        {
+            if ((PCL6046_axis_events[axis] = xEventGroupCreate()) == NULL)
+            {
+                success = false;
+            }
+        }
+    }
+
+    return (success);
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_INT_IRQHandler
+ *              Handler for the falling edge of the PCL6046 INT pin.  All
+ *              register access is deferred to ASIC_events, since the bus
+ *              belongs to ASIC_bus.
+ *  @returns    none
+ ************************************************************************/
+void PCL6046_INT_IRQHandler(void)
+{
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+    irqStamp = (uint32_t) TIMESTAMP();
+    eventStats.irqs++;
+
+    if (eventTask != (TaskHandle_t) NULL)
+    {
+        vTaskNotifyGiveFromISR(eventTask, &higherPriorityTaskWoken);
+    }
+
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+/*************************************************************************
+ *  @brief      factors_to_events
+ *              Translates the interrupt factors of one axis to event bits.
+ *  @param[in]  mstatus is the main status word of the axis
+ *  @param[in]  rist is the event interrupt cause register value
+ *  @param[in]  rest is the error interrupt cause register value
+ *  @returns    PCL6046_EVT_xxx bits
+ ************************************************************************/
+static EventBits_t factors_to_events(uint16_t mstatus, uint32_t rist, uint32_t rest)
+{
+    EventBits_t events = 0;
+
+    if ((rist & FIELD_MASK(RIST, ISEN)) || (mstatus & MSTS_SENI))
+    {
+        events |= PCL6046_EVT_END;
+    }
+
+    if (rist & (FIELD_MASK(RIST, ISN) | FIELD_MASK(RIST, ISNM)))
+    {
+        events |= PCL6046_EVT_PREREG;
+    }
+
+    if (rest != 0)
+    {
+        events |= PCL6046_EVT_ERROR;
+    }
+
+    //  ISC1..ISC5 of RIST and ESC1..ESC5 of REST both map onto the
+    //  comparator event bits
+    events |= (EventBits_t) ((FIELD_GET(RIST, ISC, rist) | FIELD_GET(REST, ESC, rest)) * PCL6046_EVT_CMP1);
+
+    return (events);
+}
+
+/*************************************************************************
+ *  @brief      ASIC_events
+ *              This RTOS task collects and publishes PCL6046 interrupt
+ *              factors each time the INT handler notifies it.  It should run
+ *              above every task that uses the ASIC.
+ *  @param[in]  pvParameters is ignored, currently
+ *  @returns    none
+ ************************************************************************/
+void ASIC_events(void *pvParameters)
+{
+    MOTION_AXIS axis;
+
+    if ((init_PCL6046_resources() == true) && (init_PCL6046_events() == true))
+    {
+        eventTask = xTaskGetCurrentTaskHandle();
+
+        //  enable the default event interrupts on all axes
+        modify_register(RIRQ, 0x0F, RIRQ_DEFAULT, RIRQ_DEFAULT);
+
+#ifdef  PCL6046_HOST_SIM
+        PCL6046_sim_attach_INT(PCL6046_INT_IRQHandler);
+#endif
+
+        //  collect anything that was pending before the handler was live
+        (void) xTaskNotifyGive(eventTask);
+
+        while (1)
+        {
+            (void) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+            //  INT stays asserted while any factor is pending, so keep
+            //  collecting until it's released; an edge that arrives meanwhile
+            //  just leaves a notification pending
+            do
+            {
+                bool publish = false;
+                uint8_t listenerAxes[EVENT_LISTENERS] = {0};
+                uint32_t latency;
+                uint8_t n;
+
+                //  reading RIST and REST clears them; reading MSTSW clears SENI;
+                //  they're read as one transaction, ahead of everything but stops
+                BUS_OP ops[3] =
+                {
+                    {OP_READ,  (uint8_t) RIST, 0x0F, 0, {0}},
+                    {OP_READ,  (uint8_t) REST, 0x0F, 0, {0}},
+                    {OP_MSTSW, 0,              0x0F, 0, {0}}
+                };
+
+                bus_transact(0, BUS_SAFETY, ops, 3);
+
+                eventStats.dispatches++;
+
+                for (axis = AXIS_X; axis < AXISCNT; axis++)
+                {
+                    EventBits_t events = factors_to_events((uint16_t) ops[2].values[axis], ops[0].values[axis], ops[1].values[axis]);
+
+                    if (events != 0)
+                    {
+                        lastRIST[axis] = ops[0].values[axis];
+                        lastREST[axis] = ops[1].values[axis];
+                        (void) xEventGroupSetBits(PCL6046_axis_events[axis], events);
+                        publish = true;
+
+                        for (n = 0; n < EVENT_LISTENERS; n++)
+                        {
+                            if (events & listenerEvents[n])
+                            {
+                                listenerAxes[n] |= (uint8_t) (1 << axis);
+                            }
+                        }
+                    }
+                }
+
+                //  a listener gets the axes as notification bits, so a single
+                //  task can serve all 4 axes
+                for (n = 0; n < EVENT_LISTENERS; n++)
+                {
+                    if ((listenerAxes[n] != 0) && (eventListener[n] != (TaskHandle_t) NULL))
+                    {
+                        (void) xTaskNotify(eventListener[n], listenerAxes[n], eSetBits);
+                    }
+                }
+
+                if (publish)
+                {
+                    latency = (uint32_t) TIMESTAMP() - irqStamp;
+
+                    eventStats.published++;
+                    eventStats.lastLatency = latency;
+
+                    if (latency > eventStats.maxLatency)
+                    {
+                        eventStats.maxLatency = latency;
+                    }
+                }
+
+            } while (INT_ASSERTED());
+        }
+    }
+
+    //  we should never get here
+    vTaskDelete(NULL);
+}
+
+/*************************************************************************
+ *  @brief      enable_axis_events
+ *              Adds event interrupt factors to RIRQ; only the field is
+ *              written, so other enables are left alone.
+ *  @param[in]  axis is a bit mask of the axes to enable, bits 0..3 = X..U
+ *  @param[in]  rirqBits are the RIRQ enable bits to set
+ *  @returns    none
+ ************************************************************************/
+void enable_axis_events(uint8_t axis, uint32_t rirqBits)
+{
+    modify_register(RIRQ, axis, rirqBits, rirqBits);
+}
+
+/*************************************************************************
+ *  @brief      wait_axis_events
+ *              Blocks until any of the selected events is published for an
+ *              axis; the events returned are cleared.
+ *  @param[in]  axis identifies X, Y, Z, or U axis
+ *  @param[in]  events are the PCL6046_EVT_xxx bits of interest
+ *  @param[in]  timeout is the maximum wait, in RTOS ticks
+ *  @returns    the events that occurred, or 0 on timeout
+ ************************************************************************/
+EventBits_t wait_axis_events(MOTION_AXIS axis, EventBits_t events, TickType_t timeout)
+{
+    return (xEventGroupWaitBits(PCL6046_axis_events[axis], events, pdTRUE, pdFALSE, timeout) & events);
+}
+
+/*************************************************************************
+ *  @brief      listen_axis_events
+ *              Registers a task that is notified, rather than having to wait
+ *              on each axis's event group, when events are published; up to
+ *              EVENT_LISTENERS tasks can listen.  The notification value gets
+ *              bit n set for axis n; the task collects it with
+ *              xTaskNotifyWait().
+ *  @param[in]  task is the listening task
+ *  @param[in]  events are the PCL6046_EVT_xxx bits of interest, replacing
+ *              any the task had; 0 removes the task
+ *  @returns    true, if the task was registered or removed; false, if every
+ *              place is taken
+ ************************************************************************/
+bool listen_axis_events(TaskHandle_t task, EventBits_t events)
+{
+    uint8_t slot = EVENT_LISTENERS;
+    uint8_t n;
+
+    taskENTER_CRITICAL();
+
+    for (n = 0; n < EVENT_LISTENERS; n++)
+    {
+        if (eventListener[n] == task)
+        {
+            break;
+        }
+
+        if ((eventListener[n] == (TaskHandle_t) NULL) && (slot == EVENT_LISTENERS))
+        {
+            slot = n;
+        }
+    }
+
+    if (n == EVENT_LISTENERS)
+    {
+        n = slot;
+    }
+
+    if (n < EVENT_LISTENERS)
+    {
+        listenerEvents[n] = events;
+        eventListener[n] = (events != 0) ? task : (TaskHandle_t) NULL;
+    }
+
+    taskEXIT_CRITICAL();
+
+    return ((n < EVENT_LISTENERS) || (events == 0));
+}
+
+/*************************************************************************
+ *  @brief      get_axis_factors
+ *              Get method for the last interrupt factors published for an
+ *              axis
+ *  @param[in]  axis identifies X, Y, Z, or U axis
+ *  @param[out] rist receives the last RIST value
+ *  @param[out] rest receives the last REST value
+ *  @returns    none
+ ************************************************************************/
+void get_axis_factors(MOTION_AXIS axis, uint32_t *rist, uint32_t *rest)
+{
+    *rist = lastRIST[axis];
+    *rest = lastREST[axis];
+}
+
+/*************************************************************************
+ *  @brief      get_irq_stamp
+ *              Get method for the time of the last INT assertion; a consumer
+ *              subtracts it from TIMESTAMP() to measure its own latency.
+ *  @returns    the TIMESTAMP() value taken by the INT handler
+ ************************************************************************/
+uint32_t get_irq_stamp(void)
+{
+    return (irqStamp);
+}
+
+/*************************************************************************
+ *  @brief      get_event_stats
+ *              Get method for the event dispatch counters
+ *  @param[out] stats receives a copy of the counters
+ *  @returns    none
+ ************************************************************************/
+void get_event_stats(PCL6046_EVENT_STATS *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = eventStats;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,80 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_event.h
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_EVENT_H
+    #define PCL6046_EVENT_H
+
+    //  per-axis event bits published by ASIC_events; consumers wait on them
+    //  with wait_axis_events() instead of polling the status registers
+    #define PCL6046_EVT_END         0x0001      //  operation ended (RIST.ISEN, MSTS.SENI)
+    #define PCL6046_EVT_PREREG      0x0002      //  pre-register consumed (RIST.ISN, RIST.ISNM)
+    #define PCL6046_EVT_ERROR       0x0004      //  any error factor (REST != 0)
+    #define PCL6046_EVT_CMP1        0x0100      //  comparator 1 met, or stopped by it
+    #define PCL6046_EVT_CMP2        0x0200      //  comparator 2 ...
+    #define PCL6046_EVT_CMP3        0x0400
+    #define PCL6046_EVT_CMP4        0x0800
+    #define PCL6046_EVT_CMP5        0x1000
+    #define PCL6046_EVT_ALL         0x1F07
+
+    //  event interrupt factors enabled in RIRQ by default:  end of operation;
+    //  error interrupts can't be masked
+    #define RIRQ_DEFAULT            FIELD_MASK(RIRQ, IREN)
+
+    //  tasks that can listen to all axes at once, see listen_axis_events()
+    #define EVENT_LISTENERS         3
+
+    //  event dispatch counters; latencies are in TIMESTAMP() counts, measured
+    //  from the INT handler to the moment the events were published
+    typedef struct
+    {
+        uint32_t    irqs;               //  INT assertions seen by the handler
+        uint32_t    dispatches;         //  RIST/REST collection passes
+        uint32_t    published;          //  passes that set at least one event bit
+        uint32_t    lastLatency;
+        uint32_t    maxLatency;
+
+    }   PCL6046_EVENT_STATS;
+
+    //  ASIC_events's stack:  a dispatch pass's three bus operations, and the
+    //  scalars on the way down
+    #define EVENT_STACK_SIZE        TASK_STACK_SIZE((3 * sizeof(BUS_OP)) + (32 * sizeof(uint32_t)))
+
+    #ifdef  PCL6046_EVENT_C
+
+        EventGroupHandle_t  PCL6046_axis_events[AXISCNT] = {NULL, NULL, NULL, NULL};
+
+        //  the deferred-processing task, notified by the INT handler
+        static TaskHandle_t         eventTask = (TaskHandle_t) NULL;
+
+        //  TIMESTAMP() of the most recent INT assertion
+        static volatile uint32_t    irqStamp;
+
+        //  the last interrupt factors collected per axis
+        static uint32_t             lastRIST[AXISCNT];
+        static uint32_t             lastREST[AXISCNT];
+
+        static PCL6046_EVENT_STATS  eventStats;
+
+        //  the tasks that listen to all axes at once, and their events; see
+        //  listen_axis_events()
+        static TaskHandle_t         eventListener[EVENT_LISTENERS];
+        static EventBits_t          listenerEvents[EVENT_LISTENERS];
+
+    #else
+
+        extern EventGroupHandle_t   PCL6046_axis_events[AXISCNT];
+
+        bool init_PCL6046_events(void);
+        void PCL6046_INT_IRQHandler(void);
+        void ASIC_events(void *pvParameters);
+        void enable_axis_events(uint8_t axis, uint32_t rirqBits);
+        EventBits_t wait_axis_events(MOTION_AXIS axis, EventBits_t events, TickType_t timeout);
+        bool listen_axis_events(TaskHandle_t task, EventBits_t events);
+        void get_axis_factors(MOTION_AXIS axis, uint32_t *rist, uint32_t *rest);
+        uint32_t get_irq_stamp(void);
+        void get_event_stats(PCL6046_EVENT_STATS *stats);
+    #endif
+#endif
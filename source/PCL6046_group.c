@@ -0,0 +1,197 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_group.c
+ *                          Motion groups:  carriers, on any chips, that are
+ *                          started and stopped together.  Each member's move
+ *                          is loaded into its operation registers first, so
+ *                          the start itself is one command word:  members on
+ *                          one chip with the same start command are started
+ *                          by that command with all their axes selected, and
+ *                          any other group waits for the CSTA input (RMD.MSY)
+ *                          and is started by one CMSTA.  Either way, every
+ *                          member starts on the same CLK cycle.  The CSTA
+ *                          pins of all the chips are assumed to be wired
+ *                          together.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_GROUP_C
+
+#include    <stdint.h>
+#include    <stdbool.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+#include    "queue.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_maint.h"
+#include    "PCL6046_motion.h"
+#include    "PCL6046_group.h"
+
+
+/*************************************************************************
+ *  @brief      start_group
+ *              Loads each member's move into its RMV, RFH, RUR and RMD, and
+ *              starts all the members together.  The chips are loaded
+ *              concurrently; nothing moves until the start.
+ *  @param[in]  carriers has bit n set for each member, carrier n
+ *  @param[in]  moves are the members' moves, indexed by carrier; the mode's
+ *              RMD.MSY is set by the group, and the start command is STAFL,
+ *              STAFH, STAD or STAUD
+ *  @returns    true, if the group was started; false, if a member is still
+ *              moving or has another start command
+ ************************************************************************/
+bool start_group(uint32_t carriers, const MOTION_SEGMENT moves[CARRIERCNT])
+{
+    uint32_t chips = 0;
+    uint8_t starts = 0;
+    uint8_t carrier;
+    uint8_t chip;
+    uint8_t n;
+    bool csta;
+
+    if ((carriers == 0) || ((carriers >> (CARRIERCNT - 1)) > 1))
+    {
+        return (false);
+    }
+
+    get_snapshot(&groupSnap);
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        if ((carriers & (1UL << carrier)) == 0)
+        {
+            continue;
+        }
+
+        if ((moves[carrier].start < STAFL) || (moves[carrier].start > STAUD) ||
+            ((groupSnap.items & ACQ_MSTSW) && (groupSnap.mstatus[carrier] & (MSTS_SSCM | MSTS_SRUN))))
+        {
+            taskENTER_CRITICAL();
+            groupStats.refused++;
+            taskEXIT_CRITICAL();
+
+            return (false);
+        }
+
+        chips |= (1UL << CARRIER_CHIP(carrier));
+        starts |= (uint8_t) (1 << (moves[carrier].start - STAFL));
+    }
+
+    //  one start command on one chip starts all of its axes on the same
+    //  clock; a group that needs more waits for CSTA
+    csta = (((chips & (chips - 1)) != 0) || ((starts & (starts - 1)) != 0));
+
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        groupOps[chip][0] = (BUS_OP) {OP_WRITE, (uint8_t) RMV, 0, 0, {0}};
+        groupOps[chip][1] = (BUS_OP) {OP_WRITE, (uint8_t) RFH, 0, 0, {0}};
+        groupOps[chip][2] = (BUS_OP) {OP_WRITE, (uint8_t) RUR, 0, 0, {0}};
+        groupOps[chip][3] = (BUS_OP) {OP_WRITE, (uint8_t) RMD, 0, 0, {0}};
+
+        for (n = 0; n < (GROUP_OPS - GROUP_LOADS); n++)
+        {
+            groupOps[chip][GROUP_LOADS + n] = (BUS_OP) {OP_COMMAND, (uint8_t) (STAFL + n), 0, 0, {0}};
+        }
+    }
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        BUS_OP *chipOps = groupOps[CARRIER_CHIP(carrier)];
+        MOTION_AXIS axis = CARRIER_AXIS(carrier);
+
+        if ((carriers & (1UL << carrier)) == 0)
+        {
+            continue;
+        }
+
+        chipOps[0].values[axis] = moves[carrier].distance;
+        chipOps[1].values[axis] = moves[carrier].high;
+        chipOps[2].values[axis] = moves[carrier].rate;
+        chipOps[3].values[axis] = (moves[carrier].mode & ~FIELD_MASK(RMD, MSY)) | FIELD_SET(RMD, MSY, csta ? MSY_CSTA : MSY_IMMEDIATE);
+
+        for (n = 0; n < GROUP_LOADS; n++)
+        {
+            chipOps[n].axis |= (uint8_t) (1 << axis);
+        }
+
+        chipOps[GROUP_LOADS + (moves[carrier].start - STAFL)].axis |= (uint8_t) (1 << axis);
+    }
+
+    //  without CSTA, this is the start
+    bus_transact_all(BUS_CONFIG, &groupOps[0][0], GROUP_OPS);
+
+    if (csta)
+    {
+        BUS_OP start = {OP_COMMAND, (uint8_t) CMSTA, 0x01, 0, {0}};
+        BUS_OP clear[PCL6046_CHIPS];
+
+        bus_transact(0, BUS_CONFIG, &start, 1);
+
+        //  the members' next moves mustn't wait for CSTA; they take this from
+        //  the pre-register when they start
+        for (chip = 0; chip < PCL6046_CHIPS; chip++)
+        {
+            clear[chip] = (BUS_OP) {OP_MODIFY, (uint8_t) RMD, groupOps[chip][3].axis, FIELD_MASK(RMD, MSY), {0}};
+        }
+
+        bus_transact_all(BUS_CONFIG, clear, 1);
+    }
+
+    taskENTER_CRITICAL();
+    groupStats.starts++;
+    groupStats.cstaStarts += csta ? 1 : 0;
+    taskEXIT_CRITICAL();
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      stop_group
+ *              Stops the members of a group, ahead of all other traffic;
+ *              each chip's members are stopped by one command word, and the
+ *              chips are stopped concurrently.  A member still waiting for
+ *              CSTA doesn't start.
+ *  @param[in]  carriers has bit n set for each member, carrier n
+ *  @param[in]  decelerate selects SDSTP, rather than STOP
+ *  @returns    none
+ ************************************************************************/
+void stop_group(uint32_t carriers, bool decelerate)
+{
+    BUS_OP ops[PCL6046_CHIPS];
+    uint8_t carrier;
+    uint8_t chip;
+
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        ops[chip] = (BUS_OP) {OP_COMMAND, (uint8_t) (decelerate ? SDSTP : STOP), 0, 0, {0}};
+    }
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        if (carriers & (1UL << carrier))
+        {
+            ops[CARRIER_CHIP(carrier)].axis |= (uint8_t) (1 << CARRIER_AXIS(carrier));
+        }
+    }
+
+    bus_transact_all(BUS_EMERGENCY, ops, 1);
+
+    taskENTER_CRITICAL();
+    groupStats.stops++;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      get_group_stats
+ *              Get method for the group counters
+ *  @param[out] stats receives a copy of the counters
+ *  @returns    none
+ ************************************************************************/
+void get_group_stats(GROUP_STATS *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = groupStats;
+    taskEXIT_CRITICAL();
+}
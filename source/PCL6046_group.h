@@ -0,0 +1,39 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_group.h
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_GROUP_H
+    #define PCL6046_GROUP_H
+
+    //  bus operations per chip of a group start:  RMV, RFH, RUR and RMD
+    //  writes, then a start command for each of STAFL..STAUD
+    #define GROUP_LOADS             4
+    #define GROUP_OPS               (GROUP_LOADS + 4)
+
+    //  group counters
+    typedef struct
+    {
+        uint32_t    starts;             //  groups started
+        uint32_t    cstaStarts;         //  ... of them through CSTA
+        uint32_t    refused;            //  groups with a member still moving, or a bad start command
+        uint32_t    stops;              //  group stops
+
+    }   GROUP_STATS;
+
+    #ifdef  PCL6046_GROUP_C
+
+        static GROUP_STATS      groupStats;
+
+        //  start_group()'s bus operations and snapshot; only ASIC_comm
+        //  starts groups, so these are never shared
+        static BUS_OP           groupOps[PCL6046_CHIPS][GROUP_OPS];
+        static PCL6046_SNAPSHOT groupSnap;
+
+    #else
+        bool start_group(uint32_t carriers, const MOTION_SEGMENT moves[CARRIERCNT]);
+        void stop_group(uint32_t carriers, bool decelerate);
+        void get_group_stats(GROUP_STATS *stats);
+    #endif
+#endif
@@ -0,0 +1,342 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_home.c
+ *                          Homing:  every carrier on the track is returned to
+ *                          its ORG sensor by the ASIC's origin return
+ *                          operation, all of them at once where the track
+ *                          allows it, and then COUNTER1 of every carrier
+ *                          that got there is cleared by one CUN1R per chip.
+ *                          The carriers run at FL speed, which they can stop
+ *                          from at once, so each stops on its sensor.
+ *
+ *                          Carriers homing toward the same end follow the
+ *                          one outside them (nearer that end), which is
+ *                          never started after them; a carrier faster than
+ *                          the one outside it waits until that one is home,
+ *                          as it would otherwise close on it.  With equal
+ *                          speeds, everything starts together and the
+ *                          time to ready is that of the slowest carrier.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_HOME_C
+
+#include    <stdint.h>
+#include    <stdbool.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+#include    "queue.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_maint.h"
+#include    "PCL6046_motion.h"
+#include    "PCL6046_group.h"
+#include    "PCL6046_home.h"
+
+
+/*************************************************************************
+ *  @brief      faster
+ *              Whether one carrier's FL speed is higher than another's; a
+ *              speed step is worth CLK / ((RMG + 1) * 65536) pps.
+ *  @param[in]  low and magnification are the carriers' RFL and RMG
+ *  @returns    true, if carrier a is faster than carrier b
+ ************************************************************************/
+static bool faster(const uint32_t low[CARRIERCNT], const uint32_t magnification[CARRIERCNT], uint8_t a, uint8_t b)
+{
+    return (((uint64_t) low[a] * (magnification[b] + 1)) > ((uint64_t) low[b] * (magnification[a] + 1)));
+}
+
+/*************************************************************************
+ *  @brief      start_wave
+ *              Starts carriers on their origin returns; each chip's carriers
+ *              are started by one STAFL, and the chips concurrently.
+ *  @param[in]  carriers has bit n set for each carrier, n, to start
+ *  @param[in]  minus has bit n set for each carrier homing toward the - end
+ *  @returns    none
+ ************************************************************************/
+static void start_wave(uint32_t carriers, uint32_t minus)
+{
+    uint8_t carrier;
+    uint8_t chip;
+
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        homeOps[chip][0] = (BUS_OP) {OP_MODIFY, (uint8_t) RENV3, 0, FIELD_MASK(RENV3, ORM), {0}};
+        homeOps[chip][1] = (BUS_OP) {OP_MODIFY, (uint8_t) RMD, 0, (FIELD_MASK(RMD, MOD) | FIELD_MASK(RMD, MSY)), {0}};
+        homeOps[chip][2] = (BUS_OP) {OP_COMMAND, (uint8_t) STAFL, 0, 0, {0}};
+    }
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        BUS_OP *chipOps = homeOps[CARRIER_CHIP(carrier)];
+        MOTION_AXIS axis = CARRIER_AXIS(carrier);
+
+        if ((carriers & (1UL << carrier)) == 0)
+        {
+            continue;
+        }
+
+        chipOps[0].values[axis] = FIELD_SET(RENV3, ORM, ORM_ORG_STOP);
+        chipOps[1].values[axis] = FIELD_SET(RMD, MOD, (minus & (1UL << carrier)) ? MOD_ORIGIN_MINUS : MOD_ORIGIN_PLUS);
+
+        chipOps[0].axis |= (uint8_t) (1 << axis);
+        chipOps[1].axis |= (uint8_t) (1 << axis);
+        chipOps[2].axis |= (uint8_t) (1 << axis);
+    }
+
+    bus_transact_all(BUS_CONFIG, &homeOps[0][0], HOME_OPS);
+}
+
+/*************************************************************************
+ *  @brief      home_carriers
+ *              Homes the carriers of a request, and records the outcome.
+ *              Each pass, it starts every carrier that can go (see the file
+ *              header) in one wave, then waits for the snapshot to show
+ *              which have stopped; a carrier stopped by an error (a limit,
+ *              say) rather than its sensor hasn't homed.
+ *  @param[in]  params is the request
+ *  @returns    none
+ ************************************************************************/
+static void home_carriers(const HOME_PARAMS *params)
+{
+    uint32_t low[CARRIERCNT];
+    uint32_t magnification[CARRIERCNT];
+    uint32_t stamp[CARRIERCNT];
+    uint32_t all = 0;
+    uint32_t minus = 0;
+    uint32_t started = 0;
+    uint32_t stopped = 0;
+    uint32_t failed = 0;
+    uint32_t waves = 0;
+    TickType_t start = xTaskGetTickCount();
+    uint8_t carrier;
+    uint8_t chip;
+    uint8_t k;
+
+    for (k = 0; k < params->carriers; k++)
+    {
+        all |= (1UL << params->order[k]);
+        minus |= (k < params->minus) ? (1UL << params->order[k]) : 0;
+    }
+
+    //  the FL speeds decide which carriers may run together
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        homeReads[chip][0] = (BUS_OP) {OP_READ, (uint8_t) RFL, 0x0F, 0, {0}};
+        homeReads[chip][1] = (BUS_OP) {OP_READ, (uint8_t) RMG, 0x0F, 0, {0}};
+    }
+
+    bus_transact_all(BUS_CONFIG, &homeReads[0][0], 2);
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        low[carrier] = FIELD_GET(RFL, FL, homeReads[CARRIER_CHIP(carrier)][0].values[CARRIER_AXIS(carrier)]);
+        magnification[carrier] = FIELD_GET(RMG, MG, homeReads[CARRIER_CHIP(carrier)][1].values[CARRIER_AXIS(carrier)]);
+    }
+
+    while ((stopped != all) && ((xTaskGetTickCount() - start) < (TickType_t) HOME_TIMEOUT))
+    {
+        uint32_t going = started;
+        uint32_t wave = 0;
+
+        //  from the ends inward, so a carrier sees whether the one outside
+        //  it goes in this wave
+        for (k = 0; k < params->carriers; k++)
+        {
+            uint8_t m = (k < params->minus) ? k : (uint8_t) (params->carriers - 1 - (k - params->minus));
+            uint8_t outside = (k < params->minus) ? (uint8_t) (m - 1) : (uint8_t) (m + 1);
+            bool ready;
+
+            carrier = params->order[m];
+
+            if (going & (1UL << carrier))
+            {
+                continue;
+            }
+
+            if ((k == 0) || (k == params->minus))
+            {
+                ready = true;
+            }
+            else
+            {
+                uint8_t ahead = params->order[outside];
+
+                ready = ((stopped & (1UL << ahead)) != 0) ||
+                        (((going & (1UL << ahead)) != 0) && !faster(low, magnification, carrier, ahead));
+            }
+
+            if (ready)
+            {
+                going |= (1UL << carrier);
+                wave |= (1UL << carrier);
+            }
+        }
+
+        if (wave != 0)
+        {
+            start_wave(wave, minus);
+            waves++;
+            started |= wave;
+
+            for (carrier = 0; carrier < CARRIERCNT; carrier++)
+            {
+                if (wave & (1UL << carrier))
+                {
+                    stamp[carrier] = (uint32_t) TIMESTAMP();
+                }
+            }
+        }
+
+        vTaskDelay((TickType_t) HOME_PERIOD);
+        get_snapshot(&homeSnap);
+
+        //  only a snapshot sampled after a carrier was started can show it
+        //  has stopped
+        for (carrier = 0; carrier < CARRIERCNT; carrier++)
+        {
+            if (((started & ~stopped) & (1UL << carrier)) &&
+                ((int32_t) (homeSnap.sampled - stamp[carrier]) > 0) && !(homeSnap.mstatus[carrier] & (MSTS_SSCM | MSTS_SRUN)))
+            {
+                stopped |= (1UL << carrier);
+                failed |= (homeSnap.mstatus[carrier] & MSTS_SERR) ? (1UL << carrier) : 0;
+            }
+        }
+    }
+
+    //  out of time:  whatever is still running hasn't found its sensor
+    if (stopped != all)
+    {
+        stop_group(started & ~stopped, false);
+        failed |= (all & ~stopped);
+    }
+
+    //  the homed carriers' origins, all at once
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        homeClear[chip] = (BUS_OP) {OP_COMMAND, (uint8_t) CUN1R, 0, 0, {0}};
+    }
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        if ((all & ~failed) & (1UL << carrier))
+        {
+            homeClear[CARRIER_CHIP(carrier)].axis |= (uint8_t) (1 << CARRIER_AXIS(carrier));
+        }
+    }
+
+    bus_transact_all(BUS_CONFIG, homeClear, 1);
+
+    taskENTER_CRITICAL();
+    homeStats.busy = 0;
+    homeStats.homed = all & ~failed;
+    homeStats.failed = failed;
+    homeStats.waves = waves;
+    homeStats.readyMs = (uint32_t) (((uint64_t) (xTaskGetTickCount() - start) * 1000) / configTICK_RATE_HZ);
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      ASIC_home
+ *              This RTOS task runs the homing requests from start_homing(),
+ *              one at a time.
+ *  @param[in]  pvParameters is ignored
+ *  @returns    none
+ ************************************************************************/
+void ASIC_home(void *pvParameters)
+{
+    HOME_PARAMS params;
+
+    homeTask = xTaskGetCurrentTaskHandle();
+
+    while (1)
+    {
+        (void) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        taskENTER_CRITICAL();
+        params = homeRequest;
+        taskEXIT_CRITICAL();
+
+        home_carriers(&params);
+    }
+
+    vTaskDelete(NULL);
+}
+
+/*************************************************************************
+ *  @brief      start_homing
+ *              Hands a homing request to ASIC_home.  The carriers' RMD.MOD
+ *              is left in origin return; a move sets its own.
+ *  @param[in]  params is the request; it's copied
+ *  @returns    true, if homing was started; false, if one is under way,
+ *              the task isn't running, or the track order doesn't list 1 or
+ *              more distinct carriers
+ ************************************************************************/
+bool start_homing(const HOME_PARAMS *params)
+{
+    uint32_t listed = 0;
+    bool accepted = false;
+    uint8_t k;
+
+    if ((params->carriers == 0) || (params->carriers > CARRIERCNT) || (params->minus > params->carriers) || (homeTask == (TaskHandle_t) NULL))
+    {
+        return (false);
+    }
+
+    for (k = 0; k < params->carriers; k++)
+    {
+        if ((params->order[k] >= CARRIERCNT) || (listed & (1UL << params->order[k])))
+        {
+            return (false);
+        }
+
+        listed |= (1UL << params->order[k]);
+    }
+
+    taskENTER_CRITICAL();
+
+    if (homeStats.busy == 0)
+    {
+        homeRequest = *params;
+        homeStats.busy = 1;
+        homeStats.homings++;
+        accepted = true;
+    }
+
+    taskEXIT_CRITICAL();
+
+    if (accepted)
+    {
+        (void) xTaskNotifyGive(homeTask);
+    }
+
+    return (accepted);
+}
+
+/*************************************************************************
+ *  @brief      get_home_stats
+ *              Get method for the homing counters
+ *  @param[out] stats receives a copy of the counters
+ *  @returns    none
+ ************************************************************************/
+void get_home_stats(HOME_STATS *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = homeStats;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      set_homed
+ *              Set method for the carriers at their origins, for a warm
+ *              restart that restored COUNTER1 of carriers homed before it
+ *  @param[in]  carriers is a bitfield of carrier numbers
+ *  @returns    none
+ ************************************************************************/
+void set_homed(uint32_t carriers)
+{
+    taskENTER_CRITICAL();
+    homeStats.homed = carriers;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,74 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_home.h
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_HOME_H
+    #define PCL6046_HOME_H
+
+    //  how often homing checks on the carriers, and how long it may take
+    //  before the carriers still looking for their ORG sensors are stopped,
+    //  in milliseconds
+    #define HOME_PERIOD             ASIC_MAINT_PERIOD
+    #define HOME_TIMEOUT            60000
+
+    //  bus operations per chip to start carriers homing:  RENV3.ORM and
+    //  RMD.MOD, then STAFL
+    #define HOME_OPS                3
+
+    //  a homing request, from the HOME command:  the carriers on the track in
+    //  order from its - end, as in LIMIT_PARAMS; the first "minus" of them
+    //  home toward the - end, the rest toward the + end
+    typedef struct
+    {
+        uint8_t     carriers;           //  1 to CARRIERCNT
+        uint8_t     order[CARRIERCNT];
+        uint8_t     minus;
+
+    }   HOME_PARAMS;
+
+    //  homing counters, and how the last homing went; carriers are bitfields
+    //  of carrier numbers
+    typedef struct
+    {
+        uint32_t    homings;            //  homings run
+        uint32_t    busy;               //  1 while one is under way
+        uint32_t    homed;              //  carriers at their origins, COUNTER1 cleared
+        uint32_t    failed;             //  carriers that didn't reach their ORG sensors
+        uint32_t    waves;              //  start transactions it took
+        uint32_t    readyMs;            //  time to ready, in milliseconds
+
+    }   HOME_STATS;
+
+    //  ASIC_home's stack:  the request, each carrier's FL speed,
+    //  magnification and start stamp, and the scalars on the way down; the
+    //  bus operations and the snapshot are static
+    #define HOME_STACK_SIZE         TASK_STACK_SIZE(sizeof(HOME_PARAMS) + (3 * CARRIERCNT * sizeof(uint32_t)) + (32 * sizeof(uint32_t)))
+
+    //  the HOME_REPORT command is answered with a packet of this magic
+    //  number, then the HOME_STATS, little-endian
+    #define HOME_REPORT_MAGIC       0x48503650UL        //  "P6PH"
+
+    #ifdef  PCL6046_HOME_C
+
+        static TaskHandle_t     homeTask = (TaskHandle_t) NULL;
+
+        //  the request ASIC_home takes up next
+        static HOME_PARAMS      homeRequest;
+
+        static HOME_STATS       homeStats;
+
+        //  only ASIC_home homes, so these are never shared
+        static BUS_OP           homeOps[PCL6046_CHIPS][HOME_OPS];
+        static BUS_OP           homeReads[PCL6046_CHIPS][2];
+        static BUS_OP           homeClear[PCL6046_CHIPS];
+        static PCL6046_SNAPSHOT homeSnap;
+
+    #else
+        bool start_homing(const HOME_PARAMS *params);
+        void get_home_stats(HOME_STATS *stats);
+        void set_homed(uint32_t carriers);
+        void ASIC_home(void *pvParameters);
+    #endif
+#endif
@@ -1,8 +1,9 @@
 /*************************************************************************
  *  Challenge_1_Firmware:   PCL6046_limit.c
- *                          Thread to set limit function of 4 axes to
- *                          prevent collisions, since all 4 axes are
- *                          in the same physical dimension for this application.
+ *                          Thread to set limit function of the carriers to
+ *                          prevent collisions, since all carriers are on
+ *                          the same track for this application; the track
+ *                          can span several chips.
  *
  *  Engineer:               Larry Pelton
  *
@@ -11,130 +12,558 @@
 
 #include    <stdint.h>
 #include    <stdbool.h>
+#include    <string.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+#include    "queue.h"
+#include    "event_groups.h"
 
 #include    "PCL6046.h"
 #include    "PCL6046_maint.h"
-#include    "PCL6046_comm.h"
+#include    "PCL6046_event.h"
+#include    "PCL6046_profile.h"
 #include    "PCL6046_limit.h"
+#include    "PCL6046_safety.h"
+#include    "PCL6046_deviation.h"
 
 
+/*************************************************************************
+ *  @brief      set_limit_modes
+ *              Enables software limits per carrier, as one field update of
+ *              the comparator 1 and 2 settings in RENV4 on each chip (the
+ *              upper half is left alone).  The first carrier on the track gets
+ *              a limit in the + direction only, the last in the - direction
+ *              only, and those between in both; reaching a limit starts a
+ *              decelerate-stop.  Carriers that aren't on the track get none.
+ *              With LIMIT_APPROACH_WATCH, the carriers on the track also get
+ *              comparator 3 (RCMP3 < COUNTER1), comparator 4 (RCMP4 >
+ *              COUNTER1), and comparator 5 (RCMP5 < current speed) with their
+ *              interrupts, and ASIC_limit listens for them; turning it off
+ *              disables those interrupts again, and otherwise they're left
+ *              alone, as the deviation watch may be using them.
+ *  @param[in]  params holds the track order
+ *  @returns    none
+ ************************************************************************/
+static void set_limit_modes(const LIMIT_PARAMS *params)
+{
+    bool watch = ((params->flags & LIMIT_APPROACH_WATCH) != 0);
+    uint8_t chip;
+    uint8_t k;
+
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        limitModeOps[chip][0] = (BUS_OP) {OP_MODIFY, (uint8_t) RENV4, 0x0F, watch ? (LIMIT_RENV4_LIMITS | LIMIT_RENV4_WATCH) : LIMIT_RENV4_LIMITS, {0}};
+        limitModeOps[chip][1] = (BUS_OP) {OP_MODIFY, (uint8_t) RENV5, 0, LIMIT_RENV5_WATCH, {0}};
+        limitModeOps[chip][2] = (BUS_OP) {OP_MODIFY, (uint8_t) RIRQ, 0, LIMIT_RIRQ_WATCH, {0}};
+    }
+
+    for (k = 0; k < params->carriers; k++)
+    {
+        uint8_t carrier = params->order[k];
+        BUS_OP *ops = limitModeOps[CARRIER_CHIP(carrier)];
+        uint8_t axis = CARRIER_AXIS(carrier);
+        uint32_t mode = 0;
+
+        if (k < (params->carriers - 1))
+        {
+            mode |= LIMIT_RENV4_PLUS;
+        }
+
+        if (k > 0)
+        {
+            mode |= LIMIT_RENV4_MINUS;
+        }
+
+        if (watch)
+        {
+            mode |= LIMIT_RENV4_APPROACH;
+            ops[1].axis |= (uint8_t) (1 << axis);
+            ops[1].values[axis] = LIMIT_RENV5_SPEED;
+        }
+
+        ops[0].values[axis] = mode;
+
+        if (watch || approachWatched)
+        {
+            ops[2].axis |= (uint8_t) (1 << axis);
+            ops[2].values[axis] = watch ? LIMIT_RIRQ_WATCH : 0;
+        }
+    }
+
+    bus_transact_all(BUS_CONFIG, &limitModeOps[0][0], 3);
+
+    approachWatched = watch;
+    (void) listen_axis_events(limitTask, watch ? (PCL6046_EVT_CMP3 | PCL6046_EVT_CMP4 | PCL6046_EVT_CMP5) : 0);
+}
+
+/*************************************************************************
+ *  @brief      refresh_period
+ *              How often the limits are recomputed when nothing else asks
+ *              for it; approach watch events only come from the first chip.
+ *  @param[in]  params holds the track order
+ *  @returns    the period, in milliseconds
+ ************************************************************************/
+static TickType_t refresh_period(const LIMIT_PARAMS *params)
+{
+    uint8_t k;
+
+    if ((params->flags & LIMIT_APPROACH_WATCH) == 0)
+    {
+        return (POSITION_MONITOR_PERIOD);
+    }
+
+    for (k = 0; k < params->carriers; k++)
+    {
+        if (CARRIER_CHIP(params->order[k]) != 0)
+        {
+            return (POSITION_MONITOR_PERIOD);
+        }
+    }
+
+    return (LIMIT_REFRESH_PERIOD);
+}
+
+/*************************************************************************
+ *  @brief      set_watch
+ *              Fills in the approach watch of one carrier:  comparators 3 and
+ *              4 half way from its position to its + and - limits (never
+ *              closer than LIMIT_WATCH_MIN), and comparator 5 at the highest
+ *              speed its limits allow for.  A side without a limit isn't
+ *              watched.
+ *  @param[in,out]  ops are the chip's RCMP1..RCMP5 writes; the axis takes
+ *              part in the RCMP3..RCMP5 writes
+ *  @param[in]  axis is the carrier's axis on the chip
+ *  @param[in]  position is the carrier's position
+ *  @param[in]  reachable is the speed step its stopping distances allow for
+ *  @returns    none
+ ************************************************************************/
+static void set_watch(BUS_OP ops[5], uint8_t axis, int32_t position, uint32_t reachable)
+{
+    uint8_t bit = (uint8_t) (1 << axis);
+    int64_t window;
+    int64_t watch;
+
+    //  + side; RCMP3 < COUNTER1 is never met at INT32_MAX
+    watch = INT32_MAX;
+
+    if (ops[0].axis & bit)
+    {
+        window = ((int64_t) (int32_t) ops[0].values[axis] - position) / 2;
+        watch = position + ((window > LIMIT_WATCH_MIN) ? window : LIMIT_WATCH_MIN);
+    }
+
+    ops[2].axis |= bit;
+    ops[2].values[axis] = (uint32_t) (int32_t) ((watch < INT32_MAX) ? watch : INT32_MAX);
+
+    //  - side; RCMP4 > COUNTER1 is never met at INT32_MIN
+    watch = INT32_MIN;
+
+    if (ops[1].axis & bit)
+    {
+        window = ((int64_t) position - (int32_t) ops[1].values[axis]) / 2;
+        watch = position - ((window > LIMIT_WATCH_MIN) ? window : LIMIT_WATCH_MIN);
+    }
+
+    ops[3].axis |= bit;
+    ops[3].values[axis] = (uint32_t) (int32_t) ((watch > INT32_MIN) ? watch : INT32_MIN);
+
+    ops[4].axis |= bit;
+    ops[4].values[axis] = reachable;
+}
+
+/*************************************************************************
+ *  @brief      apply_pacing
+ *              Moves ASIC_limit to or from the safety loop timer, as
+ *              pace_limits() asked.  While the timer paces it, the task runs
+ *              at SAFETY_TASK_PRI and makes the acquisitions itself.
+ *  @param[in]  pacedUs is the timer period in effect, 0 if none
+ *  @param[in]  priority is the task's own priority
+ *  @returns    the timer period now in effect
+ ************************************************************************/
+static uint32_t apply_pacing(uint32_t pacedUs, UBaseType_t priority)
+{
+    uint32_t periodUs = limitTimerPeriod;
+
+    if (periodUs == pacedUs)
+    {
+        return (pacedUs);
+    }
+
+    if (periodUs == 0)
+    {
+        stop_safety_timer();
+        vTaskPrioritySet(NULL, priority);
+        pace_acquisition(false);
+    }
+    else
+    {
+        if (pacedUs == 0)
+        {
+            pace_acquisition(true);
+            vTaskPrioritySet(NULL, SAFETY_TASK_PRI);
+        }
+
+        start_safety_timer(limitTask, LIMIT_NOTIFY_TIMER, periodUs);
+    }
+
+    return (periodUs);
+}
+
+/*************************************************************************
+ *  @brief      get_limit_stats
+ *              Get method for the age of the positions behind the limits
+ *  @param[out] stats receives a copy of the counters
+ *  @returns    none
+ ************************************************************************/
+void get_limit_stats(LIMIT_STATS *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = limitStats;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      get_limit_stops
+ *              Get method for the stops counted per carrier
+ *  @param[out] stops receives a copy of the counts, CARRIERCNT of them
+ *  @returns    none
+ ************************************************************************/
+void get_limit_stops(LIMIT_STOPS stops[CARRIERCNT])
+{
+    taskENTER_CRITICAL();
+    memcpy(stops, limitStops, sizeof(limitStops));
+    taskEXIT_CRITICAL();
+}
+
 /*************************************************************************
  *  @brief      ASIC_limit
- *              This RTOS task monitors positions of each axis from the
+ *              This RTOS task monitors positions of each carrier from the
  *              COUNTER1 values and adjust the software limits of each
- *              axis to prevent collisions.
- *  @param[in]  pvParameters points to the message from the USB user that
- *              caused this thread to be created
+ *              carrier to prevent collisions.  The limits decelerate-stop a
+ *              carrier, so each one is placed a stopping distance short of the
+ *              space the carrier may use; that distance follows the actual
+ *              speed, so carriers can pack tightly while they're slow.
+ *              Each period is one sweep over the carriers in track order,
+ *              whichever chips they're on.
+ *              Parameters arrive through the mailbox (configure_limits());
+ *              the task waits for the first set, and a new set takes effect
+ *              on the spot instead of at the next period.  With approach
+ *              watch (LIMIT_APPROACH_WATCH), a comparator 3..5 event from
+ *              the first chip has the limits recomputed from a fresh
+ *              snapshot, and the periodic sweep slows to a refresh.
+ *              Paced by the safety loop timer (pace_limits()), each tick
+ *              makes its own acquisition and sweep, whatever the RTOS tick.
+ *  @param[in]  pvParameters is ignored
  *  @returns    none
  ************************************************************************/
 
 void ASIC_limit(void *pvParameters)
 {
-    //  create a local copy of the information referenced by the calling task
-    USB_ASIC_Q_t queueMsg = *((USB_ASIC_Q_t *) pvParameters);
-    
-    //  flag to the calling task that the information has been copied/consumed
-    (void) xSemaphoreGive(comm_data_consumed);
-
-    //  4 data words are available from the USB message; I'll assume that a common
-    // separation is being specified by the user, so only the 1st data word is used
-    int32_t userLimit = (int32_t) queueMsg.data1;
-    int32_t axialPositions[4] = {0};
-    uint32_t temp;
-
-    TickType_t lastTimeHere = xTaskGetTickCount();
-
-    //  ***********************************************************
-    //  enable software limits per axis:
-    //  ***********************************************************
-    //  set axis X for software limit in the + direction only
-    temp = ((ReadReg(RENV4, AXIS_X) & 0xFFFF0000) | 0x0038);
-    WriteReg(RENV4, AXIS_X, temp);
-
-    //  set axis Y for software limit in both directions
-    temp = ((ReadReg(RENV4, AXIS_Y) & 0xFFFF0000) | 0x3838);
-    WriteReg(RENV4, AXIS_Y, temp);
-
-    //  set axis Z for software limit in both directions
-    temp = ((ReadReg(RENV4, AXIS_Z) & 0xFFFF0000) | 0x3838);
-    WriteReg(RENV4, AXIS_Z, temp);
-
-    //  set axis U for software limit in the - direction only
-    temp = ((ReadReg(RENV4, AXIS_U) & 0xFFFF0000) | 0x3800);
-    WriteReg(RENV4, AXIS_U, temp);
-    //  ***********************************************************
-    
+    //  the track order, the minimum gaps between neighbours, and the margin
+    //  added to stopping distances, in percent
+    LIMIT_PARAMS params;
+
+    int32_t *positions;
+    uint32_t stopping[CARRIERCNT];
+    uint32_t speedLimit[CARRIERCNT];
+    uint32_t weight[CARRIERCNT][2];
+    uint8_t chip;
+    uint8_t reg;
+    uint8_t k;
+    uint32_t age;
+    uint32_t lagUs;
+    bool stopNow = false;
+
+    //  notification bits not yet acted on, and whether this update was
+    //  made for approach watch events
+    uint32_t pending = 0;
+    uint32_t notified;
+    bool watchUpdate = false;
+    bool woken;
+
+    //  the safety loop timer period, if it paces the task, and whether this
+    //  update is a cycle of it
+    uint32_t pacedUs = 0;
+    bool timedCycle = false;
+    UBaseType_t priority = uxTaskPriorityGet(NULL);
+
+    TickType_t lastTimeHere;
+    TickType_t period;
+    TickType_t wait;
+
+    (void) xQueueReceive(limitMailbox, (void *) &params, portMAX_DELAY);
+
+    set_limit_modes(&params);
+
+    //  positions, speeds, and directions come from the acquisition snapshot;
+    //  don't compute limits until one that includes them has been published
+    acquire_items(ACQ_RCUN1 | ACQ_PSPD | ACQ_RSTS);
+
+    do
+    {
+        vTaskDelay((const TickType_t) ASIC_MAINT_PERIOD);
+        get_snapshot(&limitSnap);
+
+    } while ((limitSnap.items & (ACQ_RCUN1 | ACQ_PSPD | ACQ_RSTS)) != (ACQ_RCUN1 | ACQ_PSPD | ACQ_RSTS));
+
+    lastTimeHere = xTaskGetTickCount();
+
     while (1)
     {
-        //  comparator values for limits between X and Y
-        int32_t compValXplus;
-        int32_t compValYminus;
-        //  comparator values for limits between Y and Z
-        int32_t compValYplus;
-        int32_t compValZminus;
-        //  comparator values for limits between Z and U
-        int32_t compValZplus;
-        int32_t compValUminus;
+        //  the speed profile of every carrier comes from the register
+        //  shadows, so a bus is only used if an axis has been reset; per
+        //  chip, RCMP1 holds the + limits and RCMP2 the - limits; an axis
+        //  only takes part in the writes it has a limit for; RCMP3..5 hold
+        //  the approach watch
+        for (chip = 0; chip < PCL6046_CHIPS; chip++)
+        {
+            for (reg = 0; reg < PROFILE_REGS; reg++)
+            {
+                limitProfileOps[chip][reg] = (BUS_OP) {OP_SHADOWED, (uint8_t) PCL6046_profile_regs[reg], 0x0F, 0, {0}};
+            }
+
+            for (reg = 0; reg < 5; reg++)
+            {
+                limitOps[chip][reg] = (BUS_OP) {OP_WRITE, (uint8_t) (RCMP1 + reg), 0, 0, {0}};
+            }
+
+            limitStopOps[chip] = (BUS_OP) {OP_COMMAND, (uint8_t) STOP, 0, 0, {0}};
+        }
+
+        bus_transact_all(BUS_SAFETY, &limitProfileOps[0][0], PROFILE_REGS);
 
-        //  COUNTER1 is assumed to hold the current position of each axis; read COUNTER1
-        //  of each axis
-        read_registers(RCUN1, 0x0F, (uint32_t *) axialPositions);
+        //  COUNTER1 is assumed to hold the current position of each carrier;
+        //  take COUNTER1 of each carrier from the latest snapshot, which
+        //  has all the carriers of a chip at one instant if ACQ_LATCH is set
+        get_snapshot(&limitSnap);
+        positions = (int32_t *) limitSnap.counter[0];
 
-        //  calculate limits to prevent X and Y from colliding
-        //  if there's adequate space between X and Y to set limits ...
-        if ((axialPositions[1] - axialPositions[0]) > userLimit)
+        //  a tighter loop leaves the carriers less time to speed up
+        lagUs = (pacedUs != 0) ? LIMIT_PACED_LAG_US(pacedUs) : (LIMIT_UPDATE_LAG * 1000UL);
+
+        for (k = 0; k < params.carriers; k++)
         {
-            compValXplus    = axialPositions[1] - userLimit;
-            compValYminus   = axialPositions[0] + userLimit;
+            uint8_t carrier = params.order[k];
+            const BUS_OP *ops = limitProfileOps[CARRIER_CHIP(carrier)];
+            uint32_t profile[PROFILE_REGS];
+            uint32_t reachable;
+
+            for (reg = 0; reg < PROFILE_REGS; reg++)
+            {
+                profile[reg] = ops[reg].values[CARRIER_AXIS(carrier)];
+            }
+
+            //  the carrier may speed up until the next update takes effect, so
+            //  its limit must allow for stopping from that speed
+            reachable = profile_reachable_speed(limitSnap.speed[carrier], lagUs, profile);
+            speedLimit[carrier] = reachable;
+            stopping[carrier] = profile_stop_distance(reachable, profile);
+            stopping[carrier] += (uint32_t) (((uint64_t) stopping[carrier] * params.marginPercent) / 100);
+
+            //  the free space between neighbours is shared according to how
+            //  fast each can close it; a carrier that's moving away from a
+            //  neighbour can't turn back without stopping first, so it needs
+            //  no share on that side ([0] is the - side, [1] is the + side)
+            weight[carrier][0] = reachable + 1;
+            weight[carrier][1] = reachable + 1;
+
+            if (limitSnap.mstatus[carrier] & MSTS_SRUN)
+            {
+                weight[carrier][(limitSnap.rsts[carrier] & FIELD_MASK(RSTS, SDIR)) ? 1 : 0] = 0;
+            }
         }
-        //  else stop now by specifying limit at current position
-        else
+
+        //  one pass over the neighbouring pairs, in track order
+        for (k = 0; k < (params.carriers - 1); k++)
         {
-            compValXplus    = axialPositions[0];
-            compValYminus   = axialPositions[1];    
+            uint8_t lower = params.order[k];
+            uint8_t upper = params.order[k + 1];
+            int32_t minimumGap = (int32_t) (params.minimumGap[k] ? params.minimumGap[k] : params.minimumGap[0]);
+            int64_t room = (int64_t) positions[upper] - positions[lower] - minimumGap - stopping[lower] - stopping[upper];
+            uint32_t plusLimit;
+            uint32_t minusLimit;
+            BUS_OP *plus = &limitOps[CARRIER_CHIP(lower)][0];
+            BUS_OP *minus = &limitOps[CARRIER_CHIP(upper)][1];
+
+            //  if there's adequate space between the pair to set limits, each
+            //  gets its share of the room beyond its stopping distance ...
+            if (room > 0)
+            {
+                uint32_t lowerWeight = weight[lower][1];
+                uint32_t upperWeight = weight[upper][0];
+                int64_t lowerShare;
+
+                if ((lowerWeight + upperWeight) == 0)
+                {
+                    lowerWeight = upperWeight = 1;
+                }
+
+                lowerShare = (room * lowerWeight) / (lowerWeight + upperWeight);
+
+                plusLimit  = (uint32_t) (positions[lower] + lowerShare);
+                minusLimit = (uint32_t) (positions[upper] - (room - lowerShare));
+            }
+            //  else stop now by specifying limit at current position; the
+            //  limits decelerate, which would carry a carrier that's closing
+            //  on its neighbour its whole stopping distance, so those are
+            //  stopped at once
+            else
+            {
+                plusLimit  = (uint32_t) positions[lower];
+                minusLimit = (uint32_t) positions[upper];
+
+                if ((limitSnap.mstatus[lower] & MSTS_SRUN) && (weight[lower][1] != 0))
+                {
+                    limitStopOps[CARRIER_CHIP(lower)].axis |= (uint8_t) (1 << CARRIER_AXIS(lower));
+                    stopNow = true;
+                }
+
+                if ((limitSnap.mstatus[upper] & MSTS_SRUN) && (weight[upper][0] != 0))
+                {
+                    limitStopOps[CARRIER_CHIP(upper)].axis |= (uint8_t) (1 << CARRIER_AXIS(upper));
+                    stopNow = true;
+                }
+            }
+
+            plus->axis |= (uint8_t) (1 << CARRIER_AXIS(lower));
+            plus->values[CARRIER_AXIS(lower)] = plusLimit;
+            minus->axis |= (uint8_t) (1 << CARRIER_AXIS(upper));
+            minus->values[CARRIER_AXIS(upper)] = minusLimit;
         }
 
-        //  set the limits between X and Y
-        WriteReg(RCMP1, AXIS_X, compValXplus);
-        WriteReg(RCMP2, AXIS_Y, compValYminus);
+        if (params.flags & LIMIT_APPROACH_WATCH)
+        {
+            for (k = 0; k < params.carriers; k++)
+            {
+                uint8_t carrier = params.order[k];
+
+                set_watch(limitOps[CARRIER_CHIP(carrier)], CARRIER_AXIS(carrier), positions[carrier], speedLimit[carrier]);
+            }
+        }
 
-        //  calculate limits to prevent Y and Z from colliding
-        //  if there's adequate space between Y and Z to set limits ...
-        if ((axialPositions[2] - axialPositions[1]) > userLimit)
+        //  the immediate stops go first, ahead of anything else queued
+        if (stopNow)
         {
-            compValYplus    = axialPositions[2] - userLimit;
-            compValZminus   = axialPositions[1] + userLimit;
+            bus_transact_all(BUS_EMERGENCY, limitStopOps, 1);
+            stopNow = false;
         }
-        //  else stop now
-        else
+
+        //  set the limits with 2 commands per chip, one per comparator, as
+        //  one safety transaction per chip, so nothing else gets between them
+        //  and the limits go live as close together as possible; the chips
+        //  are written at the same time; the approach watch follows them, and
+        //  without it the RCMP3..5 writes have no axes, so they're skipped
+        bus_transact_all(BUS_SAFETY, &limitOps[0][0], 5);
+
+        if (timedCycle)
         {
-            compValYplus    = axialPositions[1];
-            compValZminus   = axialPositions[2];
+            safety_cycle_end();
         }
 
-        //  set the limits between Y and Z
-        WriteReg(RCMP1, AXIS_Y, compValYplus);
-        WriteReg(RCMP2, AXIS_Z, compValZminus);
+        //  the age of the positions the limits were computed from
+        age = (uint32_t) TIMESTAMP() - limitSnap.sampled;
+
+        taskENTER_CRITICAL();
 
-        //  calculate limits to prevent Z and U from colliding
-        //  if there's adequate space between Z and U to set limits ...
-        if ((axialPositions[3] - axialPositions[2]) > userLimit)
+        limitStats.updates++;
+        limitStats.watchUpdates += watchUpdate ? 1 : 0;
+        limitStats.lastAge = age;
+
+        if (age > limitStats.maxAge)
         {
-            compValZplus    = axialPositions[3] - userLimit;
-            compValUminus   = axialPositions[2] + userLimit;
+            limitStats.maxAge = age;
+        }
+
+        taskEXIT_CRITICAL();
+
+        //  sleep out the period, unless new parameters or approach watch
+        //  events arrive; either is applied by recomputing the limits right
+        //  away, without moving the period
+        period = refresh_period(&params);
+        woken = (pending != 0);
+        watchUpdate = false;
+
+        if (!woken)
+        {
+            wait = (TickType_t) ((lastTimeHere + period) - xTaskGetTickCount());
+
+            if (wait > period)
+            {
+                wait = 0;
+            }
+
+            woken = (xTaskNotifyWait(0, UINT32_MAX, &pending, wait) == pdPASS);
+        }
+
+        if (pending & LIMIT_NOTIFY_PACING)
+        {
+            pacedUs = apply_pacing(pacedUs, priority);
+        }
+
+        timedCycle = false;
+
+        if (xQueueReceive(limitMailbox, (void *) &params, 0) == pdPASS)
+        {
+            set_limit_modes(&params);
+            lastTimeHere = xTaskGetTickCount();
+            pending = 0;
+        }
+        else if (pacedUs != 0)
+        {
+            //  every pass acquires for itself (below), so approach watch
+            //  events need nothing more
+            timedCycle = ((pending & LIMIT_NOTIFY_TIMER) != 0);
+            watchUpdate = ((pending & LIMIT_NOTIFY_AXES) != 0);
+
+            if (!woken)
+            {
+                lastTimeHere += period;
+            }
+
+            pending = 0;
+        }
+        else if ((pending & LIMIT_NOTIFY_AXES) && (params.flags & LIMIT_APPROACH_WATCH))
+        {
+            //  the snapshot may predate the event, so have a fresh one taken;
+            //  events that arrive meanwhile get another pass
+            request_acquisition(limitTask, LIMIT_NOTIFY_SNAPSHOT);
+            pending = 0;
+
+            do
+            {
+                if (xTaskNotifyWait(0, UINT32_MAX, &notified, LIMIT_UPDATE_LAG) != pdPASS)
+                {
+                    break;
+                }
+
+                pending |= notified;
+
+            } while ((pending & LIMIT_NOTIFY_SNAPSHOT) == 0);
+
+            pending &= LIMIT_NOTIFY_AXES;
+            watchUpdate = true;
         }
-        //  else stop now
         else
         {
-            compValZplus    = axialPositions[2];
-            compValUminus   = axialPositions[3];
+            if (!woken)
+            {
+                lastTimeHere += period;
+            }
+
+            pending = 0;
         }
 
-        //  set the limits between Z and U
-        WriteReg(RCMP1, AXIS_Z, compValZplus);
-        WriteReg(RCMP2, AXIS_U, compValUminus);
+        //  the timer-paced loop takes the positions at the start of the cycle
+        if (pacedUs != 0)
+        {
+            if (timedCycle)
+            {
+                safety_cycle_begin();
+            }
 
-        vTaskDelayUntil(&lastTimeHere, (const TickType_t) POSITION_MONITOR_PERIOD);
+            run_acquisition();
+        }
     }
 
     //  this should never be executed
@@ -144,43 +573,190 @@ void ASIC_limit(void *pvParameters)
 
 /*************************************************************************
  *  @brief      ASIC_limit_indicators
- *              This thread assumes 1 LED exists per axis.  An LED is lit
- *              if the motor has stopped due to software limits.
+ *              This thread assumes 1 LED exists per carrier.  An LED is lit
+ *              if the motor has stopped due to software limits.  Rather
+ *              than polling, it's woken by the acquisition that first shows
+ *              a change in any carrier's LIMIT_STOP_STATUS, and updates
+ *              every LED from that snapshot, counting the stops that
+ *              appeared.  The stops are counted from the start; the LEDs
+ *              are left alone until enable_limit_indicators() is called.
  *  @param[in]  pvParameters is unused here
  *  @returns    none
  ************************************************************************/
 void ASIC_limit_indicators(void *pvParameters)
 {
-    TickType_t lastTimeHere = xTaskGetTickCount();
-    MOTION_AXIS axis = AXIS_X;
+    bool stopped[CARRIERCNT] = {false};
+    bool stop;
+    uint8_t carrier;
+
+    watch_status(xTaskGetCurrentTaskHandle(), INDICATOR_NOTIFY_STATUS, LIMIT_STOP_STATUS);
 
     while (1)
     {
-        uint16_t currStat = get_axial_status(axis);
-    
-        //  if the comparator 1 or 2 condition is satisfied, indicating STOP
-        //  in the forward or reverse direction, then light the corresponding
-        //  LED
-        if (currStat & 0x30)
+        get_snapshot(&indicatorSnap);
+
+        if (indicatorSnap.items & ACQ_MSTSW)
         {
-            light_LED(axis);
+            for (carrier = 0; carrier < CARRIERCNT; carrier++)
+            {
+                //  if the carrier shows a stop, light the corresponding LED;
+                //  otherwise, extinguish it
+                stop = ((indicatorSnap.mstatus[carrier] & LIMIT_STOP_STATUS) != 0);
+
+                if (stop && !stopped[carrier])
+                {
+                    taskENTER_CRITICAL();
+                    limitStops[carrier].stops++;
+                    limitStops[carrier].lastStop = (uint32_t) indicatorSnap.tick;
+                    taskEXIT_CRITICAL();
+                }
+
+                stopped[carrier] = stop;
+
+                if (!indicatorsEnabled)
+                {
+                    continue;
+                }
+
+                if (stop)
+                {
+                    light_LED(carrier);
+                }
+                else
+                {
+                    extinguish_LED(carrier);
+                }
+            }
         }
 
-        //  otherwise, extinguish the LED
-        else
+        //  wait for the next change, or for the LEDs to be enabled
+        (void) xTaskNotifyWait(0, (uint32_t) ~0UL, NULL, portMAX_DELAY);
+    }
+
+    vTaskDelete(NULL);
+}
+
+/*************************************************************************
+ *  @brief      init_limit_workers
+ *              Creates the limit and indicator tasks, and the parameter
+ *              mailbox, all statically allocated.  The limit task idles
+ *              until configure_limits() is called, and the LEDs until
+ *              enable_limit_indicators() is.
+ *  @param[in]  priority is the priority of the calling task; the limit task
+ *              runs just above it
+ *  @returns    true, if no errors were encountered; false, otherwise
+ ************************************************************************/
+bool init_limit_workers(UBaseType_t priority)
+{
+    if (limitMailbox == (QueueHandle_t) NULL)
+    {
+        limitMailbox = xQueueCreateStatic(1, (UBaseType_t) sizeof(LIMIT_PARAMS), limitMailboxStorage, &limitMailboxQueue);
+        //  each depth is taken from its own buffer, so the two can't disagree
+        limitTask = xTaskCreateStatic(ASIC_limit, "limit", (sizeof(limitStack) / sizeof(StackType_t)), (void *) NULL, (priority + 1), limitStack, &limitTCB);
+        indicatorTask = xTaskCreateStatic(ASIC_limit_indicators, "leds", (sizeof(indicatorStack) / sizeof(StackType_t)), (void *) NULL, BASE_TASK_PRI, indicatorStack, &indicatorTCB);
+    }
+
+    return ((limitMailbox != (QueueHandle_t) NULL) && (limitTask != (TaskHandle_t) NULL) && (indicatorTask != (TaskHandle_t) NULL));
+}
+
+/*************************************************************************
+ *  @brief      configure_limits
+ *              Posts new parameters to ASIC_limit, which applies them at
+ *              once; the first set starts it.
+ *  @param[in]  params are the parameters; they're copied
+ *  @returns    true, if the parameters were posted; false, if the track
+ *              order doesn't list 2 or more distinct carriers, or approach
+ *              watch is asked for while the deviation watch has comparators
+ *              3 and 4
+ ************************************************************************/
+bool configure_limits(const LIMIT_PARAMS *params)
+{
+    uint32_t listed = 0;
+    uint8_t k;
+
+    if ((params->carriers < 2) || (params->carriers > CARRIERCNT) ||
+        ((params->flags & LIMIT_APPROACH_WATCH) && (deviation_watched() != 0)))
+    {
+        return (false);
+    }
+
+    for (k = 0; k < params->carriers; k++)
+    {
+        if ((params->order[k] >= CARRIERCNT) || (listed & (1UL << params->order[k])))
         {
-            extinguish_LED(axis);
+            return (false);
         }
 
-        //  advance to the next axis; one axis is handled every LED_UPDATE_PERIOD
-        //  milliseconds
-        if (++axis >= AXISCNT)
-        {
-            axis = AXIS_X;
-        }      
+        listed |= (1UL << params->order[k]);
+    }
 
-        vTaskDelayUntil(&lastTimeHere, (const TickType_t) LED_UPDATE_PERIOD);
+    taskENTER_CRITICAL();
+    trackParams = *params;
+    trackConfigured = true;
+    taskEXIT_CRITICAL();
+
+    (void) xQueueOverwrite(limitMailbox, (const void *) params);
+    (void) xTaskNotify(limitTask, LIMIT_NOTIFY_PARAMS, eSetBits);
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      get_limit_params
+ *              Get method for the track order and gaps last configured
+ *  @param[out] params receives a copy of the parameters
+ *  @returns    true, if any have been configured; false, otherwise
+ ************************************************************************/
+bool get_limit_params(LIMIT_PARAMS *params)
+{
+    bool configured;
+
+    taskENTER_CRITICAL();
+    *params = trackParams;
+    configured = trackConfigured;
+    taskEXIT_CRITICAL();
+
+    return (configured);
+}
+
+/*************************************************************************
+ *  @brief      pace_limits
+ *              Has the safety loop timer pace ASIC_limit, which then
+ *              acquires and updates the limits every period, or returns it
+ *              to the RTOS tick.  It takes effect once the first parameters
+ *              have been configured.
+ *  @param[in]  periodUs is the period, SAFETY_MIN_PERIOD_US to
+ *              SAFETY_MAX_PERIOD_US microseconds, or 0 to stop the timer
+ *  @returns    true, if the request was posted; false, if the period is out
+ *              of range, there is no safety loop timer, or the limit task
+ *              doesn't exist
+ ************************************************************************/
+bool pace_limits(uint32_t periodUs)
+{
+    if ((periodUs != 0) && ((periodUs < SAFETY_MIN_PERIOD_US) || (periodUs > SAFETY_MAX_PERIOD_US) || !SAFETY_TIMER_PRESENT))
+    {
+        return (false);
     }
 
-    vTaskDelete(NULL);
+    if (limitTask == (TaskHandle_t) NULL)
+    {
+        return (false);
+    }
+
+    limitTimerPeriod = periodUs;
+    (void) xTaskNotify(limitTask, LIMIT_NOTIFY_PACING, eSetBits);
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      enable_limit_indicators
+ *              Has ASIC_limit_indicators show the stops on the LEDs, from
+ *              the latest snapshot on; further calls have no effect.
+ *  @returns    none
+ ************************************************************************/
+void enable_limit_indicators(void)
+{
+    indicatorsEnabled = true;
+    (void) xTaskNotify(indicatorTask, INDICATOR_NOTIFY_ENABLE, eSetBits);
 }
@@ -8,16 +8,182 @@
     #define PCL6046_LIMIT_H
 
     #define POSITION_MONITOR_PERIOD     50
-    #define LED_UPDATE_PERIOD           25
 
-    //  TODO:   populate these macros based on the hardware used;
-    //          x is 0 to 3, implying 4 LEDs
-    #define light_LED(x)        ()
-    #define extinguish_LED(x)   ()
+    //  the MSTSW bits that mean a carrier has been stopped by a limit, shown
+    //  on its LED and counted as a stop when they appear:  the conditions of
+    //  comparators 1 and 2, the + and - limits (SERR and SINT only summarise
+    //  REST and RIST, which every end of operation and watch event sets)
+    #define LIMIT_STOP_STATUS           (MSTS_SCP1 | MSTS_SCP2)
+
+    //  how long, in milliseconds, a limit can lag the motion it's computed
+    //  from:  the age of the snapshot plus the time to the next update
+    #define LIMIT_UPDATE_LAG            (POSITION_MONITOR_PERIOD + ASIC_MAINT_PERIOD)
+
+    //  ... and in microseconds, when the safety loop timer paces the task:
+    //  each cycle takes its own snapshot, so a limit lags by at most the
+    //  cycle it's computed in and the next
+    #define LIMIT_PACED_LAG_US(periodUs)    (2 * (periodUs))
+
+    //  approach watch:  comparators 3 and 4 of each carrier on the track
+    //  watch COUNTER1 half way to its limits, and comparator 5 watches its
+    //  speed against the one the limits allowed for; the limits are
+    //  recomputed when one of them is met, and otherwise refreshed every
+    //  LIMIT_REFRESH_PERIOD milliseconds.  Only the first chip's INT pin is
+    //  wired, so a track with carriers on other chips keeps the
+    //  POSITION_MONITOR_PERIOD refresh.
+    #define LIMIT_APPROACH_WATCH        0x0001
+    #define LIMIT_REFRESH_PERIOD        500
+    #define LIMIT_WATCH_MIN             16          //  pulses; the narrowest watch window
+
+    //  comparator settings:  comparators 1 and 2 are the + and - software
+    //  limits on COUNTER1, with a decelerate-stop; for approach watch,
+    //  comparator 3 is met when RCMP3 < COUNTER1, comparator 4 when RCMP4 >
+    //  COUNTER1, and comparator 5 when RCMP5 < the current speed, with their
+    //  interrupts and no processing
+    #define LIMIT_RENV4_LIMITS          (FIELD_MASK(RENV4, C1C) | FIELD_MASK(RENV4, C1S) | FIELD_MASK(RENV4, C1D) | \
+                                         FIELD_MASK(RENV4, C2C) | FIELD_MASK(RENV4, C2S) | FIELD_MASK(RENV4, C2D))
+    #define LIMIT_RENV4_WATCH           (FIELD_MASK(RENV4, C3C) | FIELD_MASK(RENV4, C3S) | FIELD_MASK(RENV4, C3D) | \
+                                         FIELD_MASK(RENV4, C4C) | FIELD_MASK(RENV4, C4S) | FIELD_MASK(RENV4, C4D))
+    #define LIMIT_RENV5_WATCH           (FIELD_MASK(RENV5, C5C) | FIELD_MASK(RENV5, C5S) | FIELD_MASK(RENV5, C5D))
+    #define LIMIT_RIRQ_WATCH            (FIELD_MASK(RIRQ, IRC3) | FIELD_MASK(RIRQ, IRC4) | FIELD_MASK(RIRQ, IRC5))
+
+    #define LIMIT_RENV4_PLUS            (FIELD_SET(RENV4, C1C, CMP_COUNTER1) | FIELD_SET(RENV4, C1S, CMP_SOFT_LIMIT) | FIELD_SET(RENV4, C1D, CMP_DECEL_STOP))
+    #define LIMIT_RENV4_MINUS           (FIELD_SET(RENV4, C2C, CMP_COUNTER1) | FIELD_SET(RENV4, C2S, CMP_SOFT_LIMIT) | FIELD_SET(RENV4, C2D, CMP_DECEL_STOP))
+    #define LIMIT_RENV4_APPROACH        (FIELD_SET(RENV4, C3C, CMP_COUNTER1) | FIELD_SET(RENV4, C3S, CMP_LESS) | FIELD_SET(RENV4, C3D, CMP_NO_ACTION) | \
+                                         FIELD_SET(RENV4, C4C, CMP_COUNTER1) | FIELD_SET(RENV4, C4S, CMP_GREATER) | FIELD_SET(RENV4, C4D, CMP_NO_ACTION))
+    #define LIMIT_RENV5_SPEED           (FIELD_SET(RENV5, C5C, CMP5_SPEED) | FIELD_SET(RENV5, C5S, CMP_LESS) | FIELD_SET(RENV5, C5D, CMP_NO_ACTION))
+
+    //  ASIC_limit's notification bits:  the axes of the first chip with
+    //  approach watch events, new parameters, and an early snapshot
+    #define LIMIT_NOTIFY_AXES           0x0000000F
+    #define LIMIT_NOTIFY_PARAMS         0x00000100
+    #define LIMIT_NOTIFY_SNAPSHOT       0x00000200
+    #define LIMIT_NOTIFY_TIMER          0x00000400      //  safety loop timer tick
+    #define LIMIT_NOTIFY_PACING         0x00000800      //  see pace_limits()
+
+    //  ASIC_limit_indicators' notification bits:  a change in the carriers'
+    //  LIMIT_STOP_STATUS, and enable_limit_indicators()
+    #define INDICATOR_NOTIFY_STATUS     0x00000001
+    #define INDICATOR_NOTIFY_ENABLE     0x00000002
+
+    //  parameters of ASIC_limit, from the ANTI_COLLIDE command; the carriers
+    //  on the track are listed in order from its - end, by carrier number
+    //  (chip * AXISCNT + axis), so neighbours can be on different chips
+    typedef struct
+    {
+        uint8_t     carriers;                       //  carriers on the track, 2 to CARRIERCNT
+        uint8_t     order[CARRIERCNT];
+        uint32_t    minimumGap[CARRIERCNT - 1];     //  between neighbours, in track order;
+                                                    //  0 means use the first gap
+        uint32_t    marginPercent;                  //  added to stopping distances
+        uint32_t    flags;                          //  LIMIT_xxx
+
+    }   LIMIT_PARAMS;
+
+    //  how old the positions were when the limits computed from them were
+    //  written, in TIMESTAMP() counts; an age runs from the snapshot's
+    //  "sampled" stamp (see ACQ_LATCH) to the end of the limit writes
+    typedef struct
+    {
+        uint32_t    updates;
+        uint32_t    watchUpdates;       //  updates made for approach watch events
+        uint32_t    lastAge;
+        uint32_t    maxAge;
+
+    }   LIMIT_STATS;
+
+    //  the stops of one carrier:  how many, and the RTOS tick of the
+    //  snapshot that showed the last
+    typedef struct
+    {
+        uint32_t    stops;
+        uint32_t    lastStop;
+
+    }   LIMIT_STOPS;
+
+    //  the STOP_REPORT command is answered with a packet of this header,
+    //  then a LIMIT_STOPS per carrier, little-endian
+    #define STOP_REPORT_MAGIC           0x53503650UL        //  "P6PS"
+
+    typedef struct
+    {
+        uint32_t    magic;
+        uint32_t    tickHz;                 //  RTOS ticks per second
+        uint32_t    tick;                   //  RTOS tick of the report
+        uint32_t    carriers;               //  LIMIT_STOPS that follow
+
+    }   STOP_REPORT_HDR;
+
+    #ifdef  PCL6046_HOST_SIM
+        //  host builds drive the emulated board LEDs in PCL6046_sim.c
+        #define light_LED(x)        PCL6046_sim_LED((uint8_t) (x), true)
+        #define extinguish_LED(x)   PCL6046_sim_LED((uint8_t) (x), false)
+    #else
+        //  TODO:   populate these macros based on the hardware used;
+        //          x is 0 to CARRIERCNT - 1, implying an LED per carrier
+        #define light_LED(x)        ()
+        #define extinguish_LED(x)   ()
+    #endif
+
+    //  the workers are created once, with static stacks, and reconfigured
+    //  in place; ASIC_limit's frame holds the track parameters, and per
+    //  carrier its stopping distance, speed limit and two weights, and a
+    //  speed profile
+    #define LIMIT_STACK_SIZE            TASK_STACK_SIZE(sizeof(LIMIT_PARAMS) + (((4 * CARRIERCNT) + PROFILE_REGS) * sizeof(uint32_t)))
+    #define INDICATOR_STACK_SIZE        TASK_STACK_SIZE(CARRIERCNT * sizeof(bool))
 
     #ifdef  PCL6046_LIMIT_C
 
+        //  one-deep mailbox for ASIC_limit's parameters; a new set overwrites
+        //  one that hasn't been picked up yet
+        static QueueHandle_t    limitMailbox = (QueueHandle_t) NULL;
+        static StaticQueue_t    limitMailboxQueue;
+        static uint8_t          limitMailboxStorage[sizeof(LIMIT_PARAMS)];
+
+        static TaskHandle_t     limitTask = (TaskHandle_t) NULL;
+        static StaticTask_t     limitTCB;
+
+        //  whether comparators 3..5 were last set up for approach watch; if
+        //  not, they're left to the deviation watch
+        static bool             approachWatched = false;
+        static StackType_t      limitStack[LIMIT_STACK_SIZE];
+
+        //  ASIC_limit's bus operations, per chip, and its snapshot:  the
+        //  limit modes, the speed profiles read from the shadows, the
+        //  comparator writes, and the immediate stops of carriers out of room
+        static BUS_OP           limitModeOps[PCL6046_CHIPS][3];
+        static BUS_OP           limitProfileOps[PCL6046_CHIPS][PROFILE_REGS];
+        static BUS_OP           limitOps[PCL6046_CHIPS][5];
+        static BUS_OP           limitStopOps[PCL6046_CHIPS];
+        static PCL6046_SNAPSHOT limitSnap;
+
+        static TaskHandle_t     indicatorTask = (TaskHandle_t) NULL;
+        static StaticTask_t     indicatorTCB;
+        static StackType_t      indicatorStack[INDICATOR_STACK_SIZE];
+        static PCL6046_SNAPSHOT indicatorSnap;
+
+        static LIMIT_STATS      limitStats;
+
+        //  per-carrier stops, and whether the LEDs show them
+        static LIMIT_STOPS      limitStops[CARRIERCNT];
+        static volatile bool    indicatorsEnabled = false;
+
+        //  the parameters last accepted by configure_limits(), for
+        //  get_limit_params()
+        static LIMIT_PARAMS     trackParams;
+        static bool             trackConfigured = false;
+
+        //  the safety loop period asked for by pace_limits(), in microseconds
+        static volatile uint32_t    limitTimerPeriod = 0;
+
     #else
+        bool init_limit_workers(UBaseType_t priority);
+        bool configure_limits(const LIMIT_PARAMS *params);
+        bool pace_limits(uint32_t periodUs);
+        bool get_limit_params(LIMIT_PARAMS *params);
+        void enable_limit_indicators(void);
+        void get_limit_stats(LIMIT_STATS *stats);
+        void get_limit_stops(LIMIT_STOPS stops[CARRIERCNT]);
         void ASIC_limit(void *pvParameters);
         void ASIC_limit_indicators(void *pvParameters);
     #endif
@@ -1,11 +1,13 @@
 /*************************************************************************
  *  Challenge_1_Firmware:   PCL6046_maint.c
  *                          Handles periodic register access of PCL6046,
- *                          as specified in challenge description.  It should
- *                          be populated with polling for ASIC interrupts, etc.
- *                          Currently, it's just reading the main status registers,
- *                          which can then be read from external functions
- *                          with the getter routine provided.
+ *                          as specified in challenge description.  ASIC
+ *                          interrupts are dispatched by PCL6046_event.c, not
+ *                          polled here.  It's the acquisition stage:  each
+ *                          period it reads the requested status words and
+ *                          registers of every carrier, on all chips at once,
+ *                          and publishes them as one snapshot, which other
+ *                          tasks read without going to the bus.
  *
  *  Engineer:               Larry Pelton
  *
@@ -14,24 +16,321 @@
 
 #include	<stdint.h>
 #include	<stdbool.h>
+#include	<string.h>
+
+#include	"FreeRTOS.h"
+#include	"task.h"
 
 #include	"PCL6046.h"
 #include    "PCL6046_maint.h"
+#include    "PCL6046_comm.h"
+#include    "PCL6046_telem.h"
+
+/*************************************************************************
+ *  @brief:     get_snapshot
+ *              Copies the latest complete acquisition.  It never goes to
+ *              the bus and never waits on the acquisition; a copy that
+ *              was overtaken by a newer acquisition is simply retried.
+ *  @param[out] snap receives the snapshot
+ *  @returns    none
+ ************************************************************************/
+void get_snapshot(PCL6046_SNAPSHOT *snap)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = snapshotSeq;
+        COMPILER_BARRIER();
+
+        *snap = snapshot[seq & 1];
+
+        COMPILER_BARRIER();
+
+    } while (seq != snapshotSeq);
+}
 
 /*************************************************************************
  *  @brief:     get_axial_status
- *              Get method for status of PCL6046 on a selected axis
- *  @param[in]  axis identifies X, Y, Z, or U axis
+ *              Get method for status of PCL6046 on a selected carrier
+ *  @param[in]  carrier is the carrier number, chip * AXISCNT + axis
  *  @returns    the 16-bit status register value
  ************************************************************************/
-uint16_t get_axial_status(MOTION_AXIS axis)
+uint16_t get_axial_status(uint8_t carrier)
+{
+    PCL6046_SNAPSHOT snap;
+
+    get_snapshot(&snap);
+
+    return (snap.mstatus[carrier]);
+}
+
+/*************************************************************************
+ *  @brief:     acquire_items
+ *              Adds items to the set read by every acquisition; the next
+ *              snapshot includes them.
+ *  @param[in]  items are ACQ_xxx bits
+ *  @returns    none
+ ************************************************************************/
+void acquire_items(uint32_t items)
+{
+    taskENTER_CRITICAL();
+    acqItems |= items;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      acquire
+ *              Reads the requested items of all carriers into the snapshot
+ *              buffer that readers aren't using, then publishes it.  Each
+ *              register is one multi-axis command, and all of a chip's are
+ *              one acquisition transaction, so each chip's part is coherent;
+ *              the chips are read concurrently.
+ *  @returns    none
+ ************************************************************************/
+static void acquire(void)
+{
+    uint32_t seq = snapshotSeq;
+    PCL6046_SNAPSHOT *snap = &snapshot[(seq + 1) & 1];
+    const PCL6046_SNAPSHOT *previous = &snapshot[seq & 1];
+    TaskHandle_t watcher = statusWatcher;
+    uint32_t items = acqItems;
+    uint8_t count = 0;
+    uint8_t op;
+    uint8_t counter;
+    uint8_t carrier;
+    uint8_t chip;
+
+    //  the latch goes first, so that the status words are as close to it as
+    //  possible; the latch must only follow the LTCH command, which costs no
+    //  bus traffic once RENV5 is in the shadow
+    if (items & ACQ_LATCH)
+    {
+        acqOps[count++] = (BUS_OP) {OP_MODIFY, (uint8_t) RENV5, 0x0F, FIELD_MASK(RENV5, LTOF), {FIELD_MASK(RENV5, LTOF), FIELD_MASK(RENV5, LTOF), FIELD_MASK(RENV5, LTOF), FIELD_MASK(RENV5, LTOF)}};
+        acqOps[count++] = (BUS_OP) {OP_COMMAND, (uint8_t) LTCH, 0x0F, 0, {0}};
+    }
+
+    //  the operations, in ACQ_xxx bit order
+    if (items & ACQ_MSTSW)
+    {
+        acqOps[count++] = (BUS_OP) {OP_MSTSW, 0, 0x0F, 0, {0}};
+    }
+
+    if (items & ACQ_SSTSW)
+    {
+        acqOps[count++] = (BUS_OP) {OP_SSTSW, 0, 0x0F, 0, {0}};
+    }
+
+    if (items & ACQ_RSTS)
+    {
+        acqOps[count++] = (BUS_OP) {OP_READ, (uint8_t) RSTS, 0x0F, 0, {0}};
+    }
+
+    for (counter = 0; counter < 4; counter++)
+    {
+        if (items & (ACQ_RCUN1 << counter))
+        {
+            acqOps[count++] = (BUS_OP) {OP_READ, (uint8_t) (((items & ACQ_LATCH) ? RLTC1 : RCUN1) + counter), 0x0F, 0, {0}};
+        }
+    }
+
+    if (items & ACQ_PSPD)
+    {
+        acqOps[count++] = (BUS_OP) {OP_READ, (uint8_t) PSPD, 0x0F, 0, {0}};
+    }
+
+    //  every chip gets the same operations
+    for (chip = 1; chip < PCL6046_CHIPS; chip++)
+    {
+        memcpy(&acqOps[chip * count], acqOps, count * sizeof(BUS_OP));
+    }
+
+    snap->sampled = (uint32_t) TIMESTAMP();
+    bus_transact_all(BUS_ACQUISITION, acqOps, count);
+
+    snap->stamp = (uint32_t) TIMESTAMP();
+    snap->tick = xTaskGetTickCount();
+
+    //  unpack the results of each chip in the same order
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        const BUS_OP *results = &acqOps[chip * count];
+        uint8_t first = chip * AXISCNT;
+
+        op = (items & ACQ_LATCH) ? 2 : 0;
+
+        if (items & ACQ_MSTSW)
+        {
+            for (counter = AXIS_X; counter < AXISCNT; counter++)
+            {
+                snap->mstatus[first + counter] = (uint16_t) results[op].values[counter];
+            }
+
+            op++;
+        }
+
+        if (items & ACQ_SSTSW)
+        {
+            for (counter = AXIS_X; counter < AXISCNT; counter++)
+            {
+                snap->sstatus[first + counter] = (uint16_t) results[op].values[counter];
+            }
+
+            op++;
+        }
+
+        if (items & ACQ_RSTS)
+        {
+            memcpy(&snap->rsts[first], results[op++].values, AXISCNT * sizeof(uint32_t));
+        }
+
+        for (counter = 0; counter < 4; counter++)
+        {
+            if (items & (ACQ_RCUN1 << counter))
+            {
+                memcpy(&snap->counter[counter][first], results[op++].values, AXISCNT * sizeof(uint32_t));
+            }
+        }
+
+        if (items & ACQ_PSPD)
+        {
+            memcpy(&snap->speed[first], results[op++].values, AXISCNT * sizeof(uint32_t));
+        }
+    }
+
+    snap->items = items;
+    snap->sequence = seq + 1;
+
+    //  the buffer must be complete before readers are pointed at it
+    COMPILER_BARRIER();
+    snapshotSeq = seq + 1;
+
+    //  the previous snapshot is still in the other buffer, so a change in
+    //  the watched status bits is seen by the first acquisition after it
+    if ((watcher != (TaskHandle_t) NULL) && (items & ACQ_MSTSW))
+    {
+        for (carrier = 0; carrier < CARRIERCNT; carrier++)
+        {
+            if ((seq == 0) || ((previous->items & ACQ_MSTSW) == 0) || ((snap->mstatus[carrier] ^ previous->mstatus[carrier]) & statusWatchMask))
+            {
+                (void) xTaskNotify(watcher, statusWatcherBits, eSetBits);
+                break;
+            }
+        }
+    }
+
+    telemetry_sample(snap);
+}
+
+/*************************************************************************
+ *  @brief:     request_acquisition
+ *              Has ASIC_maintenance acquire now rather than at the end of
+ *              its period; the periodic acquisitions keep their schedule.
+ *              Only one task can wait at a time; a second request replaces
+ *              the first.
+ *  @param[in]  waiter is notified, by setting notifyBits in its notification
+ *              value, once an acquisition that started after the request has
+ *              been published; NULL if no one waits
+ *  @param[in]  notifyBits are the bits to set
+ *  @returns    none
+ ************************************************************************/
+void request_acquisition(TaskHandle_t waiter, uint32_t notifyBits)
 {
-    return (PCL6046_mstatus[axis]);
+    taskENTER_CRITICAL();
+    acqWaiter = waiter;
+    acqWaiterBits = notifyBits;
+    taskEXIT_CRITICAL();
+
+    //  an external pacer answers at its next acquisition
+    if ((maintTask != (TaskHandle_t) NULL) && !acqExternal)
+    {
+        (void) xTaskNotifyGive(maintTask);
+    }
+}
+
+/*************************************************************************
+ *  @brief:     watch_status
+ *              Has every acquisition that finds any of some MSTSW bits of
+ *              any carrier changed since the previous one notify a task.
+ *              Only one task can watch at a time; a second call replaces
+ *              the first.
+ *  @param[in]  watcher is notified by setting notifyBits in its
+ *              notification value; NULL to stop watching
+ *  @param[in]  notifyBits are the bits to set
+ *  @param[in]  mask selects the MSTSW bits watched
+ *  @returns    none
+ ************************************************************************/
+void watch_status(TaskHandle_t watcher, uint32_t notifyBits, uint16_t mask)
+{
+    acquire_items(ACQ_MSTSW);
+
+    taskENTER_CRITICAL();
+    statusWatcherBits = notifyBits;
+    statusWatchMask = mask;
+    statusWatcher = watcher;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief:     run_acquisition
+ *              Acquires and publishes a snapshot, and answers a waiting
+ *              request_acquisition().  It's called by ASIC_maintenance, or
+ *              by the task pacing the acquisitions (see pace_acquisition()).
+ *  @returns    none
+ ************************************************************************/
+void run_acquisition(void)
+{
+    TaskHandle_t waiter;
+    uint32_t waiterBits;
+
+    //  a waiter is answered by the first acquisition that starts after its
+    //  request; one made while this one runs waits for the next
+    taskENTER_CRITICAL();
+    waiter = acqWaiter;
+    waiterBits = acqWaiterBits;
+    acqWaiter = (TaskHandle_t) NULL;
+    taskEXIT_CRITICAL();
+
+    acquire();
+
+    if (waiter != (TaskHandle_t) NULL)
+    {
+        (void) xTaskNotify(waiter, waiterBits, eSetBits);
+    }
+}
+
+/*************************************************************************
+ *  @brief:     pace_acquisition
+ *              Hands the acquisitions over to another task, which then calls
+ *              run_acquisition() at its own rate, or takes them back.  The
+ *              snapshot has one writer at a time, so handing over waits for
+ *              an acquisition ASIC_maintenance has under way.
+ *  @param[in]  external is true to stop ASIC_maintenance acquiring
+ *  @returns    none
+ ************************************************************************/
+void pace_acquisition(bool external)
+{
+    taskENTER_CRITICAL();
+    acqExternal = external;
+    taskEXIT_CRITICAL();
+
+    while (external && acqBusy)
+    {
+        vTaskDelay(1);
+    }
+
+    if (!external && (maintTask != (TaskHandle_t) NULL))
+    {
+        (void) xTaskNotifyGive(maintTask);
+    }
 }
 
 /*************************************************************************
  *  @brief      ASIC_maintenance
- *              This RTOS task handles periodic maintenance of the PCL6046 interface.
+ *              This RTOS task handles periodic maintenance of the PCL6046 interface,
+ *              acquiring a snapshot of the ASIC each period, and in between
+ *              whenever request_acquisition() asks for one, unless another
+ *              task paces the acquisitions.
  *              The period of execution is set via ASIC_MAINT_PERIOD and
  *              is measured in milliseconds.
  *  @param[in]  pvParameters is ignored, currently
@@ -42,23 +341,35 @@ void ASIC_maintenance(void *pvParameters)
     if (init_PCL6046_resources() == true)
     {
         TickType_t lastTimeHere = xTaskGetTickCount();
+        TickType_t wait;
+
+        maintTask = xTaskGetCurrentTaskHandle();
 
         while (1)
         {
-            //  reserve the ASIC comm interface if possible; if not, don't block;
-            //  try again later instead
-            if (xSemaphoreTake(PCL6046_mutex, 0) ==  pdTRUE)
+            //  the acquisitions may have been handed to another task
+            taskENTER_CRITICAL();
+            acqBusy = !acqExternal;
+            taskEXIT_CRITICAL();
+
+            if (acqBusy)
             {
-                //  read the main status registers
-                PCL6046_mstatus[AXIS_X] = X_axis->MSTSWr_COMWw;
-                PCL6046_mstatus[AXIS_Y] = Y_axis->MSTSWr_COMWw;
-                PCL6046_mstatus[AXIS_Z] = Z_axis->MSTSWr_COMWw;
-                PCL6046_mstatus[AXIS_U] = U_axis->MSTSWr_COMWw;
+                run_acquisition();
+                acqBusy = false;
+            }
 
-                xSemaphoreGive(PCL6046_mutex);
+            //  sleep out the period, unless an acquisition is requested sooner
+            wait = (TickType_t) ((lastTimeHere + ASIC_MAINT_PERIOD) - xTaskGetTickCount());
+
+            if (wait > ASIC_MAINT_PERIOD)
+            {
+                wait = 0;
             }
 
-            vTaskDelayUntil(&lastTimeHere, (const TickType_t) ASIC_MAINT_PERIOD);
+            if (ulTaskNotifyTake(pdTRUE, wait) == 0)
+            {
+                lastTimeHere += ASIC_MAINT_PERIOD;
+            }
         }
     }
 
@@ -7,16 +7,92 @@
 #ifndef         PCL6046_MAINT_H
     #define     PCL6046_MAINT_H
 
-    #define     ASIC_MAINT_PERIOD   10    
+    #define     ASIC_MAINT_PERIOD   10
+
+    //  items the acquisition stage can read; each register item costs one
+    //  multi-axis read per chip, the status words one read per axis
+    #define     ACQ_MSTSW           0x0001
+    #define     ACQ_SSTSW           0x0002
+    #define     ACQ_RSTS            0x0004
+    #define     ACQ_RCUN1           0x0008
+    #define     ACQ_RCUN2           0x0010
+    #define     ACQ_RCUN3           0x0020
+    #define     ACQ_RCUN4           0x0040
+    #define     ACQ_PSPD            0x0080
+
+    //  not an item, an option:  the counters are latched on all axes of a
+    //  chip with one LTCH command and read from RLTC1..RLTC4, so each chip's
+    //  counters are a single sample instead of one per read
+    #define     ACQ_LATCH           0x0100
+
+    //  the main status words are always acquired, for get_axial_status()
+    #define     ACQ_DEFAULT         ACQ_MSTSW
+
+    //  one view of all the chips, indexed by carrier; each chip's items are
+    //  read in a single bus transaction, and the chips are read at the same
+    //  time; only the items flagged in "items" are current
+    typedef struct
+    {
+        uint32_t    sequence;               //  acquisition count
+        uint32_t    sampled;                //  TIMESTAMP() no later than the sample was taken
+        uint32_t    stamp;                  //  TIMESTAMP() when the reads completed
+        TickType_t  tick;                   //  RTOS tick when the reads completed
+        uint32_t    items;                  //  ACQ_xxx bits acquired
+        uint16_t    mstatus[CARRIERCNT];    //  MSTSW
+        uint16_t    sstatus[CARRIERCNT];    //  SSTSW
+        uint32_t    rsts[CARRIERCNT];       //  extension status
+        uint32_t    counter[4][CARRIERCNT]; //  COUNTER1..COUNTER4
+        uint32_t    speed[CARRIERCNT];      //  current speed step (PSPD)
+
+    }   PCL6046_SNAPSHOT;
+
+    //  most operations an acquisition makes per chip
+    #define     ACQ_OPS             10
+
+    //  ASIC_maintenance's stack:  acquire()'s bus operations are static, so
+    //  only its scalars and telemetry_sample()'s are left
+    #define     MAINT_STACK_SIZE    TASK_STACK_SIZE(32 * sizeof(uint32_t))
 
     #ifdef      PCL6046_MAINT_C
 
-        //  PCL6046 main status register
-        static uint16_t    PCL6046_mstatus[AXISCNT];
+        //  double-buffered snapshot; snapshotSeq selects the buffer readers
+        //  may copy, and the acquisition writes the other one before
+        //  advancing it, so a reader never waits on the writer
+        static PCL6046_SNAPSHOT     snapshot[2];
+        static volatile uint32_t    snapshotSeq = 0;
+
+        //  ACQ_xxx items requested by the users of the snapshot
+        static volatile uint32_t    acqItems = ACQ_DEFAULT;
+
+        //  the acquisition task, and the task waiting on an early acquisition
+        //  (see request_acquisition()) with the bits it's notified with
+        static TaskHandle_t         maintTask = (TaskHandle_t) NULL;
+        static TaskHandle_t         acqWaiter = (TaskHandle_t) NULL;
+        static uint32_t             acqWaiterBits;
+
+        //  the task told of changes in the watched MSTSW bits (see
+        //  watch_status()), and the bits it's notified with
+        static TaskHandle_t         statusWatcher = (TaskHandle_t) NULL;
+        static uint32_t             statusWatcherBits;
+        static uint16_t             statusWatchMask;
+
+        //  set while another task paces the acquisitions, and while
+        //  ASIC_maintenance has one under way
+        static volatile bool        acqExternal = false;
+        static volatile bool        acqBusy = false;
+
+        //  acquire()'s bus operations; the snapshot has one writer at a
+        //  time, so they're never shared
+        static BUS_OP               acqOps[PCL6046_CHIPS * ACQ_OPS];
 
     #else
-        uint16_t get_axial_status(MOTION_AXIS axis);
+        uint16_t get_axial_status(uint8_t carrier);
+        void get_snapshot(PCL6046_SNAPSHOT *snap);
+        void acquire_items(uint32_t items);
+        void request_acquisition(TaskHandle_t waiter, uint32_t notifyBits);
+        void watch_status(TaskHandle_t watcher, uint32_t notifyBits, uint16_t mask);
+        void run_acquisition(void);
+        void pace_acquisition(bool external);
         void ASIC_maintenance(void *pvParameters);
     #endif
 #endif
-
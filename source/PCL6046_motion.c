@@ -0,0 +1,284 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_motion.c
+ *                          Per-axis motion queues, streamed through the
+ *                          PCL6046 pre-registers.  The ASIC holds a running
+ *                          operation plus two determined ones (section 6.2 of
+ *                          the PCL6046 user manual) and starts the next one
+ *                          itself when the current one completes, so queued
+ *                          segments chain with no idle time between them as
+ *                          long as the pre-registers are refilled before they
+ *                          run dry.  Refills are driven by the pre-register
+ *                          events, not polled.  The queues drive the axes of
+ *                          the first chip, as the events come from its INT pin.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_MOTION_C
+
+#include    <stdint.h>
+#include    <stdbool.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+#include    "queue.h"
+#include    "event_groups.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_event.h"
+#include    "PCL6046_motion.h"
+
+/*************************************************************************
+ *  @brief      load_segment
+ *              Builds the bus operations that hand one segment to the ASIC:
+ *              the pre-registers that differ from what was last written,
+ *              then the start command that determines them.
+ *  @param[in]  axis identifies X, Y, Z, or U axis
+ *  @param[in]  segment is the segment to load
+ *  @param[out] ops receives up to 5 operations
+ *  @returns    the number of operations built
+ ************************************************************************/
+static uint8_t load_segment(MOTION_AXIS axis, const MOTION_SEGMENT *segment, BUS_OP *ops)
+{
+    uint8_t mask = (uint8_t) (1 << axis);
+    bool all = !loadedValid[axis];
+    uint8_t count = 0;
+
+    if (all || (segment->distance != loaded[axis].distance))
+    {
+        ops[count] = (BUS_OP) {OP_WRITE, (uint8_t) PRMV, mask, 0, {0}};
+        ops[count++].values[axis] = segment->distance;
+    }
+
+    if (all || (segment->high != loaded[axis].high))
+    {
+        ops[count] = (BUS_OP) {OP_WRITE, (uint8_t) PRFH, mask, 0, {0}};
+        ops[count++].values[axis] = segment->high;
+    }
+
+    if (all || (segment->rate != loaded[axis].rate))
+    {
+        ops[count] = (BUS_OP) {OP_WRITE, (uint8_t) PRUR, mask, 0, {0}};
+        ops[count++].values[axis] = segment->rate;
+    }
+
+    if (all || (segment->mode != loaded[axis].mode))
+    {
+        ops[count] = (BUS_OP) {OP_WRITE, (uint8_t) PRMD, mask, 0, {0}};
+        ops[count++].values[axis] = segment->mode;
+    }
+
+    ops[count++] = (BUS_OP) {OP_COMMAND, (uint8_t) segment->start, mask, 0, {0}};
+
+    loaded[axis] = *segment;
+    loadedValid[axis] = true;
+
+    return (count);
+}
+
+/*************************************************************************
+ *  @brief      refill_axis
+ *              Hands queued segments to the ASIC until its pre-registers
+ *              are full or the queue is empty, all in one bus transaction.
+ *  @param[in]  axis identifies X, Y, Z, or U axis
+ *  @returns    none
+ ************************************************************************/
+static void refill_axis(MOTION_AXIS axis)
+{
+    uint8_t mask = (uint8_t) (1 << axis);
+    BUS_OP status = {OP_READ, (uint8_t) RSTS, mask, 0, {0}};
+    MOTION_SEGMENT segment;
+    uint8_t count = 0;
+    uint8_t slots;
+
+    //  RSTS.PFM counts the determined operations; it can only go down
+    //  before the writes below reach the ASIC, which just leaves a slot unused
+    bus_transact(0, BUS_CONFIG, &status, 1);
+    slots = (uint8_t) (3 - FIELD_GET(RSTS, PFM, status.values[axis]));
+
+    if (slots == 3)
+    {
+        //  the ASIC has run dry; if segments were waiting, there was a gap
+        if ((streaming & mask) && (uxQueueMessagesWaiting(motionQueue[axis]) != 0))
+        {
+            motionStats[axis].underruns++;
+        }
+
+        //  while it was idle, anything may have been written through the 2nd
+        //  pre-registers
+        streaming &= (uint8_t) ~mask;
+        loadedValid[axis] = false;
+    }
+
+    while ((slots-- > 0) && (xQueueReceive(motionQueue[axis], &segment, 0) == pdPASS))
+    {
+        count += load_segment(axis, &segment, &motionOps[count]);
+        motionStats[axis].started++;
+    }
+
+    if (count != 0)
+    {
+        bus_transact(0, BUS_CONFIG, motionOps, count);
+        motionStats[axis].refills++;
+        streaming |= mask;
+    }
+}
+
+/*************************************************************************
+ *  @brief      ASIC_motion
+ *              This RTOS task streams the motion queues into the
+ *              pre-registers.  It is woken by queue_motion() and by the
+ *              operation end and pre-register events of every axis.
+ *  @param[in]  pvParameters is ignored, currently
+ *  @returns    none
+ ************************************************************************/
+void ASIC_motion(void *pvParameters)
+{
+    bool success = true;
+    uint32_t axes;
+    MOTION_AXIS axis;
+
+    motionTask = xTaskGetCurrentTaskHandle();
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        if ((motionQueue[axis] = xQueueCreate(MOTION_QUEUE_DEPTH, sizeof(MOTION_SEGMENT))) == NULL)
+        {
+            success = false;
+        }
+    }
+
+    if (success)
+    {
+        //  interrupt when a queued operation starts and when the 2nd
+        //  pre-register becomes writable again
+        enable_axis_events(0x0F, FIELD_MASK(RIRQ, IRN) | FIELD_MASK(RIRQ, IRNM));
+        listen_axis_events(motionTask, PCL6046_EVT_END | PCL6046_EVT_PREREG);
+
+        while (1)
+        {
+            (void) xTaskNotifyWait(0, 0xFFFFFFFF, &axes, portMAX_DELAY);
+
+            //  cancels first, so that segments queued after the cancel are
+            //  handed over after PRECAN
+            for (axis = AXIS_X; axis < AXISCNT; axis++)
+            {
+                if (axes & (1UL << (axis + MOTION_CANCEL_SHIFT)))
+                {
+                    BUS_OP cancel = {OP_COMMAND, (uint8_t) PRECAN, (uint8_t) (1 << axis), 0, {0}};
+
+                    bus_transact(0, BUS_SAFETY, &cancel, 1);
+                    streaming &= (uint8_t) ~(1 << axis);
+                    axes |= (1UL << axis);
+                }
+            }
+
+            for (axis = AXIS_X; axis < AXISCNT; axis++)
+            {
+                if (axes & (1UL << axis))
+                {
+                    refill_axis(axis);
+                }
+            }
+        }
+    }
+
+    //  we should never get here
+    vTaskDelete(NULL);
+}
+
+/*************************************************************************
+ *  @brief      queue_motion
+ *              Appends a segment to the motion queue of an axis.  RMD.METM
+ *              is cleared, as continuous operation requires.
+ *  @param[in]  axis identifies X, Y, Z, or U axis
+ *  @param[in]  segment is the segment; it's copied
+ *  @param[in]  timeout is the maximum wait for room, in RTOS ticks
+ *  @returns    true, if the segment was queued; false, if its start isn't
+ *              STAFL, STAFH, STAD or STAUD, or there was no room
+ ************************************************************************/
+bool queue_motion(MOTION_AXIS axis, const MOTION_SEGMENT *segment, TickType_t timeout)
+{
+    MOTION_SEGMENT entry = *segment;
+
+    if ((axis >= AXISCNT) || (motionQueue[axis] == (QueueHandle_t) NULL))
+    {
+        return (false);
+    }
+
+    //  the start goes to COMW as it is, so nothing but a start is taken
+    if ((entry.start < STAFL) || (entry.start > STAUD))
+    {
+        taskENTER_CRITICAL();
+        motionStats[axis].refused++;
+        taskEXIT_CRITICAL();
+
+        return (false);
+    }
+
+    //  METM must be 0 for an operation to start automatically from the
+    //  pre-registers, section 6.2
+    entry.mode &= ~FIELD_MASK(RMD, METM);
+
+    if (xQueueSend(motionQueue[axis], &entry, timeout) != pdPASS)
+    {
+        return (false);
+    }
+
+    taskENTER_CRITICAL();
+    motionStats[axis].queued++;
+    taskEXIT_CRITICAL();
+
+    (void) xTaskNotify(motionTask, (1UL << axis), eSetBits);
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      cancel_motion
+ *              Discards the segments of an axis that haven't started: the
+ *              software queue is emptied at once, and the determined
+ *              pre-registers are cancelled with PRECAN.  The operation in
+ *              progress isn't stopped; that takes a stop command.
+ *  @param[in]  axis identifies X, Y, Z, or U axis
+ *  @returns    none
+ ************************************************************************/
+void cancel_motion(MOTION_AXIS axis)
+{
+    if ((axis < AXISCNT) && (motionQueue[axis] != (QueueHandle_t) NULL))
+    {
+        (void) xQueueReset(motionQueue[axis]);
+        (void) xTaskNotify(motionTask, (1UL << (axis + MOTION_CANCEL_SHIFT)), eSetBits);
+    }
+}
+
+/*************************************************************************
+ *  @brief      motion_pending
+ *              Get method for the number of segments of an axis still in
+ *              the software queue
+ *  @param[in]  axis identifies X, Y, Z, or U axis
+ *  @returns    the segment count
+ ************************************************************************/
+uint32_t motion_pending(MOTION_AXIS axis)
+{
+    if ((axis >= AXISCNT) || (motionQueue[axis] == (QueueHandle_t) NULL))
+    {
+        return (0);
+    }
+
+    return ((uint32_t) uxQueueMessagesWaiting(motionQueue[axis]));
+}
+
+/*************************************************************************
+ *  @brief      get_motion_stats
+ *              Get method for the streaming counters of an axis
+ *  @param[in]  axis identifies X, Y, Z, or U axis
+ *  @param[out] stats receives a copy of the counters
+ *  @returns    none
+ ************************************************************************/
+void get_motion_stats(MOTION_AXIS axis, MOTION_STATS *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = motionStats[axis];
+    taskEXIT_CRITICAL();
+}
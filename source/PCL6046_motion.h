@@ -0,0 +1,77 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_motion.h
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_MOTION_H
+    #define PCL6046_MOTION_H
+
+    //  segments each axis can have waiting in software, beyond the 3 the
+    //  ASIC holds (current register, 1st and 2nd pre-register)
+    #define MOTION_QUEUE_DEPTH      16
+
+
+    //  one queued operation:  the values loaded into the pre-registers and the
+    //  start command that determines them
+    typedef struct
+    {
+        uint32_t    distance;           //  PRMV, feed amount or target position
+        uint32_t    high;               //  PRFH, FH speed step
+        uint32_t    rate;               //  PRUR, acceleration rate
+        uint32_t    mode;               //  PRMD, operation mode
+        ASIC_CMD    start;              //  STAFL, STAFH, STAD or STAUD
+
+    }   MOTION_SEGMENT;
+
+    //  per-axis streaming counters
+    typedef struct
+    {
+        uint32_t    queued;             //  segments accepted by queue_motion()
+        uint32_t    started;            //  segments handed to the ASIC
+        uint32_t    refills;            //  passes that handed over at least one
+        uint32_t    underruns;          //  times the ASIC ran dry with segments waiting
+        uint32_t    refused;            //  segments without a start command, STAFL to STAUD
+
+    }   MOTION_STATS;
+
+    //  most bus operations a refill makes:  three segments of up to five
+    #define MOTION_OPS              (3 * 5)
+
+    //  ASIC_motion's stack:  the segment being loaded, the status read, and
+    //  the scalars on the way down; the refill's operations are static
+    #define MOTION_STACK_SIZE       TASK_STACK_SIZE(sizeof(MOTION_SEGMENT) + sizeof(BUS_OP) + (32 * sizeof(uint32_t)))
+
+    #ifdef  PCL6046_MOTION_C
+
+        //  software FIFO of each axis, drained into the pre-registers by
+        //  ASIC_motion
+        static QueueHandle_t    motionQueue[AXISCNT] = {NULL, NULL, NULL, NULL};
+        static TaskHandle_t     motionTask = (TaskHandle_t) NULL;
+
+        //  notification bits for ASIC_motion:  bits 0..3 refill an axis (they
+        //  match the event listener's), bits 4..7 cancel one
+        #define MOTION_CANCEL_SHIFT     4
+
+        //  the values last written to the 2nd pre-registers of each axis, so
+        //  unchanged ones can be left out (section 6.2); only trusted while
+        //  the axis streams, since other writes to RMV etc. pass through them
+        static MOTION_SEGMENT   loaded[AXISCNT];
+        static bool             loadedValid[AXISCNT];
+
+        //  axes that have had a segment started and haven't run dry yet
+        static uint8_t          streaming = 0;
+
+        static MOTION_STATS     motionStats[AXISCNT];
+
+        //  only ASIC_motion refills, so this is never shared
+        static BUS_OP           motionOps[MOTION_OPS];
+
+    #else
+        bool queue_motion(MOTION_AXIS axis, const MOTION_SEGMENT *segment, TickType_t timeout);
+        void cancel_motion(MOTION_AXIS axis);
+        uint32_t motion_pending(MOTION_AXIS axis);
+        void get_motion_stats(MOTION_AXIS axis, MOTION_STATS *stats);
+        void ASIC_motion(void *pvParameters);
+    #endif
+#endif
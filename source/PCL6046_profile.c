@@ -0,0 +1,424 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_profile.c
+ *                          Speed profiles:  compiles a move's speeds,
+ *                          acceleration and jerk in physical units into the
+ *                          RFL, RFH, RUR, RDR, RMG, RUS, RDS and RMD.MSMD of
+ *                          an axis, and predicts from those registers how
+ *                          long a move takes and how far an axis needs to
+ *                          stop, per sections 5.4.1.3 to 5.4.1.5 of the
+ *                          PCL6046 user manual.  All of it is integer
+ *                          arithmetic, so the limits and the scheduler can
+ *                          use it on the control path.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_PROFILE_C
+
+#include    <stdint.h>
+#include    <stdbool.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_profile.h"
+
+
+/*************************************************************************
+ *  @brief      to_pulses
+ *              Converts micrometres (or um/s, ...) to pulses, rounded.
+ *  @param[in]  value is the length, speed, acceleration or jerk
+ *  @param[in]  resolution is in pulses per metre
+ *  @returns    the value in pulses (pps, ...)
+ ************************************************************************/
+static uint32_t to_pulses(uint32_t value, uint32_t resolution)
+{
+    return ((uint32_t) ((((uint64_t) value * resolution) + 500000ULL) / 1000000ULL));
+}
+
+/*************************************************************************
+ *  @brief      isqrt
+ *              Integer square root, rounded down.
+ *  @param[in]  value is the radicand
+ *  @returns    the root
+ ************************************************************************/
+static uint32_t isqrt(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+
+    while (bit != 0)
+    {
+        if (value >= (root + bit))
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+
+        bit >>= 2;
+    }
+
+    return ((uint32_t) root);
+}
+
+/*************************************************************************
+ *  @brief      compile_ramp
+ *              The rate and S-curve section registers of one ramp.  With
+ *              jerk, the acceleration builds up over the section (the speed
+ *              gained while it does, rate^2 / (2 * jerk)) and stays at the
+ *              rate in between; a ramp too short for that is a pure S-curve
+ *              (section 0) that peaks at sqrt(delta * jerk).  The rate is
+ *              rounded down, so it's never exceeded.
+ *  @param[in]  rate is the acceleration, in pps/s
+ *  @param[in]  jerk is in pps/s^3, or 0 for a linear ramp
+ *  @param[in]  delta is the ramp's speed change, FH - FL, in steps
+ *  @param[in]  ppsPerStep is the magnification
+ *  @param[out] rateReg receives RUR or RDR
+ *  @param[out] section receives RUS or RDS
+ *  @returns    true, if the registers can express the ramp
+ ************************************************************************/
+static bool compile_ramp(uint32_t rate, uint32_t jerk, uint32_t delta, uint32_t ppsPerStep, uint32_t *rateReg, uint32_t *section)
+{
+    uint64_t steps;
+    uint64_t clocks;
+
+    *section = 0;
+
+    if (jerk != 0)
+    {
+        steps = ((uint64_t) rate * rate) / (2ULL * jerk * ppsPerStep);
+
+        if ((2 * steps) >= delta)
+        {
+            rate = isqrt((uint64_t) delta * ppsPerStep * jerk);
+        }
+        else
+        {
+            //  0 would mean a pure S-curve
+            *section = (steps != 0) ? (uint32_t) steps : 1;
+        }
+    }
+
+    if (rate == 0)
+    {
+        return (false);
+    }
+
+    //  RUR + 1 = CLK / (4 * steps per second)
+    clocks = (((uint64_t) PCL6046_CLK_HZ * ppsPerStep) + (4ULL * rate) - 1) / (4ULL * rate);
+
+    if ((clocks == 0) || (clocks > 65536))
+    {
+        return (false);
+    }
+
+    *rateReg = FIELD_SET(RUR, UR, clocks - 1);
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      ramp_span
+ *              How many linear steps' time a ramp takes:  the speed change
+ *              for a linear ramp, plus twice the S-curve section; a pure
+ *              S-curve takes twice as long as a linear ramp.
+ *  @param[in]  profile is the axis's profile
+ *  @param[in]  down selects the deceleration, RDS
+ *  @param[in]  delta is the speed change, in steps
+ *  @returns    the span, in steps
+ ************************************************************************/
+static uint32_t ramp_span(const uint32_t profile[PROFILE_REGS], bool down, uint32_t delta)
+{
+    uint32_t section = down ? FIELD_GET(RDS, DS, profile[PROFILE_RDS]) : FIELD_GET(RUS, US, profile[PROFILE_RUS]);
+
+    if ((profile[PROFILE_RMD] & FIELD_MASK(RMD, MSMD)) == 0)
+    {
+        return (delta);
+    }
+
+    if ((section == 0) || ((2 * section) > delta))
+    {
+        return (2 * delta);
+    }
+
+    return (delta + (2 * section));
+}
+
+/*************************************************************************
+ *  @brief      ramp_clocks
+ *              CLK cycles per speed step of a linear ramp, 4 * (RUR + 1);
+ *              RDR = 0 means RUR is used for deceleration.
+ *  @param[in]  profile is the axis's profile
+ *  @param[in]  down selects the deceleration
+ *  @returns    the cycles
+ ************************************************************************/
+static uint32_t ramp_clocks(const uint32_t profile[PROFILE_REGS], bool down)
+{
+    uint32_t rate = FIELD_GET(RUR, UR, profile[PROFILE_RUR]);
+
+    if (down && (FIELD_GET(RDR, DR, profile[PROFILE_RDR]) != 0))
+    {
+        rate = FIELD_GET(RDR, DR, profile[PROFILE_RDR]);
+    }
+
+    return (4 * (rate + 1));
+}
+
+/*************************************************************************
+ *  @brief      ramp_distance
+ *              Pulses output by a ramp between two speed steps:  its
+ *              average speed, which an S-curve shares with a linear ramp,
+ *              times its time.
+ *  @param[in]  profile is the axis's profile
+ *  @param[in]  down selects the deceleration
+ *  @param[in]  low is the lower speed step
+ *  @param[in]  high is the higher one
+ *  @returns    the pulses, rounded down
+ ************************************************************************/
+static uint32_t ramp_distance(const uint32_t profile[PROFILE_REGS], bool down, uint32_t low, uint32_t high)
+{
+    uint64_t steps = (uint64_t) (low + high) * ramp_span(profile, down, high - low) * ramp_clocks(profile, down);
+
+    return ((uint32_t) (steps / (((uint64_t) FIELD_GET(RMG, MG, profile[PROFILE_RMG]) + 1) * 131072ULL)));
+}
+
+/*************************************************************************
+ *  @brief      compile_profile
+ *              Compiles a profile for the ASIC.  RMG is the finest
+ *              magnification of profileMagnification[] that still reaches
+ *              FH in 16 bits, so speeds are whole steps; the ramps get
+ *              their rates and S-curve sections from compile_ramp().
+ *  @param[in]  spec is the profile, in physical units
+ *  @param[out] profile receives the registers, in PROFILE_xxx order; RMD
+ *              holds MSMD alone
+ *  @returns    true, if the registers can express the profile; false,
+ *              otherwise
+ ************************************************************************/
+bool compile_profile(const PROFILE_SPEC *spec, uint32_t profile[PROFILE_REGS])
+{
+    const PROFILE_MAGNIFICATION *mag = NULL;
+    uint32_t high = to_pulses(spec->speed, spec->resolution);
+    uint32_t low = to_pulses(spec->startSpeed, spec->resolution);
+    uint32_t accel = to_pulses(spec->accel, spec->resolution);
+    uint32_t decel = (spec->decel != 0) ? to_pulses(spec->decel, spec->resolution) : accel;
+    uint32_t jerk = to_pulses(spec->jerk, spec->resolution);
+    uint32_t rfl;
+    uint32_t rfh;
+    uint8_t n;
+
+    //  a jerk too small to count is the softest S-curve there is
+    if ((spec->jerk != 0) && (jerk == 0))
+    {
+        jerk = 1;
+    }
+
+    for (n = 0; n < PROFILE_MAGNIFICATIONS; n++)
+    {
+        if (((high + (profileMagnification[n].ppsPerStep / 2)) / profileMagnification[n].ppsPerStep) <= 0xFFFF)
+        {
+            mag = &profileMagnification[n];
+            break;
+        }
+    }
+
+    if (mag == NULL)
+    {
+        return (false);
+    }
+
+    rfh = (high + (mag->ppsPerStep / 2)) / mag->ppsPerStep;
+    rfl = (low + (mag->ppsPerStep / 2)) / mag->ppsPerStep;
+    rfl = (rfl != 0) ? rfl : 1;
+
+    if (rfl >= rfh)
+    {
+        return (false);
+    }
+
+    profile[PROFILE_RFL] = FIELD_SET(RFL, FL, rfl);
+    profile[PROFILE_RFH] = FIELD_SET(RFH, FH, rfh);
+    profile[PROFILE_RMG] = FIELD_SET(RMG, MG, mag->rmg);
+    profile[PROFILE_RMD] = (jerk != 0) ? FIELD_MASK(RMD, MSMD) : 0;
+
+    if (!compile_ramp(accel, jerk, rfh - rfl, mag->ppsPerStep, &profile[PROFILE_RUR], &profile[PROFILE_RUS]) ||
+        !compile_ramp(decel, jerk, rfh - rfl, mag->ppsPerStep, &profile[PROFILE_RDR], &profile[PROFILE_RDS]))
+    {
+        return (false);
+    }
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      load_profile
+ *              Writes a profile to carriers on any chips, as one
+ *              transaction per chip, the chips concurrently.  Only the MSMD
+ *              field of RMD is changed.
+ *  @param[in]  carriers has bit n set for carrier n
+ *  @param[in]  profile is the profile, from compile_profile()
+ *  @returns    none
+ ************************************************************************/
+void load_profile(uint32_t carriers, const uint32_t profile[PROFILE_REGS])
+{
+    uint8_t carrier;
+    uint8_t chip;
+    uint8_t reg;
+
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        for (reg = 0; reg < PROFILE_REGS; reg++)
+        {
+            profileOps[chip][reg] = (BUS_OP) {OP_WRITE, (uint8_t) PCL6046_profile_regs[reg], 0, 0, {0}};
+        }
+
+        profileOps[chip][PROFILE_RMD].kind = OP_MODIFY;
+        profileOps[chip][PROFILE_RMD].mask = FIELD_MASK(RMD, MSMD);
+    }
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        if (carriers & (1UL << carrier))
+        {
+            BUS_OP *chipOps = profileOps[CARRIER_CHIP(carrier)];
+            MOTION_AXIS axis = CARRIER_AXIS(carrier);
+
+            for (reg = 0; reg < PROFILE_REGS; reg++)
+            {
+                chipOps[reg].axis |= (uint8_t) (1 << axis);
+                chipOps[reg].values[axis] = profile[reg];
+            }
+        }
+    }
+
+    bus_transact_all(BUS_CONFIG, &profileOps[0][0], PROFILE_REGS);
+}
+
+/*************************************************************************
+ *  @brief      profile_reachable_speed
+ *              The highest speed step an axis can reach within a lag,
+ *              accelerating from its current speed at the RUR rate but
+ *              never beyond RFH.  A pure S-curve averages half that rate;
+ *              one with a linear section reaches the full rate.
+ *  @param[in]  speed is the current speed step (PSPD)
+ *  @param[in]  lagUs is in microseconds
+ *  @param[in]  profile is the axis's profile
+ *  @returns    the speed step
+ ************************************************************************/
+uint32_t profile_reachable_speed(uint32_t speed, uint32_t lagUs, const uint32_t profile[PROFILE_REGS])
+{
+    uint32_t high = FIELD_GET(RFH, FH, profile[PROFILE_RFH]);
+    uint64_t gain = ((uint64_t) lagUs * PCL6046_CLK_HZ) / (1000000ULL * ramp_clocks(profile, false));
+
+    if ((profile[PROFILE_RMD] & FIELD_MASK(RMD, MSMD)) && (FIELD_GET(RUS, US, profile[PROFILE_RUS]) == 0))
+    {
+        gain /= 2;
+    }
+
+    if (speed >= high)
+    {
+        return (speed);
+    }
+
+    return (((uint64_t) speed + gain < high) ? (uint32_t) (speed + gain) : high);
+}
+
+/*************************************************************************
+ *  @brief      profile_stop_distance
+ *              Pulses an axis outputs while decelerating from a speed step
+ *              down to RFL.
+ *  @param[in]  speed is the speed step
+ *  @param[in]  profile is the axis's profile
+ *  @returns    the distance, rounded up, so a stop never ends a pulse
+ *              further than predicted
+ ************************************************************************/
+uint32_t profile_stop_distance(uint32_t speed, const uint32_t profile[PROFILE_REGS])
+{
+    uint32_t low = FIELD_GET(RFL, FL, profile[PROFILE_RFL]);
+
+    if (speed <= low)
+    {
+        return (0);
+    }
+
+    return (ramp_distance(profile, true, low, speed) + 1);
+}
+
+/*************************************************************************
+ *  @brief      profile_course
+ *              The course of a positioning move from a standstill:  up
+ *              from FL, at FH as long as the ramps leave room, and down to
+ *              FL.  A move too short to reach FH peaks at the highest step
+ *              whose ramps fit, found by bisection.
+ *  @param[in]  pulses is the move's length
+ *  @param[in]  profile is the axis's profile
+ *  @param[out] course receives the speed steps, the ramps' pulses, and the
+ *              CLK cycles of each part
+ *  @returns    none
+ ************************************************************************/
+void profile_course(uint32_t pulses, const uint32_t profile[PROFILE_REGS], PROFILE_COURSE *course)
+{
+    uint32_t low = FIELD_GET(RFL, FL, profile[PROFILE_RFL]);
+    uint32_t peak = FIELD_GET(RFH, FH, profile[PROFILE_RFH]);
+    uint32_t below;
+    uint32_t above;
+
+    low = (low != 0) ? low : 1;
+    peak = (peak > low) ? peak : low;
+
+    if ((ramp_distance(profile, false, low, peak) + ramp_distance(profile, true, low, peak)) > pulses)
+    {
+        below = low;
+        above = peak;
+
+        while ((above - below) > 1)
+        {
+            peak = below + ((above - below) / 2);
+
+            if ((ramp_distance(profile, false, low, peak) + ramp_distance(profile, true, low, peak)) <= pulses)
+            {
+                below = peak;
+            }
+            else
+            {
+                above = peak;
+            }
+        }
+
+        peak = below;
+    }
+
+    course->low = low;
+    course->peak = peak;
+    course->accelPulses = ramp_distance(profile, false, low, peak);
+    course->decelPulses = ramp_distance(profile, true, low, peak);
+    course->accelClocks = (uint64_t) ramp_span(profile, false, peak - low) * ramp_clocks(profile, false);
+    course->decelClocks = (uint64_t) ramp_span(profile, true, peak - low) * ramp_clocks(profile, true);
+    course->cruiseClocks = ((uint64_t) (pulses - course->accelPulses - course->decelPulses) * (FIELD_GET(RMG, MG, profile[PROFILE_RMG]) + 1) * 65536ULL) / peak;
+}
+
+/*************************************************************************
+ *  @brief      profile_move_time
+ *              How long a positioning move from a standstill takes; see
+ *              profile_course().
+ *  @param[in]  pulses is the move's length
+ *  @param[in]  profile is the axis's profile
+ *  @returns    the time, in microseconds
+ ************************************************************************/
+uint32_t profile_move_time(uint32_t pulses, const uint32_t profile[PROFILE_REGS])
+{
+    PROFILE_COURSE course;
+
+    profile_course(pulses, profile, &course);
+
+    return ((uint32_t) (((course.accelClocks + course.cruiseClocks + course.decelClocks) * 1000000ULL) / PCL6046_CLK_HZ));
+}
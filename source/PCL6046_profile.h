@@ -0,0 +1,96 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_profile.h
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_PROFILE_H
+    #define PCL6046_PROFILE_H
+
+    //  speed profile registers of an axis, in this order; of RMD, only the
+    //  MSMD field (S-curve) belongs to the profile
+    #define PROFILE_RFL                 0
+    #define PROFILE_RFH                 1
+    #define PROFILE_RUR                 2
+    #define PROFILE_RDR                 3
+    #define PROFILE_RMG                 4
+    #define PROFILE_RMD                 5
+    #define PROFILE_RUS                 6
+    #define PROFILE_RDS                 7
+    #define PROFILE_REGS                8
+
+    //  the speed of one speed step at RMG = 0, section 5.4.1.5:  a step is
+    //  CLK / ((RMG + 1) * 65536) pps, so with this CLK every RMG + 1 that
+    //  divides 300 gives a whole number of pps per step
+    #define PROFILE_BASE_PPS            (PCL6046_CLK_HZ / 65536UL)
+    #define PROFILE_MAGNIFICATIONS      16
+
+    //  a move's profile in physical units:  lengths in micrometres, so a
+    //  speed in mm/s is 1000 times the value, and so on
+    typedef struct
+    {
+        uint32_t    resolution;         //  pulses per metre of travel
+        uint32_t    startSpeed;         //  um/s, the FL speed
+        uint32_t    speed;              //  um/s, the FH speed
+        uint32_t    accel;              //  um/s^2
+        uint32_t    decel;              //  um/s^2; 0 to use accel
+        uint32_t    jerk;               //  um/s^3; 0 for linear ramps
+
+    }   PROFILE_SPEC;
+
+    //  a positioning move from a standstill, from profile_course():  speeds
+    //  are speed steps, and each part of the move is timed in CLK cycles
+    typedef struct
+    {
+        uint32_t    low;                //  FL, the speed it starts and ends at
+        uint32_t    peak;               //  FH, or less for a short move
+        uint32_t    accelPulses;
+        uint32_t    decelPulses;
+        uint64_t    accelClocks;
+        uint64_t    cruiseClocks;
+        uint64_t    decelClocks;
+
+    }   PROFILE_COURSE;
+
+    #ifdef  PCL6046_PROFILE_C
+
+        #if     ((PCL6046_CLK_HZ % 65536UL) != 0) || (PROFILE_BASE_PPS != 300)
+            #error  "profileMagnification[] assumes a 19.6608 MHz CLK"
+        #endif
+
+        //  the RMG values with a whole number of pps per step, finest first
+        typedef struct
+        {
+            uint16_t    rmg;
+            uint16_t    ppsPerStep;
+
+        }   PROFILE_MAGNIFICATION;
+
+        static const PROFILE_MAGNIFICATION  profileMagnification[PROFILE_MAGNIFICATIONS] =
+        {
+            {299, 1},   {149, 2},   {99, 3},    {74, 4},
+            {59, 5},    {49, 6},    {29, 10},   {24, 12},
+            {19, 15},   {14, 20},   {11, 25},   {9, 30},
+            {5, 50},    {4, 60},    {3, 75},    {2, 100}
+        };
+
+        //  the profile registers, in PROFILE_xxx order; the limits and the
+        //  scheduler read them from the shadows with this same table
+        const ASIC_REG                      PCL6046_profile_regs[PROFILE_REGS] = {RFL, RFH, RUR, RDR, RMG, RMD, RUS, RDS};
+
+        //  load_profile()'s bus operations; only ASIC_comm loads profiles,
+        //  so they're never shared
+        static BUS_OP                       profileOps[PCL6046_CHIPS][PROFILE_REGS];
+
+    #else
+
+        extern const ASIC_REG               PCL6046_profile_regs[PROFILE_REGS];
+
+        bool compile_profile(const PROFILE_SPEC *spec, uint32_t profile[PROFILE_REGS]);
+        void load_profile(uint32_t carriers, const uint32_t profile[PROFILE_REGS]);
+        uint32_t profile_reachable_speed(uint32_t speed, uint32_t lagUs, const uint32_t profile[PROFILE_REGS]);
+        uint32_t profile_stop_distance(uint32_t speed, const uint32_t profile[PROFILE_REGS]);
+        void profile_course(uint32_t pulses, const uint32_t profile[PROFILE_REGS], PROFILE_COURSE *course);
+        uint32_t profile_move_time(uint32_t pulses, const uint32_t profile[PROFILE_REGS]);
+    #endif
+#endif
@@ -0,0 +1,179 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_safety.c
+ *                          Hardware timer pacing of the safety loop.  The
+ *                          timer interrupt only counts the tick and notifies
+ *                          the deferred handler (ASIC_limit, see
+ *                          pace_limits()), which acquires the positions and
+ *                          rewrites the comparators once per tick, between
+ *                          safety_cycle_begin() and safety_cycle_end().  The
+ *                          loop's rate is then independent of the RTOS tick;
+ *                          its jitter and overruns are counted here.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_SAFETY_C
+
+#include    <stdint.h>
+#include    <stdbool.h>
+#include    <string.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_limit.h"
+#include    "PCL6046_safety.h"
+
+/*************************************************************************
+ *  @brief      SAFETY_TIMER_IRQHandler
+ *              Handler for the safety loop timer's update interrupt.  All
+ *              work is deferred to the handler task.
+ *  @returns    none
+ ************************************************************************/
+void SAFETY_TIMER_IRQHandler(void)
+{
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+    tickStamp = (uint32_t) TIMESTAMP();
+    timerTicks++;
+
+    if (safetyHandler != (TaskHandle_t) NULL)
+    {
+        (void) xTaskNotifyFromISR(safetyHandler, safetyBits, eSetBits, &higherPriorityTaskWoken);
+    }
+
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+/*************************************************************************
+ *  @brief      start_safety_timer
+ *              Starts, or restarts at a new period, the timer that paces the
+ *              safety loop, and clears the counters.
+ *  @param[in]  handler is the task notified on each tick
+ *  @param[in]  notifyBits are set in its notification value
+ *  @param[in]  periodUs is the period, SAFETY_MIN_PERIOD_US to
+ *              SAFETY_MAX_PERIOD_US microseconds
+ *  @returns    none
+ ************************************************************************/
+void start_safety_timer(TaskHandle_t handler, uint32_t notifyBits, uint32_t periodUs)
+{
+    SAFETY_TIMER_STOP();
+
+    taskENTER_CRITICAL();
+
+    safetyHandler = handler;
+    safetyBits = notifyBits;
+    periodCounts = (uint32_t) (((uint64_t) periodUs * TIMESTAMP_HZ) / 1000000UL);
+    handledTicks = timerTicks;
+    cycleStarted = false;
+
+    (void) memset(&safetyStats, 0, sizeof(safetyStats));
+    safetyStats.periodUs = periodUs;
+
+    taskEXIT_CRITICAL();
+
+    SAFETY_TIMER_START(periodUs);
+}
+
+/*************************************************************************
+ *  @brief      stop_safety_timer
+ *              Stops the timer; the counters are kept for reading.
+ *  @returns    none
+ ************************************************************************/
+void stop_safety_timer(void)
+{
+    SAFETY_TIMER_STOP();
+
+    taskENTER_CRITICAL();
+    safetyHandler = (TaskHandle_t) NULL;
+    safetyStats.periodUs = 0;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      safety_cycle_begin
+ *              Called by the handler as it starts a cycle for a tick.  Ticks
+ *              that arrived since the last cycle began, beyond the one being
+ *              served, were overruns.
+ *  @returns    none
+ ************************************************************************/
+void safety_cycle_begin(void)
+{
+    uint32_t now = (uint32_t) TIMESTAMP();
+    uint32_t ticks;
+    uint32_t latency;
+    uint32_t jitter;
+
+    taskENTER_CRITICAL();
+
+    ticks = timerTicks;
+    latency = now - tickStamp;
+
+    safetyStats.ticks += ticks - handledTicks;
+
+    if ((ticks - handledTicks) > 1)
+    {
+        safetyStats.overruns += (ticks - handledTicks) - 1;
+    }
+    //  jitter is only meaningful between cycles of consecutive ticks
+    else if (cycleStarted)
+    {
+        jitter = now - cycleStart;
+        jitter = (jitter > periodCounts) ? (jitter - periodCounts) : (periodCounts - jitter);
+
+        safetyStats.lastJitter = jitter;
+
+        if (jitter > safetyStats.maxJitter)
+        {
+            safetyStats.maxJitter = jitter;
+        }
+    }
+
+    if (latency > safetyStats.maxLatency)
+    {
+        safetyStats.maxLatency = latency;
+    }
+
+    handledTicks = ticks;
+    cycleStart = now;
+    cycleStarted = true;
+
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      safety_cycle_end
+ *              Called by the handler when the cycle's comparator writes are
+ *              done.
+ *  @returns    none
+ ************************************************************************/
+void safety_cycle_end(void)
+{
+    uint32_t service = (uint32_t) TIMESTAMP() - cycleStart;
+
+    taskENTER_CRITICAL();
+
+    safetyStats.cycles++;
+    safetyStats.lastService = service;
+
+    if (service > safetyStats.maxService)
+    {
+        safetyStats.maxService = service;
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      get_safety_stats
+ *              Get method for the safety loop counters
+ *  @param[out] stats receives a copy of the counters
+ *  @returns    none
+ ************************************************************************/
+void get_safety_stats(SAFETY_STATS *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = safetyStats;
+    taskEXIT_CRITICAL();
+}
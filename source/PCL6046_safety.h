@@ -0,0 +1,81 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_safety.h
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_SAFETY_H
+    #define PCL6046_SAFETY_H
+
+    //  the range of the safety loop period, in microseconds; the longest is
+    //  the RTOS-paced limit period, where the timer stops being worth it
+    #define SAFETY_MIN_PERIOD_US        250
+    #define SAFETY_MAX_PERIOD_US        (POSITION_MONITOR_PERIOD * 1000UL)
+
+    //  the deferred handler runs at this priority while the timer paces it:
+    //  with ASIC_events, just below the bus owners
+    #define SAFETY_TASK_PRI             (BASE_TASK_PRI + 3)
+
+    #ifdef  PCL6046_HOST_SIM
+        //  host builds pace the loop from a POSIX timer in PCL6046_sim.c
+        #define SAFETY_TIMER_START(us)  ((void) PCL6046_sim_timer((us), SAFETY_TIMER_IRQHandler))
+        #define SAFETY_TIMER_STOP()     ((void) PCL6046_sim_timer(0, NULL))
+        #define SAFETY_TIMER_PRESENT    1
+    #else
+        //  TODO:   populate these macros for the hardware timer used; its
+        //          update interrupt must call SAFETY_TIMER_IRQHandler() every
+        //          us microseconds.  The handler calls xTaskNotifyFromISR(), so
+        //          the interrupt's logical priority must be at or below
+        //          configMAX_SYSCALL_INTERRUPT_PRIORITY; on Cortex-M, that's a
+        //          priority value numerically equal to or greater than it.
+        //          Until then, SAFETY_LOOP is refused, rather than leaving the
+        //          acquisition to a limit task that never ticks
+        #define SAFETY_TIMER_START(us)  ((void) (us))
+        #define SAFETY_TIMER_STOP()     ((void) 0)
+        #define SAFETY_TIMER_PRESENT    0
+    #endif
+
+    //  safety loop counters; times are in TIMESTAMP() counts, and reset each
+    //  time the loop is started
+    typedef struct
+    {
+        uint32_t    periodUs;           //  0 while the loop is stopped
+        uint32_t    ticks;              //  timer interrupts
+        uint32_t    cycles;             //  cycles the handler ran
+        uint32_t    overruns;           //  ticks that found the previous cycle still running
+        uint32_t    lastJitter;         //  |cycle start to start - period|
+        uint32_t    maxJitter;
+        uint32_t    maxLatency;         //  timer interrupt to cycle start
+        uint32_t    lastService;        //  cycle start to end
+        uint32_t    maxService;
+
+    }   SAFETY_STATS;
+
+    #ifdef  PCL6046_SAFETY_C
+
+        //  the deferred handler and the notification bits it's given
+        static TaskHandle_t         safetyHandler = (TaskHandle_t) NULL;
+        static uint32_t             safetyBits;
+
+        //  the period in TIMESTAMP() counts, and the timer interrupts so far
+        //  with the TIMESTAMP() of the latest
+        static uint32_t             periodCounts;
+        static volatile uint32_t    timerTicks;
+        static volatile uint32_t    tickStamp;
+
+        //  the ticks accounted for, and when the current cycle started
+        static uint32_t             handledTicks;
+        static uint32_t             cycleStart;
+        static bool                 cycleStarted;
+
+        static SAFETY_STATS         safetyStats;
+
+    #else
+        void SAFETY_TIMER_IRQHandler(void);
+        void start_safety_timer(TaskHandle_t handler, uint32_t notifyBits, uint32_t periodUs);
+        void stop_safety_timer(void);
+        void safety_cycle_begin(void);
+        void safety_cycle_end(void);
+        void get_safety_stats(SAFETY_STATS *stats);
+    #endif
+#endif
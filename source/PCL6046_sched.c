@@ -0,0 +1,737 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_sched.c
+ *                          Track scheduler:  sequences queued carrier moves
+ *                          so that the software limits of ASIC_limit never
+ *                          have to stop one.  Each carrier has a queue of
+ *                          target positions; every pass predicts, from the
+ *                          configured speed profiles, where each carrier will
+ *                          be over time, and starts a waiting move only if
+ *                          its whole course stays clear of its neighbours'.
+ *                          A move that isn't clear is split at the furthest
+ *                          point that is, or held back until it is.  To keep
+ *                          the makespan down, the carriers with the most
+ *                          travel left are considered first, and moves are
+ *                          started as soon as they're clear rather than in
+ *                          rounds.  The track order and gaps are those given
+ *                          to configure_limits().
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_SCHED_C
+
+#include    <stdint.h>
+#include    <stdbool.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+#include    "queue.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_maint.h"
+#include    "PCL6046_profile.h"
+#include    "PCL6046_limit.h"
+#include    "PCL6046_sched.h"
+
+
+/*************************************************************************
+ *  @brief      plan_pulses
+ *              Pulses output over a time at a speed:  a step is
+ *              CLK / ((RMG + 1) * 65536) pps, section 5.4.1.5 of the PCL6046
+ *              user manual.
+ *  @param[in]  plan is the move, for its RMG
+ *  @param[in]  stepUs is the speed, in steps, times the time, in
+ *              microseconds
+ *  @returns    the pulses, rounded down
+ ************************************************************************/
+static uint32_t plan_pulses(const SCHED_PLAN *plan, uint64_t stepUs)
+{
+    return ((uint32_t) ((stepUs * PROFILE_BASE_PPS) / (((uint64_t) FIELD_GET(RMG, MG, plan->profile[PROFILE_RMG]) + 1) * 1000000ULL)));
+}
+
+/*************************************************************************
+ *  @brief      plan_move
+ *              Predicts the course of a move from a standstill with
+ *              profile_course(), so its ramps and cruise take the times the
+ *              ASIC takes.
+ *  @param[out] plan receives the course; its start is left alone
+ *  @param[in]  from is the position the move starts at
+ *  @param[in]  to is its target; from, for a carrier that holds still
+ *  @param[in]  profile holds RFL, RFH, RUR, RDR, RMG, and RMD of the axis
+ *  @returns    none
+ ************************************************************************/
+static void plan_move(SCHED_PLAN *plan, int32_t from, int32_t to, const uint32_t profile[PROFILE_REGS])
+{
+    PROFILE_COURSE course;
+    uint8_t reg;
+
+    profile_course((uint32_t) ((to > from) ? ((int64_t) to - from) : ((int64_t) from - to)), profile, &course);
+
+    for (reg = 0; reg < PROFILE_REGS; reg++)
+    {
+        plan->profile[reg] = profile[reg];
+    }
+
+    plan->from = from;
+    plan->to = to;
+    plan->low = course.low;
+    plan->peak = course.peak;
+    plan->accelPulses = course.accelPulses;
+    plan->decelPulses = course.decelPulses;
+    plan->accelTime = (uint32_t) ((course.accelClocks * 1000000ULL) / PCL6046_CLK_HZ);
+    plan->cruiseTime = (uint32_t) ((course.cruiseClocks * 1000000ULL) / PCL6046_CLK_HZ);
+    plan->decelTime = (uint32_t) ((course.decelClocks * 1000000ULL) / PCL6046_CLK_HZ);
+}
+
+/*************************************************************************
+ *  @brief      plan_end
+ *              The tick a planned move ends at.
+ *  @param[in]  plan is the move
+ *  @returns    the tick
+ ************************************************************************/
+static TickType_t plan_end(const SCHED_PLAN *plan)
+{
+    uint64_t us = (uint64_t) plan->accelTime + plan->cruiseTime + plan->decelTime;
+
+    return ((TickType_t) (plan->start + (((us * configTICK_RATE_HZ) + 999999ULL) / 1000000ULL)));
+}
+
+/*************************************************************************
+ *  @brief      predict
+ *              Where a planned move has a carrier at a given tick, and how
+ *              fast it's going; before the start and after the end, it
+ *              stands at "from" and "to".  The ramps change speed at an
+ *              even rate, so each ramp ends on the distance and speed
+ *              profile_course() gives it.
+ *  @param[in]  plan is the move
+ *  @param[in]  tick is the RTOS tick
+ *  @param[out] speed receives the speed step, as PSPD would read
+ *  @returns    the position
+ ************************************************************************/
+static int32_t predict(const SCHED_PLAN *plan, TickType_t tick, uint32_t *speed)
+{
+    int32_t elapsed = (int32_t) (tick - plan->start);
+    uint32_t distance = (uint32_t) ((plan->to > plan->from) ? ((int64_t) plan->to - plan->from) : ((int64_t) plan->from - plan->to));
+    uint32_t covered;
+    uint64_t us;
+
+    if (elapsed <= 0)
+    {
+        *speed = 0;
+        return (plan->from);
+    }
+
+    us = ((uint64_t) elapsed * 1000000ULL) / configTICK_RATE_HZ;
+
+    if (us >= ((uint64_t) plan->accelTime + plan->cruiseTime + plan->decelTime))
+    {
+        *speed = 0;
+        return (plan->to);
+    }
+
+    if (us < plan->accelTime)
+    {
+        *speed = plan->low + (uint32_t) (((uint64_t) (plan->peak - plan->low) * us) / plan->accelTime);
+        covered = plan_pulses(plan, (uint64_t) (plan->low + *speed) * us / 2);
+    }
+    else if (us < ((uint64_t) plan->accelTime + plan->cruiseTime))
+    {
+        *speed = plan->peak;
+        covered = plan->accelPulses + plan_pulses(plan, (uint64_t) plan->peak * (us - plan->accelTime));
+    }
+    else
+    {
+        us -= (uint64_t) plan->accelTime + plan->cruiseTime;
+        *speed = plan->peak - (uint32_t) (((uint64_t) (plan->peak - plan->low) * us) / plan->decelTime);
+        covered = (distance - plan->decelPulses) + plan_pulses(plan, (uint64_t) (plan->peak + *speed) * us / 2);
+    }
+
+    if (covered > distance)
+    {
+        covered = distance;
+    }
+
+    return ((plan->to > plan->from) ? (plan->from + (int32_t) covered) : (plan->from - (int32_t) covered));
+}
+
+/*************************************************************************
+ *  @brief      stopping_room
+ *              The stopping distance ASIC_limit allows a carrier at a given
+ *              speed, worked out the way it does (see ASIC_limit()):  from
+ *              the speed it could reach within LIMIT_UPDATE_LAG, the lag of
+ *              unpaced limits, which paced ones never exceed, with the
+ *              margin added.
+ *  @param[in]  plan is the carrier's move, for its profile
+ *  @param[in]  speed is its speed step
+ *  @param[in]  marginPercent is added to the distance
+ *  @param[out] reachable receives the speed step it could reach
+ *  @returns    the distance, in pulses
+ ************************************************************************/
+static uint32_t stopping_room(const SCHED_PLAN *plan, uint32_t speed, uint32_t marginPercent, uint32_t *reachable)
+{
+    uint32_t stopping;
+
+    *reachable = profile_reachable_speed(speed, LIMIT_UPDATE_LAG * 1000UL, plan->profile);
+    stopping = profile_stop_distance(*reachable, plan->profile);
+
+    return (stopping + (uint32_t) (((uint64_t) stopping * marginPercent) / 100));
+}
+
+/*************************************************************************
+ *  @brief      pair_clear
+ *              Checks a pair of neighbours over the rest of their planned
+ *              moves, every SCHED_STEP ticks:  whenever one is closing on
+ *              the other, its share of the room between their stopping
+ *              distances (shared the way ASIC_limit shares it) must cover
+ *              SCHED_GUARD at its speed, so its limit stays ahead of it.
+ *              Since the limits lag the positions, each carrier counts as
+ *              being at the closer of where it is and where it was
+ *              LIMIT_UPDATE_LAG earlier.
+ *  @param[in]  lower is the move of the carrier on the - side
+ *  @param[in]  upper is the move of the carrier on the + side
+ *  @param[in]  minimumGap is the gap between them
+ *  @param[in]  marginPercent is added to stopping distances
+ *  @param[in]  now is the RTOS tick to check from
+ *  @returns    true, if neither will run into a limit; false, otherwise
+ ************************************************************************/
+static bool pair_clear(const SCHED_PLAN *lower, const SCHED_PLAN *upper, int32_t minimumGap, uint32_t marginPercent, TickType_t now)
+{
+    TickType_t end = plan_end(lower);
+    TickType_t tick = now;
+
+    if ((int32_t) (plan_end(upper) - end) > 0)
+    {
+        end = plan_end(upper);
+    }
+
+    while (1)
+    {
+        uint32_t lowerSpeed;
+        uint32_t upperSpeed;
+        uint32_t earlierSpeed;
+        int32_t lowerPosition = predict(lower, tick, &lowerSpeed);
+        int32_t upperPosition = predict(upper, tick, &upperSpeed);
+        int32_t earlier;
+        bool lowerClosing = (lowerSpeed != 0) && (lower->to > lower->from);
+        bool upperClosing = (upperSpeed != 0) && (upper->to < upper->from);
+
+        if (lowerClosing || upperClosing)
+        {
+            //  the limits in effect were computed from positions up to
+            //  LIMIT_UPDATE_LAG old, so each is taken where it was closer
+            earlier = predict(lower, (TickType_t) (tick - LIMIT_UPDATE_LAG), &earlierSpeed);
+            lowerPosition = (earlier > lowerPosition) ? earlier : lowerPosition;
+            earlier = predict(upper, (TickType_t) (tick - LIMIT_UPDATE_LAG), &earlierSpeed);
+            upperPosition = (earlier < upperPosition) ? earlier : upperPosition;
+
+            uint32_t lowerReach;
+            uint32_t upperReach;
+            int64_t room = (int64_t) upperPosition - lowerPosition - minimumGap;
+            uint32_t lowerWeight;
+            uint32_t upperWeight;
+
+            room -= stopping_room(lower, lowerSpeed, marginPercent, &lowerReach);
+            room -= stopping_room(upper, upperSpeed, marginPercent, &upperReach);
+
+            //  a carrier moving away from its neighbour gets no share
+            lowerWeight = ((lowerSpeed != 0) && !lowerClosing) ? 0 : (lowerReach + 1);
+            upperWeight = ((upperSpeed != 0) && !upperClosing) ? 0 : (upperReach + 1);
+
+            if (room <= 0)
+            {
+                return (false);
+            }
+
+            if (lowerClosing && (((room * lowerWeight) / (lowerWeight + upperWeight)) < plan_pulses(lower, (uint64_t) lowerSpeed * SCHED_GUARD * 1000ULL)))
+            {
+                return (false);
+            }
+
+            if (upperClosing && (((room * upperWeight) / (lowerWeight + upperWeight)) < plan_pulses(upper, (uint64_t) upperSpeed * SCHED_GUARD * 1000ULL)))
+            {
+                return (false);
+            }
+        }
+
+        if ((int32_t) (end - tick) <= 0)
+        {
+            break;
+        }
+
+        tick += SCHED_STEP;
+
+        if ((int32_t) (tick - end) > 0)
+        {
+            tick = end;
+        }
+    }
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      move_clear
+ *              Plans a carrier's move from where it stands, starting now,
+ *              and checks it against both neighbours.
+ *  @param[in,out]  plan holds the carrier standing where it is; receives
+ *              the move
+ *  @param[in]  to is the target of the move
+ *  @param[in]  profile holds RFL, RFH, RUR, RDR, RMG, and RMD of the axis
+ *  @param[in]  below is the course of the neighbour on the - side, or NULL
+ *  @param[in]  above is the course of the neighbour on the + side, or NULL
+ *  @param[in]  belowGap is the gap to the neighbour below
+ *  @param[in]  aboveGap is the gap to the neighbour above
+ *  @param[in]  marginPercent is added to stopping distances
+ *  @param[in]  now is the RTOS tick the move would start at
+ *  @returns    true, if the move is clear; false, otherwise
+ ************************************************************************/
+static bool move_clear(SCHED_PLAN *plan, int32_t to, const uint32_t profile[PROFILE_REGS], const SCHED_PLAN *below, const SCHED_PLAN *above,
+                       int32_t belowGap, int32_t aboveGap, uint32_t marginPercent, TickType_t now)
+{
+    plan_move(plan, plan->from, to, profile);
+    plan->start = now;
+
+    return (((below == NULL) || pair_clear(below, plan, belowGap, marginPercent, now)) &&
+            ((above == NULL) || pair_clear(plan, above, aboveGap, marginPercent, now)));
+}
+
+/*************************************************************************
+ *  @brief      start_move
+ *              Starts a carrier on an absolute move to a target, with
+ *              acceleration and deceleration.
+ *  @param[in]  carrier is the carrier
+ *  @param[in]  target is the COUNTER1 position to move to
+ *  @returns    none
+ ************************************************************************/
+static void start_move(uint8_t carrier, int32_t target)
+{
+    uint8_t axis = CARRIER_AXIS(carrier);
+    uint8_t mask = (uint8_t) (1 << axis);
+    BUS_OP ops[3] =
+    {
+        {OP_MODIFY, (uint8_t) RMD, mask, FIELD_MASK(RMD, MOD), {0}},
+        {OP_WRITE, (uint8_t) RMV, mask, 0, {0}},
+        {OP_COMMAND, (uint8_t) STAD, mask, 0, {0}}
+    };
+
+    ops[0].values[axis] = FIELD_SET(RMD, MOD, MOD_ABSOLUTE_CUN1);
+    ops[1].values[axis] = (uint32_t) target;
+
+    bus_transact(CARRIER_CHIP(carrier), BUS_CONFIG, ops, 3);
+}
+
+/*************************************************************************
+ *  @brief      queued_travel
+ *              The travel a carrier has left through its queue.
+ *  @param[in]  carrier is the carrier
+ *  @param[in]  position is where it is
+ *  @returns    the travel, in pulses
+ ************************************************************************/
+static uint64_t queued_travel(uint8_t carrier, int32_t position)
+{
+    uint64_t travel = 0;
+    uint8_t count;
+    uint8_t n;
+
+    taskENTER_CRITICAL();
+    count = schedCount[carrier];
+    taskEXIT_CRITICAL();
+
+    for (n = 0; n < count; n++)
+    {
+        int32_t target = schedTarget[carrier][(schedHead[carrier] + n) % SCHED_QUEUE_DEPTH];
+
+        travel += (uint64_t) ((target > position) ? ((int64_t) target - position) : ((int64_t) position - target));
+        position = target;
+    }
+
+    return (travel);
+}
+
+/*************************************************************************
+ *  @brief      next_target
+ *              Get method for the target at the head of a carrier's queue
+ *  @param[in]  carrier is the carrier
+ *  @param[out] target receives the target
+ *  @returns    true, if the carrier has one; false, otherwise
+ ************************************************************************/
+static bool next_target(uint8_t carrier, int32_t *target)
+{
+    bool queued;
+
+    taskENTER_CRITICAL();
+
+    queued = (schedCount[carrier] != 0);
+    *target = schedTarget[carrier][schedHead[carrier]];
+
+    taskEXIT_CRITICAL();
+
+    return (queued);
+}
+
+/*************************************************************************
+ *  @brief      reach_target
+ *              Retires the target at the head of a carrier's queue, if it's
+ *              the one given; a cancel may have emptied the queue meanwhile.
+ *  @param[in]  carrier is the carrier
+ *  @param[in]  target is the target reached
+ *  @returns    none
+ ************************************************************************/
+static void reach_target(uint8_t carrier, int32_t target)
+{
+    taskENTER_CRITICAL();
+
+    if ((schedCount[carrier] != 0) && (schedTarget[carrier][schedHead[carrier]] == target))
+    {
+        schedHead[carrier] = (uint8_t) ((schedHead[carrier] + 1) % SCHED_QUEUE_DEPTH);
+        schedCount[carrier]--;
+        reached[carrier]++;
+        delayed[carrier] = false;
+        schedStats.completed++;
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      ASIC_schedule
+ *              This RTOS task starts the queued moves.  Each pass, every
+ *              SCHED_PERIOD or when a move is queued, it retires the moves
+ *              the latest snapshot shows have ended, then goes over the
+ *              carriers with moves waiting, most travel left first.  A
+ *              carrier's move starts if its predicted course stays clear of
+ *              its neighbours' (pair_clear()), whether they're moving or
+ *              standing; otherwise as much of it as is clear starts, if
+ *              that's worth it, and the rest waits.  A carrier doesn't start
+ *              its nth move before its neighbours have reached their (n-1)th,
+ *              so moves queued together don't wait on each other in a ring.
+ *              A move a limit stops anyway is re-planned from where it
+ *              stopped.  Nothing is started until the limits are configured;
+ *              carriers not on the track are left alone.
+ *  @param[in]  pvParameters is ignored
+ *  @returns    none
+ ************************************************************************/
+void ASIC_schedule(void *pvParameters)
+{
+    LIMIT_PARAMS params;
+    uint8_t candidates[CARRIERCNT];
+    uint8_t count;
+    uint8_t chip;
+    uint8_t reg;
+    uint8_t k;
+    uint8_t n;
+    bool busy;
+
+    schedTask = xTaskGetCurrentTaskHandle();
+
+    acquire_items(ACQ_RCUN1);
+
+    while (1)
+    {
+        TickType_t now;
+
+        (void) ulTaskNotifyTake(pdTRUE, (TickType_t) SCHED_PERIOD);
+
+        get_snapshot(&schedSnap);
+
+        if (!get_limit_params(&params) || ((schedSnap.items & ACQ_RCUN1) == 0))
+        {
+            continue;
+        }
+
+        //  retire the moves that have ended; a snapshot sampled before a move
+        //  was started can't tell
+        busy = false;
+
+        for (k = 0; k < params.carriers; k++)
+        {
+            uint8_t carrier = params.order[k];
+            int32_t position = (int32_t) schedSnap.counter[0][carrier];
+
+            if (moving[carrier] && ((int32_t) (schedSnap.sampled - inFlightStamp[carrier]) > 0) && !(schedSnap.mstatus[carrier] & MSTS_SRUN))
+            {
+                moving[carrier] = false;
+                endedAt[carrier] = xTaskGetTickCount();
+                wentUp[carrier] = (inFlight[carrier].to > inFlight[carrier].from);
+
+                if (position == inFlight[carrier].to)
+                {
+                    reach_target(carrier, position);
+                }
+                else
+                {
+                    schedStats.stops++;
+                }
+            }
+
+            busy = busy || moving[carrier] || (schedCount[carrier] != 0);
+        }
+
+        //  the count of targets reached only orders moves queued together
+        if (!busy)
+        {
+            for (k = 0; k < params.carriers; k++)
+            {
+                reached[params.order[k]] = 0;
+            }
+
+            continue;
+        }
+
+        for (chip = 0; chip < PCL6046_CHIPS; chip++)
+        {
+            for (reg = 0; reg < PROFILE_REGS; reg++)
+            {
+                schedProfileOps[chip][reg] = (BUS_OP) {OP_SHADOWED, (uint8_t) PCL6046_profile_regs[reg], 0x0F, 0, {0}};
+            }
+        }
+
+        bus_transact_all(BUS_CONFIG, &schedProfileOps[0][0], PROFILE_REGS);
+
+        now = xTaskGetTickCount();
+        count = 0;
+
+        //  the course of every carrier on the track:  the move it has under
+        //  way, or standing where it is; and the ones with moves to start,
+        //  most travel left first
+        for (k = 0; k < params.carriers; k++)
+        {
+            uint8_t carrier = params.order[k];
+            int32_t position = (int32_t) schedSnap.counter[0][carrier];
+            uint32_t profile[PROFILE_REGS];
+
+            if (moving[carrier])
+            {
+                schedCourse[carrier] = inFlight[carrier];
+                continue;
+            }
+
+            for (reg = 0; reg < PROFILE_REGS; reg++)
+            {
+                profile[reg] = schedProfileOps[CARRIER_CHIP(carrier)][reg].values[CARRIER_AXIS(carrier)];
+            }
+
+            plan_move(&schedCourse[carrier], position, position, profile);
+            schedCourse[carrier].start = now;
+
+            if (schedCount[carrier] != 0)
+            {
+                schedTravel[carrier] = queued_travel(carrier, position);
+
+                for (n = count++; (n > 0) && (schedTravel[candidates[n - 1]] < schedTravel[carrier]); n--)
+                {
+                    candidates[n] = candidates[n - 1];
+                }
+
+                candidates[n] = carrier;
+            }
+        }
+
+        for (n = 0; n < count; n++)
+        {
+            uint8_t carrier = candidates[n];
+            int32_t position = schedCourse[carrier].from;
+            const SCHED_PLAN *below = NULL;
+            const SCHED_PLAN *above = NULL;
+            int32_t belowGap = 0;
+            int32_t aboveGap = 0;
+            uint32_t profile[PROFILE_REGS];
+            SCHED_PLAN plan;
+            int32_t target;
+            int32_t good;
+            int32_t bad;
+            bool clear;
+
+            if (!next_target(carrier, &target))
+            {
+                continue;
+            }
+
+            //  already there
+            if (target == position)
+            {
+                reach_target(carrier, target);
+                continue;
+            }
+
+            for (k = 0; params.order[k] != carrier; k++);
+
+            if (k > 0)
+            {
+                below = &schedCourse[params.order[k - 1]];
+                belowGap = (int32_t) (params.minimumGap[k - 1] ? params.minimumGap[k - 1] : params.minimumGap[0]);
+            }
+
+            if (k < (params.carriers - 1))
+            {
+                above = &schedCourse[params.order[k + 1]];
+                aboveGap = (int32_t) (params.minimumGap[k] ? params.minimumGap[k] : params.minimumGap[0]);
+            }
+
+            //  don't get ahead of a neighbour that still has moves queued, or
+            //  turn back before the limits have seen the last move end
+            if (((k > 0) && (schedCount[params.order[k - 1]] != 0) && (reached[params.order[k - 1]] < reached[carrier])) ||
+                ((above != NULL) && (schedCount[params.order[k + 1]] != 0) && (reached[params.order[k + 1]] < reached[carrier])) ||
+                (((target > position) != wentUp[carrier]) && ((TickType_t) (now - endedAt[carrier]) < LIMIT_UPDATE_LAG)))
+            {
+                clear = false;
+            }
+            else
+            {
+                for (reg = 0; reg < PROFILE_REGS; reg++)
+                {
+                    profile[reg] = schedProfileOps[CARRIER_CHIP(carrier)][reg].values[CARRIER_AXIS(carrier)];
+                }
+
+                //  the whole move, or else the furthest part of it that's
+                //  clear, found by halving the span between the two
+                plan = schedCourse[carrier];
+                good = 0;
+                bad = target - position;
+                clear = move_clear(&plan, position + bad, profile, below, above, belowGap, aboveGap, params.marginPercent, now);
+
+                while (!clear && (((bad - good) > (SCHED_SPLIT_MIN / 2)) || ((good - bad) > (SCHED_SPLIT_MIN / 2))))
+                {
+                    int32_t half = good + ((bad - good) / 2);
+
+                    if (move_clear(&plan, position + half, profile, below, above, belowGap, aboveGap, params.marginPercent, now))
+                    {
+                        good = half;
+                    }
+                    else
+                    {
+                        bad = half;
+                    }
+                }
+
+                if (!clear && ((good > SCHED_SPLIT_MIN) || (good < -SCHED_SPLIT_MIN)))
+                {
+                    clear = move_clear(&plan, position + good, profile, below, above, belowGap, aboveGap, params.marginPercent, now);
+                }
+            }
+
+            if (clear)
+            {
+                start_move(carrier, plan.to);
+
+                inFlight[carrier] = plan;
+                inFlightStamp[carrier] = (uint32_t) TIMESTAMP();
+                moving[carrier] = true;
+                schedCourse[carrier] = plan;
+
+                taskENTER_CRITICAL();
+                schedStats.started++;
+                schedStats.splits += (plan.to != target) ? 1 : 0;
+                taskEXIT_CRITICAL();
+            }
+            else if (!delayed[carrier])
+            {
+                delayed[carrier] = true;
+
+                taskENTER_CRITICAL();
+                schedStats.delays++;
+                taskEXIT_CRITICAL();
+            }
+        }
+    }
+
+    //  this should never be executed
+    vTaskDelete(NULL);
+}
+
+/*************************************************************************
+ *  @brief      schedule_move
+ *              Appends a target position to a carrier's queue.
+ *  @param[in]  carrier is the carrier; it must be on the track given to
+ *              configure_limits() by the time its turn comes
+ *  @param[in]  target is the COUNTER1 position to move to
+ *  @returns    true, if the move was queued; false, if the carrier doesn't
+ *              exist or its queue is full
+ ************************************************************************/
+bool schedule_move(uint8_t carrier, int32_t target)
+{
+    bool queued = false;
+
+    if (carrier >= CARRIERCNT)
+    {
+        return (false);
+    }
+
+    taskENTER_CRITICAL();
+
+    if (schedCount[carrier] < SCHED_QUEUE_DEPTH)
+    {
+        schedTarget[carrier][(schedHead[carrier] + schedCount[carrier]) % SCHED_QUEUE_DEPTH] = target;
+        schedCount[carrier]++;
+        schedStats.queued++;
+        queued = true;
+    }
+
+    taskEXIT_CRITICAL();
+
+    if (queued && (schedTask != (TaskHandle_t) NULL))
+    {
+        (void) xTaskNotifyGive(schedTask);
+    }
+
+    return (queued);
+}
+
+/*************************************************************************
+ *  @brief      cancel_schedule
+ *              Discards every move that hasn't started; moves under way
+ *              aren't stopped, that takes a stop command.
+ *  @returns    none
+ ************************************************************************/
+void cancel_schedule(void)
+{
+    uint8_t carrier;
+
+    taskENTER_CRITICAL();
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        schedCount[carrier] = 0;
+        delayed[carrier] = false;
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      schedule_idle
+ *              Whether the scheduler has nothing queued or under way
+ *  @returns    true, if it's idle; false, otherwise
+ ************************************************************************/
+bool schedule_idle(void)
+{
+    bool idle = true;
+    uint8_t carrier;
+
+    taskENTER_CRITICAL();
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        if (moving[carrier] || (schedCount[carrier] != 0))
+        {
+            idle = false;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    return (idle);
+}
+
+/*************************************************************************
+ *  @brief      get_sched_stats
+ *              Get method for the scheduler counters
+ *  @param[out] stats receives a copy of the counters
+ *  @returns    none
+ ************************************************************************/
+void get_sched_stats(SCHED_STATS *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = schedStats;
+    taskEXIT_CRITICAL();
+}
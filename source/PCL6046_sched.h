@@ -0,0 +1,111 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_sched.h
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_SCHED_H
+    #define PCL6046_SCHED_H
+
+    //  target positions each carrier can have waiting
+    #define SCHED_QUEUE_DEPTH       16
+
+    //  how often the moves are re-planned when nothing else wakes the
+    //  scheduler, in milliseconds, and the time step occupancy is predicted at
+    #define SCHED_PERIOD            ASIC_MAINT_PERIOD
+    #define SCHED_STEP              5
+
+    //  a move may only start if, all through it, each carrier closing on a
+    //  neighbour has room for this long at its speed beyond the limits'
+    //  stopping distances, so ASIC_limit never has to stop it; in milliseconds
+    #define SCHED_GUARD             LIMIT_UPDATE_LAG
+
+    //  a move that can't start is split at the furthest point that can be
+    //  reached now, if that's at least this many pulses away
+    #define SCHED_SPLIT_MIN         500
+
+    //  the predicted course of one move from a standstill:  accelerate from
+    //  FL speed, cruise, then decelerate to FL speed at the target, as timed
+    //  by profile_course(); speeds are speed steps, and times are in
+    //  microseconds from "start"
+    typedef struct
+    {
+        int32_t     from;
+        int32_t     to;
+        TickType_t  start;
+        uint32_t    profile[PROFILE_REGS];  //  for the stopping distances
+        uint32_t    low;
+        uint32_t    peak;
+        uint32_t    accelPulses;
+        uint32_t    decelPulses;
+        uint32_t    accelTime;
+        uint32_t    cruiseTime;
+        uint32_t    decelTime;
+
+    }   SCHED_PLAN;
+
+    //  scheduler counters
+    typedef struct
+    {
+        uint32_t    queued;             //  moves accepted by schedule_move()
+        uint32_t    started;            //  moves (and parts of moves) started
+        uint32_t    completed;          //  moves that reached their targets
+        uint32_t    splits;             //  moves started short of their targets
+        uint32_t    delays;             //  moves held back at least once
+        uint32_t    stops;              //  moves a limit stopped short
+
+    }   SCHED_STATS;
+
+    //  ASIC_schedule's stack:  the limits, the order of the moves to start,
+    //  the profiles, the plan of the move being fitted and its course,
+    //  start_move()'s bus operations, and the scalars on the way down; the
+    //  snapshot, the courses and the profile reads are static
+    #define SCHED_STACK_SIZE        TASK_STACK_SIZE(sizeof(LIMIT_PARAMS) + CARRIERCNT + (2 * PROFILE_REGS * sizeof(uint32_t)) + \
+                                                    sizeof(SCHED_PLAN) + sizeof(PROFILE_COURSE) + (3 * sizeof(BUS_OP)) + (32 * sizeof(uint32_t)))
+
+    #ifdef  PCL6046_SCHED_C
+
+        //  each carrier's targets, in order; schedHead indexes the next one,
+        //  which stays queued until it's reached
+        static int32_t          schedTarget[CARRIERCNT][SCHED_QUEUE_DEPTH];
+        static uint8_t          schedHead[CARRIERCNT];
+        static uint8_t          schedCount[CARRIERCNT];
+
+        static TaskHandle_t     schedTask = (TaskHandle_t) NULL;
+
+        //  the move each carrier has under way, and the TIMESTAMP() when it
+        //  was started; only a snapshot sampled after that can show its end
+        static SCHED_PLAN       inFlight[CARRIERCNT];
+        static uint32_t         inFlightStamp[CARRIERCNT];
+        static bool             moving[CARRIERCNT];
+
+        //  targets reached by each carrier since the queues last ran empty; a
+        //  carrier doesn't get ahead of its neighbours' counts, so the moves
+        //  at the same place in the queues of neighbours run together
+        static uint32_t         reached[CARRIERCNT];
+
+        //  the tick each carrier's last move was seen to end, and which way
+        //  it went; ASIC_limit leaves a moving carrier no room behind it, so a
+        //  move back the other way waits for the limits to catch up
+        static TickType_t       endedAt[CARRIERCNT];
+        static bool             wentUp[CARRIERCNT];
+
+        //  whether the move at the head of each queue has been held back
+        static bool             delayed[CARRIERCNT];
+
+        static SCHED_STATS      schedStats;
+
+        //  only ASIC_schedule plans, so these are never shared
+        static PCL6046_SNAPSHOT schedSnap;
+        static SCHED_PLAN       schedCourse[CARRIERCNT];
+        static uint64_t         schedTravel[CARRIERCNT];
+        static BUS_OP           schedProfileOps[PCL6046_CHIPS][PROFILE_REGS];
+
+    #else
+        bool schedule_move(uint8_t carrier, int32_t target);
+        void cancel_schedule(void);
+        bool schedule_idle(void);
+        void get_sched_stats(SCHED_STATS *stats);
+        void ASIC_schedule(void *pvParameters);
+    #endif
+#endif
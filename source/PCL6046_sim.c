@@ -0,0 +1,1614 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_sim.c
+ *                          Emulated PCL6046 chips for host (Linux) builds.
+ *                          The axis blocks are backed by PCL6046_sim_space,
+ *                          and every 16-bit access the driver makes through
+ *                          ASIC_WRITE16()/ASIC_READ16() lands here, where it is
+ *                          decoded the way the ASIC would decode it and counted
+ *                          in CLK cycles.  Motion is integrated from the RMD,
+ *                          speed and comparator registers, so the driver code
+ *                          paths behave on the host much as they do on a board.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_SIM_C
+#define     _POSIX_C_SOURCE     200112L
+
+#include    <stdint.h>
+#include    <stdbool.h>
+#include    <stddef.h>
+#include    <string.h>
+#include    <stdio.h>
+#include    <time.h>
+#include    <signal.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+#include    "semphr.h"
+
+#include    "PCL6046.h"
+
+#ifdef      PCL6046_HOST_SIM
+
+//  registers are held in a 64-entry file per axis, indexed by the low 6 bits
+//  of the read command; the write command differs only in bit 6
+#define REG_INDEX(r)        ((uint8_t) (r) & 0x3F)
+
+//  RENV2.IEND, RENV5.MSMR and RENV5.ISMR (sections 5.4.3.3 and 5.4.3.6)
+#define RENV2_IEND          0x08000000
+#define RENV5_MSMR          0x00400000
+#define RENV5_ISMR          0x00800000
+
+//  REST error factors raised by the emulation (section 5.4.7.2)
+#define REST_ESC1           0x0001
+
+//  RIST event factors raised by the emulation (section 5.4.7.3)
+#define RIST_ISEN           0x0001
+#define RIST_ISN            0x0002
+#define RIST_ISNM           0x0004
+#define RIST_ISC1           0x0100
+
+//  operation pre-registers PRMV..PRDS, held in the register file at their
+//  own index (the 2nd pre-register); the current register is 0x10 above
+#define PREREG_COUNT        (REG_INDEX(PRDS) - REG_INDEX(PRMV) + 1)
+#define PREREG_CURRENT      (REG_INDEX(RMV) - REG_INDEX(PRMV))
+
+typedef struct
+{
+    uint32_t    reg[64];            //  register file, see REG_INDEX()
+    uint16_t    bufw[2];            //  [0] == BUFW0, [1] == BUFW1
+    uint16_t    mainStatus;         //  MSTS, less the SERR/SINT summary bits
+    uint16_t    subStatus;          //  SSTS
+
+    bool        running;
+    bool        ramped;             //  acceleration/deceleration in use
+    bool        positioning;        //  operation completes at a target
+    bool        decelStopping;      //  SDSTP or a decelerate-stop comparator
+    int8_t      direction;          //  +1 or -1 while running
+    uint8_t     startCmd;           //  STAFL, STAFH, STAD or STAUD
+    bool        waiting;            //  a start command waits for CSTA
+    uint8_t     waitCmd;
+    uint64_t    startClk;           //  busClk when the last operation started
+    uint32_t    startCommand;       //  ... and the COMW write that started it
+    uint64_t    runStart;           //  motionClk when the axis started running
+    uint64_t    runEnd;             //  ... and when it last stopped
+    uint32_t    remaining;          //  pulses left in a positioning operation
+    double      speed;              //  current output speed, pps
+    double      pulseFraction;      //  carried between integration steps
+
+    //  where the emulated mechanics are, in pulses from power-on, and where
+    //  the ORG sensor is, if the scenario placed one
+    int64_t     travel;
+    int64_t     origin;
+    bool        originPlaced;
+
+    //  the mechanics are stuck:  pulses are output, but the encoder doesn't
+    //  follow, so they pile up in the deviation counter
+    bool        stalled;
+
+    //  continuous operation, section 6.2:  the 2nd pre-register is in reg[],
+    //  the 1st one here; pfm counts the determined operations (RSTS.PFM)
+    uint32_t    prereg1[PREREG_COUNT];
+    uint8_t     pfm;
+    uint8_t     prereg1Cmd;         //  start commands that determined them
+    uint8_t     prereg2Cmd;
+
+}   SIM_AXIS;
+
+//  every chip's axes, in carrier order; the bus clock is shared, but each
+//  chip has its own IFB pin
+static SIM_AXIS             simAxis[CARRIERCNT];
+static PCL6046_SIM_STATS    simStats;
+static uint64_t             busClk;
+static uint64_t             motionClk;
+static uint64_t             ifbBusyUntil[PCL6046_CHIPS];
+static bool                 simLED[CARRIERCNT];
+static bool                 intAsserted;
+static void                 (*intHandler)(void);
+
+//  the POSIX timer standing in for a hardware timer, and its handler
+static timer_t              simTimer;
+static bool                 simTimerCreated;
+static void                 (*timerHandler)(void);
+
+
+/*************************************************************************
+ *  @brief      reset_axis
+ *              Puts one emulated axis into its power-on state, with defaults
+ *              that keep the speed arithmetic in range.
+ ************************************************************************/
+static void reset_axis(SIM_AXIS *sim)
+{
+    memset(sim, 0, sizeof(SIM_AXIS));
+
+    sim->reg[REG_INDEX(RMG)] = 299;
+    sim->reg[REG_INDEX(RFL)] = 1;
+    sim->reg[REG_INDEX(RFH)] = 1;
+    sim->mainStatus = MSTS_SEND;
+
+    //  the pre-registers hold the same defaults
+    memcpy(&sim->reg[REG_INDEX(PRMV)], &sim->reg[REG_INDEX(RMV)], sizeof(sim->prereg1));
+    memcpy(sim->prereg1, &sim->reg[REG_INDEX(RMV)], sizeof(sim->prereg1));
+}
+
+/*************************************************************************
+ *  @brief      bus_cycles
+ *              Charges CLK cycles to bus traffic.  Called with the critical
+ *              section held.
+ *  @param[in]  cycles is the cost of the access
+ *  @returns    none
+ ************************************************************************/
+static void bus_cycles(uint32_t cycles)
+{
+    busClk += cycles;
+    simStats.busCycles += cycles;
+}
+
+/*************************************************************************
+ *  @brief      decode_address
+ *              Maps an address inside PCL6046_sim_space to a carrier and a
+ *              byte offset within that carrier's AXIS_MAP.
+ *  @param[in]  address is the address the driver accessed
+ *  @param[out] carrier receives the carrier the address belongs to
+ *  @returns    the byte offset, or -1 if the address is outside the chips
+ ************************************************************************/
+static int32_t decode_address(const volatile uint16_t *address, uint8_t *carrier)
+{
+    const uint8_t *base = (const uint8_t *) PCL6046_sim_space;
+    const uint8_t *where = (const uint8_t *) address;
+
+    if ((where < base) || (where >= (base + sizeof(PCL6046_sim_space))))
+    {
+        return (-1);
+    }
+
+    *carrier = (uint8_t) ((size_t) (where - base) / sizeof(AXIS_MAP));
+
+    return ((int32_t) ((size_t) (where - base) % sizeof(AXIS_MAP)));
+}
+
+/*************************************************************************
+ *  @brief      speed_scale
+ *              Speed magnification of an axis, in pps per speed step, per
+ *              section 5.4.1.5 of the PCL6046 user manual.
+ ************************************************************************/
+static double speed_scale(const SIM_AXIS *sim)
+{
+    uint32_t rmg = FIELD_GET(RMG, MG, sim->reg[REG_INDEX(RMG)]);
+
+    if (rmg < 2)
+    {
+        rmg = 2;
+    }
+
+    return ((double) SIM_CLK_HZ / ((double) (rmg + 1) * 65536.0));
+}
+
+/*************************************************************************
+ *  @brief      ramp_rate
+ *              Average acceleration or deceleration of an axis in pps/s,
+ *              from the RUR/RDR relationships of section 5.4.1.3 and 5.4.1.4.
+ *              An S-curve ramp from FL to FH takes as long as a linear one
+ *              over FH - FL plus twice its RUS/RDS section; a pure S-curve
+ *              (section 0, or more than half the ramp) takes twice as long.
+ *  @param[in]  rate is the RUR or RDR register value
+ *  @param[in]  section is the RUS or RDS register value
+ ************************************************************************/
+static double ramp_rate(const SIM_AXIS *sim, uint32_t rate, uint32_t section)
+{
+    double scale = speed_scale(sim);
+    double perSecond = ((double) SIM_CLK_HZ * scale) / (4.0 * (double) (FIELD_GET(RUR, UR, rate) + 1));
+    uint32_t low = FIELD_GET(RFL, FL, sim->reg[REG_INDEX(RFL)]);
+    uint32_t high = FIELD_GET(RFH, FH, sim->reg[REG_INDEX(RFH)]);
+    uint32_t delta = (high > low) ? (high - low) : 1;
+
+    section = FIELD_GET(RUS, US, section);
+
+    if (sim->reg[REG_INDEX(RMD)] & FIELD_MASK(RMD, MSMD))
+    {
+        perSecond *= ((section == 0) || ((2 * section) > delta)) ? 0.5 : ((double) delta / (double) (delta + (2 * section)));
+    }
+
+    return (perSecond);
+}
+
+/*************************************************************************
+ *  @brief      raise_interrupts
+ *              Latches event and error factors into RIST/REST; event factors
+ *              are masked by RIRQ.
+ ************************************************************************/
+static void raise_interrupts(SIM_AXIS *sim, uint32_t events, uint32_t errors)
+{
+    sim->reg[REG_INDEX(RIST)] |= (events & sim->reg[REG_INDEX(RIRQ)]);
+    sim->reg[REG_INDEX(REST)] |= errors;
+}
+
+/*************************************************************************
+ *  @brief      set_pfm
+ *              Records the number of determined operations in RSTS.PFM, and
+ *              whether the 2nd pre-register is determined in MSTS.SPRF.
+ ************************************************************************/
+static void set_pfm(SIM_AXIS *sim, uint8_t pfm)
+{
+    sim->pfm = pfm;
+    sim->reg[REG_INDEX(RSTS)] = (sim->reg[REG_INDEX(RSTS)] & ~FIELD_MASK(RSTS, PFM)) | FIELD_SET(RSTS, PFM, pfm);
+
+    if (pfm == 3)
+    {
+        sim->mainStatus |= MSTS_SPRF;
+    }
+    else
+    {
+        sim->mainStatus &= (uint16_t) ~MSTS_SPRF;
+    }
+}
+
+/*************************************************************************
+ *  @brief      stop_axis
+ *              Ends the operation mode of an axis, immediately.
+ *  @param[in]  errors is the REST factor responsible, or 0 for a normal stop
+ ************************************************************************/
+static void stop_axis(SIM_AXIS *sim, uint32_t errors)
+{
+    if (sim->running)
+    {
+        sim->running = false;
+        sim->runEnd = motionClk;
+        sim->speed = 0.0;
+        sim->pulseFraction = 0.0;
+        sim->decelStopping = false;
+        sim->subStatus &= (uint16_t) ~(SSTS_SFU | SSTS_SFD | SSTS_SFC);
+        sim->mainStatus &= (uint16_t) ~(MSTS_SRUN | MSTS_SSCM);
+        sim->mainStatus |= MSTS_SEND;
+        sim->reg[REG_INDEX(RPLS)] = 0;
+        sim->reg[REG_INDEX(PSPD)] = 0;
+
+        //  stopping cancels any continuous operation
+        set_pfm(sim, 0);
+
+        if (sim->reg[REG_INDEX(RENV2)] & RENV2_IEND)
+        {
+            sim->mainStatus |= MSTS_SENI;
+        }
+
+        raise_interrupts(sim, (errors == 0) ? RIST_ISEN : 0, errors);
+    }
+}
+
+/*************************************************************************
+ *  @brief      cancel_wait
+ *              Discards a start command that waits for CSTA.
+ ************************************************************************/
+static void cancel_wait(SIM_AXIS *sim)
+{
+    if (sim->waiting)
+    {
+        sim->waiting = false;
+        sim->mainStatus &= (uint16_t) ~MSTS_SSCM;
+    }
+}
+
+/*************************************************************************
+ *  @brief      comparator_config
+ *              Extracts the comparison target, condition, and processing of
+ *              comparator n (0..4) from RENV4/RENV5, section 5.4.3.5/6.
+ ************************************************************************/
+static void comparator_config(const SIM_AXIS *sim, uint8_t n, uint8_t *source, uint8_t *condition, uint8_t *action)
+{
+    if (n < 4)
+    {
+        //  comparators 1..4 have the same layout, a byte apart
+        uint32_t field = sim->reg[REG_INDEX(RENV4)] >> (8 * n);
+
+        *source     = (uint8_t) FIELD_GET(RENV4, C1C, field);
+        *condition  = (uint8_t) FIELD_GET(RENV4, C1S, field);
+        *action     = (uint8_t) FIELD_GET(RENV4, C1D, field);
+    }
+    else
+    {
+        uint32_t field = sim->reg[REG_INDEX(RENV5)];
+
+        *source     = (uint8_t) FIELD_GET(RENV5, C5C, field);
+        *condition  = (uint8_t) FIELD_GET(RENV5, C5S, field);
+        *action     = (uint8_t) FIELD_GET(RENV5, C5D, field);
+    }
+}
+
+/*************************************************************************
+ *  @brief      comparator_target
+ *              The value a comparator compares its RCMPn register against.
+ ************************************************************************/
+static int32_t comparator_target(const SIM_AXIS *sim, uint8_t source)
+{
+    int32_t target;
+
+    switch (source)
+    {
+        case 0:     target = (int32_t) sim->reg[REG_INDEX(RCUN1)];  break;
+        case 1:     target = (int32_t) sim->reg[REG_INDEX(RCUN2)];  break;
+        case 2:     target = (int32_t) sim->reg[REG_INDEX(RCUN3)];
+                    target = (target < 0) ? -target : target;       break;
+        case 3:     target = (int32_t) sim->reg[REG_INDEX(RCUN4)];  break;
+        case 4:     target = (int32_t) sim->reg[REG_INDEX(RPLS)];   break;
+        default:    target = (int32_t) sim->reg[REG_INDEX(PSPD)];   break;
+    }
+
+    return (target);
+}
+
+/*************************************************************************
+ *  @brief      limit_allowance
+ *              How many pulses an axis may output in its direction of travel
+ *              before a software limit comparator (section 6.13.2) trips.
+ *  @returns    the pulse allowance, or UINT32_MAX if no limit applies
+ ************************************************************************/
+static uint32_t limit_allowance(const SIM_AXIS *sim)
+{
+    uint8_t source, condition, action;
+    uint8_t n = (sim->direction > 0) ? 0 : 1;
+    int32_t position = (int32_t) sim->reg[REG_INDEX(RCUN1)];
+    int32_t limit = (int32_t) sim->reg[REG_INDEX(RCMP1) + n];
+    int64_t allowance;
+
+    comparator_config(sim, n, &source, &condition, &action);
+
+    if (condition != CMP_SOFT_LIMIT)
+    {
+        return (UINT32_MAX);
+    }
+
+    //  + limit trips once RCMP1 < RCUN1, - limit once RCMP2 > RCUN1
+    allowance = (sim->direction > 0) ? ((int64_t) limit - position + 1) : ((int64_t) position - limit + 1);
+
+    return ((allowance > 0) ? (uint32_t) allowance : 0);
+}
+
+/*************************************************************************
+ *  @brief      pulses_to_limit
+ *              How many pulses an axis may output before it must be halted
+ *              at a software limit; a decelerate-stop keeps outputting pulses
+ *              past the limit while it slows down, so it isn't clamped.
+ *  @returns    the pulse allowance, or UINT32_MAX if no limit applies
+ ************************************************************************/
+static uint32_t pulses_to_limit(const SIM_AXIS *sim)
+{
+    uint8_t source, condition, action;
+
+    comparator_config(sim, (sim->direction > 0) ? 0 : 1, &source, &condition, &action);
+
+    if ((action == CMP_DECEL_STOP) && sim->ramped)
+    {
+        return (UINT32_MAX);
+    }
+
+    return (limit_allowance(sim));
+}
+
+/*************************************************************************
+ *  @brief      evaluate_comparators
+ *              Updates MSTS.SCPn, latches RIST.ISCn on a rising condition,
+ *              and performs the configured processing.
+ *  @param[in]  previous holds the comparison targets before the last move
+ ************************************************************************/
+static void evaluate_comparators(SIM_AXIS *sim, const int32_t previous[5])
+{
+    uint8_t n;
+
+    for (n = 0; n < 5; n++)
+    {
+        uint8_t source, condition, action;
+        int32_t target, reference, low, high;
+        bool satisfied;
+        uint16_t scpBit = (uint16_t) (MSTS_SCP1 << n);
+
+        comparator_config(sim, n, &source, &condition, &action);
+        target = comparator_target(sim, source);
+        reference = (int32_t) sim->reg[REG_INDEX(RCMP1) + n];
+
+        //  equality conditions are satisfied if the target passed through the
+        //  reference during the last integration step
+        low = (previous[n] < target) ? previous[n] : target;
+        high = (previous[n] < target) ? target : previous[n];
+
+        switch (condition)
+        {
+            case CMP_EQUAL:         satisfied = ((reference >= low) && (reference <= high));                            break;
+            case CMP_EQUAL_UP:      satisfied = ((reference >= low) && (reference <= high) && (target >= previous[n])); break;
+            case CMP_EQUAL_DOWN:    satisfied = ((reference >= low) && (reference <= high) && (target <= previous[n])); break;
+            case CMP_GREATER:       satisfied = (reference > target);                                                   break;
+            case CMP_LESS:          satisfied = (reference < target);                                                   break;
+            case CMP_SOFT_LIMIT:    satisfied = (n == 0) ? (reference < target) : ((n == 1) && (reference > target));   break;
+            default:                satisfied = false;                                                                  break;
+        }
+
+        if (satisfied)
+        {
+            if ((sim->mainStatus & scpBit) == 0)
+            {
+                raise_interrupts(sim, (uint32_t) RIST_ISC1 << n, 0);
+            }
+            sim->mainStatus |= scpBit;
+
+            if (sim->running)
+            {
+                if (condition == CMP_SOFT_LIMIT)
+                {
+                    //  a software limit only stops travel toward it
+                    if (((n == 0) && (sim->direction > 0)) || ((n == 1) && (sim->direction < 0)))
+                    {
+                        if ((action == CMP_DECEL_STOP) && sim->ramped)
+                        {
+                            sim->decelStopping = true;
+                        }
+                        else
+                        {
+                            stop_axis(sim, (uint32_t) REST_ESC1 << n);
+                        }
+                    }
+                }
+                else if (action == CMP_STOP)
+                {
+                    stop_axis(sim, (uint32_t) REST_ESC1 << n);
+                }
+                else if (action == CMP_DECEL_STOP)
+                {
+                    sim->decelStopping = true;
+                }
+            }
+        }
+        else
+        {
+            sim->mainStatus &= (uint16_t) ~scpBit;
+        }
+    }
+}
+
+/*************************************************************************
+ *  @brief      snapshot_targets
+ *              Captures every comparator's target ahead of a change.
+ ************************************************************************/
+static void snapshot_targets(const SIM_AXIS *sim, int32_t targets[5])
+{
+    uint8_t n;
+
+    for (n = 0; n < 5; n++)
+    {
+        uint8_t source, condition, action;
+
+        comparator_config(sim, n, &source, &condition, &action);
+        targets[n] = comparator_target(sim, source);
+    }
+}
+
+static void start_axis(SIM_AXIS *sim, uint8_t command);
+
+/*************************************************************************
+ *  @brief      complete_axis
+ *              Ends a positioning operation normally.  If the 1st
+ *              pre-register is determined, its data shifts into the current
+ *              registers and the next operation starts at once, section 6.2;
+ *              otherwise the axis stops.
+ ************************************************************************/
+static void complete_axis(SIM_AXIS *sim)
+{
+    uint8_t command = sim->prereg1Cmd;
+    uint8_t n;
+
+    if (sim->pfm < 2)
+    {
+        stop_axis(sim, 0);
+        return;
+    }
+
+    for (n = 0; n < PREREG_COUNT; n++)
+    {
+        sim->reg[n + PREREG_CURRENT] = sim->prereg1[n];
+        sim->prereg1[n] = sim->reg[n];
+    }
+
+    sim->prereg1Cmd = sim->prereg2Cmd;
+
+    //  the 2nd pre-register becomes writable when its data moves on
+    raise_interrupts(sim, RIST_ISN | ((sim->pfm == 3) ? RIST_ISNM : 0), 0);
+    set_pfm(sim, (uint8_t) (sim->pfm - 1));
+    simStats.chainedStarts++;
+
+    start_axis(sim, command);
+}
+
+/*************************************************************************
+ *  @brief      start_command
+ *              Handles a start command:  it starts a stopped axis, and while
+ *              one is running it determines the next pre-register instead.
+ ************************************************************************/
+static void start_command(SIM_AXIS *sim, uint8_t command)
+{
+    switch (sim->running ? sim->pfm : 0)
+    {
+        //  the operation takes its data from the 1st pre-register, which
+        //  holds anything written while the previous one ran
+        case 0:
+            simStats.idleClk += sim->running ? 0 : (motionClk - sim->runEnd);
+            memcpy(&sim->reg[REG_INDEX(RMV)], sim->prereg1, sizeof(sim->prereg1));
+            set_pfm(sim, 1);
+            start_axis(sim, command);
+            break;
+
+        case 1:
+            sim->prereg1Cmd = command;
+            set_pfm(sim, 2);
+            break;
+
+        case 2:
+            sim->prereg2Cmd = command;
+            set_pfm(sim, 3);
+            break;
+
+        //  nothing left to determine
+        default:
+            simStats.badAccesses++;
+            break;
+    }
+}
+
+/*************************************************************************
+ *  @brief      write_prereg
+ *              Writes the 2nd pre-register n (n = 0 for PRMV); RMV..RDS are
+ *              written through it as well.  Data that isn't held back by a
+ *              determined register is copied on toward the current register.
+ ************************************************************************/
+static void write_prereg(SIM_AXIS *sim, uint8_t n, uint32_t value)
+{
+    int32_t previous[5];
+
+    //  writing the 2nd pre-register while it is determined is invalid
+    if (sim->pfm == 3)
+    {
+        simStats.badAccesses++;
+        return;
+    }
+
+    sim->reg[n] = value;
+
+    if (sim->pfm <= 1)
+    {
+        sim->prereg1[n] = value;
+    }
+
+    if (sim->pfm == 0)
+    {
+        snapshot_targets(sim, previous);
+        sim->reg[n + PREREG_CURRENT] = value;
+        evaluate_comparators(sim, previous);
+    }
+}
+
+/*************************************************************************
+ *  @brief      output_pulses
+ *              Moves an axis by a number of command pulses, updating the
+ *              counters and the remaining pulse count.
+ ************************************************************************/
+static void output_pulses(SIM_AXIS *sim, uint32_t pulses)
+{
+    int32_t delta = (sim->direction > 0) ? (int32_t) pulses : -(int32_t) pulses;
+
+    //  counter 1 is the command position, unless RMD.MCCE stops it counting
+    if ((sim->reg[REG_INDEX(RMD)] & FIELD_MASK(RMD, MCCE)) == 0)
+    {
+        sim->reg[REG_INDEX(RCUN1)] += (uint32_t) delta;
+    }
+
+    //  the emulated mechanics follow the command exactly, so the encoder
+    //  counter tracks counter 1 and the deviation counter stays at zero,
+    //  unless the axis has stalled
+    if (sim->stalled)
+    {
+        sim->reg[REG_INDEX(RCUN3)] += (uint32_t) delta;
+    }
+    else
+    {
+        sim->reg[REG_INDEX(RCUN2)] += (uint32_t) delta;
+        sim->travel += delta;
+    }
+
+    if (sim->positioning)
+    {
+        sim->remaining -= pulses;
+        sim->reg[REG_INDEX(RPLS)] = sim->remaining;
+    }
+}
+
+/*************************************************************************
+ *  @brief      integrate_axis
+ *              Advances the motion of one axis by dt seconds.
+ ************************************************************************/
+static void integrate_axis(SIM_AXIS *sim, double dt)
+{
+    double scale = speed_scale(sim);
+    double lowSpeed = (double) (FIELD_GET(RFL, FL, sim->reg[REG_INDEX(RFL)]) ? FIELD_GET(RFL, FL, sim->reg[REG_INDEX(RFL)]) : 1) * scale;
+    double highSpeed = (double) (FIELD_GET(RFH, FH, sim->reg[REG_INDEX(RFH)]) ? FIELD_GET(RFH, FH, sim->reg[REG_INDEX(RFH)]) : 1) * scale;
+    double startSpeed = sim->speed;
+    double topSpeed = (sim->startCmd == STAFL) ? lowSpeed : highSpeed;
+    double pulses;
+    uint32_t whole, allowance;
+    int32_t previous[5];
+
+    sim->subStatus &= (uint16_t) ~(SSTS_SFU | SSTS_SFD | SSTS_SFC);
+
+    if (sim->ramped)
+    {
+        double accel = ramp_rate(sim, sim->reg[REG_INDEX(RUR)], sim->reg[REG_INDEX(RUS)]);
+        double decel = ramp_rate(sim, FIELD_GET(RDR, DR, sim->reg[REG_INDEX(RDR)]) ? sim->reg[REG_INDEX(RDR)] : sim->reg[REG_INDEX(RUR)], sim->reg[REG_INDEX(RDS)]);
+        double stopping = ((sim->speed * sim->speed) - (lowSpeed * lowSpeed)) / (2.0 * decel);
+
+        if (sim->decelStopping || (sim->positioning && ((double) sim->remaining <= stopping)))
+        {
+            sim->speed -= decel * dt;
+            if (sim->speed < lowSpeed)
+            {
+                sim->speed = lowSpeed;
+            }
+            sim->subStatus |= SSTS_SFD;
+        }
+        else if (sim->speed < topSpeed)
+        {
+            sim->speed += accel * dt;
+            if (sim->speed > topSpeed)
+            {
+                sim->speed = topSpeed;
+            }
+            sim->subStatus |= SSTS_SFU;
+        }
+        else
+        {
+            sim->speed = topSpeed;
+            sim->subStatus |= SSTS_SFC;
+        }
+    }
+    else
+    {
+        sim->speed = topSpeed;
+        sim->subStatus |= SSTS_SFC;
+    }
+
+    sim->reg[REG_INDEX(PSPD)] = (uint32_t) (sim->speed / scale);
+
+    //  a decelerate-stop ends once the axis is down to FL speed
+    if (sim->decelStopping && (sim->speed <= lowSpeed))
+    {
+        stop_axis(sim, 0);
+        return;
+    }
+
+    pulses = sim->pulseFraction + (0.5 * (startSpeed + sim->speed) * dt);
+    whole = (uint32_t) pulses;
+    sim->pulseFraction = pulses - (double) whole;
+
+    if (sim->positioning && (whole > sim->remaining))
+    {
+        whole = sim->remaining;
+    }
+
+    //  never overrun a software limit between integration steps
+    allowance = pulses_to_limit(sim);
+    if (whole > allowance)
+    {
+        whole = allowance;
+    }
+
+    snapshot_targets(sim, previous);
+    output_pulses(sim, whole);
+    evaluate_comparators(sim, previous);
+
+    if (sim->running && sim->positioning && (sim->remaining == 0))
+    {
+        complete_axis(sim);
+    }
+}
+
+/*************************************************************************
+ *  @brief      start_axis
+ *              Starts the operation mode programmed in RMD, per section 5.5
+ *              of the PCL6046 user manual.
+ *  @param[in]  command is STAFL, STAFH, STAD or STAUD
+ ************************************************************************/
+static void start_axis(SIM_AXIS *sim, uint8_t command)
+{
+    uint8_t mode = (uint8_t) FIELD_GET(RMD, MOD, sim->reg[REG_INDEX(RMD)]);
+    int32_t position = (int32_t) sim->reg[REG_INDEX(RCUN1)];
+    int32_t distance = 0;
+    int32_t previous[5];
+
+    sim->startCmd = command;
+    sim->startClk = busClk;
+    sim->startCommand = simStats.commands;
+    sim->ramped = ((command == STAD) || (command == STAUD));
+    sim->decelStopping = false;
+    sim->positioning = true;
+    sim->pulseFraction = 0.0;
+
+    switch (mode)
+    {
+        case MOD_INCREMENTAL:   distance = (int32_t) sim->reg[REG_INDEX(RMV)];              break;
+        case MOD_ABSOLUTE_CUN1: distance = (int32_t) sim->reg[REG_INDEX(RMV)] - position;   break;
+        case MOD_ZERO_CUN1:     distance = -position;                                       break;
+
+        //  an origin return (RENV3.ORM = 0) ends on the ORG sensor, so it
+        //  positions to it if it lies ahead; otherwise it runs on
+        case MOD_ORIGIN_PLUS:
+        case MOD_ORIGIN_MINUS:
+            distance = (int32_t) (sim->origin - sim->travel);
+            sim->positioning = sim->originPlaced && ((distance == 0) || ((distance < 0) == (mode == MOD_ORIGIN_MINUS)));
+            break;
+
+        default:                sim->positioning = false;                                   break;
+    }
+
+    if (sim->positioning)
+    {
+        sim->direction = (distance < 0) ? -1 : 1;
+        sim->remaining = (uint32_t) ((distance < 0) ? -distance : distance);
+    }
+    else
+    {
+        sim->direction = (mode & MOD_CONT_MINUS) ? -1 : 1;
+        sim->remaining = 0;
+    }
+
+    sim->reg[REG_INDEX(RPLS)] = sim->remaining;
+    sim->reg[REG_INDEX(RSTS)] = (sim->direction < 0) ? (sim->reg[REG_INDEX(RSTS)] | FIELD_MASK(RSTS, SDIR)) : (sim->reg[REG_INDEX(RSTS)] & ~FIELD_MASK(RSTS, SDIR));
+
+    //  an operation started from the pre-registers carries on at the speed
+    //  the previous one ended at
+    if (!sim->running)
+    {
+        sim->speed = 0.0;
+        sim->runStart = motionClk;
+    }
+
+    sim->running = true;
+    sim->mainStatus &= (uint16_t) ~MSTS_SEND;
+    sim->mainStatus |= (MSTS_SSCM | MSTS_SRUN);
+
+    //  a positioning operation of zero pulses completes at once, and a start
+    //  toward a software limit that is already satisfied is refused
+    snapshot_targets(sim, previous);
+    if (sim->positioning && (sim->remaining == 0))
+    {
+        complete_axis(sim);
+    }
+    else if (limit_allowance(sim) == 0)
+    {
+        evaluate_comparators(sim, previous);
+        stop_axis(sim, (uint32_t) REST_ESC1 << ((sim->direction > 0) ? 0 : 1));
+    }
+}
+
+/*************************************************************************
+ *  @brief      write_axis_register
+ *              Performs the register write half of a COMW command for one
+ *              axis, taking the data from that axis's BUFW pair.
+ ************************************************************************/
+static void write_axis_register(SIM_AXIS *sim, uint8_t index)
+{
+    uint32_t value = ((uint32_t) sim->bufw[1] << 16) | (uint32_t) sim->bufw[0];
+    int32_t previous[5];
+
+    simStats.registerWrites++;
+
+    switch (index)
+    {
+        //  RIST and REST are cleared by writing 1s
+        case REG_INDEX(RIST):
+        case REG_INDEX(REST):
+            sim->reg[index] &= ~value;
+            break;
+
+        //  read-only registers
+        case REG_INDEX(RLTC1):
+        case REG_INDEX(RLTC2):
+        case REG_INDEX(RLTC3):
+        case REG_INDEX(RLTC4):
+        case REG_INDEX(RSTS):
+        case REG_INDEX(RPLS):
+        case REG_INDEX(PSPD):
+        case REG_INDEX(RSDC):
+        case REG_INDEX(RCIC):
+        case REG_INDEX(RIPS):
+            simStats.badAccesses++;
+            break;
+
+        default:
+            if (index < PREREG_COUNT)
+            {
+                write_prereg(sim, index, value);
+            }
+            else if ((index >= PREREG_CURRENT) && (index < (PREREG_CURRENT + PREREG_COUNT)))
+            {
+                write_prereg(sim, (uint8_t) (index - PREREG_CURRENT), value);
+            }
+            else
+            {
+                snapshot_targets(sim, previous);
+                sim->reg[index] = value;
+                evaluate_comparators(sim, previous);
+            }
+            break;
+    }
+}
+
+/*************************************************************************
+ *  @brief      read_axis_register
+ *              Performs a register read command for one axis, loading the
+ *              value into that axis's BUFW pair.
+ ************************************************************************/
+static void read_axis_register(SIM_AXIS *sim, uint8_t index)
+{
+    uint32_t value = sim->reg[index];
+
+    simStats.registerReads++;
+
+    //  reading RIST/REST clears them unless RENV5.ISMR is set
+    if (((index == REG_INDEX(RIST)) || (index == REG_INDEX(REST))) && ((sim->reg[REG_INDEX(RENV5)] & RENV5_ISMR) == 0))
+    {
+        sim->reg[index] = 0;
+    }
+
+    sim->bufw[1] = (uint16_t) (value >> 16);
+    sim->bufw[0] = (uint16_t) value;
+}
+
+/*************************************************************************
+ *  @brief      execute_command
+ *              Decodes a COMW write: the lower byte is the command and the
+ *              upper byte selects the axes of the chip, section 5.1.3 of the
+ *              manual.
+ ************************************************************************/
+static void execute_command(uint8_t chip, uint16_t commWord)
+{
+    uint8_t command = (uint8_t) commWord;
+    uint8_t axes = (uint8_t) (commWord >> 8) & 0x0F;
+    uint8_t axis;
+    uint8_t carrier;
+
+    simStats.commands++;
+    ifbBusyUntil[chip] = busClk + SIM_IFB_BUSY_CLK;
+
+    //  the CSTA pins of all the chips are wired together, so CMSTA on any
+    //  of them starts every axis that waits for CSTA, on the same clock
+    if (command == CMSTA)
+    {
+        for (carrier = 0; carrier < CARRIERCNT; carrier++)
+        {
+            if (simAxis[carrier].waiting)
+            {
+                simAxis[carrier].waiting = false;
+                start_command(&simAxis[carrier], simAxis[carrier].waitCmd);
+            }
+        }
+        return;
+    }
+
+    for (axis = 0; axis < AXISCNT; axis++)
+    {
+        SIM_AXIS *sim = &simAxis[(chip * AXISCNT) + axis];
+
+        if ((axes & (1 << axis)) == 0)
+        {
+            continue;
+        }
+
+        if (command >= 0xC0)
+        {
+            read_axis_register(sim, REG_INDEX(command));
+        }
+        else if (command >= 0x80)
+        {
+            write_axis_register(sim, REG_INDEX(command));
+        }
+        else
+        {
+            switch (command)
+            {
+                //  the registers return to their power-on state, but the
+                //  mechanics stay where they are
+                case SRST:
+                {
+                    int64_t travel = sim->travel;
+                    int64_t origin = sim->origin;
+                    bool originPlaced = sim->originPlaced;
+
+                    reset_axis(sim);
+                    sim->travel = travel;
+                    sim->origin = origin;
+                    sim->originPlaced = originPlaced;
+                    break;
+                }
+
+                case CMEMG:
+                case STOP:
+                    cancel_wait(sim);
+                    stop_axis(sim, 0);
+                    break;
+
+                case SDSTP:
+                    cancel_wait(sim);
+
+                    if (sim->running)
+                    {
+                        if (sim->ramped)
+                        {
+                            sim->decelStopping = true;
+                        }
+                        else
+                        {
+                            stop_axis(sim, 0);
+                        }
+                    }
+                    break;
+
+                case CUN1R:
+                case CUN2R:
+                case CUN3R:
+                case CUN4R:
+                    sim->reg[REG_INDEX(RCUN1) + (command - CUN1R)] = 0;
+                    break;
+
+                case SENIR:
+                    sim->mainStatus &= (uint16_t) ~MSTS_SENI;
+                    break;
+
+                //  latches all 4 counters at once, section 6.12.3
+                case LTCH:
+                    memcpy(&sim->reg[REG_INDEX(RLTC1)], &sim->reg[REG_INDEX(RCUN1)], 4 * sizeof(uint32_t));
+                    break;
+
+                //  cancels the determined pre-registers, leaving the
+                //  current operation alone
+                case PRECAN:
+                    if (sim->pfm > 1)
+                    {
+                        set_pfm(sim, 1);
+                    }
+                    break;
+
+                case STAFL:
+                case STAFH:
+                case STAD:
+                case STAUD:
+                    //  a stopped axis starts with the 1st pre-register's RMD
+                    if (!sim->running && (FIELD_GET(RMD, MSY, sim->prereg1[REG_INDEX(PRMD) - REG_INDEX(PRMV)]) == MSY_CSTA))
+                    {
+                        sim->waiting = true;
+                        sim->waitCmd = command;
+                        sim->mainStatus |= MSTS_SSCM;
+                    }
+                    else
+                    {
+                        start_command(sim, command);
+                    }
+                    break;
+
+                //  the axis's own CSTA input
+                case STAON:
+                    if (sim->waiting)
+                    {
+                        sim->waiting = false;
+                        start_command(sim, sim->waitCmd);
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+/*************************************************************************
+ *  @brief      int_level
+ *              Level of the emulated INT pin of the first chip, the only one
+ *              wired:  asserted while any of its axes has an event or error
+ *              factor pending, or an operation stop interrupt.  Called with
+ *              the critical section held.
+ ************************************************************************/
+static bool int_level(void)
+{
+    MOTION_AXIS axis;
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        if ((simAxis[axis].reg[REG_INDEX(RIST)] != 0) || (simAxis[axis].reg[REG_INDEX(REST)] != 0) || (simAxis[axis].mainStatus & MSTS_SENI))
+        {
+            return (true);
+        }
+    }
+
+    return (false);
+}
+
+/*************************************************************************
+ *  @brief      int_edge
+ *              Tracks the INT pin, like an edge-triggered EXTI line would.
+ *              Called with the critical section held.
+ *  @returns    true if INT has just been asserted and a handler is attached
+ ************************************************************************/
+static bool int_edge(void)
+{
+    bool level = int_level();
+    bool edge = (level && !intAsserted);
+
+    intAsserted = level;
+
+    return (edge && (intHandler != NULL));
+}
+
+/*************************************************************************
+ *  @brief      main_status
+ *              MSTS as read from MSTSW, with the SERR/SINT summary bits.
+ ************************************************************************/
+static uint16_t main_status(SIM_AXIS *sim)
+{
+    uint16_t status = sim->mainStatus;
+
+    if (sim->reg[REG_INDEX(REST)] != 0)
+    {
+        status |= MSTS_SERR;
+    }
+
+    if (sim->reg[REG_INDEX(RIST)] != 0)
+    {
+        status |= MSTS_SINT;
+    }
+
+    //  SENI clears itself once read, unless RENV5.MSMR is set
+    if ((sim->reg[REG_INDEX(RENV5)] & RENV5_MSMR) == 0)
+    {
+        sim->mainStatus &= (uint16_t) ~MSTS_SENI;
+    }
+
+    return (status);
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_init
+ *              Resets the emulated chips, the bus statistics, and the LEDs.
+ *  @returns    none
+ ************************************************************************/
+void PCL6046_sim_init(void)
+{
+    uint8_t carrier;
+
+    taskENTER_CRITICAL();
+
+    memset(&simStats, 0, sizeof(simStats));
+    memset(simLED, 0, sizeof(simLED));
+    memset(ifbBusyUntil, 0, sizeof(ifbBusyUntil));
+    busClk = 0;
+    intAsserted = false;
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        reset_axis(&simAxis[carrier]);
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_write16
+ *              Emulates a 16-bit write strobe to the ASIC.
+ *  @param[in]  address is the AXIS_MAP field being written
+ *  @param[in]  value is the data
+ *  @returns    none
+ ************************************************************************/
+void PCL6046_sim_write16(volatile uint16_t *address, uint16_t value)
+{
+    uint8_t carrier;
+    int32_t offset;
+    bool edge;
+
+    taskENTER_CRITICAL();
+
+    simStats.busWrites++;
+    bus_cycles(SIM_ACCESS_CLK);
+
+    offset = decode_address(address, &carrier);
+
+    if (offset == (int32_t) offsetof(AXIS_MAP, BUFW0_reg))
+    {
+        simAxis[carrier].bufw[0] = value;
+    }
+    else if (offset == (int32_t) offsetof(AXIS_MAP, BUFW1_reg))
+    {
+        simAxis[carrier].bufw[1] = value;
+    }
+    else if (offset == (int32_t) offsetof(AXIS_MAP, MSTSWr_COMWw))
+    {
+        execute_command(CARRIER_CHIP(carrier), value);
+    }
+    else if (offset != (int32_t) offsetof(AXIS_MAP, SSTSWr_OTPWw))
+    {
+        simStats.badAccesses++;
+    }
+
+    edge = int_edge();
+
+    taskEXIT_CRITICAL();
+
+    if (edge)
+    {
+        intHandler();
+    }
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_read16
+ *              Emulates a 16-bit read strobe from the ASIC.
+ *  @param[in]  address is the AXIS_MAP field being read
+ *  @returns    the data
+ ************************************************************************/
+uint16_t PCL6046_sim_read16(volatile uint16_t *address)
+{
+    uint8_t carrier;
+    int32_t offset;
+    uint16_t value = 0;
+
+    taskENTER_CRITICAL();
+
+    simStats.busReads++;
+    bus_cycles(SIM_ACCESS_CLK);
+
+    offset = decode_address(address, &carrier);
+
+    if (offset == (int32_t) offsetof(AXIS_MAP, BUFW0_reg))
+    {
+        value = simAxis[carrier].bufw[0];
+    }
+    else if (offset == (int32_t) offsetof(AXIS_MAP, BUFW1_reg))
+    {
+        value = simAxis[carrier].bufw[1];
+    }
+    else if (offset == (int32_t) offsetof(AXIS_MAP, MSTSWr_COMWw))
+    {
+        simStats.statusReads++;
+        value = main_status(&simAxis[carrier]);
+    }
+    else if (offset == (int32_t) offsetof(AXIS_MAP, SSTSWr_OTPWw))
+    {
+        simStats.statusReads++;
+        value = simAxis[carrier].subStatus;
+    }
+    else
+    {
+        simStats.badAccesses++;
+    }
+
+    //  a read can only release INT, never assert it
+    (void) int_edge();
+
+    taskEXIT_CRITICAL();
+
+    return (value);
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_IFB
+ *              Emulates the IFB pin of a chip; it reads low for
+ *              SIM_IFB_BUSY_CLK cycles after each COMW write to that chip,
+ *              and each poll costs one CLK cycle.
+ *  @param[in]  chip is the chip number
+ *  @returns    true if the interface is ready
+ ************************************************************************/
+bool PCL6046_sim_IFB(uint8_t chip)
+{
+    bool ready;
+
+    taskENTER_CRITICAL();
+
+    simStats.ifbPolls++;
+    bus_cycles(1);
+    ready = (busClk >= ifbBusyUntil[chip]);
+
+    if (!ready)
+    {
+        simStats.ifbBusyPolls++;
+    }
+
+    taskEXIT_CRITICAL();
+
+    return (ready);
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_microsleep
+ *              Accounts for the BUFW settling delay.
+ *  @returns    none
+ ************************************************************************/
+void PCL6046_sim_microsleep(void)
+{
+    taskENTER_CRITICAL();
+
+    simStats.microsleeps++;
+    bus_cycles(SIM_MICROSLEEP_CLK);
+
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_INT
+ *              Emulates the INT pin:  asserted while any axis has an event
+ *              or error factor pending, or an operation stop interrupt.
+ *  @returns    true if INT is asserted
+ ************************************************************************/
+bool PCL6046_sim_INT(void)
+{
+    bool asserted;
+
+    taskENTER_CRITICAL();
+    asserted = int_level();
+    taskEXIT_CRITICAL();
+
+    return (asserted);
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_attach_INT
+ *              Connects a handler to the emulated INT pin; it is called, as
+ *              an interrupt service routine would be, each time INT becomes
+ *              asserted.
+ *  @param[in]  handler is the interrupt handler, or NULL to disconnect
+ *  @returns    none
+ ************************************************************************/
+void PCL6046_sim_attach_INT(void (*handler)(void))
+{
+    taskENTER_CRITICAL();
+    intHandler = handler;
+    intAsserted = int_level();
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      timer_expired
+ *              POSIX timer notification; calls the attached handler as the
+ *              timer's interrupt would be.
+ ************************************************************************/
+static void timer_expired(union sigval value)
+{
+    void (*handler)(void) = timerHandler;
+
+    (void) value;
+
+    if (handler != NULL)
+    {
+        handler();
+    }
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_timer
+ *              Emulates a periodic hardware timer with a POSIX timer on the
+ *              monotonic clock; the handler is called from the timer's
+ *              notification thread, as an interrupt service routine would be,
+ *              once per period.
+ *  @param[in]  periodUs is the period, in microseconds, or 0 to stop
+ *  @param[in]  handler is the interrupt handler
+ *  @returns    true, if the timer was set; false, otherwise
+ ************************************************************************/
+bool PCL6046_sim_timer(uint32_t periodUs, void (*handler)(void))
+{
+    struct sigevent event;
+    struct itimerspec spec;
+
+    if (!simTimerCreated)
+    {
+        (void) memset(&event, 0, sizeof(event));
+        event.sigev_notify = SIGEV_THREAD;
+        event.sigev_notify_function = timer_expired;
+
+        if (timer_create(CLOCK_MONOTONIC, &event, &simTimer) != 0)
+        {
+            return (false);
+        }
+
+        simTimerCreated = true;
+    }
+
+    (void) memset(&spec, 0, sizeof(spec));
+
+    if (periodUs != 0)
+    {
+        timerHandler = handler;
+        spec.it_interval.tv_sec = (time_t) (periodUs / 1000000UL);
+        spec.it_interval.tv_nsec = (long) ((periodUs % 1000000UL) * 1000UL);
+        spec.it_value = spec.it_interval;
+    }
+
+    if (timer_settime(simTimer, 0, &spec, NULL) != 0)
+    {
+        return (false);
+    }
+
+    if (periodUs == 0)
+    {
+        timerHandler = NULL;
+    }
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_inject_irq
+ *              Raises event and/or error interrupt factors on an axis, as if
+ *              the ASIC had detected them; used to measure event latency.
+ *  @param[in]  axis identifies X, Y, Z, or U axis
+ *  @param[in]  events are RIST bits to raise; they are masked by RIRQ
+ *  @param[in]  errors are REST bits to raise
+ *  @returns    none
+ ************************************************************************/
+void PCL6046_sim_inject_irq(MOTION_AXIS axis, uint32_t events, uint32_t errors)
+{
+    bool edge;
+
+    taskENTER_CRITICAL();
+    raise_interrupts(&simAxis[axis], events, errors);
+    edge = int_edge();
+    taskEXIT_CRITICAL();
+
+    if (edge)
+    {
+        intHandler();
+    }
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_timestamp
+ *              Host stand-in for the DWT cycle counter.
+ *  @returns    monotonic time in nanoseconds, modulo 2^32
+ ************************************************************************/
+uint32_t PCL6046_sim_timestamp(void)
+{
+    struct timespec now;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint32_t) ((uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec));
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_advance
+ *              Advances the motion of every carrier by a number of CLK cycles.
+ *  @param[in]  clkCycles is the simulated time step
+ *  @returns    none
+ ************************************************************************/
+void PCL6046_sim_advance(uint32_t clkCycles)
+{
+    double dt = (double) clkCycles / (double) SIM_CLK_HZ;
+    uint8_t carrier;
+    bool edge;
+
+    taskENTER_CRITICAL();
+
+    simStats.clkCycles += clkCycles;
+    motionClk += clkCycles;
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        if (simAxis[carrier].running)
+        {
+            integrate_axis(&simAxis[carrier], dt);
+        }
+    }
+
+    edge = int_edge();
+
+    taskEXIT_CRITICAL();
+
+    if (edge)
+    {
+        intHandler();
+    }
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_clock
+ *              RTOS task that keeps the emulated chips moving in step with
+ *              the RTOS tick.
+ *  @param[in]  pvParameters is ignored
+ *  @returns    none
+ ************************************************************************/
+void PCL6046_sim_clock(void *pvParameters)
+{
+    TickType_t lastTimeHere = xTaskGetTickCount();
+
+    while (1)
+    {
+        vTaskDelayUntil(&lastTimeHere, (const TickType_t) SIM_CLOCK_PERIOD);
+        PCL6046_sim_advance((uint32_t) ((SIM_CLK_HZ / 1000UL) * SIM_CLOCK_PERIOD));
+    }
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_peek
+ *              Reads an emulated register without touching the bus or the
+ *              statistics; for scenario set-up and checking only.
+ ************************************************************************/
+uint32_t PCL6046_sim_peek(uint8_t carrier, ASIC_REG regName)
+{
+    uint32_t value;
+
+    taskENTER_CRITICAL();
+    value = simAxis[carrier].reg[REG_INDEX(regName)];
+    taskEXIT_CRITICAL();
+
+    return (value);
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_poke
+ *              Writes an emulated register without touching the bus or the
+ *              statistics; for scenario set-up only.
+ ************************************************************************/
+void PCL6046_sim_poke(uint8_t carrier, ASIC_REG regName, uint32_t value)
+{
+    taskENTER_CRITICAL();
+    simAxis[carrier].reg[REG_INDEX(regName)] = value;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_started
+ *              When an emulated axis last started an operation:  the bus
+ *              clock, and the count of COMW writes including the one that
+ *              started it; for comparing the starts of several axes.
+ ************************************************************************/
+void PCL6046_sim_started(uint8_t carrier, uint64_t *clk, uint32_t *command)
+{
+    taskENTER_CRITICAL();
+    *clk = simAxis[carrier].startClk;
+    *command = simAxis[carrier].startCommand;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_place_origin
+ *              Places the ORG sensor of an emulated axis, relative to where
+ *              the axis is now; for scenario set-up only.
+ *  @param[in]  distance is in pulses, + or -
+ ************************************************************************/
+void PCL6046_sim_place_origin(uint8_t carrier, int32_t distance)
+{
+    taskENTER_CRITICAL();
+    simAxis[carrier].origin = simAxis[carrier].travel + distance;
+    simAxis[carrier].originPlaced = true;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_stall
+ *              Stalls or frees the mechanics of an emulated axis; for
+ *              scenario set-up only.
+ ************************************************************************/
+void PCL6046_sim_stall(uint8_t carrier, bool stalled)
+{
+    taskENTER_CRITICAL();
+    simAxis[carrier].stalled = stalled;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_run_time
+ *              How long an emulated axis ran, in CLK cycles of motion time,
+ *              from starting until it last stopped (or until now, while it
+ *              is still running).
+ ************************************************************************/
+uint64_t PCL6046_sim_run_time(uint8_t carrier)
+{
+    uint64_t clk;
+
+    taskENTER_CRITICAL();
+    clk = (simAxis[carrier].running ? motionClk : simAxis[carrier].runEnd) - simAxis[carrier].runStart;
+    taskEXIT_CRITICAL();
+
+    return (clk);
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_get_stats
+ *              Copies the bus statistics.
+ *  @param[out] stats receives the counts
+ *  @returns    none
+ ************************************************************************/
+void PCL6046_sim_get_stats(PCL6046_SIM_STATS *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = simStats;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_reset_stats
+ *              Zeroes the bus statistics.
+ *  @returns    none
+ ************************************************************************/
+void PCL6046_sim_reset_stats(void)
+{
+    taskENTER_CRITICAL();
+    memset(&simStats, 0, sizeof(simStats));
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_store_write
+ *              Emulates the flash store of the warm-restart snapshot with a
+ *              file, SIM_STORE_FILE, replacing what it held.
+ *  @param[in]  data and length are what to store
+ *  @returns    true, if it was stored; false, otherwise
+ ************************************************************************/
+bool PCL6046_sim_store_write(const void *data, uint32_t length)
+{
+    FILE *file = fopen(SIM_STORE_FILE, "wb");
+    bool stored;
+
+    if (file == NULL)
+    {
+        return (false);
+    }
+
+    stored = (fwrite(data, 1, length, file) == length);
+
+    return ((fclose(file) == 0) && stored);
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_store_read
+ *              Reads the emulated flash store back.
+ *  @param[out] data receives up to length bytes
+ *  @returns    true, if the store held length bytes or more; false, if it
+ *              is erased or shorter
+ ************************************************************************/
+bool PCL6046_sim_store_read(void *data, uint32_t length)
+{
+    FILE *file = fopen(SIM_STORE_FILE, "rb");
+    bool read;
+
+    if (file == NULL)
+    {
+        return (false);
+    }
+
+    read = (fread(data, 1, length, file) == length);
+    (void) fclose(file);
+
+    return (read);
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_store_erase
+ *              Erases the emulated flash store.
+ *  @returns    none
+ ************************************************************************/
+void PCL6046_sim_store_erase(void)
+{
+    (void) remove(SIM_STORE_FILE);
+}
+
+/*************************************************************************
+ *  @brief      PCL6046_sim_LED / PCL6046_sim_LED_lit
+ *              Emulated board LEDs driven by light_LED()/extinguish_LED().
+ ************************************************************************/
+void PCL6046_sim_LED(uint8_t led, bool lit)
+{
+    if (led < CARRIERCNT)
+    {
+        simLED[led] = lit;
+    }
+}
+
+bool PCL6046_sim_LED_lit(uint8_t led)
+{
+    return ((led < CARRIERCNT) ? simLED[led] : false);
+}
+
+#endif
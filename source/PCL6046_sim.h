@@ -0,0 +1,91 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_sim.h
+ *                          Host-side emulation of the PCL6046 bus interface,
+ *                          used when the firmware is built for Linux with
+ *                          PCL6046_HOST_SIM defined
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_SIM_H
+    #define PCL6046_SIM_H
+
+    //  reference clock of the ASIC, per section 5.1.3 of the PCL6046 user manual
+    #define SIM_CLK_HZ              19660800UL
+
+    //  bus cost model, in CLK cycles:  one read or write strobe, the > 1us
+    //  settling delay between BUFW writes (microsleep()), and the IFB busy
+    //  window that follows a COMW write
+    #define SIM_ACCESS_CLK          2
+    #define SIM_MICROSLEEP_CLK      2
+    #define SIM_IFB_BUSY_CLK        4
+
+    //  the simulated clock task advances the chip by this many milliseconds
+    //  of motion each time it runs
+    #define SIM_CLOCK_PERIOD        1
+
+    //  the file that stands in for the flash store of the warm-restart
+    //  snapshot, in the working directory
+    #ifndef SIM_STORE_FILE
+        #define SIM_STORE_FILE      "PCL6046_store.bin"
+    #endif
+
+    //  counts of everything that has crossed the emulated bus since the last
+    //  call to PCL6046_sim_reset_stats()
+    typedef struct
+    {
+        uint32_t    busWrites;          //  16-bit write strobes
+        uint32_t    busReads;           //  16-bit read strobes
+        uint32_t    commands;           //  COMW writes (each one is a bus transaction)
+        uint32_t    registerWrites;     //  per-axis register writes decoded from COMW
+        uint32_t    registerReads;      //  per-axis register reads decoded from COMW
+        uint32_t    statusReads;        //  MSTSW/SSTSW reads
+        uint32_t    ifbPolls;           //  reads of the IFB pin
+        uint32_t    ifbBusyPolls;       //  ... that found the interface busy
+        uint32_t    microsleeps;
+        uint32_t    badAccesses;        //  accesses to offsets the interface doesn't decode
+        uint32_t    chainedStarts;      //  operations started from the pre-registers
+        uint64_t    busCycles;          //  CLK cycles spent on bus traffic
+        uint64_t    idleClk;            //  CLK cycles of motion time axes stood still
+                                        //  before a start command started them again
+        uint64_t    clkCycles;          //  CLK cycles of simulated motion time
+
+    }   PCL6046_SIM_STATS;
+
+    #ifdef  PCL6046_SIM_C
+
+        //  the banks of PCL6046.c point into this block, AXISCNT axis blocks
+        //  per chip; the contents are never used, only the addresses
+        AXIS_MAP    PCL6046_sim_space[CARRIERCNT];
+
+    #else
+
+        extern AXIS_MAP PCL6046_sim_space[CARRIERCNT];
+
+        void PCL6046_sim_init(void);
+        void PCL6046_sim_write16(volatile uint16_t *address, uint16_t value);
+        uint16_t PCL6046_sim_read16(volatile uint16_t *address);
+        bool PCL6046_sim_IFB(uint8_t chip);
+        void PCL6046_sim_microsleep(void);
+        bool PCL6046_sim_INT(void);
+        void PCL6046_sim_advance(uint32_t clkCycles);
+        void PCL6046_sim_clock(void *pvParameters);
+        uint32_t PCL6046_sim_peek(uint8_t carrier, ASIC_REG regName);
+        void PCL6046_sim_poke(uint8_t carrier, ASIC_REG regName, uint32_t value);
+        void PCL6046_sim_started(uint8_t carrier, uint64_t *clk, uint32_t *command);
+        uint64_t PCL6046_sim_run_time(uint8_t carrier);
+        void PCL6046_sim_place_origin(uint8_t carrier, int32_t distance);
+        void PCL6046_sim_stall(uint8_t carrier, bool stalled);
+        void PCL6046_sim_get_stats(PCL6046_SIM_STATS *stats);
+        void PCL6046_sim_reset_stats(void);
+        void PCL6046_sim_attach_INT(void (*handler)(void));
+        bool PCL6046_sim_timer(uint32_t periodUs, void (*handler)(void));
+        void PCL6046_sim_inject_irq(MOTION_AXIS axis, uint32_t events, uint32_t errors);
+        uint32_t PCL6046_sim_timestamp(void);
+        bool PCL6046_sim_store_write(const void *data, uint32_t length);
+        bool PCL6046_sim_store_read(void *data, uint32_t length);
+        void PCL6046_sim_store_erase(void);
+        void PCL6046_sim_LED(uint8_t led, bool lit);
+        bool PCL6046_sim_LED_lit(uint8_t led);
+    #endif
+#endif
@@ -0,0 +1,299 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_telem.c
+ *                          Telemetry stream:  the host subscribes to some
+ *                          of the snapshot's fields for some carriers, and
+ *                          every n'th acquisition is sampled into one of two
+ *                          packet-sized pages, each value as a zigzag varint
+ *                          of its change since the previous sample.  A full
+ *                          page is sent by ASIC_telemetry while the other
+ *                          fills; if the host reads too slowly for both to
+ *                          be full, samples are dropped and counted, so the
+ *                          acquisition (and the limit loop it may be part
+ *                          of) never waits on USB.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_TELEM_C
+
+#include    <stdint.h>
+#include    <stdbool.h>
+#include    <string.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_maint.h"
+#include    "PCL6046_comm.h"
+#include    "PCL6046_telem.h"
+
+
+/*************************************************************************
+ *  @brief      put_varint
+ *              Encodes a change as a zigzag varint, so that small changes
+ *              either way take few bytes.
+ *  @param[in]  data is where to put it, TELEM_VARINT_MAX bytes of room
+ *  @param[in]  delta is the change, modulo 2^32
+ *  @returns    the bytes used, 1 to TELEM_VARINT_MAX
+ ************************************************************************/
+static uint16_t put_varint(uint8_t *data, uint32_t delta)
+{
+    uint32_t zigzag = (delta << 1) ^ (0 - (delta >> 31));
+    uint16_t n = 0;
+
+    while (zigzag >= 0x80)
+    {
+        data[n++] = (uint8_t) (zigzag | 0x80);
+        zigzag >>= 7;
+    }
+
+    data[n++] = (uint8_t) zigzag;
+
+    return (n);
+}
+
+/*************************************************************************
+ *  @brief      field_value
+ *              Get method for one field of one carrier in a snapshot
+ *  @param[in]  snap is the snapshot
+ *  @param[in]  field indexes telemFieldItem[]
+ *  @param[in]  carrier is the carrier
+ *  @returns    the value
+ ************************************************************************/
+static uint32_t field_value(const PCL6046_SNAPSHOT *snap, uint8_t field, uint8_t carrier)
+{
+    switch (telemFieldItem[field])
+    {
+        case ACQ_MSTSW:
+            return (snap->mstatus[carrier]);
+
+        case ACQ_PSPD:
+            return (snap->speed[carrier]);
+
+        default:
+            return (snap->counter[field - 1][carrier]);
+    }
+}
+
+/*************************************************************************
+ *  @brief      close_page
+ *              Hands the page being encoded into to ASIC_telemetry, and
+ *              moves on to the other one.
+ *  @returns    none
+ ************************************************************************/
+static void close_page(void)
+{
+    //  the page must be complete before ASIC_telemetry is pointed at it
+    COMPILER_BARRIER();
+    telemFull[telemActive] = true;
+    telemActive ^= 1;
+    telemFlush = false;
+
+    if (telemTask != (TaskHandle_t) NULL)
+    {
+        (void) xTaskNotifyGive(telemTask);
+    }
+}
+
+/*************************************************************************
+ *  @brief      subscribe_telemetry
+ *              Set method for the telemetry subscription; the fields are
+ *              added to the acquisition, and the next sample starts a new
+ *              packet.
+ *  @param[in]  items are the ACQ_xxx bits of TELEM_ITEMS to stream, or 0 to
+ *              stop streaming
+ *  @param[in]  carriers has bit n set to stream carrier n
+ *  @param[in]  decimation is how many acquisitions there are per sample, 1
+ *              or more
+ *  @returns    true, if the subscription was valid; false, otherwise
+ ************************************************************************/
+bool subscribe_telemetry(uint32_t items, uint32_t carriers, uint32_t decimation)
+{
+    uint32_t values = 0;
+    uint8_t carrier;
+    uint8_t field;
+
+    if ((items & ~TELEM_ITEMS) || (decimation == 0) || ((carriers >> (CARRIERCNT - 1)) > 1) || ((items != 0) && (carriers == 0)))
+    {
+        return (false);
+    }
+
+    //  a sample must fit a page whatever its values
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        for (field = 0; field < TELEM_FIELDS; field++)
+        {
+            if ((carriers & (1UL << carrier)) && (items & telemFieldItem[field]))
+            {
+                values++;
+            }
+        }
+    }
+
+    if (((2 + values) * TELEM_VARINT_MAX) > TELEM_PAGE_BYTES)
+    {
+        return (false);
+    }
+
+    acquire_items(items);
+
+    taskENTER_CRITICAL();
+    telemItems = items;
+    telemCarriers = carriers;
+    telemDecimation = decimation;
+    telemSkipped = 0;
+    taskEXIT_CRITICAL();
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      telemetry_sample
+ *              Samples a published snapshot, if it's the one of
+ *              telemDecimation due.  It's called by the acquisition, so
+ *              it never waits:  if both pages are full, the sample is
+ *              dropped.
+ *  @param[in]  snap is the snapshot
+ *  @returns    none
+ ************************************************************************/
+void telemetry_sample(const PCL6046_SNAPSHOT *snap)
+{
+    TELEM_PAGE *page = &telemPage[telemActive];
+    uint32_t items = telemItems;
+    uint32_t carriers = telemCarriers;
+    uint32_t worst = 2;
+    uint16_t bytes;
+    uint32_t value;
+    uint8_t carrier;
+    uint8_t field;
+
+    //  a subscription change, or an end to it, ends the page
+    if (!telemFull[telemActive] && (page->header.count != 0) && ((page->header.items != items) || (page->header.carriers != carriers)))
+    {
+        close_page();
+        page = &telemPage[telemActive];
+    }
+
+    if ((items == 0) || ((snap->items & items) != items) || (++telemSkipped < telemDecimation))
+    {
+        return;
+    }
+
+    telemSkipped = 0;
+
+    if (telemFull[telemActive])
+    {
+        telemStats.dropped++;
+        telemDropped++;
+        return;
+    }
+
+    //  a new page starts from this sample
+    if (page->header.count == 0)
+    {
+        page->header.magic = TELEM_MAGIC;
+        page->header.first = snap->sequence;
+        page->header.tick = (uint32_t) snap->tick;
+        page->header.carriers = carriers;
+        page->header.items = (uint16_t) items;
+        page->header.bytes = 0;
+        page->header.dropped = telemDropped;
+        telemDropped = 0;
+        telemSequence = snap->sequence;
+        telemTick = snap->tick;
+        memset(telemPrevious, 0, sizeof(telemPrevious));
+    }
+
+    bytes = page->header.bytes;
+    bytes += put_varint(&page->data[bytes], snap->sequence - telemSequence);
+    bytes += put_varint(&page->data[bytes], (uint32_t) (snap->tick - telemTick));
+    telemSequence = snap->sequence;
+    telemTick = snap->tick;
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        if ((carriers & (1UL << carrier)) == 0)
+        {
+            continue;
+        }
+
+        for (field = 0; field < TELEM_FIELDS; field++)
+        {
+            if (items & telemFieldItem[field])
+            {
+                value = field_value(snap, field, carrier);
+                bytes += put_varint(&page->data[bytes], value - telemPrevious[field][carrier]);
+                telemPrevious[field][carrier] = value;
+                worst++;
+            }
+        }
+    }
+
+    page->header.bytes = bytes;
+    page->header.count++;
+    telemStats.samples++;
+
+    //  the page goes when another sample mightn't fit, or when it's due
+    if (telemFlush || ((bytes + (worst * TELEM_VARINT_MAX)) > TELEM_PAGE_BYTES))
+    {
+        close_page();
+    }
+}
+
+/*************************************************************************
+ *  @brief      get_telem_stats
+ *              Get method for the telemetry counters
+ *  @param[out] stats receives a copy of the counters
+ *  @returns    none
+ ************************************************************************/
+void get_telem_stats(TELEM_STATS *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = telemStats;
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      ASIC_telemetry
+ *              This RTOS task sends the telemetry pages as they fill, and
+ *              has a page that's been filling for TELEM_FLUSH_PERIOD closed
+ *              early, so a slow stream still reaches the host promptly.
+ *  @param[in]  pvParameters is ignored, currently
+ *  @returns    none
+ ************************************************************************/
+void ASIC_telemetry(void *pvParameters)
+{
+    TELEM_PAGE *page;
+
+    telemTask = xTaskGetCurrentTaskHandle();
+
+    while (1)
+    {
+        if ((ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TELEM_FLUSH_PERIOD)) == 0) && (telemPage[telemActive].header.count != 0))
+        {
+            telemFlush = true;
+        }
+
+        while (telemFull[telemSend])
+        {
+            page = &telemPage[telemSend];
+
+            if (usb_transmit((const uint8_t *) page, (uint16_t) (sizeof(TELEM_HDR) + page->header.bytes)))
+            {
+                telemStats.packets++;
+                telemStats.bytes += page->header.bytes;
+            }
+            else
+            {
+                telemStats.failed++;
+            }
+
+            //  the page is the acquisition's again
+            page->header.count = 0;
+            COMPILER_BARRIER();
+            telemFull[telemSend] = false;
+            telemSend ^= 1;
+        }
+    }
+}
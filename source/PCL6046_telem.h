@@ -0,0 +1,111 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_telem.h
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_TELEM_H
+    #define PCL6046_TELEM_H
+
+    //  first word of every telemetry packet, "P6TM"
+    #define TELEM_MAGIC             0x4D543650UL
+
+    //  the snapshot items that can be streamed, per carrier, in this order:
+    //  MSTSW, COUNTER1..COUNTER4, and the current speed step
+    #define TELEM_ITEMS             (ACQ_MSTSW | ACQ_RCUN1 | ACQ_RCUN2 | ACQ_RCUN3 | ACQ_RCUN4 | ACQ_PSPD)
+    #define TELEM_FIELDS            6
+
+    //  the two pages of the ring:  each is encoded into until the next sample
+    //  might not fit, then sent as one packet while the other fills
+    #define TELEM_PAGE_BYTES        (USB_TX_BUFFER_SIZE - sizeof(TELEM_HDR))
+
+    //  a page that isn't full is sent anyway once it's this old, in
+    //  milliseconds
+    #define TELEM_FLUSH_PERIOD      100
+
+    //  longest encoding of one value:  a zigzag varint of a 32-bit delta
+    #define TELEM_VARINT_MAX        5
+
+    //  a telemetry packet is this header and "bytes" of samples.  Each sample
+    //  is a series of zigzag varints (7 bits per byte, least significant
+    //  first, bit 7 set on all but the last byte):  the change in snapshot
+    //  sequence and in RTOS tick since the previous sample, then the change
+    //  in each subscribed field of each subscribed carrier, by carrier then
+    //  field.  The first sample of a packet is relative to "first" and
+    //  "tick", so its first two values are 0, and to 0 for its fields, so
+    //  every packet decodes on its own.  Little-endian.
+    typedef struct
+    {
+        uint32_t    magic;
+        uint32_t    first;                  //  snapshot sequence of the first sample
+        uint32_t    tick;                   //  RTOS tick of the first sample
+        uint32_t    carriers;               //  bit n set for carrier n
+        uint16_t    items;                  //  ACQ_xxx bits of TELEM_ITEMS
+        uint16_t    count;                  //  samples in the packet
+        uint16_t    bytes;                  //  sample bytes that follow
+        uint16_t    dropped;                //  samples lost since the last packet
+
+    }   TELEM_HDR;
+
+    //  telemetry counters
+    typedef struct
+    {
+        uint32_t    samples;                //  samples encoded
+        uint32_t    dropped;                //  ... lost because both pages were full
+        uint32_t    packets;                //  packets sent
+        uint32_t    bytes;                  //  sample bytes sent
+        uint32_t    failed;                 //  packets the USB endpoint refused
+
+    }   TELEM_STATS;
+
+    //  ASIC_telemetry's stack:  only scalars, the pages being static
+    #define TELEM_STACK_SIZE        TASK_STACK_SIZE(32 * sizeof(uint32_t))
+
+    #ifdef  PCL6046_TELEM_C
+
+        //  the item of each field, in encoding order
+        static const uint32_t       telemFieldItem[TELEM_FIELDS] = {ACQ_MSTSW, ACQ_RCUN1, ACQ_RCUN2, ACQ_RCUN3, ACQ_RCUN4, ACQ_PSPD};
+
+        //  a page of the ring is a whole packet, header and samples
+        typedef struct
+        {
+            TELEM_HDR   header;
+            uint8_t     data[TELEM_PAGE_BYTES];
+
+        }   TELEM_PAGE;
+
+        //  the page being encoded into belongs to the acquisition, a full one
+        //  to ASIC_telemetry until it has been sent; the pages fill and are
+        //  sent in turn
+        static TELEM_PAGE           telemPage[2];
+        static volatile uint8_t     telemActive = 0;
+        static uint8_t              telemSend = 0;
+        static volatile bool        telemFull[2] = {false, false};
+
+        //  the previous sample, the base of the next one's deltas
+        static uint32_t             telemPrevious[TELEM_FIELDS][CARRIERCNT];
+        static uint32_t             telemSequence;
+        static TickType_t           telemTick;
+
+        //  the subscription; items == 0 means none.  Only every telemDecimation'th
+        //  snapshot is sampled
+        static volatile uint32_t    telemItems = 0;
+        static volatile uint32_t    telemCarriers = 0;
+        static volatile uint32_t    telemDecimation = 1;
+        static uint32_t             telemSkipped = 0;
+
+        //  set by ASIC_telemetry to have the next sample close its page
+        static volatile bool        telemFlush = false;
+        static uint16_t             telemDropped = 0;
+
+        static TaskHandle_t         telemTask = (TaskHandle_t) NULL;
+
+        static TELEM_STATS          telemStats;
+
+    #else
+        bool subscribe_telemetry(uint32_t items, uint32_t carriers, uint32_t decimation);
+        void telemetry_sample(const PCL6046_SNAPSHOT *snap);
+        void get_telem_stats(TELEM_STATS *stats);
+        void ASIC_telemetry(void *pvParameters);
+    #endif
+#endif
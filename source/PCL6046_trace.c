@@ -0,0 +1,164 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_trace.c
+ *                          Trace ring of the command words written to the
+ *                          PCL6046.  Each record says which task's transaction
+ *                          it belonged to, how long that transaction waited
+ *                          for the bus, and how long IFB held the bus busy
+ *                          afterwards.  Records are stamped with TIMESTAMP(),
+ *                          which counts CPU cycles on the target.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_TRACE_C
+
+#include    <stdint.h>
+#include    <stdbool.h>
+#include    <string.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_trace.h"
+
+/*************************************************************************
+ *  @brief      trace_enable
+ *              Starts or stops recording.  Records already in the ring are
+ *              kept either way.
+ *  @param[in]  on is true to record
+ *  @returns    none
+ ************************************************************************/
+void trace_enable(bool on)
+{
+    traceOn = on;
+}
+
+/*************************************************************************
+ *  @brief      trace_context
+ *              Sets the transaction that following command words to a chip
+ *              belong to; only called by the owner of that chip's bus.
+ *  @param[in]  chip is the chip number
+ *  @param[in]  caller is the handle of the submitting task
+ *  @param[in]  busClass is the priority class of the transaction
+ *  @param[in]  queueWait is the time the transaction waited for the bus
+ *  @param[in]  merged is the number of transactions sharing the command word
+ *  @returns    none
+ ************************************************************************/
+void trace_context(uint8_t chip, const void *caller, uint8_t busClass, uint32_t queueWait, uint8_t merged)
+{
+    traceContext[chip].caller = caller;
+    traceContext[chip].busClass = busClass;
+    traceContext[chip].queueWait = queueWait;
+    traceContext[chip].merged = merged;
+    traceContext[chip].chip = chip;
+}
+
+/*************************************************************************
+ *  @brief      trace_command
+ *              Records a command word in the ring; called by the owner of
+ *              each chip's bus, so the entry is written in a critical section.
+ *  @param[in]  chip is the chip number
+ *  @param[in]  commWord is the word written to COMW
+ *  @param[in]  stamp is TIMESTAMP() as it was written
+ *  @param[in]  ifbWait is the time IFB stayed low afterwards
+ *  @returns    none
+ ************************************************************************/
+void trace_command(uint8_t chip, uint16_t commWord, uint32_t stamp, uint32_t ifbWait)
+{
+    TRACE_ENTRY *entry;
+    uint32_t head;
+
+    if (!traceOn)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+
+    head = traceHead;
+    entry = &traceRing[head & (TRACE_DEPTH - 1)];
+
+    *entry = traceContext[chip];
+    entry->stamp = stamp;
+    entry->ifbWait = ifbWait;
+    entry->commWord = commWord;
+
+    //  the entry must be complete before readers can see it
+    COMPILER_BARRIER();
+    traceHead = head + 1;
+
+    taskEXIT_CRITICAL();
+}
+
+/*************************************************************************
+ *  @brief      trace_read
+ *              Copies records from the ring without stopping the writer.
+ *              Records the writer overwrote during the copy are dropped, so
+ *              every record returned is whole.
+ *  @param[in,out]  cursor is the sequence number of the next record wanted;
+ *              it's advanced past the records returned, and past any that
+ *              were lost to overwriting
+ *  @param[out] records receives up to max records
+ *  @param[in]  max is the room in records
+ *  @returns    the number of records copied
+ ************************************************************************/
+uint16_t trace_read(uint32_t *cursor, TRACE_RECORD *records, uint16_t max)
+{
+    uint32_t head = traceHead;
+    uint32_t from = *cursor;
+    uint32_t oldest;
+    uint16_t count = 0;
+    uint16_t skip = 0;
+    uint16_t n;
+
+    //  anything older than TRACE_DEPTH records has already been overwritten
+    if ((head - from) > TRACE_DEPTH)
+    {
+        from = head - TRACE_DEPTH;
+    }
+
+    while (((from + count) != head) && (count < max))
+    {
+        const TRACE_ENTRY *entry = &traceRing[(from + count) & (TRACE_DEPTH - 1)];
+        TRACE_RECORD *record = &records[count];
+
+        record->stamp = entry->stamp;
+        record->queueWait = entry->queueWait;
+        record->ifbWait = entry->ifbWait;
+        record->commWord = entry->commWord;
+        record->busClass = entry->busClass;
+        record->merged = entry->merged;
+        record->chip = entry->chip;
+        (void) memset(record->reserved, 0, sizeof(record->reserved));
+
+        (void) memset(record->task, 0, TRACE_NAME_LEN);
+
+        //  the name is cut short, if need be, to leave room for its NUL
+        if (entry->caller != NULL)
+        {
+            (void) strncpy(record->task, pcTaskGetName((TaskHandle_t) entry->caller), TRACE_NAME_LEN - 1);
+            record->task[TRACE_NAME_LEN - 1] = '\0';
+        }
+
+        count++;
+    }
+
+    //  drop whatever the writer reached while the records were copied
+    COMPILER_BARRIER();
+    oldest = traceHead - TRACE_DEPTH;
+
+    if (((int32_t) (oldest - from)) > 0)
+    {
+        skip = (uint16_t) (((oldest - from) < count) ? (oldest - from) : count);
+
+        for (n = skip; n < count; n++)
+        {
+            records[n - skip] = records[n];
+        }
+    }
+
+    *cursor = from + count;
+
+    return ((uint16_t) (count - skip));
+}
@@ -0,0 +1,82 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_trace.h
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_TRACE_H
+    #define PCL6046_TRACE_H
+
+    //  command words kept in the ring; must be a power of 2
+    #define TRACE_DEPTH             256
+
+    //  task names take this many bytes of a record, their NUL included
+    #define TRACE_NAME_LEN          8
+
+    //  first word of every dump packet, "P6TR"
+    #define TRACE_MAGIC             0x52543650UL
+
+    //  one command word written to the ASIC, as it's dumped to the host;
+    //  times are in TIMESTAMP() counts (CPU cycles on target, nanoseconds on
+    //  the host), little-endian
+    typedef struct
+    {
+        uint32_t    stamp;                  //  TIMESTAMP() as the command word was written
+        uint32_t    queueWait;              //  submission to the start of its transaction
+        uint32_t    ifbWait;                //  spent polling IFB after the command word
+        uint16_t    commWord;               //  axis bits and command/register code
+        uint8_t     busClass;               //  BUS_CLASS of the transaction
+        uint8_t     merged;                 //  transactions sharing the command word
+        uint8_t     chip;                   //  chip the command word went to
+        uint8_t     reserved[3];
+        char        task[TRACE_NAME_LEN];   //  submitting task, NUL-terminated
+
+    }   TRACE_RECORD;
+
+    //  a dump is a series of packets, each this header and "count" records;
+    //  "first" is the sequence number of the first record, so the host can
+    //  tell when records were overwritten before they were read
+    typedef struct
+    {
+        uint32_t    magic;
+        uint32_t    stampHz;                //  TIMESTAMP_HZ
+        uint32_t    first;
+        uint16_t    count;
+        uint16_t    reserved;
+
+    }   TRACE_DUMP_HDR;
+
+    #ifdef  PCL6046_TRACE_C
+
+        //  what the ring holds; the task name is only looked up when dumped
+        typedef struct
+        {
+            uint32_t    stamp;
+            uint32_t    queueWait;
+            uint32_t    ifbWait;
+            uint16_t    commWord;
+            uint8_t     busClass;
+            uint8_t     merged;
+            uint8_t     chip;
+            const void  *caller;
+
+        }   TRACE_ENTRY;
+
+        //  the ring is written by the bus owner of every chip (or whoever owns
+        //  a bus before its owner runs), each entry inside a short critical
+        //  section; traceHead counts every entry ever written, and readers use
+        //  it to detect overwrites
+        static TRACE_ENTRY          traceRing[TRACE_DEPTH];
+        static volatile uint32_t    traceHead = 0;
+        static volatile bool        traceOn = false;
+
+        //  the transaction being carried out on each chip, see trace_context()
+        static TRACE_ENTRY          traceContext[PCL6046_CHIPS];
+
+    #else
+        void trace_enable(bool on);
+        void trace_context(uint8_t chip, const void *caller, uint8_t busClass, uint32_t queueWait, uint8_t merged);
+        void trace_command(uint8_t chip, uint16_t commWord, uint32_t stamp, uint32_t ifbWait);
+        uint16_t trace_read(uint32_t *cursor, TRACE_RECORD *records, uint16_t max);
+    #endif
+#endif
@@ -0,0 +1,356 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_warm.c
+ *                          Warm restart:  on a controlled stop, every
+ *                          carrier's counters, configuration registers and
+ *                          comparators, and the track's limit parameters,
+ *                          are saved as one versioned, CRC-checked snapshot
+ *                          in a flash-backed store.  At start-up, before
+ *                          ASIC_comm takes any command, a snapshot that
+ *                          checks out is written back to all the chips at
+ *                          once, one transaction per chip, which reads every
+ *                          register back before it's accepted; the track is
+ *                          then configured again, so the carriers needn't be
+ *                          homed.
+ *
+ *                          The snapshot is erased once it has been read, and
+ *                          once a command may start a carrier after it was
+ *                          saved, so a reset that wasn't preceded by a
+ *                          controlled stop starts cold, rather than from
+ *                          positions that the carriers have since moved away
+ *                          from.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#define     PCL6046_WARM_C
+
+#include    <stdint.h>
+#include    <stdbool.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+#include    "queue.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_maint.h"
+#include    "PCL6046_motion.h"
+#include    "PCL6046_profile.h"
+#include    "PCL6046_limit.h"
+#include    "PCL6046_sched.h"
+#include    "PCL6046_group.h"
+#include    "PCL6046_home.h"
+#include    "PCL6046_warm.h"
+
+
+/*************************************************************************
+ *  @brief      snapshot_crc
+ *              The CRC-32 (IEEE 802.3) of the snapshot, less its header
+ *  @returns    the CRC
+ ************************************************************************/
+static uint32_t snapshot_crc(void)
+{
+    const uint8_t *data = (const uint8_t *) &warmSnapshot + sizeof(WARM_HDR);
+    uint32_t length = sizeof(WARM_SNAPSHOT) - sizeof(WARM_HDR);
+    uint32_t crc = 0xFFFFFFFFUL;
+    uint8_t bit;
+
+    while (length-- > 0)
+    {
+        crc ^= *data++;
+
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320UL : 0);
+        }
+    }
+
+    return (~crc);
+}
+
+/*************************************************************************
+ *  @brief      restore_order
+ *              The n'th register a restore writes:  the counters and the
+ *              comparator values first, then the configuration that acts on
+ *              them, and the interrupt enables last.
+ *  @param[in]  n is 0 to WARM_REGS - 1
+ *  @returns    the register
+ ************************************************************************/
+static ASIC_REG restore_order(uint8_t n)
+{
+    if (n < (RIRQ - RCUN1))
+    {
+        return ((ASIC_REG) (RCUN1 + n));
+    }
+
+    if (n < (RIRQ - RFL))
+    {
+        return ((ASIC_REG) (RFL + (n - (RIRQ - RCUN1))));
+    }
+
+    return (RIRQ);
+}
+
+/*************************************************************************
+ *  @brief      snapshot_outcome
+ *              Checks the snapshot read from the store.
+ *  @returns    WARM_RESTORED, if it can be restored; WARM_CORRUPT or
+ *              WARM_INCOMPATIBLE, otherwise
+ ************************************************************************/
+static uint32_t snapshot_outcome(void)
+{
+    const WARM_HDR *header = &warmSnapshot.header;
+
+    if (header->magic != WARM_MAGIC)
+    {
+        return (WARM_CORRUPT);
+    }
+
+    if ((header->version != WARM_VERSION) || (header->carriers != CARRIERCNT))
+    {
+        return (WARM_INCOMPATIBLE);
+    }
+
+    if ((header->length != sizeof(WARM_SNAPSHOT)) || (header->crc != snapshot_crc()) ||
+        (warmSnapshot.limitsSet > 1) || ((warmSnapshot.homed >> (CARRIERCNT - 1)) > 1))
+    {
+        return (WARM_CORRUPT);
+    }
+
+    return (WARM_RESTORED);
+}
+
+/*************************************************************************
+ *  @brief      save_warm_state
+ *              Brings every carrier to a controlled stop, and saves the
+ *              snapshot:  the schedule and the motion queues are emptied,
+ *              every carrier decelerates to a stop, and once the acquisition
+ *              shows them all stopped, each chip's registers are taken in
+ *              one transaction, the configuration from the shadow.
+ *  @returns    true, if the snapshot was saved; false, if a carrier didn't
+ *              stop within WARM_STOP_TIMEOUT or the store couldn't be written
+ ************************************************************************/
+bool save_warm_state(void)
+{
+    uint32_t all = (uint32_t) ((1ULL << CARRIERCNT) - 1);
+    uint32_t moving = all;
+    uint32_t stamp;
+    TickType_t start;
+    MOTION_AXIS axis;
+    uint8_t carrier;
+    uint8_t chip;
+    uint8_t n;
+
+    cancel_schedule();
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        cancel_motion(axis);
+    }
+
+    stop_group(all, true);
+
+    //  only a snapshot sampled after the stop can show the carriers stopped
+    stamp = (uint32_t) TIMESTAMP();
+    start = xTaskGetTickCount();
+
+    while ((moving != 0) && ((xTaskGetTickCount() - start) < (TickType_t) WARM_STOP_TIMEOUT))
+    {
+        vTaskDelay((TickType_t) ASIC_MAINT_PERIOD);
+        get_snapshot(&warmStatus);
+
+        if ((int32_t) (warmStatus.sampled - stamp) > 0)
+        {
+            moving = 0;
+
+            for (carrier = 0; carrier < CARRIERCNT; carrier++)
+            {
+                moving |= (warmStatus.mstatus[carrier] & (MSTS_SSCM | MSTS_SRUN)) ? (1UL << carrier) : 0;
+            }
+        }
+    }
+
+    //  the registers, and the status to be sure nothing started since
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        BUS_OP *ops = &warmOps[chip * (WARM_REGS + 1)];
+
+        for (n = 0; n < WARM_REGS; n++)
+        {
+            ops[n] = (BUS_OP) {OP_SHADOWED, (uint8_t) (WARM_FIRST + n), 0x0F, 0, {0}};
+        }
+
+        ops[WARM_REGS] = (BUS_OP) {OP_MSTSW, 0, 0x0F, 0, {0}};
+    }
+
+    bus_transact_all(BUS_CONFIG, warmOps, WARM_REGS + 1);
+
+    for (carrier = 0; carrier < CARRIERCNT; carrier++)
+    {
+        const BUS_OP *ops = &warmOps[CARRIER_CHIP(carrier) * (WARM_REGS + 1)];
+
+        for (n = 0; n < WARM_REGS; n++)
+        {
+            warmSnapshot.regs[carrier][n] = ops[n].values[CARRIER_AXIS(carrier)];
+        }
+
+        moving |= (ops[WARM_REGS].values[CARRIER_AXIS(carrier)] & (MSTS_SSCM | MSTS_SRUN)) ? (1UL << carrier) : 0;
+    }
+
+    if (moving != 0)
+    {
+        return (false);
+    }
+
+    get_home_stats(&warmHome);
+    warmSnapshot.homed = warmHome.homed;
+    warmSnapshot.limitsSet = get_limit_params(&warmSnapshot.limits) ? 1 : 0;
+
+    warmSnapshot.header.magic = WARM_MAGIC;
+    warmSnapshot.header.version = WARM_VERSION;
+    warmSnapshot.header.carriers = CARRIERCNT;
+    warmSnapshot.header.length = sizeof(WARM_SNAPSHOT);
+    warmSnapshot.header.crc = snapshot_crc();
+
+    if (!WARM_STORE_WRITE(&warmSnapshot, sizeof(WARM_SNAPSHOT)))
+    {
+        return (false);
+    }
+
+    warmSaved = true;
+
+    taskENTER_CRITICAL();
+    warmStats.saves++;
+    warmStats.bytes = sizeof(WARM_SNAPSHOT);
+    taskEXIT_CRITICAL();
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      consume_warm_state
+ *              Erases the snapshot a save left in the store, the first time
+ *              a command may start a carrier after it; only the reset that
+ *              follows the controlled stop may restore it.
+ *  @returns    none
+ ************************************************************************/
+void consume_warm_state(void)
+{
+    if (warmSaved)
+    {
+        WARM_STORE_ERASE();
+        warmSaved = false;
+    }
+}
+
+/*************************************************************************
+ *  @brief      restore_warm_state
+ *              Restores the snapshot in the store, if there is one that
+ *              checks out, and erases the store.  Every chip's registers are
+ *              written and read back in one transaction per chip, the chips
+ *              concurrently; if a chip doesn't read back what was written,
+ *              all the chips are reset, so they start cold rather than half
+ *              restored.  Must be called before anything starts a carrier.
+ *  @returns    true, if the carriers were restored; false, if they start
+ *              cold (see get_warm_stats() for why)
+ ************************************************************************/
+bool restore_warm_state(void)
+{
+    uint32_t stamp = (uint32_t) TIMESTAMP();
+    uint32_t outcome = WARM_NONE;
+    uint32_t restored = 0;
+    uint8_t carrier;
+    uint8_t chip;
+    uint8_t n;
+
+    if (WARM_STORE_READ(&warmSnapshot, sizeof(WARM_SNAPSHOT)))
+    {
+        outcome = snapshot_outcome();
+
+        //  the snapshot is only good for the reset that followed it
+        WARM_STORE_ERASE();
+    }
+
+    if (outcome == WARM_RESTORED)
+    {
+        for (chip = 0; chip < PCL6046_CHIPS; chip++)
+        {
+            BUS_OP *ops = &warmOps[chip * WARM_OPS];
+
+            for (n = 0; n < WARM_REGS; n++)
+            {
+                ops[n] = (BUS_OP) {OP_WRITE, (uint8_t) restore_order(n), 0x0F, 0, {0}};
+                ops[WARM_REGS + n] = (BUS_OP) {OP_READ, (uint8_t) restore_order(n), 0x0F, 0, {0}};
+            }
+        }
+
+        for (carrier = 0; carrier < CARRIERCNT; carrier++)
+        {
+            BUS_OP *ops = &warmOps[CARRIER_CHIP(carrier) * WARM_OPS];
+
+            for (n = 0; n < WARM_REGS; n++)
+            {
+                ops[n].values[CARRIER_AXIS(carrier)] = warmSnapshot.regs[carrier][restore_order(n) - WARM_FIRST];
+            }
+        }
+
+        bus_transact_all(BUS_CONFIG, warmOps, WARM_OPS);
+
+        for (carrier = 0; carrier < CARRIERCNT; carrier++)
+        {
+            const BUS_OP *ops = &warmOps[CARRIER_CHIP(carrier) * WARM_OPS];
+
+            for (n = 0; n < WARM_REGS; n++)
+            {
+                if (ops[WARM_REGS + n].values[CARRIER_AXIS(carrier)] != ops[n].values[CARRIER_AXIS(carrier)])
+                {
+                    outcome = WARM_UNVERIFIED;
+                }
+            }
+        }
+
+        if (outcome == WARM_UNVERIFIED)
+        {
+            for (chip = 0; chip < PCL6046_CHIPS; chip++)
+            {
+                warmOps[chip] = (BUS_OP) {OP_COMMAND, (uint8_t) SRST, 0x0F, 0, {0}};
+            }
+
+            bus_transact_all(BUS_CONFIG, warmOps, 1);
+        }
+        else
+        {
+            restored = (uint32_t) ((1ULL << CARRIERCNT) - 1);
+
+            if (warmSnapshot.limitsSet != 0)
+            {
+                (void) configure_limits(&warmSnapshot.limits);
+            }
+        }
+    }
+
+    //  the homing isn't lost with a warm restart, nor kept with a cold one
+    set_homed(warmSnapshot.homed & restored);
+
+    taskENTER_CRITICAL();
+    warmStats.outcome = outcome;
+    warmStats.restored = restored;
+    warmStats.homed = warmSnapshot.homed & restored;
+    warmStats.restoreUs = (uint32_t) (((uint64_t) ((uint32_t) TIMESTAMP() - stamp) * 1000000) / TIMESTAMP_HZ);
+    taskEXIT_CRITICAL();
+
+    return (outcome == WARM_RESTORED);
+}
+
+/*************************************************************************
+ *  @brief      get_warm_stats
+ *              Get method for the snapshot counters, and how the restore
+ *              at start-up went
+ *  @param[out] stats receives a copy of the counters
+ *  @returns    none
+ ************************************************************************/
+void get_warm_stats(WARM_STATS *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = warmStats;
+    taskEXIT_CRITICAL();
+}
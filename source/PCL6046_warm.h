@@ -0,0 +1,108 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_warm.h
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     PCL6046_WARM_H
+    #define PCL6046_WARM_H
+
+    //  the snapshot holds, per carrier, the registers from RFL to RIRQ:  the
+    //  shadowed configuration, COUNTER1..COUNTER4, and the comparators
+    #define WARM_FIRST              RFL
+    #define WARM_REGS               (RIRQ - RFL + 1)
+
+    //  the most bus operations per chip:  a restore writes every register,
+    //  then reads them all back in the same transaction
+    #define WARM_OPS                (2 * WARM_REGS)
+
+    //  how long a controlled stop may take before the snapshot is given up,
+    //  in milliseconds
+    #define WARM_STOP_TIMEOUT       10000
+
+    #define WARM_MAGIC              0x57503650UL        //  "P6PW"
+    #define WARM_VERSION            1
+
+    #ifdef  PCL6046_HOST_SIM
+        //  host builds keep the store in a file, in PCL6046_sim.c
+        #define WARM_STORE_WRITE(data, length)  PCL6046_sim_store_write((data), (length))
+        #define WARM_STORE_READ(data, length)   PCL6046_sim_store_read((data), (length))
+        #define WARM_STORE_ERASE()              PCL6046_sim_store_erase()
+        #define WARM_STORE_PRESENT              1
+    #else
+        //  TODO:   populate these macros for the flash sector set aside for
+        //          the snapshot; a write erases the sector and programs it,
+        //          and an erased sector reads as all 1s, which no header
+        //          matches.  Until then, WARM_SAVE and WARM_REPORT are
+        //          refused, rather than stopping every carrier for a save
+        //          that can't be written
+        #define WARM_STORE_WRITE(data, length)  ((void) (data), (void) (length), false)
+        #define WARM_STORE_READ(data, length)   ((void) (data), (void) (length), false)
+        #define WARM_STORE_ERASE()              ((void) 0)
+        #define WARM_STORE_PRESENT              0
+    #endif
+
+    //  the header is checked before anything is restored; the CRC-32 covers
+    //  everything after it
+    typedef struct
+    {
+        uint32_t    magic;
+        uint16_t    version;
+        uint16_t    carriers;               //  CARRIERCNT of the firmware that saved it
+        uint32_t    length;                 //  bytes, including this header
+        uint32_t    crc;
+
+    }   WARM_HDR;
+
+    typedef struct
+    {
+        WARM_HDR        header;
+        uint32_t        homed;              //  carriers homed when it was saved
+        uint32_t        limitsSet;          //  1, if limits holds the track
+        LIMIT_PARAMS    limits;
+        uint32_t        regs[CARRIERCNT][WARM_REGS];
+
+    }   WARM_SNAPSHOT;
+
+    //  how the restore at start-up went
+    #define WARM_NONE               0       //  the store is erased:  a cold start
+    #define WARM_RESTORED           1
+    #define WARM_CORRUPT            2       //  bad magic, length, or CRC
+    #define WARM_INCOMPATIBLE       3       //  another version, or chip count
+    #define WARM_UNVERIFIED         4       //  the chips didn't read back what was written
+
+    typedef struct
+    {
+        uint32_t    saves;
+        uint32_t    outcome;                //  WARM_xxx
+        uint32_t    restored;               //  carriers restored
+        uint32_t    homed;                  //  ... of them, homed when saved
+        uint32_t    restoreUs;              //  store read to validated, in microseconds
+        uint32_t    bytes;                  //  size of the snapshot
+
+    }   WARM_STATS;
+
+    //  the WARM_REPORT command is answered with a packet of this magic
+    //  number, then the WARM_STATS, little-endian
+    #define WARM_REPORT_MAGIC       0x52503650UL        //  "P6PR"
+
+    #ifdef  PCL6046_WARM_C
+
+        //  only ASIC_comm saves and restores, so these are never shared
+        static WARM_SNAPSHOT    warmSnapshot;
+        static BUS_OP           warmOps[PCL6046_CHIPS * WARM_OPS];
+        static PCL6046_SNAPSHOT warmStatus;
+        static HOME_STATS       warmHome;
+
+        static WARM_STATS       warmStats;
+
+        //  true from a save until a command may have moved a carrier
+        static bool             warmSaved = false;
+
+    #else
+        bool save_warm_state(void);
+        bool restore_warm_state(void);
+        void consume_warm_state(void);
+        void get_warm_stats(WARM_STATS *stats);
+    #endif
+#endif
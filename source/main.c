@@ -15,29 +15,81 @@
 #include	<stdint.h>
 #include	<stdbool.h>
 
+#include	"FreeRTOS.h"
+#include	"task.h"
+#include	"queue.h"
+#include	"semphr.h"
+#include	"event_groups.h"
+
 #include    "PCL6046.h"
 #include    "PCL6046_maint.h"
 #include    "PCL6046_comm.h"
+#include    "PCL6046_event.h"
+#include    "PCL6046_motion.h"
+#include    "PCL6046_profile.h"
+#include    "PCL6046_limit.h"
+#include    "PCL6046_sched.h"
+#include    "PCL6046_home.h"
+#include    "PCL6046_deviation.h"
+#include    "PCL6046_telem.h"
 
 
 
+#ifdef  PCL6046_HOST_SIM
+int main(void)
+#else
 void main(void)
+#endif
 {
+    uintptr_t chip;
+    bool created = true;
+
     //  TODO:   hardware initialization, including setting-up parallel interface from STM32
     //          to PCL6046, setting-up USB connection, etc.
     //  hw_init();
 
-    //  create the ASIC quantities and its periodic maintenance task
-    if (xTaskCreate(ASIC_maintenance, "maint6046", configMINIMAL_STACK_SIZE, (void *) NULL, (BASE_TASK_PRI + 1), (TaskHandle_t *) NULL) == pdPASS)
+#ifdef  PCL6046_HOST_SIM
+    //  on the host, bring up the emulated ASIC and keep its axes moving with
+    //  the RTOS tick
+    PCL6046_sim_init();
+    (void) xTaskCreate(PCL6046_sim_clock, "sim6046", configMINIMAL_STACK_SIZE, (void *) NULL, (configMAX_PRIORITIES - 1), (TaskHandle_t *) NULL);
+#endif
+
+    //  create a bus-owner task per chip, above everything that submits
+    //  transactions, then the ASIC interrupt dispatch task, the motion queue
+    //  streaming task, the periodic maintenance task, the track scheduler,
+    //  the homing task, the deviation watch, and the telemetry sender
+    //  TODO:   route the falling edge of the first PCL6046's INT pin to an
+    //          EXTI line and call PCL6046_INT_IRQHandler() from its handler
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        if (xTaskCreate(ASIC_bus, "bus6046", BUS_STACK_SIZE, (void *) chip, (BASE_TASK_PRI + 4), (TaskHandle_t *) NULL) != pdPASS)
+        {
+            created = false;
+        }
+    }
+
+    if (created &&
+        (xTaskCreate(ASIC_events, "evt6046", EVENT_STACK_SIZE, (void *) NULL, (BASE_TASK_PRI + 3), (TaskHandle_t *) NULL) == pdPASS) &&
+        (xTaskCreate(ASIC_motion, "mot6046", MOTION_STACK_SIZE, (void *) NULL, (BASE_TASK_PRI + 2), (TaskHandle_t *) NULL) == pdPASS) &&
+        (xTaskCreate(ASIC_maintenance, "maint6046", MAINT_STACK_SIZE, (void *) NULL, (BASE_TASK_PRI + 1), (TaskHandle_t *) NULL) == pdPASS) &&
+        (xTaskCreate(ASIC_schedule, "sched6046", SCHED_STACK_SIZE, (void *) NULL, BASE_TASK_PRI, (TaskHandle_t *) NULL) == pdPASS) &&
+        (xTaskCreate(ASIC_home, "home6046", HOME_STACK_SIZE, (void *) NULL, BASE_TASK_PRI, (TaskHandle_t *) NULL) == pdPASS) &&
+        (xTaskCreate(ASIC_deviation, "dev6046", DEVIATION_STACK_SIZE, (void *) NULL, (BASE_TASK_PRI + 1), (TaskHandle_t *) NULL) == pdPASS) &&
+        (xTaskCreate(ASIC_telemetry, "telem6046", TELEM_STACK_SIZE, (void *) NULL, BASE_TASK_PRI, (TaskHandle_t *) NULL) == pdPASS))
     {
         //  create the task for USB-to-ASIC communication
-        if (xTaskCreate(ASIC_comm, "comm6046", configMINIMAL_STACK_SIZE, (void *) NULL, BASE_TASK_PRI, (TaskHandle_t *) NULL) == pdPASS)
+        if (xTaskCreate(ASIC_comm, "comm6046", COMM_STACK_SIZE, (void *) NULL, BASE_TASK_PRI, (TaskHandle_t *) NULL) == pdPASS)
         {
 
             //  start-up the RTOS scheduler
             vTaskStartScheduler();
         }
     }
+
+#ifdef  PCL6046_HOST_SIM
+    return (0);
+#endif
 }
 
 
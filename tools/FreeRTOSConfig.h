@@ -0,0 +1,73 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   FreeRTOSConfig.h
+ *                          Kernel configuration of the host build (the
+ *                          FreeRTOS POSIX port), used by the Makefile; the
+ *                          board has its own, next to its start-up code.
+ *                          Requires kernel V11 or later, which provides
+ *                          the idle task's static memory.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#ifndef     FREERTOS_CONFIG_H
+    #define FREERTOS_CONFIG_H
+
+    #define configUSE_PREEMPTION                        1
+    #define configUSE_PORT_OPTIMISED_TASK_SELECTION     0
+    #define configUSE_TICKLESS_IDLE                     0
+    #define configTICK_RATE_HZ                          ((TickType_t) 1000)
+
+    //  the bus owners run at BASE_TASK_PRI + 4, and the emulated chip's
+    //  clock at configMAX_PRIORITIES - 1 above them
+    #define configMAX_PRIORITIES                        8
+    #define configMINIMAL_STACK_SIZE                    ((unsigned short) 1024)
+    #define configMAX_TASK_NAME_LEN                     16
+    #define configTICK_TYPE_WIDTH_IN_BITS               TICK_TYPE_WIDTH_32_BITS
+    #define configIDLE_SHOULD_YIELD                     1
+
+    //  index 0 is each task's own; BUS_NOTIFY_INDEX completes bus transactions
+    #define configUSE_TASK_NOTIFICATIONS                1
+    #define configTASK_NOTIFICATION_ARRAY_ENTRIES       2
+
+    #define configUSE_MUTEXES                           1
+    #define configUSE_RECURSIVE_MUTEXES                 0
+    #define configUSE_COUNTING_SEMAPHORES               0
+    #define configQUEUE_REGISTRY_SIZE                   0
+    #define configUSE_QUEUE_SETS                        0
+    #define configUSE_TIME_SLICING                      1
+
+    #define configSUPPORT_STATIC_ALLOCATION             1
+    #define configSUPPORT_DYNAMIC_ALLOCATION            1
+    #define configKERNEL_PROVIDED_STATIC_MEMORY         1
+    #define configTOTAL_HEAP_SIZE                       ((size_t) (1024 * 1024))
+
+    #define configUSE_IDLE_HOOK                         0
+    #define configUSE_TICK_HOOK                         0
+    #define configCHECK_FOR_STACK_OVERFLOW              0
+    #define configUSE_MALLOC_FAILED_HOOK                0
+    #define configUSE_TRACE_FACILITY                    0
+    #define configGENERATE_RUN_TIME_STATS               0
+
+    #define configUSE_TIMERS                            1
+    #define configTIMER_TASK_PRIORITY                   (configMAX_PRIORITIES - 1)
+    #define configTIMER_QUEUE_LENGTH                    10
+    #define configTIMER_TASK_STACK_DEPTH                configMINIMAL_STACK_SIZE
+
+    #define configUSE_CO_ROUTINES                       0
+
+    //  the POSIX port has no interrupt priorities; PCL6046_safety.h only
+    //  names this in a comment
+    #define configMAX_SYSCALL_INTERRUPT_PRIORITY        0
+
+    #define INCLUDE_vTaskPrioritySet                    1
+    #define INCLUDE_uxTaskPriorityGet                   1
+    #define INCLUDE_vTaskDelete                         1
+    #define INCLUDE_vTaskSuspend                        1
+    #define INCLUDE_xTaskDelayUntil                     1
+    #define INCLUDE_vTaskDelay                          1
+    #define INCLUDE_xTaskGetCurrentTaskHandle           1
+    #define INCLUDE_uxTaskGetStackHighWaterMark         1
+    #define INCLUDE_xTaskGetSchedulerState              1
+
+    #define configASSERT(x)                             if ((x) == 0) { taskDISABLE_INTERRUPTS(); for (;;); }
+#endif
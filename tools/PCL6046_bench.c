@@ -0,0 +1,1796 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   PCL6046_bench.c
+ *                          Host benchmarks of the PCL6046 interface, run
+ *                          against the emulated chip (PCL6046_sim.c) and the
+ *                          FreeRTOS POSIX port.  It measures the register
+ *                          primitives, the INT-to-event dispatch latency,
+ *                          the USB command path, the acquisition stage under
+ *                          bus contention, the limit loop, the timer-paced
+ *                          safety loop, the track scheduler against issuing
+ *                          moves naively, the telemetry stream, the start
+ *                          skew of motion groups, segments streamed back to
+ *                          back through the pre-registers, how well a
+ *                          compiled speed profile predicts the motion it
+ *                          produces, homing all the carriers at once against
+ *                          one at a time, the encoder deviation watch, and a
+ *                          warm restart from the saved snapshot, and compares
+ *                          the results with a saved baseline:
+ *
+ *                          PCL6046_bench --save tools/bench_baseline_chips1.txt
+ *                          PCL6046_bench --check tools/bench_baseline_chips1.txt
+ *
+ *                          --check exits with 1 if any metric is worse than
+ *                          its baseline by more than the metric's tolerance;
+ *                          the host timing metrics only warn.  Bus traffic
+ *                          grows with the chip count, so each CHIPS build
+ *                          has its own baseline.
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#include    <stdio.h>
+#include    <stdint.h>
+#include    <stdbool.h>
+#include    <string.h>
+#include    <stdlib.h>
+#include    <math.h>
+
+#include    "FreeRTOS.h"
+#include    "task.h"
+#include    "queue.h"
+#include    "event_groups.h"
+
+#include    "PCL6046.h"
+#include    "PCL6046_maint.h"
+#include    "PCL6046_event.h"
+#include    "PCL6046_profile.h"
+#include    "PCL6046_limit.h"
+#include    "PCL6046_safety.h"
+#include    "PCL6046_sched.h"
+#include    "PCL6046_trace.h"
+#include    "PCL6046_comm.h"
+#include    "PCL6046_telem.h"
+#include    "PCL6046_motion.h"
+#include    "PCL6046_group.h"
+#include    "PCL6046_home.h"
+#include    "PCL6046_deviation.h"
+#include    "PCL6046_warm.h"
+
+//  calls per primitive throughput run, and task hand-offs timed to calibrate
+//  them:  a call's cost on the host is mostly the hand-off to the bus owner
+//  and back, so throughput is recorded relative to it
+#define PRIMITIVE_CALLS         20000
+#define CALIBRATION_HANDOFFS    20000
+
+//  limit cycles in the transaction count window
+#define LIMIT_CYCLES            40
+
+//  position changes timed to the RCMP update
+#define LATENCY_TRIALS          20
+
+//  interrupts injected to time the event dispatch, and the longest the
+//  bench waits for each one's event, in milliseconds
+#define IRQ_TRIALS              50
+#define IRQ_TIMEOUT             100
+
+//  frames submitted through the USB receive path, each of this many
+//  STOP_REPORT commands, and the longest the replies may take, in
+//  milliseconds
+#define COMM_FRAMES             2000
+#define COMM_COMMANDS           8
+#define COMM_TIMEOUT            10000
+
+//  length of the contention run, in milliseconds, and the tasks loading the bus
+#define CONTENTION_TIME         2000
+#define CONTENTION_TASKS        3
+
+//  the timer-paced safety loop runs in this many windows of this long, in
+//  milliseconds, at each of these periods, in microseconds:  the rate other
+//  stages are measured under, and the fastest SAFETY_LOOP accepts.  Host
+//  preemption puts an outlier in the odd window, so the worst jitter and
+//  cycle time are taken from the median window
+#define SAFETY_WINDOWS          20
+#define SAFETY_WINDOW_TIME      100
+#define SAFETY_TIME             (SAFETY_WINDOWS * SAFETY_WINDOW_TIME)
+#define SAFETY_PERIOD_US        1000
+#define SAFETY_FAST_PERIOD_US   SAFETY_MIN_PERIOD_US
+
+//  the scheduler workload:  rounds of one move per carrier to targets in track
+//  order, at least SCHED_SPACING apart along SCHED_TRACK pulses; and the
+//  longest either way of running it may take, in milliseconds
+#define SCHED_ROUNDS            8
+#define SCHED_TRACK             80000
+#define SCHED_SPACING           4000
+#define SCHED_TIMEOUT           60000
+
+//  each telemetry run streams for this long, in milliseconds; in the second,
+//  the host takes this long to read each packet
+#define TELEM_TIME              2000
+#define TELEM_SLOW_READ         200
+
+//  each carrier of a motion group moves this far, in pulses
+#define GROUP_DISTANCE          2000
+
+//  motion streaming:  carrier U runs this many segments back to back, each
+//  this far at this FH step (at RMG = 299, 1 pps per step), 100 ms apiece
+#define MOTION_SEGMENTS         8
+#define MOTION_DISTANCE         2000
+#define MOTION_SPEED            20000
+
+//  the profiled move's length, in pulses, and the longest a profile run may
+//  take, in milliseconds
+#define PROFILE_DISTANCE        100000
+#define PROFILE_TIMEOUT         5000
+
+//  homing:  each carrier's ORG sensor, in pulses from where it stands, and
+//  the FL speed step (at RMG = 299, 1 pps per step) they all home at
+#define HOME_SPEED              2000
+static const int32_t homeOrigins[AXISCNT] = {-1000, -2000, 1500, 3000};
+
+//  the deviation watch:  the threshold that trips it, in pulses, and the
+//  healthy moves run before one that stalls, each this far toward the - end
+#define DEVIATION_THRESHOLD     500
+#define DEVIATION_MOVES         4
+#define DEVIATION_DISTANCE      3000
+
+//  a metric regresses when it is worse than baseline * (1 + tolerance) + slack
+//  (or baseline * (1 - tolerance) - slack, where higher is better); timing on a
+//  host varies, so those metrics get wide tolerances, while bus cycle and
+//  transaction counts are deterministic; advisory metrics are measured in host
+//  time, so a preempted run can push them past any tolerance, and they only
+//  warn
+typedef struct
+{
+    const char  *name;
+    bool        higherIsBetter;
+    bool        advisory;
+    double      tolerance;
+    double      slack;
+    double      value;
+
+}   METRIC;
+
+static METRIC metrics[] =
+{
+    {"read1.calls_per_handoff",         true,   true,   0.25,   0.0,    0.0},
+    {"read4.calls_per_handoff",         true,   true,   0.25,   0.0,    0.0},
+    {"read4.values_per_handoff",        true,   true,   0.25,   0.0,    0.0},
+    {"read1.clk_per_call",              false,  false,  0.05,   0.0,    0.0},
+    {"read4.clk_per_call",              false,  false,  0.05,   0.0,    0.0},
+    {"irq.publish_avg_us",              false,  true,   1.00,   200.0,  0.0},
+    {"irq.publish_max_us",              false,  true,   1.00,   2000.0, 0.0},
+    {"irq.wake_max_us",                 false,  true,   1.00,   2000.0, 0.0},
+    {"irq.missed_events",               false,  false,  0.00,   0.0,    0.0},
+    {"comm.frames_per_handoff",         true,   true,   0.50,   0.0,    0.0},
+    {"comm.commands_per_handoff",       true,   true,   0.50,   0.0,    0.0},
+    {"comm.lost_replies",               false,  false,  0.00,   0.0,    0.0},
+    {"limit.transactions_per_cycle",    false,  false,  0.10,   0.0,    0.0},
+    {"limit.command_words_per_cycle",   false,  false,  0.10,   0.0,    0.0},
+    {"limit.rcmp_latency_avg_ms",       false,  true,   0.50,   5.0,    0.0},
+    {"limit.rcmp_latency_max_ms",       false,  true,   0.50,   5.0,    0.0},
+    {"limit.sample_age_max_ms",         false,  true,   0.50,   5.0,    0.0},
+    {"maint.dropped_samples",           false,  true,   0.00,   2.0,    0.0},
+    {"safety.cycles_per_s",             true,   true,   0.10,   0.0,    0.0},
+    {"safety.overrun_percent",          false,  true,   0.00,   2.0,    0.0},
+    {"safety.window_jitter_us",         false,  true,   1.00,   2000.0, 0.0},
+    {"safety.window_service_us",        false,  true,   1.00,   2000.0, 0.0},
+    {"safety250.cycles_per_s",          true,   true,   0.10,   0.0,    0.0},
+    {"safety250.overrun_percent",       false,  true,   0.00,   5.0,    0.0},
+    {"safety250.window_jitter_us",      false,  true,   1.00,   1000.0, 0.0},
+    {"safety250.window_service_us",     false,  true,   1.00,   1000.0, 0.0},
+    {"sched.naive_moves_per_h",         true,   true,   0.25,   0.0,    0.0},
+    {"sched.moves_per_h",               true,   true,   0.25,   0.0,    0.0},
+    {"sched.speedup",                   true,   true,   0.15,   0.0,    0.0},
+    {"sched.limit_stops",               false,  false,  0.00,   2.0,    0.0},
+    {"telem.samples_per_s",             true,   true,   0.10,   0.0,    0.0},
+    {"telem.bytes_per_sample",          false,  false,  0.25,   0.0,    0.0},
+    {"telem.decode_errors",             false,  false,  0.00,   0.0,    0.0},
+    {"telem.slow_cycles_per_s",         true,   true,   0.10,   0.0,    0.0},
+    {"telem.slow_dropped_percent",      false,  true,   0.50,   10.0,   0.0},
+    {"group.naive_skew_commands",       false,  true,   0.50,   2.0,    0.0},
+    {"group.start_skew_commands",       false,  false,  0.00,   0.0,    0.0},
+    {"group.csta_skew_commands",        false,  false,  0.00,   0.0,    0.0},
+    {"group.start_skew_clk",            false,  false,  0.00,   0.0,    0.0},
+    {"motion.underruns",                false,  false,  0.00,   0.0,    0.0},
+    {"motion.unchained_segments",       false,  false,  0.00,   0.0,    0.0},
+    {"motion.idle_clk",                 false,  false,  0.00,   0.0,    0.0},
+    {"profile.time_error_percent",      false,  false,  0.50,   1.0,    0.0},
+    {"profile.stop_error_percent",      false,  false,  0.50,   1.0,    0.0},
+    {"home.sequential_ms",              false,  true,   0.25,   0.0,    0.0},
+    {"home.parallel_ms",                false,  true,   0.25,   0.0,    0.0},
+    {"home.speedup",                    true,   true,   0.15,   0.0,    0.0},
+    {"home.failed_carriers",            false,  false,  0.00,   0.0,    0.0},
+    {"deviation.reads_per_move",        false,  false,  0.00,   0.5,    0.0},
+    {"deviation.stall_overrun_pulses",  false,  false,  0.25,   50.0,   0.0},
+    {"deviation.peak_error_pulses",     false,  false,  0.00,   31.0,   0.0},
+    {"warm.snapshot_bytes",             false,  false,  0.00,   0.0,    0.0},
+    {"warm.restore_us",                 false,  true,   1.00,   2000.0, 0.0},
+    {"warm.lost_registers",             false,  false,  0.00,   0.0,    0.0},
+    {"warm.lost_homed",                 false,  false,  0.00,   0.0,    0.0},
+    {"warm.corrupt_restored",           false,  false,  0.00,   0.0,    0.0},
+    {"warm.refused_erased",             false,  false,  0.00,   0.0,    0.0},
+    {"warm.stale_kept",                 false,  false,  0.00,   0.0,    0.0}
+};
+
+#define METRIC_COUNT    (sizeof(metrics) / sizeof(metrics[0]))
+
+static const char   *baselineFile = NULL;
+static bool         saveBaseline = false;
+static int          exitCode = 0;
+
+//  tells the contention tasks to finish
+static volatile bool loadRunning = false;
+
+//  STOP_REPORT packets received by comm_receive()
+static volatile uint32_t commReplies = 0;
+
+//  seconds per task hand-off and back, from calibrate(), and the task it
+//  hands off to
+static double       handoffSeconds = 0.0;
+static TaskHandle_t handoffCaller = (TaskHandle_t) NULL;
+static volatile bool handoffRunning = false;
+
+//  what the telemetry host has received, and whether it reads slowly
+static volatile bool telemSlow = false;
+static uint32_t     telemDecoded = 0;
+static uint32_t     telemBytes = 0;
+static uint32_t     telemErrors = 0;
+static uint32_t     telemLastSequence = 0;
+
+/*************************************************************************
+ *  @brief      set_metric
+ *              Records the measured value of a metric.
+ ************************************************************************/
+static void set_metric(const char *name, double value)
+{
+    uint8_t m;
+
+    for (m = 0; m < METRIC_COUNT; m++)
+    {
+        if (strcmp(metrics[m].name, name) == 0)
+        {
+            metrics[m].value = value;
+        }
+    }
+}
+
+/*************************************************************************
+ *  @brief      elapsed_s
+ *              Seconds since a TIMESTAMP() value.
+ ************************************************************************/
+static double elapsed_s(uint32_t since)
+{
+    return ((double) ((uint32_t) TIMESTAMP() - since) / (double) TIMESTAMP_HZ);
+}
+
+/*************************************************************************
+ *  @brief      elapsed_ticks_s
+ *              Seconds since an RTOS tick count, for runs longer than
+ *              TIMESTAMP() can time.
+ ************************************************************************/
+static double elapsed_ticks_s(TickType_t since)
+{
+    return ((double) (xTaskGetTickCount() - since) / (double) configTICK_RATE_HZ);
+}
+
+/*************************************************************************
+ *  @brief      handoff_echo
+ *              Calibration task:  hands every notification straight back
+ *              to the task that gave it, until handoffRunning is cleared.
+ ************************************************************************/
+static void handoff_echo(void *pvParameters)
+{
+    while (1)
+    {
+        (void) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (!handoffRunning)
+        {
+            break;
+        }
+
+        (void) xTaskNotifyGive(handoffCaller);
+    }
+
+    vTaskDelete(NULL);
+}
+
+/*************************************************************************
+ *  @brief      calibrate
+ *              Times a notification to a task at the bus owner's priority
+ *              and back, the round trip every bus transaction makes; host
+ *              throughput is measured in these, so the baseline holds on
+ *              any machine.
+ ************************************************************************/
+static void calibrate(void)
+{
+    TaskHandle_t echo;
+    uint32_t start;
+    uint32_t n;
+
+    handoffCaller = xTaskGetCurrentTaskHandle();
+    handoffRunning = true;
+
+    if (xTaskCreate(handoff_echo, "echo", configMINIMAL_STACK_SIZE, (void *) NULL, (BASE_TASK_PRI + 4), &echo) != pdPASS)
+    {
+        printf("calibrate:  no echo task\n");
+        exitCode = 1;
+        return;
+    }
+
+    start = (uint32_t) TIMESTAMP();
+
+    for (n = 0; n < CALIBRATION_HANDOFFS; n++)
+    {
+        (void) xTaskNotifyGive(echo);
+        (void) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+
+    handoffSeconds = elapsed_s(start) / CALIBRATION_HANDOFFS;
+
+    handoffRunning = false;
+    (void) xTaskNotifyGive(echo);
+}
+
+/*************************************************************************
+ *  @brief      per_handoff
+ *              Operations completed per calibrated task hand-off.
+ *  @param[in]  operations were completed
+ *  @param[in]  seconds is how long they took
+ ************************************************************************/
+static double per_handoff(double operations, double seconds)
+{
+    return ((seconds > 0.0) ? (operations * handoffSeconds / seconds) : 0.0);
+}
+
+/*************************************************************************
+ *  @brief      bench_primitives
+ *              Throughput of single-axis and 4-axis read_registers() on an
+ *              otherwise idle bus, in calls per task hand-off and in CLK
+ *              cycles of bus traffic per call.  The IFB polls are left out of
+ *              the cycles:  how many a call makes depends on when the host
+ *              runs the task, not on the primitive.
+ ************************************************************************/
+static void bench_primitives(void)
+{
+    PCL6046_SIM_STATS before, after;
+    uint32_t results[AXISCNT];
+    uint32_t start;
+    double seconds;
+    uint32_t n;
+
+    calibrate();
+
+    PCL6046_sim_get_stats(&before);
+    start = (uint32_t) TIMESTAMP();
+
+    for (n = 0; n < PRIMITIVE_CALLS; n++)
+    {
+        read_registers(RCUN1, AXIS_X_MASK, results);
+    }
+
+    seconds = elapsed_s(start);
+    PCL6046_sim_get_stats(&after);
+
+    set_metric("read1.calls_per_handoff", per_handoff(PRIMITIVE_CALLS, seconds));
+    set_metric("read1.clk_per_call", (double) ((after.busCycles - before.busCycles) - (after.ifbPolls - before.ifbPolls)) / PRIMITIVE_CALLS);
+
+    PCL6046_sim_get_stats(&before);
+    start = (uint32_t) TIMESTAMP();
+
+    for (n = 0; n < PRIMITIVE_CALLS; n++)
+    {
+        read_registers(RCUN1, 0x0F, results);
+    }
+
+    seconds = elapsed_s(start);
+    PCL6046_sim_get_stats(&after);
+
+    set_metric("read4.calls_per_handoff", per_handoff(PRIMITIVE_CALLS, seconds));
+    set_metric("read4.values_per_handoff", per_handoff(AXISCNT * PRIMITIVE_CALLS, seconds));
+    set_metric("read4.clk_per_call", (double) ((after.busCycles - before.busCycles) - (after.ifbPolls - before.ifbPolls)) / PRIMITIVE_CALLS);
+}
+
+/*************************************************************************
+ *  @brief      bench_events
+ *              The time from the INT handler to ASIC_events publishing the
+ *              end-of-operation events that the emulated chip raises on X,
+ *              and on to a task waiting for them; and the events that
+ *              never arrive.  It runs before anything else listens to X.
+ ************************************************************************/
+static void bench_events(void)
+{
+    PCL6046_EVENT_STATS stats;
+    double total = 0.0;
+    double worst = 0.0;
+    double wake = 0.0;
+    uint32_t missed = 0;
+    uint8_t trial;
+
+    for (trial = 0; trial < IRQ_TRIALS; trial++)
+    {
+        double us;
+
+        vTaskDelay((TickType_t) (1 + (trial % 3)));
+        (void) xEventGroupClearBits(PCL6046_axis_events[AXIS_X], PCL6046_EVT_END);
+
+        PCL6046_sim_inject_irq(AXIS_X, FIELD_MASK(RIST, ISEN), 0);
+
+        if (wait_axis_events(AXIS_X, PCL6046_EVT_END, (TickType_t) IRQ_TIMEOUT) == 0)
+        {
+            missed++;
+            continue;
+        }
+
+        us = (double) ((uint32_t) TIMESTAMP() - get_irq_stamp()) * 1000000.0 / TIMESTAMP_HZ;
+        wake = (us > wake) ? us : wake;
+
+        get_event_stats(&stats);
+        us = (double) stats.lastLatency * 1000000.0 / TIMESTAMP_HZ;
+        total += us;
+        worst = (us > worst) ? us : worst;
+    }
+
+    set_metric("irq.publish_avg_us", (missed < IRQ_TRIALS) ? (total / (IRQ_TRIALS - missed)) : 0.0);
+    set_metric("irq.publish_max_us", worst);
+    set_metric("irq.wake_max_us", wake);
+    set_metric("irq.missed_events", (double) missed);
+}
+
+/*************************************************************************
+ *  @brief      comm_receive
+ *              Stands in for the host during bench_comm():  counts the
+ *              STOP_REPORT packets.
+ ************************************************************************/
+static bool comm_receive(const uint8_t *data, uint16_t length)
+{
+    const STOP_REPORT_HDR *header = (const STOP_REPORT_HDR *) data;
+
+    if ((length >= sizeof(STOP_REPORT_HDR)) && (header->magic == STOP_REPORT_MAGIC))
+    {
+        commReplies++;
+    }
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      bench_comm
+ *              Throughput of the USB command path:  frames of STOP_REPORT
+ *              commands are submitted with usb_rx_submit(), as the endpoint
+ *              would, as fast as ASIC_comm hands the receive buffers back,
+ *              and timed until the last reply is sent; in frames and
+ *              commands per task hand-off, and the replies that never came.
+ ************************************************************************/
+static void bench_comm(void)
+{
+    uint32_t expected = COMM_FRAMES * COMM_COMMANDS;
+    uint32_t start;
+    double seconds;
+    uint32_t frame;
+    uint8_t n;
+
+    commReplies = 0;
+    usb_attach_tx(comm_receive);
+    start = (uint32_t) TIMESTAMP();
+
+    for (frame = 0; frame < COMM_FRAMES; frame++)
+    {
+        uint32_t *buffer = usb_rx_buffer(portMAX_DELAY);
+
+        if (buffer == NULL)
+        {
+            break;
+        }
+
+        *(USB_FRAME_HDR *) buffer = (USB_FRAME_HDR) {(uint16_t) ((1 + COMM_COMMANDS) * sizeof(uint32_t)), COMM_COMMANDS, (uint8_t) frame};
+
+        for (n = 0; n < COMM_COMMANDS; n++)
+        {
+            *(USB_CMD_HDR *) &buffer[1 + n] = (USB_CMD_HDR) {STOP_REPORT, 0, 0};
+        }
+
+        (void) usb_rx_submit(buffer, (uint16_t) ((1 + COMM_COMMANDS) * sizeof(uint32_t)), portMAX_DELAY);
+    }
+
+    while ((commReplies < expected) && (elapsed_s(start) < (COMM_TIMEOUT / 1000.0)))
+    {
+        taskYIELD();
+    }
+
+    seconds = elapsed_s(start);
+    usb_attach_tx(NULL);
+
+    set_metric("comm.frames_per_handoff", per_handoff(COMM_FRAMES, seconds));
+    set_metric("comm.commands_per_handoff", per_handoff(expected, seconds));
+    set_metric("comm.lost_replies", (double) (expected - commReplies));
+}
+
+/*************************************************************************
+ *  @brief      bus_load
+ *              Contention task:  keeps configuration and acquisition-class
+ *              traffic on the bus until loadRunning is cleared.
+ ************************************************************************/
+static void bus_load(void *pvParameters)
+{
+    uint32_t values[AXISCNT] = {1, 2, 3, 4};
+    uint32_t results[AXISCNT];
+
+    while (loadRunning)
+    {
+        write_registers(RCUN3, 0x0F, values);
+        read_registers(RCUN3, 0x0F, results);
+        values[0]++;
+        taskYIELD();
+    }
+
+    vTaskDelete(NULL);
+}
+
+/*************************************************************************
+ *  @brief      bench_contention
+ *              Counts the acquisition periods that produced no snapshot
+ *              while other tasks load the bus.
+ ************************************************************************/
+static void bench_contention(void)
+{
+    PCL6046_SNAPSHOT snap;
+    TickType_t end;
+    TickType_t lastTick = 0;
+    uint32_t lastSeq = 0;
+    uint32_t dropped = 0;
+    uint8_t t;
+
+    loadRunning = true;
+
+    for (t = 0; t < CONTENTION_TASKS; t++)
+    {
+        (void) xTaskCreate(bus_load, "load", configMINIMAL_STACK_SIZE, (void *) NULL, (BASE_TASK_PRI + 2), (TaskHandle_t *) NULL);
+    }
+
+    end = xTaskGetTickCount() + CONTENTION_TIME;
+
+    while ((int32_t) (end - xTaskGetTickCount()) > 0)
+    {
+        get_snapshot(&snap);
+
+        if (snap.sequence != lastSeq)
+        {
+            //  the acquisition catches up after a late period, so only gaps
+            //  longer than a period mean samples were lost
+            if ((lastSeq != 0) && ((snap.tick - lastTick) > ASIC_MAINT_PERIOD))
+            {
+                dropped += ((snap.tick - lastTick) + (ASIC_MAINT_PERIOD / 2)) / ASIC_MAINT_PERIOD - 1;
+            }
+
+            lastSeq = snap.sequence;
+            lastTick = snap.tick;
+        }
+
+        vTaskDelay(1);
+    }
+
+    loadRunning = false;
+    vTaskDelay(ASIC_MAINT_PERIOD);
+
+    set_metric("maint.dropped_samples", dropped);
+}
+
+/*************************************************************************
+ *  @brief      bench_limit
+ *              Bus transactions and command words per limit cycle, and the
+ *              time from a position change to the RCMP update it causes,
+ *              and the oldest positions a limit update was computed from.
+ ************************************************************************/
+static void bench_limit(void)
+{
+    LIMIT_PARAMS params =
+    {
+        .carriers = AXISCNT,
+        .order = {AXIS_X, AXIS_Y, AXIS_Z, AXIS_U},
+        .minimumGap = {1000},
+        .marginPercent = 0,
+        .flags = 0
+    };
+    int32_t positions[AXISCNT] = {0, 20000, 40000, 60000};
+    BUS_STATS before, after;
+    LIMIT_STATS ages;
+    TRACE_RECORD records[64];
+    uint32_t cursor;
+    uint32_t words = 0;
+    double total = 0.0;
+    double worst = 0.0;
+    MOTION_AXIS axis;
+    uint16_t count;
+    uint16_t n;
+    uint8_t cycle;
+    uint8_t step;
+    uint8_t trial;
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        PCL6046_sim_poke(axis, RCUN1, (uint32_t) positions[axis]);
+    }
+
+    write_register(RFL, 0x0F, 100);
+    write_register(RFH, 0x0F, 5000);
+    write_register(RUR, 0x0F, 999);
+    write_register(RMG, 0x0F, 299);
+
+    (void) init_limit_workers(BASE_TASK_PRI);
+    (void) configure_limits(&params);
+    vTaskDelay(10 * POSITION_MONITOR_PERIOD);
+
+    //  the limit task is the only BUS_SAFETY user while nothing interrupts;
+    //  its command words are picked out of the trace by task name
+    trace_enable(true);
+    cursor = 0;
+    while (trace_read(&cursor, records, 64) != 0);
+
+    //  Y creeps along, so every cycle has limits to move
+    get_bus_stats(BUS_SAFETY, &before);
+
+    for (cycle = 0; cycle < LIMIT_CYCLES; cycle++)
+    {
+        positions[AXIS_Y] += 100;
+        PCL6046_sim_poke(AXIS_Y, RCUN1, (uint32_t) positions[AXIS_Y]);
+
+        //  drain the trace in steps, as acquisition traffic would otherwise
+        //  overwrite it within a cycle or two
+        for (step = 0; step < (POSITION_MONITOR_PERIOD / ASIC_MAINT_PERIOD); step++)
+        {
+            vTaskDelay(ASIC_MAINT_PERIOD);
+
+            while ((count = trace_read(&cursor, records, 64)) != 0)
+            {
+                for (n = 0; n < count; n++)
+                {
+                    words += (strncmp(records[n].task, "limit", TRACE_NAME_LEN) == 0) ? 1 : 0;
+                }
+            }
+        }
+    }
+
+    get_bus_stats(BUS_SAFETY, &after);
+    trace_enable(false);
+
+    //  let the last position land before timing changes
+    vTaskDelay(2 * LIMIT_UPDATE_LAG);
+
+    set_metric("limit.transactions_per_cycle", (double) (after.transactions - before.transactions) / LIMIT_CYCLES);
+    set_metric("limit.command_words_per_cycle", (double) words / LIMIT_CYCLES);
+
+    //  move Y toward X at staggered points in the cycle; X's + limit must follow
+    for (trial = 0; trial < LATENCY_TRIALS; trial++)
+    {
+        uint32_t limit = PCL6046_sim_peek(AXIS_X, RCMP1);
+        uint32_t start;
+        double ms;
+
+        vTaskDelay((TickType_t) (1 + ((trial * 7) % POSITION_MONITOR_PERIOD)));
+
+        positions[AXIS_Y] += (trial & 1) ? 500 : -500;
+        PCL6046_sim_poke(AXIS_Y, RCUN1, (uint32_t) positions[AXIS_Y]);
+        start = (uint32_t) TIMESTAMP();
+
+        while ((PCL6046_sim_peek(AXIS_X, RCMP1) == limit) && (elapsed_s(start) < 1.0))
+        {
+            vTaskDelay(1);
+        }
+
+        ms = elapsed_s(start) * 1000.0;
+        total += ms;
+
+        if (ms > worst)
+        {
+            worst = ms;
+        }
+    }
+
+    set_metric("limit.rcmp_latency_avg_ms", total / LATENCY_TRIALS);
+    set_metric("limit.rcmp_latency_max_ms", worst);
+
+    get_limit_stats(&ages);
+    set_metric("limit.sample_age_max_ms", (double) ages.maxAge * 1000.0 / TIMESTAMP_HZ);
+}
+
+/*************************************************************************
+ *  @brief      compare_counts
+ *              qsort() comparison of two uint32_t.
+ ************************************************************************/
+static int compare_counts(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+
+    return ((x > y) - (x < y));
+}
+
+/*************************************************************************
+ *  @brief      bench_safety
+ *              The limit loop paced by the safety loop timer (a POSIX timer
+ *              on the host):  the cycles it completes, the ticks it misses,
+ *              and the worst start jitter and cycle time of the median
+ *              window.  It runs after bench_limit(), with the limits already
+ *              configured.
+ *  @param[in]  periodUs is the timer period, in microseconds
+ *  @param[in]  group names the metrics, "safety" or "safety250"
+ ************************************************************************/
+static void bench_safety(uint32_t periodUs, const char *group)
+{
+    SAFETY_STATS stats;
+    uint32_t jitter[SAFETY_WINDOWS];
+    uint32_t service[SAFETY_WINDOWS];
+    uint32_t cycles = 0;
+    uint32_t ticks = 0;
+    uint32_t overruns = 0;
+    char name[64];
+    uint8_t w;
+
+    //  each start resets the counters
+    for (w = 0; w < SAFETY_WINDOWS; w++)
+    {
+        (void) pace_limits(periodUs);
+        vTaskDelay(SAFETY_WINDOW_TIME);
+        (void) pace_limits(0);
+        vTaskDelay(POSITION_MONITOR_PERIOD);
+
+        get_safety_stats(&stats);
+
+        cycles += stats.cycles;
+        ticks += stats.ticks;
+        overruns += stats.overruns;
+        jitter[w] = stats.maxJitter;
+        service[w] = stats.maxService;
+    }
+
+    qsort(jitter, SAFETY_WINDOWS, sizeof(uint32_t), compare_counts);
+    qsort(service, SAFETY_WINDOWS, sizeof(uint32_t), compare_counts);
+
+    snprintf(name, sizeof(name), "%s.cycles_per_s", group);
+    set_metric(name, (double) cycles * 1000.0 / SAFETY_TIME);
+    snprintf(name, sizeof(name), "%s.overrun_percent", group);
+    set_metric(name, (ticks != 0) ? ((double) overruns * 100.0 / ticks) : 100.0);
+    snprintf(name, sizeof(name), "%s.window_jitter_us", group);
+    set_metric(name, (double) jitter[SAFETY_WINDOWS / 2] * 1000000.0 / TIMESTAMP_HZ);
+    snprintf(name, sizeof(name), "%s.window_service_us", group);
+    set_metric(name, (double) service[SAFETY_WINDOWS / 2] * 1000000.0 / TIMESTAMP_HZ);
+}
+
+/*************************************************************************
+ *  @brief      sched_workload
+ *              Fills in the scheduler workload, the same every run:  each
+ *              round is a target per carrier, in track order with room for
+ *              the gaps, so the rounds can always be completed in turn.
+ ************************************************************************/
+static void sched_workload(int32_t targets[SCHED_ROUNDS][AXISCNT])
+{
+    uint32_t seed = 6046;
+    uint8_t round;
+    uint8_t k;
+    uint8_t n;
+
+    for (round = 0; round < SCHED_ROUNDS; round++)
+    {
+        for (k = 0; k < AXISCNT; k++)
+        {
+            seed = (seed * 1103515245UL) + 12345UL;
+            targets[round][k] = (int32_t) ((seed >> 8) % (SCHED_TRACK - ((AXISCNT - 1) * SCHED_SPACING)));
+
+            for (n = k; (n > 0) && (targets[round][n - 1] > targets[round][n]); n--)
+            {
+                int32_t swap = targets[round][n];
+
+                targets[round][n] = targets[round][n - 1];
+                targets[round][n - 1] = swap;
+            }
+        }
+
+        for (k = 0; k < AXISCNT; k++)
+        {
+            targets[round][k] += k * SCHED_SPACING;
+        }
+    }
+}
+
+/*************************************************************************
+ *  @brief      sched_start
+ *              Puts the carriers back at their starting positions.
+ ************************************************************************/
+static void sched_start(void)
+{
+    MOTION_AXIS axis;
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        PCL6046_sim_poke(axis, RCUN1, (uint32_t) (axis * (SCHED_TRACK / (AXISCNT - 1))));
+    }
+
+    vTaskDelay(4 * POSITION_MONITOR_PERIOD);
+}
+
+/*************************************************************************
+ *  @brief      bench_schedule
+ *              Moves per hour through the same rounds of moves, issued the
+ *              way a host does today (each round's moves at once, and a move
+ *              a limit stops issued again until it gets there) and through
+ *              the track scheduler; and how often a limit had to stop one of
+ *              the scheduler's moves.  The carriers get a faster profile, so
+ *              each move is a second or so.
+ ************************************************************************/
+static void bench_schedule(void)
+{
+    int32_t targets[SCHED_ROUNDS][AXISCNT];
+    uint32_t issued[AXISCNT];
+    PCL6046_SNAPSHOT snap;
+    SCHED_STATS stats;
+    TickType_t start;
+    double naive;
+    double scheduled;
+    uint8_t round;
+    uint8_t done;
+    MOTION_AXIS axis;
+
+    sched_workload(targets);
+
+    write_register(RFL, 0x0F, 100);
+    write_register(RFH, 0x0F, 20000);
+    write_register(RUR, 0x0F, 99);
+    write_register(RMG, 0x0F, 299);
+    modify_register(RMD, 0x0F, FIELD_MASK(RMD, MOD), FIELD_SET(RMD, MOD, MOD_ABSOLUTE_CUN1));
+
+    //  naively:  start every move of a round, then start again any that a
+    //  limit stopped short, until the round is done
+    sched_start();
+    start = xTaskGetTickCount();
+
+    for (round = 0; (round < SCHED_ROUNDS) && (elapsed_ticks_s(start) < (SCHED_TIMEOUT / 1000.0)); round++)
+    {
+        for (axis = AXIS_X; axis < AXISCNT; axis++)
+        {
+            issued[axis] = 0;
+        }
+
+        do
+        {
+            get_snapshot(&snap);
+            done = 0;
+
+            for (axis = AXIS_X; axis < AXISCNT; axis++)
+            {
+                //  a snapshot from before the start can't show where it ended
+                if ((issued[axis] != 0) && (((int32_t) (snap.sampled - issued[axis]) <= 0) || (snap.mstatus[axis] & MSTS_SRUN)))
+                {
+                    continue;
+                }
+
+                if ((int32_t) snap.counter[0][axis] == targets[round][axis])
+                {
+                    done++;
+                }
+                else
+                {
+                    BUS_OP ops[2] =
+                    {
+                        {OP_WRITE, (uint8_t) RMV, (uint8_t) (1 << axis), 0, {0}},
+                        {OP_COMMAND, (uint8_t) STAD, (uint8_t) (1 << axis), 0, {0}}
+                    };
+
+                    ops[0].values[axis] = (uint32_t) targets[round][axis];
+                    bus_transact(0, BUS_CONFIG, ops, 2);
+                    issued[axis] = (uint32_t) TIMESTAMP();
+                }
+            }
+
+            vTaskDelay(ASIC_MAINT_PERIOD);
+
+        } while ((done < AXISCNT) && (elapsed_ticks_s(start) < (SCHED_TIMEOUT / 1000.0)));
+    }
+
+    naive = (double) (round * AXISCNT) * 3600.0 / elapsed_ticks_s(start);
+
+    //  through the scheduler, all the rounds queued at once
+    sched_start();
+    start = xTaskGetTickCount();
+
+    for (round = 0; round < SCHED_ROUNDS; round++)
+    {
+        for (axis = AXIS_X; axis < AXISCNT; axis++)
+        {
+            (void) schedule_move((uint8_t) axis, targets[round][axis]);
+        }
+    }
+
+    do
+    {
+        vTaskDelay(ASIC_MAINT_PERIOD);
+
+    } while (!schedule_idle() && (elapsed_ticks_s(start) < (SCHED_TIMEOUT / 1000.0)));
+
+    get_sched_stats(&stats);
+    scheduled = (double) stats.completed * 3600.0 / elapsed_ticks_s(start);
+
+    set_metric("sched.naive_moves_per_h", naive);
+    set_metric("sched.moves_per_h", scheduled);
+    set_metric("sched.speedup", scheduled / naive);
+    set_metric("sched.limit_stops", (double) stats.stops);
+}
+
+/*************************************************************************
+ *  @brief      get_varint
+ *              Decodes a zigzag varint of the telemetry stream.
+ ************************************************************************/
+static uint32_t get_varint(const uint8_t **data, const uint8_t *end, bool *ok)
+{
+    uint32_t zigzag = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+
+    do
+    {
+        if ((*data >= end) || (shift > 28))
+        {
+            *ok = false;
+            return (0);
+        }
+
+        byte = *(*data)++;
+        zigzag |= (uint32_t) (byte & 0x7F) << shift;
+        shift += 7;
+
+    } while (byte & 0x80);
+
+    return ((zigzag >> 1) ^ (0 - (zigzag & 1)));
+}
+
+/*************************************************************************
+ *  @brief      telem_receive
+ *              The host end of the telemetry stream, attached as the USB
+ *              transmit function:  decodes each packet of the bench's
+ *              subscription (every field of every carrier) and counts what
+ *              doesn't decode, or decodes to a position off the track.
+ ************************************************************************/
+static bool telem_receive(const uint8_t *data, uint16_t length)
+{
+    const TELEM_HDR *header = (const TELEM_HDR *) data;
+    const uint8_t *next = data + sizeof(TELEM_HDR);
+    uint32_t values[AXISCNT][TELEM_FIELDS] = {{0}};
+    uint32_t sequence;
+    bool ok = true;
+    uint16_t sample;
+    uint8_t axis;
+    uint8_t field;
+
+    if (telemSlow)
+    {
+        vTaskDelay(TELEM_SLOW_READ);
+    }
+
+    if ((length < sizeof(TELEM_HDR)) || (header->magic != TELEM_MAGIC) || (length != (sizeof(TELEM_HDR) + header->bytes)) ||
+        (header->items != TELEM_ITEMS) || (header->carriers != 0x0F) || ((int32_t) (header->first - telemLastSequence) <= 0))
+    {
+        telemErrors++;
+        return (true);
+    }
+
+    sequence = header->first;
+
+    for (sample = 0; ok && (sample < header->count); sample++)
+    {
+        uint32_t step = get_varint(&next, data + length, &ok);
+
+        (void) get_varint(&next, data + length, &ok);
+
+        //  only the first sample of a packet is at its "first"
+        ok = ok && ((sample == 0) == (step == 0));
+        sequence += step;
+
+        for (axis = AXIS_X; axis < AXISCNT; axis++)
+        {
+            for (field = 0; field < TELEM_FIELDS; field++)
+            {
+                values[axis][field] += get_varint(&next, data + length, &ok);
+            }
+
+            //  COUNTER1 follows MSTSW
+            ok = ok && ((int32_t) values[axis][1] >= -SCHED_SPACING) && ((int32_t) values[axis][1] <= (SCHED_TRACK + SCHED_SPACING));
+        }
+    }
+
+    if (!ok || (next != (data + length)))
+    {
+        telemErrors++;
+        return (true);
+    }
+
+    telemLastSequence = sequence;
+    telemDecoded += header->count;
+    telemBytes += length;
+
+    return (true);
+}
+
+/*************************************************************************
+ *  @brief      telem_subscribe
+ *              Sends the TELEMETRY command to ASIC_comm, as the host does.
+ ************************************************************************/
+static void telem_subscribe(uint32_t items, uint32_t carriers, uint32_t decimation)
+{
+    uint32_t *buffer = usb_rx_buffer(portMAX_DELAY);
+    USB_FRAME_HDR *frame = (USB_FRAME_HDR *) buffer;
+    USB_CMD_HDR *cmd = (USB_CMD_HDR *) (buffer + 1);
+
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    *frame = (USB_FRAME_HDR) {5 * sizeof(uint32_t), 1, 0};
+    *cmd = (USB_CMD_HDR) {TELEMETRY, 0, 3};
+    buffer[2] = items;
+    buffer[3] = carriers;
+    buffer[4] = decimation;
+
+    (void) usb_rx_submit(buffer, frame->length, portMAX_DELAY);
+}
+
+/*************************************************************************
+ *  @brief      bench_telemetry
+ *              Streams every field of every carrier at every acquisition of
+ *              the safety loop while the scheduler moves the carriers, and
+ *              measures the samples per second that reach the host, the
+ *              bytes each took, and the packets that didn't decode.  Then
+ *              again to a host that reads too slowly, to show that samples
+ *              are dropped rather than the limit loop held up.
+ ************************************************************************/
+static void bench_telemetry(void)
+{
+    TELEM_STATS before, after;
+    SAFETY_STATS safety;
+    int32_t targets[SCHED_ROUNDS][AXISCNT];
+    uint32_t decoded;
+    uint32_t samples;
+    uint8_t round;
+    MOTION_AXIS axis;
+
+    usb_attach_tx(telem_receive);
+
+    sched_workload(targets);
+    sched_start();
+
+    for (round = 0; round < SCHED_ROUNDS; round++)
+    {
+        for (axis = AXIS_X; axis < AXISCNT; axis++)
+        {
+            (void) schedule_move((uint8_t) axis, targets[round][axis]);
+        }
+    }
+
+    (void) pace_limits(SAFETY_PERIOD_US);
+
+    get_telem_stats(&before);
+    telem_subscribe(TELEM_ITEMS, 0x0F, 1);
+    vTaskDelay(TELEM_TIME);
+    telem_subscribe(0, 0, 1);
+    vTaskDelay(2 * TELEM_FLUSH_PERIOD);
+    get_telem_stats(&after);
+
+    set_metric("telem.samples_per_s", (double) telemDecoded * 1000.0 / TELEM_TIME);
+    set_metric("telem.bytes_per_sample", (telemDecoded != 0) ? ((double) telemBytes / telemDecoded) : 1e9);
+
+    //  every sample taken must have reached the host
+    if (telemDecoded != (after.samples - before.samples))
+    {
+        telemErrors++;
+    }
+
+    //  the slow host, with the limit loop's counters started afresh
+    telemSlow = true;
+    decoded = telemDecoded;
+    (void) pace_limits(0);
+    vTaskDelay(POSITION_MONITOR_PERIOD);
+    (void) pace_limits(SAFETY_PERIOD_US);
+
+    get_telem_stats(&before);
+    telem_subscribe(TELEM_ITEMS, 0x0F, 1);
+    vTaskDelay(TELEM_TIME);
+    get_safety_stats(&safety);
+    telem_subscribe(0, 0, 1);
+    vTaskDelay(2 * TELEM_SLOW_READ);
+    get_telem_stats(&after);
+
+    samples = (after.samples - before.samples) + (after.dropped - before.dropped);
+
+    set_metric("telem.slow_cycles_per_s", (double) safety.cycles * 1000.0 / TELEM_TIME);
+    set_metric("telem.slow_dropped_percent", (samples != 0) ? ((double) (after.dropped - before.dropped) * 100.0 / samples) : 100.0);
+
+    if ((telemDecoded - decoded) != (after.samples - before.samples))
+    {
+        telemErrors++;
+    }
+
+    set_metric("telem.decode_errors", (double) telemErrors);
+
+    (void) pace_limits(0);
+    cancel_schedule();
+    telemSlow = false;
+    usb_attach_tx(NULL);
+}
+
+/*************************************************************************
+ *  @brief      start_skew
+ *              How far apart the carriers' last starts were, in COMW writes
+ *              and in CLK cycles, once the moves are over.
+ ************************************************************************/
+static void start_skew(uint32_t *commands, uint64_t *clk)
+{
+    uint64_t startClk[AXISCNT];
+    uint32_t startCommand[AXISCNT];
+    MOTION_AXIS axis;
+
+    vTaskDelay(2000);
+
+    *commands = 0;
+    *clk = 0;
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        PCL6046_sim_started((uint8_t) axis, &startClk[axis], &startCommand[axis]);
+
+        if ((startCommand[axis] - startCommand[0]) > *commands)
+        {
+            *commands = startCommand[axis] - startCommand[0];
+        }
+
+        if ((startClk[axis] - startClk[0]) > *clk)
+        {
+            *clk = startClk[axis] - startClk[0];
+        }
+    }
+}
+
+/*************************************************************************
+ *  @brief      bench_group
+ *              Start skew of the carriers of a motion group:  started one
+ *              transaction each, the way a host does today; as a group with
+ *              one start command; and as a group that mixes start commands,
+ *              which goes through CSTA.
+ ************************************************************************/
+static void bench_group(void)
+{
+    MOTION_SEGMENT moves[CARRIERCNT];
+    uint32_t commands;
+    uint64_t clk;
+    MOTION_AXIS axis;
+
+    stop_group(0x0F, false);
+    sched_start();
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        moves[axis] = (MOTION_SEGMENT) {GROUP_DISTANCE, 20000, 99, MOD_INCREMENTAL, STAD};
+    }
+
+    //  naively
+    write_register(RMD, 0x0F, MOD_INCREMENTAL);
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        BUS_OP ops[2] =
+        {
+            {OP_WRITE, (uint8_t) RMV, (uint8_t) (1 << axis), 0, {0}},
+            {OP_COMMAND, (uint8_t) STAD, (uint8_t) (1 << axis), 0, {0}}
+        };
+
+        ops[0].values[axis] = GROUP_DISTANCE;
+        bus_transact(0, BUS_CONFIG, ops, 2);
+    }
+
+    start_skew(&commands, &clk);
+    set_metric("group.naive_skew_commands", (double) commands);
+
+    //  as a group
+    (void) start_group(0x0F, moves);
+    start_skew(&commands, &clk);
+    set_metric("group.start_skew_commands", (double) commands);
+    set_metric("group.start_skew_clk", (double) clk);
+
+    //  with mixed start commands
+    moves[AXIS_Z].start = STAUD;
+    (void) start_group(0x0F, moves);
+    start_skew(&commands, &clk);
+    set_metric("group.csta_skew_commands", (double) commands);
+}
+
+/*************************************************************************
+ *  @brief      wait_stopped
+ *              Waits for a carrier to stop, or for PROFILE_TIMEOUT.
+ ************************************************************************/
+static void wait_stopped(uint8_t carrier)
+{
+    PCL6046_SNAPSHOT snap;
+    TickType_t start = xTaskGetTickCount();
+
+    do
+    {
+        vTaskDelay(ASIC_MAINT_PERIOD);
+        get_snapshot(&snap);
+
+    } while ((snap.mstatus[carrier] & MSTS_SRUN) && (elapsed_ticks_s(start) < (PROFILE_TIMEOUT / 1000.0)));
+}
+
+/*************************************************************************
+ *  @brief      bench_motion
+ *              Streaming through the pre-registers:  carrier U is given one
+ *              segment, and once it's running, the rest are queued behind
+ *              it.  Every one after the first must start from the
+ *              pre-registers the moment the one before ends, with no
+ *              underruns and no CLK cycles standing between them.
+ ************************************************************************/
+static void bench_motion(void)
+{
+    const MOTION_SEGMENT segment = {MOTION_DISTANCE, MOTION_SPEED, 99, MOD_INCREMENTAL, STAFH};
+    PCL6046_SIM_STATS before, after;
+    MOTION_STATS streamed, queued;
+    TickType_t start;
+    uint32_t command;
+    uint32_t first;
+    uint64_t clk;
+    uint8_t n;
+
+    stop_group(0x0F, false);
+    sched_start();
+
+    write_register(RMG, 1 << AXIS_U, 299);
+    get_motion_stats(AXIS_U, &streamed);
+    PCL6046_sim_started(AXIS_U, &clk, &first);
+
+    if (!queue_motion(AXIS_U, &segment, 0))
+    {
+        printf("motion:  the segment was refused\n");
+        exitCode = 1;
+        return;
+    }
+
+    //  the first start leaves the axis standing until then, so the count
+    //  begins once it's running
+    start = xTaskGetTickCount();
+
+    do
+    {
+        vTaskDelay(1);
+        PCL6046_sim_started(AXIS_U, &clk, &command);
+
+    } while ((command == first) && (elapsed_ticks_s(start) < (PROFILE_TIMEOUT / 1000.0)));
+
+    PCL6046_sim_get_stats(&before);
+
+    for (n = 1; n < MOTION_SEGMENTS; n++)
+    {
+        (void) queue_motion(AXIS_U, &segment, portMAX_DELAY);
+    }
+
+    start = xTaskGetTickCount();
+
+    while ((motion_pending(AXIS_U) != 0) && (elapsed_ticks_s(start) < (PROFILE_TIMEOUT / 1000.0)))
+    {
+        vTaskDelay(ASIC_MAINT_PERIOD);
+    }
+
+    wait_stopped(AXIS_U);
+
+    PCL6046_sim_get_stats(&after);
+    get_motion_stats(AXIS_U, &queued);
+
+    set_metric("motion.underruns", (double) (queued.underruns - streamed.underruns));
+    set_metric("motion.unchained_segments", (double) (MOTION_SEGMENTS - 1) - (double) (after.chainedStarts - before.chainedStarts));
+    set_metric("motion.idle_clk", (double) (after.idleClk - before.idleClk));
+}
+
+/*************************************************************************
+ *  @brief      bench_profile
+ *              How far the compiled profile's predictions are from what an
+ *              axis does with it:  the time a positioning move takes, and the
+ *              distance a decelerating stop from full speed takes, in percent.
+ *              Carrier U moves toward +, where it has no software limit.
+ ************************************************************************/
+static void bench_profile(void)
+{
+    const PROFILE_SPEC spec = {1000000, 10000, 200000, 1000000, 0, 10000000};
+    uint32_t profile[PROFILE_REGS];
+    uint32_t predicted;
+    double actual;
+    BUS_OP ops[2] =
+    {
+        {OP_WRITE, (uint8_t) RMV, (uint8_t) (1 << AXIS_U), 0, {0}},
+        {OP_COMMAND, (uint8_t) STAD, (uint8_t) (1 << AXIS_U), 0, {0}}
+    };
+
+    stop_group(0x0F, false);
+    sched_start();
+
+    if (!compile_profile(&spec, profile))
+    {
+        printf("profile:  the specification does not compile\n");
+        exitCode = 1;
+        return;
+    }
+
+    load_profile(1 << AXIS_U, profile);
+
+    //  a positioning move
+    modify_register(RMD, 1 << AXIS_U, FIELD_MASK(RMD, MOD), FIELD_SET(RMD, MOD, MOD_INCREMENTAL));
+    ops[0].values[AXIS_U] = PROFILE_DISTANCE;
+    bus_transact(0, BUS_CONFIG, ops, 2);
+    wait_stopped(AXIS_U);
+
+    predicted = profile_move_time(PROFILE_DISTANCE, profile);
+    actual = (double) PCL6046_sim_run_time(AXIS_U) * 1000000.0 / (double) SIM_CLK_HZ;
+    set_metric("profile.time_error_percent", 100.0 * fabs(actual - (double) predicted) / (double) predicted);
+
+    //  a continuous move, stopped once it is at full speed; the counter is
+    //  read in the same transaction as the stop
+    modify_register(RMD, 1 << AXIS_U, FIELD_MASK(RMD, MOD), FIELD_SET(RMD, MOD, MOD_CONT_PLUS));
+    ops[0].values[AXIS_U] = 0;
+    bus_transact(0, BUS_CONFIG, ops, 2);
+
+    vTaskDelay(2 * (predicted / 1000));
+
+    ops[0] = (BUS_OP) {OP_READ, (uint8_t) RCUN1, (uint8_t) (1 << AXIS_U), 0, {0}};
+    ops[1] = (BUS_OP) {OP_COMMAND, (uint8_t) SDSTP, (uint8_t) (1 << AXIS_U), 0, {0}};
+    bus_transact(0, BUS_CONFIG, ops, 2);
+    wait_stopped(AXIS_U);
+
+    predicted = profile_stop_distance(profile[PROFILE_RFH], profile);
+    actual = (double) (PCL6046_sim_peek(AXIS_U, RCUN1) - ops[0].values[AXIS_U]);
+    set_metric("profile.stop_error_percent", 100.0 * fabs(actual - (double) predicted) / (double) predicted);
+}
+
+/*************************************************************************
+ *  @brief      home
+ *              Runs a homing request through ASIC_home and waits for it.
+ *  @returns    the time to ready, in milliseconds; failed carriers are
+ *              added to "failed"
+ ************************************************************************/
+static uint32_t home(const HOME_PARAMS *params, uint32_t *failed)
+{
+    HOME_STATS stats;
+
+    if (!start_homing(params))
+    {
+        *failed |= 0x0F;
+        return (0);
+    }
+
+    do
+    {
+        vTaskDelay(ASIC_MAINT_PERIOD);
+        get_home_stats(&stats);
+
+    } while (stats.busy != 0);
+
+    *failed |= stats.failed;
+
+    return (stats.readyMs);
+}
+
+/*************************************************************************
+ *  @brief      bench_home
+ *              Time to ready of homing the carriers one at a time, the way
+ *              a host script does today, and all at once; X and Y home
+ *              toward the - end, Z and U toward the + end.
+ ************************************************************************/
+static void bench_home(void)
+{
+    HOME_PARAMS params = {AXISCNT, {AXIS_X, AXIS_Y, AXIS_Z, AXIS_U}, 2};
+    uint32_t sequential = 0;
+    uint32_t parallel;
+    uint32_t failed = 0;
+    uint8_t missed = 0;
+    MOTION_AXIS axis;
+
+    stop_group(0x0F, false);
+    sched_start();
+
+    write_register(RFL, 0x0F, HOME_SPEED);
+    write_register(RMG, 0x0F, 299);
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        HOME_PARAMS one = {1, {(uint8_t) axis}, (homeOrigins[axis] < 0) ? 1 : 0};
+
+        PCL6046_sim_place_origin(axis, homeOrigins[axis]);
+        sequential += home(&one, &failed);
+    }
+
+    //  the same distances again, all at once
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        PCL6046_sim_place_origin(axis, homeOrigins[axis]);
+    }
+
+    parallel = home(&params, &failed);
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        missed += (failed & (1UL << axis)) ? 1 : 0;
+    }
+
+    set_metric("home.sequential_ms", (double) sequential);
+    set_metric("home.parallel_ms", (double) parallel);
+    set_metric("home.speedup", (parallel != 0) ? ((double) sequential / (double) parallel) : 0.0);
+    set_metric("home.failed_carriers", (double) missed);
+}
+
+/*************************************************************************
+ *  @brief      deviation_move
+ *              Moves carrier X DEVIATION_DISTANCE toward the - end, where it
+ *              has no neighbour, and waits for it to stop and for ASIC_deviation
+ *              to close the move.
+ ************************************************************************/
+static void deviation_move(void)
+{
+    BUS_OP ops[2] =
+    {
+        {OP_WRITE, (uint8_t) RMV, (uint8_t) (1 << AXIS_X), 0, {(uint32_t) -DEVIATION_DISTANCE}},
+        {OP_COMMAND, (uint8_t) STAD, (uint8_t) (1 << AXIS_X), 0, {0}}
+    };
+
+    bus_transact(0, BUS_CONFIG, ops, 2);
+    wait_stopped(AXIS_X);
+    vTaskDelay(4 * ASIC_MAINT_PERIOD);
+}
+
+/*************************************************************************
+ *  @brief      bench_deviation
+ *              The deviation watch on carrier X:  the bus reads its events
+ *              take per healthy move, which don't deviate; then, in a move
+ *              that stalls, how far past the threshold the ASIC's own stop
+ *              lets the deviation run, and how far the peak deviation the
+ *              watch reports is from the real one, in pulses.
+ ************************************************************************/
+static void bench_deviation(void)
+{
+    DEVIATION_STATS stats[CARRIERCNT];
+    uint32_t deviation;
+    int32_t counted;
+    uint8_t move;
+
+    stop_group(0x0F, false);
+    sched_start();
+
+    modify_register(RMD, 1 << AXIS_X, FIELD_MASK(RMD, MOD), FIELD_SET(RMD, MOD, MOD_INCREMENTAL));
+
+    if (!configure_deviation(1 << AXIS_X, DEVIATION_THRESHOLD, DEVIATION_STOP))
+    {
+        printf("deviation:  the watch was refused\n");
+        exitCode = 1;
+        return;
+    }
+
+    for (move = 0; move < DEVIATION_MOVES; move++)
+    {
+        deviation_move();
+    }
+
+    get_deviation_stats(stats);
+    set_metric("deviation.reads_per_move", (stats[AXIS_X].moves != 0) ? ((double) stats[AXIS_X].reads / (double) stats[AXIS_X].moves) : 1000.0);
+
+    //  the mechanics stall, so every pulse from here on is deviation
+    PCL6046_sim_stall(AXIS_X, true);
+    deviation_move();
+    PCL6046_sim_stall(AXIS_X, false);
+
+    counted = (int32_t) PCL6046_sim_peek(AXIS_X, RCUN3);
+    deviation = (uint32_t) ((counted < 0) ? -counted : counted);
+
+    get_deviation_stats(stats);
+    set_metric("deviation.stall_overrun_pulses", (stats[AXIS_X].trips != 0) ? (double) (deviation - DEVIATION_THRESHOLD) : (double) DEVIATION_DISTANCE);
+    set_metric("deviation.peak_error_pulses", fabs((double) deviation - (double) stats[AXIS_X].lastPeak));
+
+    (void) configure_deviation(1 << AXIS_X, 0, 0);
+}
+
+/*************************************************************************
+ *  @brief      warm_lost
+ *              Counts the counters and configuration registers (RFL..RENV7)
+ *              of the carriers that don't hold what they held before; the
+ *              comparators and RIRQ are left out, as the limit task owns
+ *              some of them.
+ ************************************************************************/
+static uint32_t warm_lost(const uint32_t before[AXISCNT][WARM_REGS])
+{
+    uint32_t lost = 0;
+    MOTION_AXIS axis;
+    uint8_t n;
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        for (n = 0; n < (RCMP1 - WARM_FIRST); n++)
+        {
+            lost += (PCL6046_sim_peek(axis, (ASIC_REG) (WARM_FIRST + n)) != before[axis][n]) ? 1 : 0;
+        }
+    }
+
+    return (lost);
+}
+
+/*************************************************************************
+ *  @brief      warm_schedule
+ *              Sends ASIC_comm a frame with one SCHEDULE command, then one
+ *              with a STOP_REPORT, and waits for the reply, which shows the
+ *              SCHEDULE was done with, whether it was taken or not.
+ ************************************************************************/
+static void warm_schedule(uint32_t carrier, uint32_t target)
+{
+    uint32_t *buffer;
+    uint32_t start;
+
+    commReplies = 0;
+    usb_attach_tx(comm_receive);
+
+    if ((buffer = usb_rx_buffer(portMAX_DELAY)) != NULL)
+    {
+        *(USB_FRAME_HDR *) buffer = (USB_FRAME_HDR) {(uint16_t) (4 * sizeof(uint32_t)), 1, 0};
+        *(USB_CMD_HDR *) &buffer[1] = (USB_CMD_HDR) {SCHEDULE, 0, 2};
+        buffer[2] = carrier;
+        buffer[3] = target;
+        (void) usb_rx_submit(buffer, (uint16_t) (4 * sizeof(uint32_t)), portMAX_DELAY);
+    }
+
+    if ((buffer = usb_rx_buffer(portMAX_DELAY)) != NULL)
+    {
+        *(USB_FRAME_HDR *) buffer = (USB_FRAME_HDR) {(uint16_t) (2 * sizeof(uint32_t)), 1, 1};
+        *(USB_CMD_HDR *) &buffer[1] = (USB_CMD_HDR) {STOP_REPORT, 0, 0};
+        (void) usb_rx_submit(buffer, (uint16_t) (2 * sizeof(uint32_t)), portMAX_DELAY);
+    }
+
+    start = (uint32_t) TIMESTAMP();
+
+    while ((commReplies == 0) && (elapsed_s(start) < (COMM_TIMEOUT / 1000.0)))
+    {
+        taskYIELD();
+    }
+
+    usb_attach_tx(NULL);
+}
+
+/*************************************************************************
+ *  @brief      bench_warm
+ *              A warm restart:  the snapshot is saved on a controlled stop,
+ *              the chip is reset (SRST of every axis), and the snapshot is
+ *              restored; its size, the time the restore takes, and the
+ *              registers and homed carriers it fails to bring back.  Then a
+ *              snapshot with one bit flipped in the store must be refused,
+ *              and one saved before a SCHEDULE command must be erased by it,
+ *              but not by one that's refused.
+ ************************************************************************/
+static void bench_warm(void)
+{
+    static WARM_SNAPSHOT stored;
+    uint32_t before[AXISCNT][WARM_REGS];
+    WARM_STATS stats;
+    HOME_STATS homed;
+    HOME_STATS home;
+    MOTION_AXIS axis;
+    uint8_t unhomed = 0;
+    uint8_t n;
+    bool restored;
+
+    stop_group(0x0F, false);
+    sched_start();
+
+    if (!save_warm_state())
+    {
+        printf("warm:  the snapshot was not saved\n");
+        exitCode = 1;
+        return;
+    }
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        for (n = 0; n < WARM_REGS; n++)
+        {
+            before[axis][n] = PCL6046_sim_peek(axis, (ASIC_REG) (WARM_FIRST + n));
+        }
+    }
+
+    //  a reset starts with nothing homed
+    get_home_stats(&homed);
+    write_command(SRST, 0x0F);
+    set_homed(0);
+
+    restored = restore_warm_state();
+    get_warm_stats(&stats);
+    get_home_stats(&home);
+
+    set_metric("warm.snapshot_bytes", (double) stats.bytes);
+    set_metric("warm.restore_us", (double) stats.restoreUs);
+    set_metric("warm.lost_registers", restored ? (double) warm_lost(before) : (double) (AXISCNT * WARM_REGS));
+
+    for (axis = AXIS_X; axis < AXISCNT; axis++)
+    {
+        unhomed += ((homed.homed & ~home.homed) & (1UL << axis)) ? 1 : 0;
+    }
+
+    set_metric("warm.lost_homed", (double) unhomed);
+
+    //  a bit of COUNTER1 flipped in flash
+    (void) save_warm_state();
+    (void) PCL6046_sim_store_read(&stored, sizeof(stored));
+    stored.regs[AXIS_Y][RCUN1 - WARM_FIRST] ^= 1;
+    (void) PCL6046_sim_store_write(&stored, sizeof(stored));
+
+    write_command(SRST, 0x0F);
+    restored = restore_warm_state();
+    get_warm_stats(&stats);
+
+    set_metric("warm.corrupt_restored", (restored || (stats.outcome != WARM_CORRUPT)) ? 1.0 : 0.0);
+
+    //  a SCHEDULE of a carrier that doesn't exist is refused, and must
+    //  leave the snapshot; one of X to where it stands, which moves nothing,
+    //  is taken, and must erase it
+    (void) save_warm_state();
+    warm_schedule(CARRIERCNT, 0);
+    set_metric("warm.refused_erased", PCL6046_sim_store_read(&stored, sizeof(stored)) ? 0.0 : 1.0);
+
+    warm_schedule(AXIS_X, PCL6046_sim_peek(AXIS_X, RCUN1));
+    set_metric("warm.stale_kept", PCL6046_sim_store_read(&stored, sizeof(stored)) ? 1.0 : 0.0);
+
+    PCL6046_sim_store_erase();
+}
+
+/*************************************************************************
+ *  @brief      report
+ *              Prints the results, then saves them or checks them against
+ *              the baseline.
+ ************************************************************************/
+static void report(void)
+{
+    FILE *file;
+    char name[64];
+    double base;
+    uint8_t m;
+
+    for (m = 0; m < METRIC_COUNT; m++)
+    {
+        printf("%-34s %14.3f\n", metrics[m].name, metrics[m].value);
+    }
+
+    if (baselineFile == NULL)
+    {
+        return;
+    }
+
+    if (saveBaseline)
+    {
+        if ((file = fopen(baselineFile, "w")) == NULL)
+        {
+            perror(baselineFile);
+            exitCode = 2;
+            return;
+        }
+
+        fprintf(file, "# PCL6046_bench baseline:  metric value\n");
+
+        for (m = 0; m < METRIC_COUNT; m++)
+        {
+            fprintf(file, "%s %.3f\n", metrics[m].name, metrics[m].value);
+        }
+
+        fclose(file);
+        return;
+    }
+
+    if ((file = fopen(baselineFile, "r")) == NULL)
+    {
+        perror(baselineFile);
+        exitCode = 2;
+        return;
+    }
+
+    while (fscanf(file, " %63s", name) == 1)
+    {
+        if (name[0] == '#')
+        {
+            (void) fscanf(file, "%*[^\n]");
+            continue;
+        }
+
+        if (fscanf(file, "%lf", &base) != 1)
+        {
+            break;
+        }
+
+        for (m = 0; m < METRIC_COUNT; m++)
+        {
+            if (strcmp(metrics[m].name, name) == 0)
+            {
+                bool worse = metrics[m].higherIsBetter ?
+                             (metrics[m].value < ((base * (1.0 - metrics[m].tolerance)) - metrics[m].slack)) :
+                             (metrics[m].value > ((base * (1.0 + metrics[m].tolerance)) + metrics[m].slack));
+
+                if (worse && metrics[m].advisory)
+                {
+                    printf("WARNING %s: %.3f, baseline %.3f\n", metrics[m].name, metrics[m].value, base);
+                }
+                else if (worse)
+                {
+                    printf("REGRESSION %s: %.3f, baseline %.3f\n", metrics[m].name, metrics[m].value, base);
+                    exitCode = 1;
+                }
+            }
+        }
+    }
+
+    fclose(file);
+}
+
+/*************************************************************************
+ *  @brief      bench
+ *              Runs the benchmarks in turn, then ends the scheduler.
+ ************************************************************************/
+static void bench(void *pvParameters)
+{
+    //  let the acquisition stage and the event task start
+    vTaskDelay(5 * ASIC_MAINT_PERIOD);
+
+    bench_primitives();
+    bench_events();
+    bench_comm();
+    bench_contention();
+    bench_limit();
+    bench_safety(SAFETY_PERIOD_US, "safety");
+    bench_safety(SAFETY_FAST_PERIOD_US, "safety250");
+    bench_schedule();
+    bench_telemetry();
+    bench_group();
+    bench_motion();
+    bench_profile();
+    bench_home();
+    bench_deviation();
+    bench_warm();
+
+    report();
+
+    vTaskEndScheduler();
+}
+
+int main(int argc, char *argv[])
+{
+    uintptr_t chip;
+
+    if ((argc == 3) && ((strcmp(argv[1], "--save") == 0) || (strcmp(argv[1], "--check") == 0)))
+    {
+        saveBaseline = (strcmp(argv[1], "--save") == 0);
+        baselineFile = argv[2];
+    }
+    else if (argc != 1)
+    {
+        fprintf(stderr, "usage: %s [--save | --check baseline]\n", argv[0]);
+        return (2);
+    }
+
+    PCL6046_sim_init();
+
+    (void) xTaskCreate(PCL6046_sim_clock, "sim6046", configMINIMAL_STACK_SIZE, (void *) NULL, (configMAX_PRIORITIES - 1), (TaskHandle_t *) NULL);
+    //  the firmware's tasks, as main.c creates them:  a bus owner per chip
+    for (chip = 0; chip < PCL6046_CHIPS; chip++)
+    {
+        (void) xTaskCreate(ASIC_bus, "bus6046", BUS_STACK_SIZE, (void *) chip, (BASE_TASK_PRI + 4), (TaskHandle_t *) NULL);
+    }
+
+    (void) xTaskCreate(ASIC_events, "evt6046", EVENT_STACK_SIZE, (void *) NULL, (BASE_TASK_PRI + 3), (TaskHandle_t *) NULL);
+    (void) xTaskCreate(ASIC_maintenance, "maint6046", MAINT_STACK_SIZE, (void *) NULL, (BASE_TASK_PRI + 1), (TaskHandle_t *) NULL);
+    (void) xTaskCreate(ASIC_motion, "mot6046", MOTION_STACK_SIZE, (void *) NULL, (BASE_TASK_PRI + 2), (TaskHandle_t *) NULL);
+    (void) xTaskCreate(ASIC_schedule, "sched6046", SCHED_STACK_SIZE, (void *) NULL, BASE_TASK_PRI, (TaskHandle_t *) NULL);
+    (void) xTaskCreate(ASIC_home, "home6046", HOME_STACK_SIZE, (void *) NULL, BASE_TASK_PRI, (TaskHandle_t *) NULL);
+    (void) xTaskCreate(ASIC_deviation, "dev6046", DEVIATION_STACK_SIZE, (void *) NULL, (BASE_TASK_PRI + 1), (TaskHandle_t *) NULL);
+    (void) xTaskCreate(ASIC_telemetry, "telem6046", TELEM_STACK_SIZE, (void *) NULL, BASE_TASK_PRI, (TaskHandle_t *) NULL);
+    (void) xTaskCreate(ASIC_comm, "comm6046", COMM_STACK_SIZE, (void *) NULL, BASE_TASK_PRI, (TaskHandle_t *) NULL);
+    (void) xTaskCreate(bench, "bench", configMINIMAL_STACK_SIZE, (void *) NULL, BASE_TASK_PRI, (TaskHandle_t *) NULL);
+
+    vTaskStartScheduler();
+
+    return (exitCode);
+}
@@ -0,0 +1,244 @@
+/*************************************************************************
+ *  Challenge_1_Firmware:   trace_decode.c
+ *                          Host decoder for PCL6046 bus trace dumps (the
+ *                          TRACE command's TRACE_DUMP action).  It reads the
+ *                          dump packets from a file, or stdin, and prints
+ *                          latency histograms of the bus wait and the IFB
+ *                          wait per register/command code and per task.
+ *
+ *                          cc -I../source -o trace_decode trace_decode.c
+ *                          trace_decode [dump file]
+ *
+ *  Engineer:               Larry Pelton
+ *
+ ************************************************************************/
+#include    <stdio.h>
+#include    <stdint.h>
+#include    <stdbool.h>
+#include    <string.h>
+
+#include    "PCL6046_trace.h"
+
+//  histogram buckets are powers of 2 microseconds:  < 1us, < 2us, < 4us, ...
+#define HIST_BUCKETS        16
+#define MAX_TASKS           32
+
+typedef struct
+{
+    uint32_t    count;
+    uint64_t    queueTotal;         //  nanoseconds
+    uint64_t    ifbTotal;
+    uint32_t    queueMax;
+    uint32_t    ifbMax;
+    uint32_t    queueHist[HIST_BUCKETS];
+    uint32_t    ifbHist[HIST_BUCKETS];
+
+}   LATENCY;
+
+static LATENCY  byCode[256];
+static LATENCY  byTask[MAX_TASKS];
+static char     taskName[MAX_TASKS][TRACE_NAME_LEN + 1];
+static uint32_t taskCount = 0;
+
+/*************************************************************************
+ *  @brief      bucket
+ *              Picks the histogram bucket of a latency.
+ *  @param[in]  ns is the latency, in nanoseconds
+ *  @returns    the bucket index
+ ************************************************************************/
+static uint8_t bucket(uint32_t ns)
+{
+    uint32_t us = ns / 1000;
+    uint8_t b = 0;
+
+    while ((us != 0) && (b < (HIST_BUCKETS - 1)))
+    {
+        us >>= 1;
+        b++;
+    }
+
+    return (b);
+}
+
+/*************************************************************************
+ *  @brief      add_sample
+ *              Accumulates one record into a latency set.
+ ************************************************************************/
+static void add_sample(LATENCY *lat, uint32_t queueNs, uint32_t ifbNs)
+{
+    lat->count++;
+    lat->queueTotal += queueNs;
+    lat->ifbTotal += ifbNs;
+    lat->queueHist[bucket(queueNs)]++;
+    lat->ifbHist[bucket(ifbNs)]++;
+
+    if (queueNs > lat->queueMax)
+    {
+        lat->queueMax = queueNs;
+    }
+
+    if (ifbNs > lat->ifbMax)
+    {
+        lat->ifbMax = ifbNs;
+    }
+}
+
+/*************************************************************************
+ *  @brief      task_index
+ *              Finds or adds a task by name.
+ *  @returns    its index, or MAX_TASKS - 1 if the table is full
+ ************************************************************************/
+static uint32_t task_index(const char name[TRACE_NAME_LEN])
+{
+    uint32_t t;
+
+    for (t = 0; t < taskCount; t++)
+    {
+        if (strncmp(taskName[t], name, TRACE_NAME_LEN) == 0)
+        {
+            return (t);
+        }
+    }
+
+    if (taskCount == MAX_TASKS)
+    {
+        return (MAX_TASKS - 1);
+    }
+
+    memcpy(taskName[taskCount], name, TRACE_NAME_LEN);
+    taskName[taskCount][TRACE_NAME_LEN] = '\0';
+
+    if (taskName[taskCount][0] == '\0')
+    {
+        strcpy(taskName[taskCount], "-");
+    }
+
+    return (taskCount++);
+}
+
+/*************************************************************************
+ *  @brief      to_ns
+ *              Converts TIMESTAMP() counts to nanoseconds.
+ ************************************************************************/
+static uint32_t to_ns(uint32_t counts, uint32_t stampHz)
+{
+    uint64_t ns = ((uint64_t) counts * 1000000000ULL) / (stampHz ? stampHz : 1);
+
+    return ((ns > UINT32_MAX) ? UINT32_MAX : (uint32_t) ns);
+}
+
+/*************************************************************************
+ *  @brief      print_histogram
+ *              Prints one histogram on a line, as counts per bucket up to
+ *              the last non-empty one.
+ ************************************************************************/
+static void print_histogram(const char *label, const uint32_t hist[HIST_BUCKETS])
+{
+    int8_t last = HIST_BUCKETS - 1;
+    int8_t b;
+
+    while ((last > 0) && (hist[last] == 0))
+    {
+        last--;
+    }
+
+    printf("      %-5s", label);
+
+    for (b = 0; b <= last; b++)
+    {
+        printf(" <%uus:%u", 1U << b, hist[b]);
+    }
+
+    printf("\n");
+}
+
+/*************************************************************************
+ *  @brief      print_latency
+ *              Prints the summary and histograms of one latency set.
+ ************************************************************************/
+static void print_latency(const char *name, const LATENCY *lat)
+{
+    printf("  %-12s %8u  bus wait avg %8.2fus max %8.2fus   IFB avg %6.3fus max %6.3fus\n",
+           name, lat->count,
+           (double) lat->queueTotal / lat->count / 1000.0, lat->queueMax / 1000.0,
+           (double) lat->ifbTotal / lat->count / 1000.0, lat->ifbMax / 1000.0);
+    print_histogram("bus", lat->queueHist);
+    print_histogram("IFB", lat->ifbHist);
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    TRACE_DUMP_HDR header;
+    TRACE_RECORD record;
+    uint32_t expected = 0;
+    uint32_t records = 0;
+    uint32_t lost = 0;
+    bool first = true;
+    uint32_t n;
+
+    if ((argc > 1) && ((in = fopen(argv[1], "rb")) == NULL))
+    {
+        perror(argv[1]);
+        return (1);
+    }
+
+    while (fread(&header, sizeof(header), 1, in) == 1)
+    {
+        if (header.magic != TRACE_MAGIC)
+        {
+            fprintf(stderr, "bad packet after %u records\n", records);
+            return (1);
+        }
+
+        //  a gap in the sequence numbers means records were overwritten
+        //  before they were dumped
+        if (!first && (header.first != expected))
+        {
+            lost += header.first - expected;
+        }
+
+        first = false;
+        expected = header.first + header.count;
+
+        for (n = 0; n < header.count; n++)
+        {
+            uint32_t queueNs, ifbNs;
+
+            if (fread(&record, sizeof(record), 1, in) != 1)
+            {
+                fprintf(stderr, "truncated packet\n");
+                return (1);
+            }
+
+            queueNs = to_ns(record.queueWait, header.stampHz);
+            ifbNs = to_ns(record.ifbWait, header.stampHz);
+
+            add_sample(&byCode[record.commWord & 0xFF], queueNs, ifbNs);
+            add_sample(&byTask[task_index(record.task)], queueNs, ifbNs);
+            records++;
+        }
+    }
+
+    printf("%u command words, %u lost\n\nby code (Rxx register read, Wxx register write, Cxx command):\n", records, lost);
+
+    for (n = 0; n < 256; n++)
+    {
+        if (byCode[n].count != 0)
+        {
+            char name[8];
+
+            snprintf(name, sizeof(name), "%c%02X", (n >= 0xC0) ? 'R' : ((n >= 0x80) ? 'W' : 'C'), n);
+            print_latency(name, &byCode[n]);
+        }
+    }
+
+    printf("\nby task:\n");
+
+    for (n = 0; n < taskCount; n++)
+    {
+        print_latency(taskName[n], &byTask[n]);
+    }
+
+    return (0);
+}